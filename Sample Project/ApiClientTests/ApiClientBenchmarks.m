@@ -0,0 +1,643 @@
+//
+//  ApiClientBenchmarks.m
+//  ApiClientTests
+//
+//  Copyright (c) 2015 Mobile Jazz. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+#import <XCTest/XCTest.h>
+#import <mach/mach.h>
+
+#import "HMClient.h"
+#import "HMOAuthSession.h"
+#import "HMOAuthTokenStore.h"
+#import "HMStubServerTestCase.h"
+
+@interface HMCountingTokenStorage : HMFileTokenStorage
+
+@property (nonatomic, assign, readonly) NSUInteger writeCount;
+
+@end
+
+@implementation HMCountingTokenStorage
+
+- (void)setData:(NSData*)data forKey:(NSString*)key
+{
+    _writeCount += 1;
+    [super setData:data forKey:key];
+}
+
+@end
+
+@interface ApiClientBenchmarks : HMStubServerTestCase
+
+@end
+
+@implementation ApiClientBenchmarks
+{
+    HMClient *_apiClient;
+}
+
+- (void)setUp
+{
+    [super setUp];
+
+    _apiClient = [[HMClient alloc] initWithConfigurator:^(HMClientConfigurator *configurator) {
+        configurator.serverPath = @"http://localhost";
+        configurator.apiPath = @"/api/v1";
+    }];
+}
+
+- (void)tearDown
+{
+    _apiClient = nil;
+    [super tearDown];
+}
+
+#pragma mark Request Building
+
+- (HMRequest*)mjz_requestAtIndex:(NSUInteger)index
+{
+    HMRequest *request = [HMRequest requestWithPath:@"users/%lu/hobbies", (unsigned long)index];
+    request.parameters = @{@"page": @(index % 10), @"query": @"kitesurfing", @"rating": @8};
+    request.timeoutInterval = 5 + (index % 3);
+    return request;
+}
+
+- (double)mjz_requestBuildThroughputWithThreads:(NSUInteger)threads iterations:(NSUInteger)iterations
+{
+    NSUInteger iterationsPerThread = iterations / threads;
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    dispatch_apply(threads, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t thread) {
+        for (NSUInteger i=0; i<iterationsPerThread; ++i)
+        {
+            @autoreleasepool {
+                HMRequest *request = [self mjz_requestAtIndex:thread * iterationsPerThread + i];
+                NSMutableURLRequest *urlRequest = [_apiClient URLRequestForRequest:request apiPath:_apiClient.apiPath error:nil];
+                NSAssert(urlRequest.timeoutInterval == request.timeoutInterval, @"Timeout must be applied to the URL request");
+            }
+        }
+    });
+    CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+
+    return (iterationsPerThread * threads) / elapsed;
+}
+
+- (void)testRequestBuildThroughputScalesWithCores
+{
+    NSUInteger cores = [[NSProcessInfo processInfo] activeProcessorCount];
+    NSUInteger iterations = 20000;
+
+    // Warm up
+    [self mjz_requestBuildThroughputWithThreads:1 iterations:1000];
+
+    double singleThreaded = [self mjz_requestBuildThroughputWithThreads:1 iterations:iterations];
+    double multiThreaded = [self mjz_requestBuildThroughputWithThreads:cores iterations:iterations];
+
+    NSLog(@"[Benchmark] Request build throughput: 1 thread %.0f req/s, %lu threads %.0f req/s (x%.2f)",
+          singleThreaded, (unsigned long)cores, multiThreaded, multiThreaded / singleThreaded);
+
+    // Like the other benchmarks, comparing two measurements of the same run, with a margin well below the expected gain
+    if (cores > 1)
+        XCTAssertGreaterThan(multiThreaded, singleThreaded * 1.2);
+}
+
+- (void)testRequestBuildPerformance
+{
+    NSUInteger cores = [[NSProcessInfo processInfo] activeProcessorCount];
+    [self measureBlock:^{
+        [self mjz_requestBuildThroughputWithThreads:cores iterations:10000];
+    }];
+}
+
+#pragma mark Request Identity
+
+- (NSArray <HMRequest*>*)mjz_requestsForIdentityBenchmark
+{
+    NSMutableArray *requests = [NSMutableArray array];
+    for (NSUInteger i=0; i<2000; ++i)
+    {
+        HMRequest *request = [HMRequest requestWithPath:@"feed/%lu", (unsigned long)(i % 500)];
+        request.parameters = @{@"page": @(i % 4), @"limit": @50, @"sort": @"date", @"filter": @{@"type": @"video", @"lang": @"en"}};
+        [requests addObject:request];
+    }
+    return requests;
+}
+
+- (void)testIdentityFingerprintVersusIdentifier
+{
+    NSArray <HMRequest*> *requests = [self mjz_requestsForIdentityBenchmark];
+    NSUInteger rounds = 20;
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger round=0; round<rounds; ++round)
+    {
+        @autoreleasepool {
+            NSMutableSet *set = [NSMutableSet set];
+            for (HMRequest *request in requests)
+                [set addObject:request.identifier];
+        }
+    }
+    CFAbsoluteTime identifierTime = CFAbsoluteTimeGetCurrent() - start;
+
+    start = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger round=0; round<rounds; ++round)
+    {
+        @autoreleasepool {
+            NSMutableSet *set = [NSMutableSet set];
+            for (HMRequest *request in requests)
+                [set addObject:request];
+        }
+    }
+    CFAbsoluteTime fingerprintTime = CFAbsoluteTimeGetCurrent() - start;
+
+    NSLog(@"[Benchmark] Request identity: identifier (MD5) %.2f ms, fingerprint %.2f ms (x%.1f)",
+          identifierTime * 1000, fingerprintTime * 1000, identifierTime / fingerprintTime);
+
+    XCTAssertLessThan(fingerprintTime, identifierTime);
+}
+
+#pragma mark Streaming JSON
+
+- (void)testStreamingJSONParserPerformance
+{
+    NSData *data = [self JSONDataWithItemCount:20000];
+    
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    @autoreleasepool {
+        [NSJSONSerialization JSONObjectWithData:data options:NSJSONReadingAllowFragments error:nil];
+    }
+    CFAbsoluteTime bufferedTime = CFAbsoluteTimeGetCurrent() - start;
+    
+    start = CFAbsoluteTimeGetCurrent();
+    @autoreleasepool {
+        [self mjz_streamingParseData:data chunkSize:16 * 1024 options:NSJSONReadingAllowFragments error:nil];
+    }
+    CFAbsoluteTime streamingTime = CFAbsoluteTimeGetCurrent() - start;
+    
+    NSLog(@"[Benchmark] JSON parsing of %.1f MB: NSJSONSerialization %.2f ms, streaming parser %.2f ms (%.2f ms per 16 KB chunk)",
+          data.length / (1024.0 * 1024.0), bufferedTime * 1000, streamingTime * 1000, streamingTime * 1000 / (data.length / (16.0 * 1024)));
+    
+    // Downloading at half the speed of the streaming parser, so the network is the bottleneck
+    NSUInteger bytesPerSecond = (NSUInteger)(data.length / streamingTime / 2);
+    
+    NSTimeInterval streamingDuration = 0;
+    NSTimeInterval bufferedDuration = 0;
+    uint64_t streamingMemory = [self mjz_peakResidentMemoryGrowthOfResponseWithSerializerType:HMClientResponseSerializerTypeStreamingJSON data:data bytesPerSecond:bytesPerSecond duration:&streamingDuration];
+    uint64_t bufferedMemory = [self mjz_peakResidentMemoryGrowthOfResponseWithSerializerType:HMClientResponseSerializerTypeJSON data:data bytesPerSecond:bytesPerSecond duration:&bufferedDuration];
+    
+    NSLog(@"[Benchmark] JSON response of %.1f MB at %.1f MB/s: NSJSONSerialization %.2f ms (peak memory +%.1f MB), streaming parser %.2f ms (peak memory +%.1f MB)",
+          data.length / (1024.0 * 1024.0), bytesPerSecond / (1024.0 * 1024.0),
+          bufferedDuration * 1000, bufferedMemory / (1024.0 * 1024.0), streamingDuration * 1000, streamingMemory / (1024.0 * 1024.0));
+    
+    // While streaming, parsing overlaps with the download, so only the parsing of the last chunk is added to the time-to-completion.
+    XCTAssertLessThan(streamingDuration, bufferedDuration);
+    
+    // The raw body is never buffered entirely while streaming
+    XCTAssertLessThan(streamingMemory, bufferedMemory);
+}
+
+- (uint64_t)mjz_peakResidentMemoryGrowthOfResponseWithSerializerType:(HMClientResponseSerializerType)serializerType
+                                                                data:(NSData*)data
+                                                      bytesPerSecond:(NSUInteger)bytesPerSecond
+                                                            duration:(NSTimeInterval*)duration
+{
+    HMClient *apiClient = [self stubClientWithConfigurator:^(HMClientConfigurator *configurator) {
+        configurator.responseSerializerType = serializerType;
+    }];
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        HMStubResponse *response = [HMStubResponse responseWithData:data statusCode:200 delay:0];
+        response.headerFields = @{@"Content-Type": @"application/json"};
+        response.bytesPerSecond = bytesPerSecond;
+        return response;
+    }];
+    
+    uint64_t baseline = [self mjz_residentMemorySize];
+    __block uint64_t peak = baseline;
+    
+    // Sampling the resident memory while the body is received and parsed
+    dispatch_queue_t samplingQueue = dispatch_queue_create("com.mobilejazz.hermod.tests.rss", DISPATCH_QUEUE_SERIAL);
+    dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, samplingQueue);
+    dispatch_source_set_timer(timer, DISPATCH_TIME_NOW, 5 * NSEC_PER_MSEC, NSEC_PER_MSEC);
+    dispatch_source_set_event_handler(timer, ^{
+        peak = MAX(peak, [self mjz_residentMemorySize]);
+    });
+    dispatch_resume(timer);
+    
+    @autoreleasepool {
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        HMResponse *response = [self performRequest:[HMRequest requestWithPath:@"users"] client:apiClient];
+        *duration = CFAbsoluteTimeGetCurrent() - start;
+        
+        XCTAssertNil(response.error);
+        XCTAssertEqual([response.responseObject[@"items"] count], [response.responseObject[@"count"] unsignedIntegerValue]);
+    }
+    
+    dispatch_source_cancel(timer);
+    dispatch_sync(samplingQueue, ^{ });
+    return peak > baseline ? peak - baseline : 0;
+}
+
+#pragma mark Request Scheduling
+
+- (NSTimeInterval)mjz_interactiveLatencyWithPriority:(HMRequestPriority)priority backgroundRequestCount:(NSUInteger)backgroundRequestCount
+{
+    HMClient *apiClient = [self stubClientWithConfigurator:^(HMClientConfigurator *configurator) {
+        configurator.maximumConcurrentRequestsPerHost = 4;
+    }];
+    
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        return [HMStubResponse responseWithJSONObject:@{@"path": request.URL.path} statusCode:200 delay:0.02];
+    }];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"All requests finished"];
+    dispatch_group_t group = dispatch_group_create();
+    
+    // Background load
+    for (NSUInteger i=0; i<backgroundRequestCount; ++i)
+    {
+        HMRequest *request = [HMRequest requestWithPath:@"sync/%lu", (unsigned long)i];
+        request.priority = HMRequestPriorityLow;
+        
+        dispatch_group_enter(group);
+        [apiClient performRequest:request completionBlock:^(HMResponse *response) {
+            dispatch_group_leave(group);
+        }];
+    }
+    
+    // Interactive requests, issued while the background requests are pending
+    NSUInteger interactiveRequestCount = 5;
+    __block NSTimeInterval totalLatency = 0;
+    for (NSUInteger i=0; i<interactiveRequestCount; ++i)
+    {
+        HMRequest *request = [HMRequest requestWithPath:@"feed/%lu", (unsigned long)i];
+        request.priority = priority;
+        
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        dispatch_group_enter(group);
+        [apiClient performRequest:request completionBlock:^(HMResponse *response) {
+            XCTAssertNil(response.error);
+            totalLatency += CFAbsoluteTimeGetCurrent() - start;
+            dispatch_group_leave(group);
+        }];
+    }
+    
+    dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+        [expectation fulfill];
+    });
+    
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+    
+    return totalLatency / interactiveRequestCount;
+}
+
+- (void)testInteractiveLatencyUnderBackgroundLoad
+{
+    NSUInteger backgroundRequestCount = 200;
+    
+    NSTimeInterval fifoLatency = [self mjz_interactiveLatencyWithPriority:HMRequestPriorityLow backgroundRequestCount:backgroundRequestCount];
+    NSTimeInterval prioritizedLatency = [self mjz_interactiveLatencyWithPriority:HMRequestPriorityHigh backgroundRequestCount:backgroundRequestCount];
+    
+    NSLog(@"[Benchmark] Interactive latency with %lu background requests: same priority %.1f ms, high priority %.1f ms (x%.1f)",
+          (unsigned long)backgroundRequestCount, fifoLatency * 1000, prioritizedLatency * 1000, fifoLatency / prioritizedLatency);
+    
+    XCTAssertLessThan(prioritizedLatency, fifoLatency);
+}
+
+#pragma mark OAuth
+
+- (void)testOAuthValidationThroughput
+{
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    [self stubOAuthResponsesWithDelay:0.1 responseBlock:nil];
+    
+    NSUInteger requestCount = 1000;
+    
+    // Expired token: all requests wait for a single refresh
+    HMOAuthSession *session = [self oauthSessionWithClient:apiClient accessToken:@"expired" expiryDate:[NSDate dateWithTimeIntervalSinceNow:-60] configurator:nil];
+    NSTimeInterval staleDuration = [self durationOfConcurrentRequests:requestCount session:session];
+    
+    XCTAssertEqual(self.tokenRequestCount, 1);
+    XCTAssertEqualObjects(session.oauthForUserAccess.accessToken, @"fresh");
+    
+    // Valid token: requests go straight through
+    NSTimeInterval freshDuration = [self durationOfConcurrentRequests:requestCount session:session];
+    
+    XCTAssertEqual(self.tokenRequestCount, 1);
+    
+    NSLog(@"[Benchmark] %lu concurrent OAuth requests: %.0f req/s with a stale token, %.0f req/s with a valid token",
+          (unsigned long)requestCount, requestCount / staleDuration, requestCount / freshDuration);
+    
+    [session logout];
+}
+
+- (void)testWriteBehindTokenPersistence
+{
+    NSURL *directoryURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    HMCountingTokenStorage *storage = [[HMCountingTokenStorage alloc] initWithDirectoryURL:directoryURL];
+    HMOAuthTokenStore *tokenStore = [[HMOAuthTokenStore alloc] initWithStorage:storage];
+    
+    HMOAuthSession *session = [[HMOAuthSession alloc] initWithConfigurator:^(HMOAuthSesionConfigurator *configurator) {
+        configurator.apiClient = _apiClient;
+        configurator.clientId = @"client";
+        configurator.tokenStore = tokenStore;
+    }];
+    
+    NSUInteger updateCount = 1000;
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger i=0; i<updateCount; ++i)
+    {
+        NSString *accessToken = [NSString stringWithFormat:@"token-%lu", (unsigned long)i];
+        HMOAuth *oauth = [[HMOAuth alloc] initWithAccessToken:accessToken refreshToken:@"refresh" expiryDate:[NSDate dateWithTimeIntervalSinceNow:3600] tokenType:@"bearer" scope:nil];
+        [session configureWithOAuth:oauth forSessionAccess:HMOAuthSesionAccessUser];
+    }
+    NSTimeInterval duration = CFAbsoluteTimeGetCurrent() - start;
+    
+    [tokenStore flush];
+    
+    NSLog(@"[Benchmark] %lu token updates: %.2f ms, %lu storage writes", (unsigned long)updateCount, duration * 1000, (unsigned long)storage.writeCount);
+    XCTAssertLessThan(storage.writeCount, updateCount);
+    
+    // A new session reading from the storage gets the latest token
+    HMOAuthSession *restoredSession = [[HMOAuthSession alloc] initWithConfigurator:^(HMOAuthSesionConfigurator *configurator) {
+        configurator.apiClient = [self stubClientWithConfigurator:nil];
+        configurator.clientId = @"client";
+        configurator.tokenStore = [[HMOAuthTokenStore alloc] initWithStorage:storage];
+    }];
+    
+    XCTAssertEqualObjects(restoredSession.oauthForUserAccess.accessToken, @"token-999");
+    
+    [[NSFileManager defaultManager] removeItemAtURL:directoryURL error:nil];
+}
+
+#pragma mark Decoded Object Cache
+
+- (NSTimeInterval)mjz_durationOfCacheHits:(NSUInteger)hitCount client:(HMClient*)apiClient
+{
+    NSDate *startDate = [NSDate date];
+    for (NSUInteger i=0; i<hitCount; ++i)
+        XCTAssertEqualObjects([self performRequest:[HMRequest requestWithPath:@"users"] client:apiClient].responseObject[@"count"], @2000);
+    return -[startDate timeIntervalSinceNow];
+}
+
+- (void)testDecodedObjectCache
+{
+    HMHTTPCache *httpCache = [[HMHTTPCache alloc] initWithDirectoryURL:nil memoryCapacity:16*1024*1024 diskCapacity:0];
+    HMClient *apiClient = [self stubClientWithConfigurator:^(HMClientConfigurator *configurator) {
+        configurator.httpCache = httpCache;
+    }];
+    
+    NSData *data = [self JSONDataWithItemCount:2000];
+    __block NSString *cacheControl = @"max-age=60";
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        HMStubResponse *response = [HMStubResponse responseWithData:data statusCode:200 delay:0];
+        response.headerFields = @{@"Content-Type": @"application/json", @"Cache-Control": cacheControl};
+        return response;
+    }];
+    
+    // The object decoded from the received body is reused by the cache hits
+    id receivedObject = [self performRequest:[HMRequest requestWithPath:@"users"] client:apiClient].responseObject;
+    id cachedObject = [self performRequest:[HMRequest requestWithPath:@"users"] client:apiClient].responseObject;
+    XCTAssertNotNil(receivedObject);
+    XCTAssertTrue(cachedObject == receivedObject);
+    XCTAssertEqual(httpCache.decodedObjectHitCount, 1);
+    
+    NSTimeInterval reusingDuration = [self mjz_durationOfCacheHits:50 client:apiClient];
+    
+    httpCache.decodedObjectCapacity = 0;
+    NSTimeInterval decodingDuration = [self mjz_durationOfCacheHits:50 client:apiClient];
+    
+    NSLog(@"[Benchmark] Cache hits (2000 items): %.2fms decoding, %.2fms reusing decoded objects",
+          decodingDuration * 1000.0 / 50, reusingDuration * 1000.0 / 50);
+    XCTAssertLessThan(reusingDuration, decodingDuration);
+    
+    // A new body of the resource drops the decoded object
+    httpCache.decodedObjectCapacity = 16*1024*1024;
+    cacheControl = @"max-age=0";
+    id firstObject = [self performRequest:[HMRequest requestWithPath:@"users"] client:apiClient].responseObject;
+    id secondObject = [self performRequest:[HMRequest requestWithPath:@"users"] client:apiClient].responseObject;
+    XCTAssertEqualObjects(firstObject, secondObject);
+    XCTAssertFalse(firstObject == secondObject);
+}
+
+#pragma mark Uploads
+
+- (uint64_t)mjz_residentMemorySize
+{
+    struct mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+        return 0;
+    return info.resident_size;
+}
+
+- (uint64_t)mjz_peakResidentMemoryGrowthDuringUpload:(HMUploadTask*)task client:(HMClient*)apiClient
+{
+    uint64_t baseline = [self mjz_residentMemorySize];
+    __block uint64_t peak = baseline;
+    
+    // Sampling the resident memory while the body is sent
+    dispatch_queue_t samplingQueue = dispatch_queue_create("com.mobilejazz.hermod.tests.rss", DISPATCH_QUEUE_SERIAL);
+    dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, samplingQueue);
+    dispatch_source_set_timer(timer, DISPATCH_TIME_NOW, 5 * NSEC_PER_MSEC, NSEC_PER_MSEC);
+    dispatch_source_set_event_handler(timer, ^{
+        peak = MAX(peak, [self mjz_residentMemorySize]);
+    });
+    dispatch_resume(timer);
+    
+    HMUploadRequest *request = [HMUploadRequest requestWithPath:@"videos"];
+    request.uploadTasks = @[task];
+    HMResponse *response = [self performRequest:request client:apiClient];
+    XCTAssertNil(response.error);
+    
+    dispatch_source_cancel(timer);
+    dispatch_sync(samplingQueue, ^{ });
+    return peak > baseline ? peak - baseline : 0;
+}
+
+- (void)testStreamedUploadMemory
+{
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    [self stubResponsesWithJSONObject:@{} statusCode:200 delay:0];
+    
+    // Writing a 128MB file in chunks
+    const unsigned long long fileSize = 128*1024*1024;
+    NSURL *fileURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]]];
+    [[NSFileManager defaultManager] createFileAtPath:fileURL.path contents:nil attributes:nil];
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingToURL:fileURL error:nil];
+    NSMutableData *chunk = [NSMutableData dataWithLength:1024*1024];
+    for (unsigned long long offset = 0; offset < fileSize; offset += chunk.length)
+    {
+        memset(chunk.mutableBytes, (int)(offset / chunk.length), chunk.length);
+        [fileHandle writeData:chunk];
+    }
+    [fileHandle closeFile];
+    
+    unsigned long long receivedLength = [HMStubURLProtocol receivedBodyLength];
+    HMUploadTask *fileTask = [HMUploadTask taskWithFileURL:fileURL fieldName:@"video" filename:@"video.mp4" mimeType:@"video/mp4"];
+    uint64_t fileGrowth = [self mjz_peakResidentMemoryGrowthDuringUpload:fileTask client:apiClient];
+    XCTAssertGreaterThan([HMStubURLProtocol receivedBodyLength] - receivedLength, fileSize);
+    
+    receivedLength = [HMStubURLProtocol receivedBodyLength];
+    HMUploadTask *streamTask = [HMUploadTask taskWithInputStream:[NSInputStream inputStreamWithURL:fileURL] length:fileSize fieldName:@"video" filename:@"video.mp4" mimeType:@"video/mp4"];
+    uint64_t streamGrowth = [self mjz_peakResidentMemoryGrowthDuringUpload:streamTask client:apiClient];
+    XCTAssertGreaterThan([HMStubURLProtocol receivedBodyLength] - receivedLength, fileSize);
+    
+    uint64_t dataGrowth = 0;
+    @autoreleasepool
+    {
+        HMUploadTask *dataTask = [HMUploadTask taskWithData:[NSData dataWithContentsOfURL:fileURL] fieldName:@"video" filename:@"video.mp4" mimeType:@"video/mp4"];
+        dataGrowth = [self mjz_peakResidentMemoryGrowthDuringUpload:dataTask client:apiClient];
+    }
+    
+    [[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+    
+    NSLog(@"[Benchmark] Peak RSS growth uploading 128MB: %.1fMB from file, %.1fMB from stream, %.1fMB from data",
+          fileGrowth / 1048576.0, streamGrowth / 1048576.0, dataGrowth / 1048576.0);
+    XCTAssertLessThan(fileGrowth, 16*1024*1024);
+    XCTAssertLessThan(streamGrowth, 16*1024*1024);
+}
+
+- (void)testUploadTaskContentDigest
+{
+    NSMutableData *content = [NSMutableData dataWithLength:32*1024*1024];
+    arc4random_buf(content.mutableBytes, content.length);
+    
+    HMUploadTask *task1 = [HMUploadTask taskWithData:[content copy] fieldName:@"video" filename:@"video.mp4" mimeType:@"video/mp4"];
+    HMUploadTask *task2 = [HMUploadTask taskWithData:[content copy] fieldName:@"video" filename:@"video.mp4" mimeType:@"video/mp4"];
+    HMUploadTask *thumbnailTask = [HMUploadTask taskWithData:[@"thumbnail" dataUsingEncoding:NSUTF8StringEncoding] fieldName:@"thumbnail" filename:@"thumbnail.jpg" mimeType:@"image/jpeg"];
+    
+    // Files with the same content get the same digest
+    NSURL *fileURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]]];
+    [content writeToURL:fileURL atomically:YES];
+    HMUploadTask *fileTask = [HMUploadTask taskWithFileURL:fileURL fieldName:@"video" filename:@"video.mp4" mimeType:@"video/mp4"];
+    XCTAssertEqualObjects(fileTask.contentDigest, task1.contentDigest);
+    XCTAssertEqualObjects(fileTask, task1);
+    [[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+    
+    // Once the digests are computed, comparing and hashing tasks doesn't read their content
+    const NSUInteger iterations = 1000;
+    NSDate *startDate = [NSDate date];
+    for (NSUInteger i=0; i<iterations; ++i)
+    {
+        XCTAssertEqualObjects(task1, task2);
+        XCTAssertEqual(task1.hash, task2.hash);
+    }
+    NSTimeInterval digestDuration = -[startDate timeIntervalSinceNow];
+    
+    startDate = [NSDate date];
+    for (NSUInteger i=0; i<10; ++i)
+        XCTAssertTrue([task1.data isEqualToData:task2.data]);
+    NSTimeInterval bytewiseDuration = -[startDate timeIntervalSinceNow] * iterations / 10;
+    
+    NSLog(@"[Benchmark] Comparing 32MB upload tasks x%lu: %.2fms by digest, %.2fms byte for byte (estimated)",
+          (unsigned long)iterations, digestDuration * 1000.0, bytewiseDuration * 1000.0);
+    XCTAssertLessThan(digestDuration, bytewiseDuration);
+    
+    // The identifier doesn't depend on the order of the tasks
+    HMUploadRequest *request1 = [HMUploadRequest requestWithPath:@"videos"];
+    request1.uploadTasks = @[task1, thumbnailTask];
+    HMUploadRequest *request2 = [HMUploadRequest requestWithPath:@"videos"];
+    request2.uploadTasks = @[thumbnailTask, task2];
+    XCTAssertEqualObjects(request1.identifier, request2.identifier);
+    
+    task2.filename = @"other.mp4";
+    XCTAssertNotEqualObjects(request1.identifier, request2.identifier);
+    XCTAssertNotEqualObjects(task1, task2);
+}
+
+#pragma mark Downloads
+
+- (NSTimeInterval)mjz_durationOfDownload:(HMDownloadRequest*)request client:(HMClient*)apiClient content:(NSData*)content
+{
+    [[NSFileManager defaultManager] removeItemAtURL:request.fileURL error:nil];
+    
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    HMResponse *response = [self performRequest:request client:apiClient];
+    NSTimeInterval duration = CFAbsoluteTimeGetCurrent() - start;
+    
+    XCTAssertNil(response.error);
+    XCTAssertEqualObjects([NSData dataWithContentsOfURL:request.fileURL], content);
+    return duration;
+}
+
+- (void)testSegmentedDownloadThroughput
+{
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    
+    NSMutableData *content = [NSMutableData dataWithLength:6*1024*1024 + 789];
+    arc4random_buf(content.mutableBytes, content.length);
+    
+    // Stand-in server honouring ranges, each connection throttled to 2MB/s
+    const NSUInteger bytesPerSecond = 2*1024*1024;
+    __block BOOL acceptsRanges = YES;
+    __block NSUInteger headRequestCount = 0;
+    __block NSUInteger rangeRequestCount = 0;
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        NSMutableDictionary *headerFields = [@{@"ETag": @"\"v1\"", @"Content-Type": @"application/octet-stream"} mutableCopy];
+        if (acceptsRanges)
+            headerFields[@"Accept-Ranges"] = @"bytes";
+        
+        if ([request.HTTPMethod isEqualToString:@"HEAD"])
+        {
+            @synchronized (content)
+            {
+                headRequestCount += 1;
+            }
+            headerFields[@"Content-Length"] = [NSString stringWithFormat:@"%lu", (unsigned long)content.length];
+            HMStubResponse *response = [HMStubResponse responseWithData:nil statusCode:200 delay:0.01];
+            response.headerFields = headerFields;
+            return response;
+        }
+        
+        HMStubResponse *response = nil;
+        unsigned long long first = 0, last = 0;
+        NSString *range = [request valueForHTTPHeaderField:@"Range"];
+        if (acceptsRanges && range && sscanf(range.UTF8String, "bytes=%llu-%llu", &first, &last) == 2)
+        {
+            @synchronized (content)
+            {
+                rangeRequestCount += 1;
+            }
+            XCTAssertEqualObjects([request valueForHTTPHeaderField:@"If-Range"], @"\"v1\"");
+            last = MIN(last, content.length - 1);
+            headerFields[@"Content-Range"] = [NSString stringWithFormat:@"bytes %llu-%llu/%lu", first, last, (unsigned long)content.length];
+            response = [HMStubResponse responseWithData:[content subdataWithRange:NSMakeRange((NSUInteger)first, (NSUInteger)(last - first + 1))] statusCode:206 delay:0.01];
+        }
+        else
+        {
+            response = [HMStubResponse responseWithData:content statusCode:200 delay:0.01];
+        }
+        response.headerFields = headerFields;
+        response.bytesPerSecond = bytesPerSecond;
+        return response;
+    }];
+    
+    NSURL *fileURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    HMDownloadRequest *request = [HMDownloadRequest requestWithPath:@"videos/1"];
+    request.fileURL = fileURL;
+    
+    NSTimeInterval singleDuration = [self mjz_durationOfDownload:request client:apiClient content:content];
+    
+    request.segmentCount = 4;
+    NSTimeInterval segmentedDuration = [self mjz_durationOfDownload:request client:apiClient content:content];
+    XCTAssertEqual(headRequestCount, 1);
+    XCTAssertEqual(rangeRequestCount, 4);
+    
+    double megabytes = content.length / (1024.0 * 1024.0);
+    NSLog(@"[Benchmark] Download of %.1fMB at 2MB/s per connection: %.2fs (%.2fMB/s) with one request, %.2fs (%.2fMB/s) with 4 ranges",
+          megabytes, singleDuration, megabytes / singleDuration, segmentedDuration, megabytes / segmentedDuration);
+    XCTAssertLessThan(segmentedDuration, singleDuration * 0.5);
+    
+    // Servers not accepting ranges send the whole resource with a single request
+    acceptsRanges = NO;
+    [self mjz_durationOfDownload:request client:apiClient content:content];
+    XCTAssertEqual(headRequestCount, 2);
+    XCTAssertEqual(rangeRequestCount, 4);
+    
+    [[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+}
+
+@end
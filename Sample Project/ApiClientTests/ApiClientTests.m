@@ -11,37 +11,1389 @@
 
 #import "HMClient.h"
 #import "HMOAuthSession.h"
+#import "HMHTTPCacheBodyStore.h"
+#import "HMMutationQueue.h"
+#import "HMStreamingJSONParser.h"
+#import "HMJSONResponseSerializer.h"
+#import "HMStubServerTestCase.h"
 
-@interface ApiClientTests : XCTestCase
+@interface HMErrorRecordingDelegate : NSObject <HMClientDelegate>
+
+@property (nonatomic, copy) void (^errorBlock)(HMResponse *response);
+
+@end
+
+@implementation HMErrorRecordingDelegate
+
+- (void)apiClient:(HMClient*)apiClient didReceiveErrorInResponse:(HMResponse*)response
+{
+    if (_errorBlock)
+        _errorBlock(response);
+}
+
+@end
+
+@interface ApiClientTests : HMStubServerTestCase
 
 @end
 
 @implementation ApiClientTests
+
+#pragma mark Request Building
+
+- (void)testRequestBuildFailureSetsError
+{
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    
+    NSURL *missingFileURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    HMUploadRequest *request = [HMUploadRequest requestWithPath:@"videos"];
+    request.httpMethod = HMHTTPMethodPOST;
+    request.uploadTasks = @[[HMUploadTask taskWithFileURL:missingFileURL fieldName:@"video" filename:@"video.mp4" mimeType:@"video/mp4"]];
+    
+    NSError *error = nil;
+    XCTAssertNil([apiClient URLRequestForRequest:request apiPath:apiClient.apiPath error:&error]);
+    XCTAssertNotNil(error);
+}
+
+#pragma mark Request Identity
+
+- (void)testIdentityFingerprintIsStable
+{
+    HMRequest *request1 = [HMRequest requestWithPath:@"feed"];
+    request1.parameters = @{@"a": @1, @"b": @"two", @"c": @[@3, @4]};
+
+    HMRequest *request2 = [HMRequest requestWithPath:@"feed"];
+    request2.parameters = @{@"c": @[@3, @4], @"b": @"two", @"a": @1.0};
+
+    XCTAssertEqual(request1.fingerprint, request2.fingerprint);
+    XCTAssertEqualObjects(request1, request2);
+
+    uint64_t fingerprint = request1.fingerprint;
+    request1.parameters = @{@"a": @2};
+    XCTAssertNotEqual(fingerprint, request1.fingerprint);
+    
+    // Requests without parameters are equal to their copies
+    HMRequest *request3 = [HMRequest requestWithPath:@"feed"];
+    XCTAssertEqualObjects(request3, [request3 copy]);
+    XCTAssertEqual(request3.hash, [request3 copy].hash);
+}
+
+#pragma mark Streaming JSON
+
+- (id)mjz_streamingParseData:(NSData*)data chunkSize:(NSUInteger)chunkSize options:(NSJSONReadingOptions)options error:(NSError**)error
+{
+    HMStreamingJSONParser *parser = [[HMStreamingJSONParser alloc] initWithReadingOptions:options];
+    for (NSUInteger offset=0; offset<data.length; offset += chunkSize)
+    {
+        @autoreleasepool {
+            NSData *chunk = [data subdataWithRange:NSMakeRange(offset, MIN(chunkSize, data.length - offset))];
+            if (![parser appendData:chunk error:error])
+                return nil;
+        }
+    }
+    return [parser finishWithError:error];
+}
+
+- (void)testStreamingJSONParserMatchesNSJSONSerialization
+{
+    NSData *data = [self JSONDataWithItemCount:200];
+    id expected = [NSJSONSerialization JSONObjectWithData:data options:NSJSONReadingAllowFragments error:nil];
+    
+    for (NSNumber *chunkSize in @[@1, @2, @3, @7, @64, @4096, @(data.length)])
+    {
+        NSError *error = nil;
+        id object = [self mjz_streamingParseData:data chunkSize:chunkSize.unsignedIntegerValue options:NSJSONReadingAllowFragments error:&error];
+        XCTAssertNil(error);
+        XCTAssertEqualObjects(object, expected, @"Chunk size %@", chunkSize);
+    }
+}
+
+- (void)testStreamingJSONParserFragmentsAndErrors
+{
+    NSArray *documents = @[@"12", @"-0.5e3", @"\"text\"", @"true", @"null", @" [ ] ", @"{}", @"[1,]", @"{\"a\" 1}", @"[1] 2", @"[tru]", @"{\"a\":[1,{\"b\":null}]}"];
+    
+    for (NSString *document in documents)
+    {
+        NSData *data = [document dataUsingEncoding:NSUTF8StringEncoding];
+        for (NSNumber *options in @[@0, @(NSJSONReadingAllowFragments)])
+        {
+            NSError *expectedError = nil;
+            id expected = [NSJSONSerialization JSONObjectWithData:data options:options.unsignedIntegerValue error:&expectedError];
+            
+            NSError *error = nil;
+            id object = [self mjz_streamingParseData:data chunkSize:1 options:options.unsignedIntegerValue error:&error];
+            
+            XCTAssertEqualObjects(object, expected, @"Document: %@", document);
+            XCTAssertEqual(error != nil, expectedError != nil, @"Document: %@", document);
+        }
+    }
+    
+    XCTAssertNil([self mjz_streamingParseData:[NSData data] chunkSize:1 options:0 error:nil]);
+}
+
+#pragma mark Lazy Responses
+
+- (void)testLazyResponseDecodesOnce
+{
+    NSData *data = [self JSONDataWithItemCount:100];
+    __block NSUInteger decodings = 0;
+    
+    HMResponse *response = [[HMResponse alloc] initWithRequest:[HMRequest requestWithPath:@"users"]
+                                                  httpResponse:nil
+                                                          data:data
+                                                 decodingBlock:^id(NSData *data, NSError **error) {
+                                                     decodings += 1;
+                                                     return [NSJSONSerialization JSONObjectWithData:data options:0 error:error];
+                                                 }
+                                                         error:nil];
+    
+    XCTAssertFalse(response.isResponseObjectDecoded);
+    XCTAssertNotNil(response.description);
+    XCTAssertEqual(decodings, 0);
+    
+    NSMutableArray *objects = [NSMutableArray array];
+    dispatch_apply(64, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t index) {
+        id object = response.responseObject;
+        @synchronized (objects) {
+            [objects addObject:object];
+        }
+    });
+    
+    XCTAssertEqual(decodings, 1);
+    XCTAssertTrue(response.isResponseObjectDecoded);
+    XCTAssertEqual(objects.count, 64);
+    for (id object in objects)
+        XCTAssertEqual(object, objects.firstObject);
+}
+
+- (void)testLazyResponseDecodingError
+{
+    NSData *data = [@"{\"broken\": " dataUsingEncoding:NSUTF8StringEncoding];
+    HMJSONResponseSerializer *serializer = [HMJSONResponseSerializer serializer];
+    
+    HMResponse *response = [[HMResponse alloc] initWithRequest:[HMRequest requestWithPath:@"users"]
+                                                  httpResponse:nil
+                                                          data:data
+                                                 decodingBlock:^id(NSData *data, NSError **error) {
+                                                     return [serializer JSONObjectWithData:data error:error];
+                                                 }
+                                                         error:nil];
+    
+    // As documented, the decoding error is only known once the body is decoded
+    XCTAssertNil(response.error);
+    XCTAssertNil(response.responseObject);
+    XCTAssertNotNil(response.error);
+}
+
+- (void)testLazyResponseDecodingErrorIsReported
+{
+    HMErrorRecordingDelegate *delegate = [[HMErrorRecordingDelegate alloc] init];
+    HMClient *apiClient = [self stubClientWithConfigurator:^(HMClientConfigurator *configurator) {
+        configurator.decodesResponsesLazily = YES;
+    }];
+    apiClient.delegate = delegate;
+    
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        HMStubResponse *response = [HMStubResponse responseWithData:[@"{\"broken\": " dataUsingEncoding:NSUTF8StringEncoding] statusCode:200 delay:0];
+        response.headerFields = @{@"Content-Type": @"application/json"};
+        return response;
+    }];
+    
+    // Successful responses stay lazy, even if the delegate is notified of errors
+    __block NSUInteger reportedErrorCount = 0;
+    delegate.errorBlock = ^(HMResponse *response) {
+        reportedErrorCount += 1;
+    };
+    
+    HMResponse *response = [self performRequest:[HMRequest requestWithPath:@"users"] client:apiClient];
+    XCTAssertFalse(response.isResponseObjectDecoded);
+    XCTAssertNil(response.error);
+    
+    // Decoding errors of bodies decoded by the completion block are reported to the delegate
+    XCTestExpectation *reported = [self expectationWithDescription:@"Delegate notified"];
+    delegate.errorBlock = ^(HMResponse *response) {
+        reportedErrorCount += 1;
+        [reported fulfill];
+    };
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Request finished"];
+    [apiClient performRequest:[HMRequest requestWithPath:@"users"] completionBlock:^(HMResponse *response) {
+        XCTAssertNil(response.responseObject);
+        XCTAssertNotNil(response.error);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+    XCTAssertEqual(reportedErrorCount, 1);
+}
+
+#pragma mark Response Decoding
+
+- (void)testDecoderLookup
+{
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    
+    id <HMResponseDecoder> usersDecoder = [HMBlockResponseDecoder decoderWithBlock:^id(id responseObject, NSHTTPURLResponse *httpResponse, NSError **error) {
+        return responseObject;
+    }];
+    id <HMResponseDecoder> userDecoder = [HMBlockResponseDecoder decoderWithBlock:^id(id responseObject, NSHTTPURLResponse *httpResponse, NSError **error) {
+        return responseObject;
+    }];
+    id <HMResponseDecoder> requestDecoder = [HMBlockResponseDecoder decoderWithBlock:^id(id responseObject, NSHTTPURLResponse *httpResponse, NSError **error) {
+        return responseObject;
+    }];
+    
+    [apiClient registerDecoder:usersDecoder forPath:@"users"];
+    [apiClient registerDecoder:userDecoder forPath:@"users/*"];
+    
+    XCTAssertEqual([apiClient decoderForRequest:[HMRequest requestWithPath:@"users"]], usersDecoder);
+    XCTAssertEqual([apiClient decoderForRequest:[HMRequest requestWithPath:@"users/42"]], userDecoder);
+    XCTAssertNil([apiClient decoderForRequest:[HMRequest requestWithPath:@"users/42/hobbies"]]);
+    
+    HMRequest *request = [HMRequest requestWithPath:@"users/42"];
+    request.decoder = requestDecoder;
+    XCTAssertEqual([apiClient decoderForRequest:request], requestDecoder);
+    XCTAssertEqual([[request copy] decoder], requestDecoder);
+    
+    [apiClient registerDecoder:nil forPath:@"users/*"];
+    XCTAssertNil([apiClient decoderForRequest:[HMRequest requestWithPath:@"users/42"]]);
+}
+
+#pragma mark Request Scheduling
+
+- (NSUInteger)mjz_networkRequestCountForRequests:(NSArray <HMRequest*>*)requests client:(HMClient*)apiClient
+{
+    NSUInteger initialRequestCount = [HMStubURLProtocol requestCount];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"All requests finished"];
+    expectation.expectedFulfillmentCount = requests.count;
+    
+    for (HMRequest *request in requests)
+    {
+        [apiClient performRequest:request completionBlock:^(HMResponse *response) {
+            XCTAssertNil(response.error);
+            XCTAssertEqualObjects(response.responseObject[@"path"], request.path);
+            [expectation fulfill];
+        }];
+    }
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+    
+    return [HMStubURLProtocol requestCount] - initialRequestCount;
+}
+
+- (void)testRequestCoalescing
+{
+    HMClient *apiClient = [self stubClientWithConfigurator:^(HMClientConfigurator *configurator) {
+        configurator.coalescesRequests = YES;
+    }];
+    
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        NSString *path = [request.URL.path stringByReplacingOccurrencesOfString:@"/api/v1/" withString:@""];
+        return [HMStubResponse responseWithJSONObject:@{@"path": path} statusCode:200 delay:0.2];
+    }];
+    
+    // Identical GET requests without parameters share a single network request
+    NSMutableArray <HMRequest*> *requests = [NSMutableArray array];
+    for (NSUInteger i=0; i<5; ++i)
+        [requests addObject:[HMRequest requestWithPath:@"feed"]];
+    
+    XCTAssertEqual([self mjz_networkRequestCountForRequests:requests client:apiClient], 1);
+    XCTAssertEqual(apiClient.coalescedRequestCount, 4);
+    
+    // With parameters, only requests with the same parameters are coalesced
+    [requests removeAllObjects];
+    for (NSUInteger i=0; i<4; ++i)
+    {
+        HMRequest *request = [HMRequest requestWithPath:@"feed"];
+        request.parameters = @{@"page": i < 3 ? @1 : @2};
+        [requests addObject:request];
+    }
+    
+    XCTAssertEqual([self mjz_networkRequestCountForRequests:requests client:apiClient], 2);
+    XCTAssertEqual(apiClient.coalescedRequestCount, 6);
+    
+    // Other methods are never coalesced
+    [requests removeAllObjects];
+    for (NSUInteger i=0; i<3; ++i)
+    {
+        HMRequest *request = [HMRequest requestWithPath:@"feed"];
+        request.httpMethod = HMHTTPMethodPOST;
+        [requests addObject:request];
+    }
+    
+    XCTAssertEqual([self mjz_networkRequestCountForRequests:requests client:apiClient], 3);
+    XCTAssertEqual(apiClient.coalescedRequestCount, 6);
+}
+
+- (NSArray <NSNumber*>*)mjz_completionOrderWithBatching:(BOOL)batchesCompletionDelivery completedBeforeMarker:(NSUInteger*)completedBeforeMarker
+{
+    static void *queueKey = &queueKey;
+    dispatch_queue_t queue = dispatch_queue_create("com.mobilejazz.hermod.tests.delivery", DISPATCH_QUEUE_SERIAL);
+    dispatch_queue_set_specific(queue, queueKey, queueKey, NULL);
+    
+    HMClient *apiClient = [self stubClientWithConfigurator:^(HMClientConfigurator *configurator) {
+        configurator.completionBlockQueue = queue;
+        configurator.batchesCompletionDelivery = batchesCompletionDelivery;
+    }];
+    
+    // The first response finishes right away, the others later, one after the other
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        NSInteger index = request.URL.lastPathComponent.integerValue;
+        return [HMStubResponse responseWithJSONObject:@{} statusCode:200 delay:index == 0 ? 0 : 0.3 + 0.03 * index];
+    }];
+    
+    // The completion queue is busy until all responses have finished
+    dispatch_suspend(queue);
+    
+    const NSUInteger requestCount = 8;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"All requests finished"];
+    expectation.expectedFulfillmentCount = requestCount;
+    NSMutableArray <NSNumber*> *completionOrder = [NSMutableArray array];
+    for (NSUInteger i=0; i<requestCount; ++i)
+    {
+        [apiClient performRequest:[HMRequest requestWithPath:@"items/%lu", (unsigned long)i] completionBlock:^(HMResponse *response) {
+            XCTAssertNil(response.error);
+            XCTAssertTrue(dispatch_get_specific(queueKey) == queueKey);
+            [completionOrder addObject:@(i)];
+            [expectation fulfill];
+        }];
+    }
+    
+    // Once the first response has finished, a block is dispatched to the completion queue
+    [NSThread sleepForTimeInterval:0.15];
+    __block NSUInteger completionCount = 0;
+    dispatch_async(queue, ^{
+        completionCount = completionOrder.count;
+    });
+    
+    [NSThread sleepForTimeInterval:0.8];
+    dispatch_resume(queue);
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+    
+    dispatch_sync(queue, ^{ });
+    *completedBeforeMarker = completionCount;
+    return completionOrder;
+}
+
+- (void)testBatchedCompletionDelivery
+{
+    NSArray *expectedOrder = @[@0, @1, @2, @3, @4, @5, @6, @7];
+    
+    // Without batching, each response is dispatched on its own: the block dispatched in between runs after the first one only
+    NSUInteger completedBeforeMarker = 0;
+    NSArray *completionOrder = [self mjz_completionOrderWithBatching:NO completedBeforeMarker:&completedBeforeMarker];
+    XCTAssertEqualObjects(completionOrder, expectedOrder);
+    XCTAssertEqual(completedBeforeMarker, 1);
+    
+    // With batching, the responses finished before the queue gets to run are delivered together, in the order they finished
+    completionOrder = [self mjz_completionOrderWithBatching:YES completedBeforeMarker:&completedBeforeMarker];
+    XCTAssertEqualObjects(completionOrder, expectedOrder);
+    XCTAssertEqual(completedBeforeMarker, expectedOrder.count);
+}
+
+- (void)testCancellingRequestsAndGroups
+{
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        return [HMStubResponse responseWithJSONObject:@{@"path": request.URL.path} statusCode:200 delay:0.5];
+    }];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"All requests finished"];
+    dispatch_group_t group = dispatch_group_create();
+    
+    NSUInteger requestCount = 10;
+    __block NSUInteger cancelledCount = 0;
+    __block NSUInteger completionCount = 0;
+    
+    HMCancellationGroup *cancellationGroup = [HMCancellationGroup new];
+    for (NSUInteger i=0; i<requestCount; ++i)
+    {
+        HMRequest *request = [HMRequest requestWithPath:@"feed/%lu", (unsigned long)i];
+        
+        dispatch_group_enter(group);
+        HMRequestHandle *handle = [apiClient performRequest:request completionBlock:^(HMResponse *response) {
+            completionCount += 1;
+            if ([response.error.domain isEqualToString:NSURLErrorDomain] && response.error.code == NSURLErrorCancelled)
+                cancelledCount += 1;
+            dispatch_group_leave(group);
+        }];
+        [cancellationGroup addHandle:handle];
+    }
+    
+    [cancellationGroup cancelAll];
+    
+    // Cancelling again must not deliver a second response
+    [cancellationGroup cancelAll];
+    
+    dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+        [expectation fulfill];
+    });
+    
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+    
+    XCTAssertEqual(completionCount, requestCount);
+    XCTAssertEqual(cancelledCount, requestCount);
+    
+    // Handles added to an invalidated group are cancelled right away
+    [cancellationGroup invalidate];
+    
+    XCTestExpectation *lateExpectation = [self expectationWithDescription:@"Late request cancelled"];
+    HMRequestHandle *handle = [apiClient performRequest:[HMRequest requestWithPath:@"late"] completionBlock:^(HMResponse *response) {
+        XCTAssertEqual(response.error.code, NSURLErrorCancelled);
+        [lateExpectation fulfill];
+    }];
+    [cancellationGroup addHandle:handle];
+    XCTAssertTrue(handle.isCancelled);
+    
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+}
+
+#pragma mark OAuth
+
+- (void)testProactiveOAuthRefresh
+{
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    [self stubOAuthResponsesWithDelay:0.1 responseBlock:nil];
+    
+    // The token is refreshed about half a second before becoming invalid, without any request
+    HMOAuthSession *session = [self oauthSessionWithClient:apiClient accessToken:@"initial" expiryDate:[NSDate dateWithTimeIntervalSinceNow:1.7] configurator:^(HMOAuthSesionConfigurator *configurator) {
+        configurator.validTokenOffsetTimeInterval = 1;
+        configurator.refreshesTokensProactively = YES;
+        configurator.proactiveRefreshJitterTimeInterval = 0.2;
+    }];
+    
+    [self expectationForPredicate:[NSPredicate predicateWithFormat:@"oauthForUserAccess.accessToken == 'fresh'"] evaluatedWithObject:session handler:nil];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    
+    XCTAssertEqual(self.tokenRequestCount, 1);
+    
+    // Requests do not wait for any refresh afterwards
+    [self durationOfConcurrentRequests:10 session:session];
+    XCTAssertEqual(self.tokenRequestCount, 1);
+    
+    [session logout];
+}
+
+- (void)testProactiveOAuthRefreshDoesNotHoldRequests
+{
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    
+    __block NSString *authorization = nil;
+    [self stubOAuthResponsesWithDelay:2 responseBlock:^HMStubResponse *(NSURLRequest *request) {
+        authorization = [request valueForHTTPHeaderField:@"Authorization"];
+        return [HMStubResponse responseWithJSONObject:@{} statusCode:200 delay:0];
+    }];
+    
+    // The proactive refresh starts up to 4 seconds before the token expires (given the offset)
+    NSDate *expiryDate = [NSDate dateWithTimeIntervalSinceNow:5];
+    HMOAuthSession *session = [self oauthSessionWithClient:apiClient accessToken:@"initial" expiryDate:expiryDate configurator:^(HMOAuthSesionConfigurator *configurator) {
+        configurator.validTokenOffsetTimeInterval = 1;
+        configurator.refreshesTokensProactively = YES;
+        configurator.proactiveRefreshJitterTimeInterval = 4;
+    }];
+    
+    [self expectationForPredicate:[NSPredicate predicateWithFormat:@"tokenRequestCount > 0"] evaluatedWithObject:self handler:nil];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+    
+    // While the refresh is in flight, requests are sent right away with the still valid token
+    BOOL isValid = [expiryDate timeIntervalSinceNow] > 1.5;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Request finished"];
+    [session performRequest:[HMRequest requestWithPath:@"feed"] completionBlock:^(HMResponse *response) {
+        XCTAssertNil(response.error);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+    
+    if (isValid)
+        XCTAssertTrue([authorization hasSuffix:@"initial"]);
+    else
+        XCTAssertTrue([authorization hasSuffix:@"fresh"]);
+    
+    [session logout];
+}
+
+- (void)testUnauthorizedRequestsShareOneRefresh
+{
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    [self stubOAuthResponsesWithDelay:0.1 responseBlock:^HMStubResponse *(NSURLRequest *request) {
+        // The initial token has been revoked by the server
+        if ([[request valueForHTTPHeaderField:@"Authorization"] hasSuffix:@"revoked"])
+            return [HMStubResponse responseWithJSONObject:@{} statusCode:401 delay:0.01];
+        
+        return [HMStubResponse responseWithJSONObject:@{} statusCode:200 delay:0.01];
+    }];
+    
+    HMOAuthSession *session = [self oauthSessionWithClient:apiClient accessToken:@"revoked" expiryDate:[NSDate dateWithTimeIntervalSinceNow:3600] configurator:nil];
+    
+    // Every request is rejected once, then replayed with the refreshed token
+    [self durationOfConcurrentRequests:50 session:session];
+    
+    XCTAssertEqual(self.tokenRequestCount, 1);
+    XCTAssertEqualObjects(session.oauthForUserAccess.accessToken, @"fresh");
+    
+    [session logout];
+}
+
+- (void)testOAuthRequestsDoNotRequireTheMainThread
+{
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    [self stubOAuthResponsesWithDelay:0.05 responseBlock:nil];
+    
+    HMOAuthSession *session = [self oauthSessionWithClient:apiClient accessToken:@"expired" expiryDate:[NSDate dateWithTimeIntervalSinceNow:-60] configurator:^(HMOAuthSesionConfigurator *configurator) {
+        configurator.callbackQueue = dispatch_queue_create("com.mobilejazz.hermod.tests.oauth", DISPATCH_QUEUE_SERIAL);
+    }];
+    
+    // The main thread is blocked until all requests finish: any hop to the main thread would time out.
+    dispatch_group_t group = dispatch_group_create();
+    __block NSUInteger mainThreadCompletionCount = 0;
+    for (NSUInteger i=0; i<100; ++i)
+    {
+        dispatch_group_enter(group);
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [session performRequest:[HMRequest requestWithPath:@"sync/%lu", (unsigned long)i] completionBlock:^(HMResponse *response) {
+                XCTAssertNil(response.error);
+                if ([NSThread isMainThread])
+                    mainThreadCompletionCount += 1;
+                dispatch_group_leave(group);
+            }];
+        });
+    }
+    
+    long result = dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(10 * NSEC_PER_SEC)));
+    XCTAssertEqual(result, 0);
+    XCTAssertEqual(mainThreadCompletionCount, 0);
+    
+    [session logout];
+}
+
+- (void)testOAuthRequestsUseTheAPIPath
+{
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    
+    NSMutableArray <NSString*> *requestPaths = [NSMutableArray array];
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        @synchronized (requestPaths)
+        {
+            [requestPaths addObject:request.URL.path];
+        }
+        return [HMStubResponse responseWithJSONObject:@{} statusCode:200 delay:0];
+    }];
+    
+    HMOAuthSession *session = [self oauthSessionWithClient:apiClient accessToken:@"valid" expiryDate:[NSDate dateWithTimeIntervalSinceNow:3600] configurator:nil];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Requests finished"];
+    dispatch_group_t group = dispatch_group_create();
+    
+    dispatch_group_enter(group);
+    [session performRequest:[HMRequest requestWithPath:@"feed"] completionBlock:^(HMResponse *response) {
+        XCTAssertNil(response.error);
+        dispatch_group_leave(group);
+    }];
+    
+    dispatch_group_enter(group);
+    [session performRequest:[HMRequest requestWithPath:@"profile"] completionBlock:^(HMResponse *response) {
+        XCTAssertNil(response.error);
+        dispatch_group_leave(group);
+    } refreshBlock:nil];
+    
+    dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+        [expectation fulfill];
+    });
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+    
+    // Requests performed without an API path use the one of the client
+    XCTAssertEqual(requestPaths.count, 2);
+    XCTAssertTrue([requestPaths containsObject:@"/api/v1/feed"]);
+    XCTAssertTrue([requestPaths containsObject:@"/api/v1/profile"]);
+    
+    [session logout];
+}
+
+#pragma mark HTTP Cache
+
+- (void)testHTTPCacheFreshnessAndRevalidation
+{
+    HMHTTPCache *httpCache = [[HMHTTPCache alloc] initWithDirectoryURL:nil memoryCapacity:1024*1024 diskCapacity:0];
+    HMClient *apiClient = [self stubClientWithConfigurator:^(HMClientConfigurator *configurator) {
+        configurator.httpCache = httpCache;
+    }];
+    
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        if ([request.URL.path hasSuffix:@"/fresh"])
+        {
+            HMStubResponse *response = [HMStubResponse responseWithJSONObject:@{@"value": @"fresh"} statusCode:200 delay:0];
+            response.headerFields = @{@"Content-Type": @"application/json", @"Cache-Control": @"max-age=60"};
+            return response;
+        }
+        
+        // Always revalidated
+        if ([[request valueForHTTPHeaderField:@"If-None-Match"] isEqualToString:@"\"v1\""])
+            return [HMStubResponse responseWithData:nil statusCode:304 delay:0];
+        
+        HMStubResponse *response = [HMStubResponse responseWithJSONObject:@{@"value": @"validated"} statusCode:200 delay:0];
+        response.headerFields = @{@"Content-Type": @"application/json", @"Cache-Control": @"no-cache", @"ETag": @"\"v1\""};
+        return response;
+    }];
+    
+    NSUInteger initialRequestCount = [HMStubURLProtocol requestCount];
+    
+    // Fresh responses are served without sending the request
+    XCTAssertEqualObjects([self performRequest:[HMRequest requestWithPath:@"fresh"] client:apiClient].responseObject[@"value"], @"fresh");
+    XCTAssertEqualObjects([self performRequest:[HMRequest requestWithPath:@"fresh"] client:apiClient].responseObject[@"value"], @"fresh");
+    XCTAssertEqual([HMStubURLProtocol requestCount] - initialRequestCount, 1);
+    
+    // Stale responses are revalidated with a conditional request
+    XCTAssertEqualObjects([self performRequest:[HMRequest requestWithPath:@"validated"] client:apiClient].responseObject[@"value"], @"validated");
+    HMResponse *revalidatedResponse = [self performRequest:[HMRequest requestWithPath:@"validated"] client:apiClient];
+    XCTAssertNil(revalidatedResponse.error);
+    XCTAssertEqualObjects(revalidatedResponse.responseObject[@"value"], @"validated");
+    XCTAssertEqual([HMStubURLProtocol requestCount] - initialRequestCount, 3);
+    
+    XCTAssertEqual(httpCache.hitCount, 1);
+    XCTAssertEqual(httpCache.missCount, 2);
+    XCTAssertEqual(httpCache.revalidationCount, 1);
+    XCTAssertEqual(httpCache.notModifiedCount, 1);
+    
+    // Unsafe requests invalidate the cached response
+    HMRequest *putRequest = [HMRequest requestWithPath:@"fresh"];
+    putRequest.httpMethod = HMHTTPMethodPUT;
+    [self performRequest:putRequest client:apiClient];
+    [self performRequest:[HMRequest requestWithPath:@"fresh"] client:apiClient];
+    XCTAssertEqual(httpCache.missCount, 3);
+}
+
+- (void)testHTTPCacheDiskTier
+{
+    NSURL *directoryURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    HMHTTPCache *httpCache = [[HMHTTPCache alloc] initWithDirectoryURL:directoryURL memoryCapacity:1024*1024 diskCapacity:1024*1024];
+    
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:@"http://LOCALHOST:80/api/v1/items?b=2&a=1#top"]];
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:request.URL statusCode:200 HTTPVersion:@"HTTP/1.1" headerFields:@{@"Cache-Control": @"max-age=60"}];
+    NSData *data = [@"[1,2,3]" dataUsingEncoding:NSUTF8StringEncoding];
+    [httpCache storeResponse:response data:data forRequest:request requestDate:[NSDate date]];
+    
+    // Equivalent URLs share the same key
+    NSMutableURLRequest *equivalentRequest = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:@"http://localhost/api/v1/items?a=1&b=2"]];
+    XCTAssertEqualObjects([httpCache keyForRequest:request], [httpCache keyForRequest:equivalentRequest]);
+    
+    // Waiting for the pending disk write (disk reads are serialized with writes)
+    [httpCache entryForKey:@"unknown"];
+    
+    // A new cache on the same directory reads the entry from disk
+    HMHTTPCache *restoredCache = [[HMHTTPCache alloc] initWithDirectoryURL:directoryURL memoryCapacity:1024*1024 diskCapacity:1024*1024];
+    
+    HMHTTPCacheEntry *entry = nil;
+    XCTAssertEqual([restoredCache lookupEntry:&entry forRequest:equivalentRequest options:HMHTTPCacheLookupOptionsNone], HMHTTPCacheResultHit);
+    XCTAssertEqualObjects(entry.data, data);
+    
+    [[NSFileManager defaultManager] removeItemAtURL:directoryURL error:nil];
+}
+
+- (void)testHTTPCacheKeepsForeignFiles
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSURL *directoryURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    [fileManager createDirectoryAtURL:directoryURL withIntermediateDirectories:YES attributes:nil error:nil];
+    
+    NSData *data = [@"data" dataUsingEncoding:NSUTF8StringEncoding];
+    NSURL *legacyFileURL = [directoryURL URLByAppendingPathComponent:@"3c6e0b8a9c15224a8228b9a98ca1531d"];
+    NSURL *foreignFileURL = [directoryURL URLByAppendingPathComponent:@"settings.plist"];
+    [data writeToURL:legacyFileURL atomically:YES];
+    [data writeToURL:foreignFileURL atomically:YES];
+    
+    HMHTTPCache *httpCache = [[HMHTTPCache alloc] initWithDirectoryURL:directoryURL memoryCapacity:1024*1024 diskCapacity:1024*1024];
+    
+    // Waiting for the body store to be opened
+    [httpCache entryForKey:@"unknown"];
+    
+    XCTAssertFalse([fileManager fileExistsAtPath:legacyFileURL.path]);
+    XCTAssertTrue([fileManager fileExistsAtPath:foreignFileURL.path]);
+    
+    [fileManager removeItemAtURL:directoryURL error:nil];
+}
+
+- (void)testStaleWhileRevalidate
+{
+    HMHTTPCache *httpCache = [[HMHTTPCache alloc] initWithDirectoryURL:nil memoryCapacity:1024*1024 diskCapacity:0];
+    HMClient *apiClient = [self stubClientWithConfigurator:^(HMClientConfigurator *configurator) {
+        configurator.httpCache = httpCache;
+        configurator.cacheManagement = HMClientCacheManagementStaleWhileRevalidate;
+    }];
+    
+    // Responses are stale right away
+    __block NSInteger version = 1;
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        NSString *entityTag = [NSString stringWithFormat:@"\"v%ld\"", (long)version];
+        if ([[request valueForHTTPHeaderField:@"If-None-Match"] isEqualToString:entityTag])
+            return [HMStubResponse responseWithData:nil statusCode:304 delay:0];
+        
+        HMStubResponse *response = [HMStubResponse responseWithJSONObject:@{@"version": @(version)} statusCode:200 delay:0.1];
+        response.headerFields = @{@"Content-Type": @"application/json", @"Cache-Control": @"max-age=0", @"ETag": entityTag};
+        return response;
+    }];
+    
+    XCTAssertEqualObjects([self performRequest:[HMRequest requestWithPath:@"items"] client:apiClient].responseObject[@"version"], @1);
+    version = 2;
+    
+    // The stale response is delivered first, then the refreshed one
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Response refreshed"];
+    __block NSNumber *deliveredVersion = nil;
+    __block NSNumber *refreshedVersion = nil;
+    NSDate *startDate = [NSDate date];
+    __block NSTimeInterval staleResponseLatency = 0;
+    [apiClient performRequest:[HMRequest requestWithPath:@"items"] completionBlock:^(HMResponse *response) {
+        staleResponseLatency = -[startDate timeIntervalSinceNow];
+        deliveredVersion = response.responseObject[@"version"];
+    } refreshBlock:^(HMResponse *response) {
+        XCTAssertNotNil(deliveredVersion);
+        refreshedVersion = response.responseObject[@"version"];
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+    
+    NSLog(@"[Benchmark] Stale response latency: %.1fms", staleResponseLatency * 1000.0);
+    XCTAssertEqualObjects(deliveredVersion, @1);
+    XCTAssertEqualObjects(refreshedVersion, @2);
+    XCTAssertLessThan(staleResponseLatency, 0.1);
+    
+    // The refreshed response replaced the stale one in the cache
+    XCTAssertEqualObjects([self performRequest:[HMRequest requestWithPath:@"items"] client:apiClient].responseObject[@"version"], @2);
+}
+
+- (void)testStaleIfError
+{
+    HMHTTPCache *httpCache = [[HMHTTPCache alloc] initWithDirectoryURL:nil memoryCapacity:1024*1024 diskCapacity:0];
+    HMClient *apiClient = [self stubClientWithConfigurator:^(HMClientConfigurator *configurator) {
+        configurator.httpCache = httpCache;
+        configurator.cacheManagement = HMClientCacheManagementStaleIfError;
+    }];
+    
+    __block NSInteger statusCode = 200;
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        if (statusCode != 200)
+            return [HMStubResponse responseWithData:nil statusCode:statusCode delay:0];
+        
+        HMStubResponse *response = [HMStubResponse responseWithJSONObject:@{@"value": @"cached"} statusCode:200 delay:0];
+        response.headerFields = @{@"Content-Type": @"application/json", @"Cache-Control": @"max-age=0"};
+        return response;
+    }];
+    
+    XCTAssertEqualObjects([self performRequest:[HMRequest requestWithPath:@"items"] client:apiClient].responseObject[@"value"], @"cached");
+    
+    // Server errors are replaced by the stale response
+    statusCode = 503;
+    HMResponse *response = [self performRequest:[HMRequest requestWithPath:@"items"] client:apiClient];
+    XCTAssertNil(response.error);
+    XCTAssertEqualObjects(response.responseObject[@"value"], @"cached");
+    
+    // Client errors are not
+    statusCode = 404;
+    response = [self performRequest:[HMRequest requestWithPath:@"items"] client:apiClient];
+    XCTAssertNotNil(response.error);
+}
+
+- (void)testHTTPCacheBodyStore
+{
+    NSURL *directoryURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    HMHTTPCacheBodyStore *store = [[HMHTTPCacheBodyStore alloc] initWithDirectoryURL:directoryURL capacity:64*1024];
+    
+    NSData *metadata = [@"metadata" dataUsingEncoding:NSUTF8StringEncoding];
+    NSMutableData *body = [NSMutableData dataWithLength:4096];
+    memset(body.mutableBytes, 'a', body.length);
+    for (NSInteger i = 0; i < 8; ++i)
+        XCTAssertTrue([store setMetadata:metadata body:body forKey:@(i).stringValue]);
+    
+    // Hits are views over the mapped segment file, not copies
+    NSData *body1 = nil;
+    NSData *body2 = nil;
+    XCTAssertTrue([store getMetadata:nil body:&body1 forKey:@"0"]);
+    XCTAssertTrue([store getMetadata:nil body:&body2 forKey:@"0"]);
+    XCTAssertEqual(body1.bytes, body2.bytes);
+    XCTAssertEqualObjects(body1, body);
+    
+    NSDate *startDate = [NSDate date];
+    for (NSInteger i = 0; i < 10000; ++i)
+    {
+        NSData *readBody = nil;
+        [store getMetadata:nil body:&readBody forKey:@(i % 8).stringValue];
+    }
+    NSLog(@"[Benchmark] 10000 disk hits: %.1fms", -[startDate timeIntervalSinceNow] * 1000.0);
+    
+    // Changes after the saved index are replayed when opening the store
+    [store removeRecordForKey:@"1"];
+    [store saveIndex];
+    XCTAssertTrue([store setMetadata:metadata body:body forKey:@"8"]);
+    [store removeRecordForKey:@"2"];
+    store = nil;
+    
+    // Simulating a crash while appending a record
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingToURL:[directoryURL URLByAppendingPathComponent:@"responses.segment"] error:nil];
+    [fileHandle seekToEndOfFile];
+    [fileHandle writeData:[NSData dataWithBytes:"HMRC partial" length:12]];
+    [fileHandle closeFile];
+    
+    store = [[HMHTTPCacheBodyStore alloc] initWithDirectoryURL:directoryURL capacity:64*1024];
+    XCTAssertEqual(store.recordCount, 7);
+    XCTAssertFalse([store getMetadata:nil body:nil forKey:@"1"]);
+    XCTAssertFalse([store getMetadata:nil body:nil forKey:@"2"]);
+    
+    NSData *readMetadata = nil;
+    NSData *readBody = nil;
+    XCTAssertTrue([store getMetadata:&readMetadata body:&readBody forKey:@"8"]);
+    XCTAssertEqualObjects(readMetadata, metadata);
+    XCTAssertEqualObjects(readBody, body);
+    
+    // Compaction discards the dead space, and views over the previous segment file remain valid
+    NSUInteger segmentSize = store.segmentSize;
+    [store compact];
+    XCTAssertLessThan(store.segmentSize, segmentSize);
+    XCTAssertEqual(store.recordCount, 7);
+    XCTAssertEqualObjects(readBody, body);
+    XCTAssertTrue([store getMetadata:nil body:&readBody forKey:@"8"]);
+    XCTAssertEqualObjects(readBody, body);
+    
+    [[NSFileManager defaultManager] removeItemAtURL:directoryURL error:nil];
+}
+
+- (NSString*)mjz_storeResponseWithPath:(NSString*)path maxAge:(NSInteger)maxAge inCache:(HMHTTPCache*)httpCache
+{
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:[@"http://localhost" stringByAppendingString:path]]];
+    NSString *cacheControl = [NSString stringWithFormat:@"max-age=%ld", (long)maxAge];
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:request.URL statusCode:200 HTTPVersion:@"HTTP/1.1" headerFields:@{@"Cache-Control": cacheControl}];
+    [httpCache storeResponse:response data:[path dataUsingEncoding:NSUTF8StringEncoding] forRequest:request requestDate:[NSDate date]];
+    return [httpCache keyForRequest:request];
+}
+
+- (void)testHTTPCacheEvictionPolicies
+{
+    HMHTTPCache *httpCache = [[HMHTTPCache alloc] initWithDirectoryURL:nil memoryCapacity:1024*1024 diskCapacity:0];
+    httpCache.memoryCountLimit = 3;
+    
+    // LRU: the least recently used entry is evicted
+    NSString *key1 = [self mjz_storeResponseWithPath:@"/1" maxAge:60 inCache:httpCache];
+    NSString *key2 = [self mjz_storeResponseWithPath:@"/2" maxAge:60 inCache:httpCache];
+    NSString *key3 = [self mjz_storeResponseWithPath:@"/3" maxAge:60 inCache:httpCache];
+    [httpCache entryForKey:key1];
+    [self mjz_storeResponseWithPath:@"/4" maxAge:60 inCache:httpCache];
+    XCTAssertNotNil([httpCache entryForKey:key1]);
+    XCTAssertNil([httpCache entryForKey:key2]);
+    XCTAssertEqual(httpCache.evictionCount, 1);
+    
+    // LFU: the least frequently used entry is evicted
+    [httpCache removeAllEntries];
+    httpCache.evictionPolicy = HMHTTPCacheEvictionPolicyLFU;
+    key1 = [self mjz_storeResponseWithPath:@"/1" maxAge:60 inCache:httpCache];
+    key2 = [self mjz_storeResponseWithPath:@"/2" maxAge:60 inCache:httpCache];
+    key3 = [self mjz_storeResponseWithPath:@"/3" maxAge:60 inCache:httpCache];
+    [httpCache entryForKey:key1];
+    [httpCache entryForKey:key2];
+    [httpCache entryForKey:key1];
+    [self mjz_storeResponseWithPath:@"/4" maxAge:60 inCache:httpCache];
+    XCTAssertNil([httpCache entryForKey:key3]);
+    XCTAssertNotNil([httpCache entryForKey:key2]);
+    
+    // TTL-first: the entry expiring first is evicted
+    [httpCache removeAllEntries];
+    httpCache.evictionPolicy = HMHTTPCacheEvictionPolicyTTLFirst;
+    key1 = [self mjz_storeResponseWithPath:@"/1" maxAge:600 inCache:httpCache];
+    key2 = [self mjz_storeResponseWithPath:@"/2" maxAge:0 inCache:httpCache];
+    key3 = [self mjz_storeResponseWithPath:@"/3" maxAge:60 inCache:httpCache];
+    [httpCache entryForKey:key2];
+    [self mjz_storeResponseWithPath:@"/4" maxAge:300 inCache:httpCache];
+    XCTAssertNil([httpCache entryForKey:key2]);
+    XCTAssertNotNil([httpCache entryForKey:key3]);
+    
+    // Per path prefix limits do not evict entries of other paths
+    [httpCache removeAllEntries];
+    httpCache.memoryCountLimit = 0;
+    httpCache.evictionPolicy = HMHTTPCacheEvictionPolicyLRU;
+    [httpCache setMemoryCapacity:0 countLimit:2 forPathPrefix:@"/images/"];
+    key1 = [self mjz_storeResponseWithPath:@"/items/1" maxAge:60 inCache:httpCache];
+    NSString *imageKey = [self mjz_storeResponseWithPath:@"/images/1" maxAge:60 inCache:httpCache];
+    for (NSInteger i = 2; i <= 10; ++i)
+        [self mjz_storeResponseWithPath:[NSString stringWithFormat:@"/images/%ld", (long)i] maxAge:60 inCache:httpCache];
+    XCTAssertEqual(httpCache.residentEntryCount, 3);
+    XCTAssertNotNil([httpCache entryForKey:key1]);
+    XCTAssertNil([httpCache entryForKey:imageKey]);
+    
+    // Partial flush
+    NSUInteger residentMemorySize = httpCache.residentMemorySize;
+    [httpCache trimMemoryToSize:residentMemorySize / 2];
+    XCTAssertLessThanOrEqual(httpCache.residentMemorySize, residentMemorySize / 2);
+    XCTAssertLessThan(httpCache.residentEntryCount, 3);
+    
+    NSLog(@"[Benchmark] Evictions: %lu, resident bytes: %lu", (unsigned long)httpCache.evictionCount, (unsigned long)httpCache.residentMemorySize);
+}
+
+#pragma mark Mutation Queue
+
+- (HMRequest*)mjz_requestWithMethod:(HMHTTPMethod)httpMethod path:(NSString*)path
+{
+    HMRequest *request = [HMRequest requestWithPath:path];
+    request.httpMethod = httpMethod;
+    request.parameters = @{@"path": path};
+    return request;
+}
+
+- (void)testMutationQueueCompactionAndReplay
+{
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    NSURL *fileURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    HMMutationQueue *mutationQueue = [[HMMutationQueue alloc] initWithRequestExecutor:apiClient fileURL:fileURL];
+    mutationQueue.retryTimeInterval = 60;
+    
+    __block BOOL offline = YES;
+    NSMutableArray *receivedRequests = [NSMutableArray array];
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        if (offline)
+            return [HMStubResponse responseWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNotConnectedToInternet userInfo:nil] delay:0];
+        
+        @synchronized (receivedRequests)
+        {
+            [receivedRequests addObject:[NSString stringWithFormat:@"%@ %@", request.HTTPMethod, request.URL.path]];
+        }
+        return [HMStubResponse responseWithJSONObject:@{} statusCode:200 delay:0.02];
+    }];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"All requests replayed"];
+    __block NSInteger completionCount = 0;
+    __block NSInteger errorCount = 0;
+    HMResponseBlock completionBlock = ^(HMResponse *response) {
+        if (response.error)
+            errorCount += 1;
+        if (++completionCount == 7)
+            [expectation fulfill];
+    };
+    
+    // The first request fails without reaching the server: it is queued
+    [mutationQueue performRequest:[self mjz_requestWithMethod:HMHTTPMethodPUT path:@"items/1"] completionBlock:completionBlock];
+    [self waitForExpectations:@[[self expectationForPredicate:[NSPredicate predicateWithFormat:@"queuedRequestCount == 1"] evaluatedWithObject:mutationQueue handler:nil]] timeout:10];
+    
+    // The following requests are queued after it, and superseded requests are compacted
+    [mutationQueue performRequest:[self mjz_requestWithMethod:HMHTTPMethodPUT path:@"items/1"] completionBlock:completionBlock];
+    [mutationQueue performRequest:[self mjz_requestWithMethod:HMHTTPMethodPATCH path:@"items/1"] completionBlock:completionBlock];
+    [mutationQueue performRequest:[self mjz_requestWithMethod:HMHTTPMethodPUT path:@"items/1"] completionBlock:completionBlock];
+    [mutationQueue performRequest:[self mjz_requestWithMethod:HMHTTPMethodPOST path:@"items"] completionBlock:completionBlock];
+    [mutationQueue performRequest:[self mjz_requestWithMethod:HMHTTPMethodPUT path:@"items/2"] completionBlock:completionBlock];
+    [mutationQueue performRequest:[self mjz_requestWithMethod:HMHTTPMethodDELETE path:@"items/2"] completionBlock:completionBlock];
+    
+    XCTAssertEqual(mutationQueue.queuedRequestCount, 3);
+    XCTAssertEqual(mutationQueue.compactedRequestCount, 4);
+    
+    // Queued requests survive a relaunch
+    [mutationQueue flush];
+    HMMutationQueue *restoredQueue = [[HMMutationQueue alloc] initWithRequestExecutor:nil fileURL:fileURL];
+    XCTAssertEqual(restoredQueue.queuedRequestCount, 3);
+    
+    // Back online: replayed in order, the callers of superseded requests get the response of the request superseding them
+    offline = NO;
+    [mutationQueue replay];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+    
+    NSArray *expectedRequests = @[@"PUT /api/v1/items/1", @"POST /api/v1/items", @"DELETE /api/v1/items/2"];
+    XCTAssertEqualObjects(receivedRequests, expectedRequests);
+    XCTAssertEqual(errorCount, 0);
+    XCTAssertEqual(mutationQueue.replayedRequestCount, 3);
+    XCTAssertEqual(mutationQueue.redundantWriteCount, 0);
+    XCTAssertEqual(mutationQueue.queuedRequestCount, 0);
+    
+    NSLog(@"[Benchmark] Mutations: 7 requested, %lu sent, %lu compacted", (unsigned long)mutationQueue.replayedRequestCount, (unsigned long)mutationQueue.compactedRequestCount);
+    
+    [[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+}
+
+- (void)testMutationQueueServerErrorRetries
+{
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    HMMutationQueue *mutationQueue = [[HMMutationQueue alloc] initWithRequestExecutor:apiClient fileURL:nil];
+    mutationQueue.retryTimeInterval = 0.05;
+    mutationQueue.maximumRetryCount = 2;
+    
+    // The server fails every request of "items" paths
+    NSMutableArray *receivedRequests = [NSMutableArray array];
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        @synchronized (receivedRequests)
+        {
+            [receivedRequests addObject:[NSString stringWithFormat:@"%@ %@", request.HTTPMethod, request.URL.path]];
+        }
+        NSInteger statusCode = [request.URL.path hasPrefix:@"/api/v1/items"] ? 500 : 200;
+        return [HMStubResponse responseWithJSONObject:@{} statusCode:statusCode delay:0.01];
+    }];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"All requests finished"];
+    expectation.expectedFulfillmentCount = 3;
+    NSMutableDictionary <NSString*, NSNumber*> *statusCodes = [NSMutableDictionary dictionary];
+    void (^performRequest)(HMHTTPMethod, NSString*, BOOL) = ^(HMHTTPMethod httpMethod, NSString *path, BOOL enqueues) {
+        HMResponseBlock completionBlock = ^(HMResponse *response) {
+            @synchronized (statusCodes)
+            {
+                statusCodes[path] = @(response.httpResponse.statusCode);
+            }
+            [expectation fulfill];
+        };
+        
+        HMRequest *request = [self mjz_requestWithMethod:httpMethod path:path];
+        if (enqueues)
+            [mutationQueue enqueueRequest:request apiPath:nil completionBlock:completionBlock];
+        else
+            [mutationQueue performRequest:request completionBlock:completionBlock];
+    };
+    
+    // A POST that reached the server is not sent again. A PUT is retried, then fails to its caller without blocking the requests queued after it.
+    performRequest(HMHTTPMethodPOST, @"items", YES);
+    performRequest(HMHTTPMethodPUT, @"items/1", YES);
+    performRequest(HMHTTPMethodPUT, @"users/1", NO);
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+    
+    XCTAssertEqualObjects(statusCodes[@"items"], @500);
+    XCTAssertEqualObjects(statusCodes[@"items/1"], @500);
+    XCTAssertEqualObjects(statusCodes[@"users/1"], @200);
+    
+    NSPredicate *postPredicate = [NSPredicate predicateWithFormat:@"SELF == 'POST /api/v1/items'"];
+    NSPredicate *putPredicate = [NSPredicate predicateWithFormat:@"SELF == 'PUT /api/v1/items/1'"];
+    XCTAssertEqual([receivedRequests filteredArrayUsingPredicate:postPredicate].count, 1);
+    XCTAssertEqual([receivedRequests filteredArrayUsingPredicate:putPredicate].count, 3);
+    XCTAssertEqual(mutationQueue.queuedRequestCount, 0);
+}
+
+- (void)testMutationQueueKeepsOrderBehindDirectRequests
 {
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    HMMutationQueue *mutationQueue = [[HMMutationQueue alloc] initWithRequestExecutor:apiClient fileURL:nil];
+    mutationQueue.retryTimeInterval = 0.05;
+    
+    // The first request is lost after a while. The server records the order of the writes.
+    __block BOOL dropsRequest = YES;
+    NSMutableArray *receivedVersions = [NSMutableArray array];
+    [HMStubURLProtocol setBuffersRequestBodies:YES];
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        @synchronized (receivedVersions)
+        {
+            if (dropsRequest)
+            {
+                dropsRequest = NO;
+                return [HMStubResponse responseWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCannotConnectToHost userInfo:nil] delay:0.2];
+            }
+            
+            NSDictionary *body = [NSJSONSerialization JSONObjectWithData:request.HTTPBody ?: [NSData data] options:0 error:nil];
+            [receivedVersions addObject:body[@"version"] ?: [NSNull null]];
+        }
+        return [HMStubResponse responseWithJSONObject:@{} statusCode:200 delay:0.01];
+    }];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"All requests finished"];
+    expectation.expectedFulfillmentCount = 2;
+    for (NSInteger version = 1; version <= 2; ++version)
+    {
+        HMRequest *request = [HMRequest requestWithPath:@"items/1"];
+        request.httpMethod = HMHTTPMethodPUT;
+        request.parameters = @{@"version": @(version)};
+        [mutationQueue performRequest:request completionBlock:^(HMResponse *response) {
+            XCTAssertNil(response.error);
+            [expectation fulfill];
+        }];
+        
+        // The second request is performed while the first one is still being sent: it waits for it
+        if (version == 1)
+            XCTAssertEqual(mutationQueue.queuedRequestCount, 0);
+        else
+            XCTAssertEqual(mutationQueue.queuedRequestCount, 1);
+    }
+    [self waitForExpectationsWithTimeout:10 handler:nil];
     
+    // The first request has been replayed before the second one
+    XCTAssertEqualObjects(receivedVersions, (@[@1, @2]));
+    XCTAssertEqual(mutationQueue.queuedRequestCount, 0);
+    
+    [HMStubURLProtocol setBuffersRequestBodies:NO];
 }
 
-- (void)setUp
+#pragma mark Uploads
+
+- (void)testResumableChunkedUpload
 {
-    [super setUp];
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    
+    const NSUInteger chunkSize = 1024*1024;
+    NSMutableData *content = [NSMutableData dataWithLength:5 * chunkSize + 123];
+    arc4random_buf(content.mutableBytes, content.length);
+    
+    // Stand-in server assembling the chunks. The connection drops while receiving the fourth chunk the first time.
+    NSMutableData *assembledContent = [NSMutableData dataWithLength:content.length];
+    __block NSUInteger chunkRequestCount = 0;
+    __block BOOL dropsConnection = YES;
+    [HMStubURLProtocol setBuffersRequestBodies:YES];
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        NSString *contentRange = [request valueForHTTPHeaderField:@"Content-Range"];
+        if (!contentRange)
+        {
+            // Request completing the upload
+            BOOL complete = [assembledContent isEqualToData:content] && [[request valueForHTTPHeaderField:@"Upload-Length"] integerValue] == content.length;
+            return [HMStubResponse responseWithJSONObject:@{@"complete": @(complete)} statusCode:complete ? 200 : 409 delay:0];
+        }
+        
+        unsigned long long first = 0, last = 0, total = 0;
+        sscanf(contentRange.UTF8String, "bytes %llu-%llu/%llu", &first, &last, &total);
+        @synchronized (assembledContent)
+        {
+            chunkRequestCount += 1;
+            if (dropsConnection && first == 3 * chunkSize)
+            {
+                dropsConnection = NO;
+                return [HMStubResponse responseWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil] delay:0.05];
+            }
+            
+            XCTAssertEqual(request.HTTPBody.length, last - first + 1);
+            [assembledContent replaceBytesInRange:NSMakeRange((NSUInteger)first, request.HTTPBody.length) withBytes:request.HTTPBody.bytes];
+        }
+        return [HMStubResponse responseWithData:nil statusCode:204 delay:0.05];
+    }];
+    
+    HMUploadRequest *request = [HMUploadRequest requestWithPath:@"videos"];
+    request.parameters = @{@"upload": [[NSUUID UUID] UUIDString]};
+    request.uploadTasks = @[[HMUploadTask taskWithData:content fieldName:@"video" filename:@"video.mp4" mimeType:@"video/mp4"]];
+    request.chunkSize = chunkSize;
+    request.maximumConcurrentChunks = 2;
+    
+    NSProgress *progress = nil;
+    HMResponse *response = [self performRequest:request client:apiClient progress:&progress];
+    XCTAssertEqual(response.error.code, NSURLErrorNetworkConnectionLost);
+    XCTAssertLessThan(progress.completedUnitCount, (int64_t)content.length);
+    NSUInteger firstAttemptChunkCount = chunkRequestCount;
+    
+    // Performing the upload again only sends the chunks not acknowledged yet
+    HMUploadRequest *resumedRequest = [HMUploadRequest requestWithPath:@"videos"];
+    resumedRequest.parameters = request.parameters;
+    resumedRequest.uploadTasks = request.uploadTasks;
+    resumedRequest.chunkSize = chunkSize;
+    
+    response = [self performRequest:resumedRequest client:apiClient progress:&progress];
+    XCTAssertNil(response.error);
+    XCTAssertEqualObjects(response.responseObject[@"complete"], @YES);
+    XCTAssertEqual(progress.completedUnitCount, (int64_t)content.length);
+    XCTAssertEqual(progress.totalUnitCount, (int64_t)content.length);
+    
+    NSUInteger resumedChunkCount = chunkRequestCount - firstAttemptChunkCount;
+    NSLog(@"[Benchmark] Chunked upload: %lu chunks sent before the connection dropped, %lu after resuming (6 chunks)",
+          (unsigned long)firstAttemptChunkCount, (unsigned long)resumedChunkCount);
+    XCTAssertLessThan(resumedChunkCount, 6);
+    XCTAssertGreaterThanOrEqual(resumedChunkCount, 3);
+    
+    [HMStubURLProtocol setBuffersRequestBodies:NO];
 }
 
-- (void)tearDown
+#pragma mark Downloads
+
+- (void)testResumableFileDownload
 {
-    [super tearDown];
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    
+    NSMutableData *content = [NSMutableData dataWithLength:4*1024*1024 + 321];
+    arc4random_buf(content.mutableBytes, content.length);
+    
+    // Stand-in server honouring ranges. The connection drops after sending 40% of the body the first time.
+    __block NSString *entityTag = @"\"v1\"";
+    __block BOOL dropsConnection = YES;
+    __block NSString *receivedRange = nil;
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        NSString *range = [request valueForHTTPHeaderField:@"Range"];
+        NSString *ifRange = [request valueForHTTPHeaderField:@"If-Range"];
+        receivedRange = range;
+        
+        HMStubResponse *response = nil;
+        unsigned long long first = 0;
+        if (range && [ifRange isEqualToString:entityTag] && sscanf(range.UTF8String, "bytes=%llu-", &first) == 1)
+        {
+            NSData *body = [content subdataWithRange:NSMakeRange((NSUInteger)first, content.length - (NSUInteger)first)];
+            response = [HMStubResponse responseWithData:body statusCode:206 delay:0];
+            response.headerFields = @{@"ETag": entityTag,
+                                      @"Content-Type": @"application/octet-stream",
+                                      @"Content-Range": [NSString stringWithFormat:@"bytes %llu-%lu/%lu", first, (unsigned long)content.length - 1, (unsigned long)content.length]};
+            return response;
+        }
+        
+        if (dropsConnection)
+        {
+            dropsConnection = NO;
+            response = [HMStubResponse responseWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil] delay:0];
+            response.statusCode = 200;
+            response.body = [content subdataWithRange:NSMakeRange(0, content.length * 2 / 5)];
+        }
+        else
+        {
+            response = [HMStubResponse responseWithData:content statusCode:200 delay:0];
+        }
+        response.headerFields = @{@"ETag": entityTag, @"Content-Type": @"application/octet-stream"};
+        return response;
+    }];
+    
+    NSURL *fileURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    HMDownloadRequest *request = [HMDownloadRequest requestWithPath:@"videos/1"];
+    request.fileURL = fileURL;
+    
+    NSProgress *progress = nil;
+    HMResponse *response = [self performRequest:request client:apiClient progress:&progress];
+    XCTAssertEqual(response.error.code, NSURLErrorNetworkConnectionLost);
+    XCTAssertEqual(progress.completedUnitCount, (int64_t)(content.length * 2 / 5));
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:fileURL.path]);
+    
+    // Performing the download again only requests the missing bytes
+    response = [self performRequest:request client:apiClient progress:&progress];
+    XCTAssertNil(response.error);
+    XCTAssertEqualObjects(receivedRange, ([NSString stringWithFormat:@"bytes=%lu-", (unsigned long)content.length * 2 / 5]));
+    XCTAssertEqualObjects(response.fileURL, fileURL);
+    XCTAssertNil(response.responseObject);
+    XCTAssertEqualObjects([NSData dataWithContentsOfURL:fileURL], content);
+    XCTAssertEqual(progress.completedUnitCount, (int64_t)content.length);
+    XCTAssertEqual(progress.totalUnitCount, (int64_t)content.length);
+    
+    // A partial file of a resource that has changed since is downloaded again from the start
+    dropsConnection = YES;
+    response = [self performRequest:request client:apiClient];
+    XCTAssertEqual(response.error.code, NSURLErrorNetworkConnectionLost);
+    
+    entityTag = @"\"v2\"";
+    response = [self performRequest:request client:apiClient];
+    XCTAssertNil(response.error);
+    XCTAssertNotNil(receivedRange);
+    XCTAssertEqualObjects([NSData dataWithContentsOfURL:fileURL], content);
+    
+    [[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
 }
 
-- (void)testExample
+- (void)testFileDownloadDiscardsUnresumablePartialFile
 {
-    XCTAssert(YES, @"Pass");
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    
+    NSMutableData *content = [NSMutableData dataWithLength:1024*1024 + 123];
+    arc4random_buf(content.mutableBytes, content.length);
+    
+    // Stand-in server dropping the connection after half of the body, then answering range requests with the given status code
+    __block BOOL dropsConnection = YES;
+    __block NSInteger rangeStatusCode = 416;
+    __block NSString *receivedRange = nil;
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        receivedRange = [request valueForHTTPHeaderField:@"Range"];
+        
+        HMStubResponse *response = nil;
+        if (dropsConnection)
+        {
+            dropsConnection = NO;
+            response = [HMStubResponse responseWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil] delay:0];
+            response.statusCode = 200;
+            response.body = [content subdataWithRange:NSMakeRange(0, content.length / 2)];
+            response.headerFields = @{@"ETag": @"\"v1\"", @"Content-Type": @"application/octet-stream"};
+        }
+        else if (receivedRange && rangeStatusCode == 416)
+        {
+            response = [HMStubResponse responseWithData:nil statusCode:416 delay:0];
+            response.headerFields = @{@"Content-Range": [NSString stringWithFormat:@"bytes */%lu", (unsigned long)content.length]};
+        }
+        else if (receivedRange)
+        {
+            // The range does not start where the partial file ends
+            response = [HMStubResponse responseWithData:content statusCode:206 delay:0];
+            response.headerFields = @{@"ETag": @"\"v1\"",
+                                      @"Content-Type": @"application/octet-stream",
+                                      @"Content-Range": [NSString stringWithFormat:@"bytes 0-%lu/%lu", (unsigned long)content.length - 1, (unsigned long)content.length]};
+        }
+        else
+        {
+            response = [HMStubResponse responseWithData:content statusCode:200 delay:0];
+            response.headerFields = @{@"ETag": @"\"v1\"", @"Content-Type": @"application/octet-stream"};
+        }
+        return response;
+    }];
+    
+    NSURL *fileURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    HMDownloadRequest *request = [HMDownloadRequest requestWithPath:@"videos/1"];
+    request.fileURL = fileURL;
+    
+    for (NSNumber *statusCode in @[@416, @206])
+    {
+        rangeStatusCode = statusCode.integerValue;
+        dropsConnection = YES;
+        
+        HMResponse *response = [self performRequest:request client:apiClient];
+        XCTAssertEqual(response.error.code, NSURLErrorNetworkConnectionLost);
+        
+        // The range cannot be satisfied (or does not match): the partial file is discarded
+        response = [self performRequest:request client:apiClient];
+        XCTAssertNotNil(receivedRange);
+        XCTAssertNotNil(response.error);
+        
+        // The next attempt starts over
+        response = [self performRequest:request client:apiClient];
+        XCTAssertNil(receivedRange);
+        XCTAssertNil(response.error);
+        XCTAssertEqualObjects([NSData dataWithContentsOfURL:fileURL], content);
+    }
+    
+    [[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
 }
 
-//- (void)testPerformanceExample
-//{
-//    // This is an example of a performance test case.
-//    [self measureBlock:^{
-//        // Put the code you want to measure the time of here.
-//    }];
-//}
+- (void)testSegmentedDownloadDroppedConnection
+{
+    HMClient *apiClient = [self stubClientWithConfigurator:nil];
+    
+    NSMutableData *content = [NSMutableData dataWithLength:2*1024*1024 + 55];
+    arc4random_buf(content.mutableBytes, content.length);
+    
+    // Stand-in server whose connections drop after sending half of the body (or that closes them before sending the announced length)
+    __block BOOL acceptsRanges = YES;
+    __block BOOL closesConnection = NO;
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        NSMutableDictionary *headerFields = [@{@"ETag": @"\"v1\"", @"Content-Type": @"application/octet-stream"} mutableCopy];
+        if (acceptsRanges)
+            headerFields[@"Accept-Ranges"] = @"bytes";
+        
+        if ([request.HTTPMethod isEqualToString:@"HEAD"])
+        {
+            headerFields[@"Content-Length"] = [NSString stringWithFormat:@"%lu", (unsigned long)content.length];
+            HMStubResponse *response = [HMStubResponse responseWithData:nil statusCode:200 delay:0];
+            response.headerFields = headerFields;
+            return response;
+        }
+        
+        NSInteger statusCode = 200;
+        NSData *body = content;
+        unsigned long long first = 0, last = 0;
+        NSString *range = [request valueForHTTPHeaderField:@"Range"];
+        if (acceptsRanges && range && sscanf(range.UTF8String, "bytes=%llu-%llu", &first, &last) == 2)
+        {
+            statusCode = 206;
+            body = [content subdataWithRange:NSMakeRange((NSUInteger)first, (NSUInteger)(last - first + 1))];
+            headerFields[@"Content-Range"] = [NSString stringWithFormat:@"bytes %llu-%llu/%lu", first, last, (unsigned long)content.length];
+        }
+        headerFields[@"Content-Length"] = [NSString stringWithFormat:@"%lu", (unsigned long)body.length];
+        
+        HMStubResponse *response = nil;
+        if (closesConnection)
+            response = [HMStubResponse responseWithData:[body subdataWithRange:NSMakeRange(0, body.length / 2)] statusCode:statusCode delay:0];
+        else
+            response = [HMStubResponse responseWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil] delay:0];
+        response.statusCode = statusCode;
+        response.body = [body subdataWithRange:NSMakeRange(0, body.length / 2)];
+        response.headerFields = headerFields;
+        return response;
+    }];
+    
+    NSURL *fileURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    HMDownloadRequest *request = [HMDownloadRequest requestWithPath:@"videos/1"];
+    request.fileURL = fileURL;
+    request.segmentCount = 4;
+    
+    // Truncated bodies are never moved into place, with ranges or with a single request
+    for (NSNumber *ranged in @[@YES, @NO])
+    {
+        acceptsRanges = ranged.boolValue;
+        for (NSNumber *closes in @[@NO, @YES])
+        {
+            closesConnection = closes.boolValue;
+            HMResponse *response = [self performRequest:request client:apiClient];
+            XCTAssertNotNil(response.error, @"ranged: %@, connection closed: %@", ranged, closes);
+            XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:fileURL.path]);
+        }
+    }
+}
 
 @end
@@ -0,0 +1,89 @@
+//
+//  HMStubServerTestCase.h
+//  ApiClientTests
+//
+//  Copyright (c) 2015 Mobile Jazz. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "HMClient.h"
+#import "HMOAuthSession.h"
+#import "HMStubURLProtocol.h"
+
+/**
+ * Base test case performing requests against the local stand-in server of `HMStubURLProtocol`. The response block is reset after each test.
+ **/
+@interface HMStubServerTestCase : XCTestCase
+
+/** *************************************************** **
+ * @name Clients and sessions
+ ** *************************************************** **/
+
+/**
+ * A client for "http://localhost/api/v1" using the stub server, with a serial completion block queue.
+ * @param configuratorBlock Optional block to customize the configuration further.
+ **/
+- (HMClient*)stubClientWithConfigurator:(void (^)(HMClientConfigurator *configurator))configuratorBlock;
+
+/**
+ * A user OAuth session on top of the given client, requesting tokens to "/oauth/token" and configured with the given access token.
+ * @param apiClient The client of the session.
+ * @param accessToken The access token (with "refresh" as refresh token).
+ * @param expiryDate The expiry date of the access token.
+ * @param configuratorBlock Optional block to customize the configuration further.
+ **/
+- (HMOAuthSession*)oauthSessionWithClient:(HMClient*)apiClient
+                              accessToken:(NSString*)accessToken
+                               expiryDate:(NSDate*)expiryDate
+                             configurator:(void (^)(HMOAuthSesionConfigurator *configurator))configuratorBlock;
+
+/** *************************************************** **
+ * @name Stubbing responses
+ ** *************************************************** **/
+
+/**
+ * Answers every request with the given JSON object.
+ **/
+- (void)stubResponsesWithJSONObject:(id)object statusCode:(NSInteger)statusCode delay:(NSTimeInterval)delay;
+
+/**
+ * Answers the OAuth token requests with a "fresh" token after the given delay, and any other request with the given block (or an empty JSON object if nil).
+ **/
+- (void)stubOAuthResponsesWithDelay:(NSTimeInterval)delay responseBlock:(HMStubResponseBlock)responseBlock;
+
+/**
+ * The number of OAuth token requests answered since the test started.
+ **/
+@property (atomic, assign, readonly) NSUInteger tokenRequestCount;
+
+/** *************************************************** **
+ * @name Performing requests
+ ** *************************************************** **/
+
+/**
+ * Performs the request and waits for its response.
+ **/
+- (HMResponse*)performRequest:(HMRequest*)request client:(HMClient*)apiClient;
+
+/**
+ * Performs the request and waits for its response, returning the progress of the request handle.
+ **/
+- (HMResponse*)performRequest:(HMRequest*)request client:(HMClient*)apiClient progress:(NSProgress * __autoreleasing *)progress;
+
+/**
+ * Performs the given number of concurrent requests from several threads and waits for all of them to succeed.
+ * @return The time it took.
+ **/
+- (NSTimeInterval)durationOfConcurrentRequests:(NSUInteger)requestCount session:(HMOAuthSession*)session;
+
+/** *************************************************** **
+ * @name Test data
+ ** *************************************************** **/
+
+/**
+ * A JSON object with `count` user-like objects in its "items" array.
+ **/
+- (NSData*)JSONDataWithItemCount:(NSUInteger)count;
+
+@end
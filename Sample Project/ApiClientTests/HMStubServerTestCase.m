@@ -0,0 +1,150 @@
+//
+//  HMStubServerTestCase.m
+//  ApiClientTests
+//
+//  Copyright (c) 2015 Mobile Jazz. All rights reserved.
+//
+
+#import "HMStubServerTestCase.h"
+
+@interface HMStubServerTestCase ()
+
+@property (atomic, assign, readwrite) NSUInteger tokenRequestCount;
+
+@end
+
+@implementation HMStubServerTestCase
+
+- (void)setUp
+{
+    [super setUp];
+    self.tokenRequestCount = 0;
+}
+
+- (void)tearDown
+{
+    [HMStubURLProtocol setResponseBlock:nil];
+    [super tearDown];
+}
+
+#pragma mark Public Methods
+
+- (HMClient*)stubClientWithConfigurator:(void (^)(HMClientConfigurator *configurator))configuratorBlock
+{
+    return [[HMClient alloc] initWithConfigurator:^(HMClientConfigurator *configurator) {
+        configurator.serverPath = @"http://localhost";
+        configurator.apiPath = @"/api/v1";
+        configurator.sessionConfiguration = [HMStubURLProtocol sessionConfiguration];
+        configurator.completionBlockQueue = dispatch_queue_create("com.mobilejazz.hermod.tests", DISPATCH_QUEUE_SERIAL);
+        if (configuratorBlock)
+            configuratorBlock(configurator);
+    }];
+}
+
+- (HMOAuthSession*)oauthSessionWithClient:(HMClient*)apiClient
+                              accessToken:(NSString*)accessToken
+                               expiryDate:(NSDate*)expiryDate
+                             configurator:(void (^)(HMOAuthSesionConfigurator *configurator))configuratorBlock
+{
+    HMOAuthSession *session = [[HMOAuthSession alloc] initWithConfigurator:^(HMOAuthSesionConfigurator *configurator) {
+        configurator.apiClient = apiClient;
+        configurator.apiOAuthPath = @"/oauth/token";
+        configurator.clientId = @"client";
+        configurator.clientSecret = @"secret";
+        configurator.useAppToken = NO;
+        if (configuratorBlock)
+            configuratorBlock(configurator);
+    }];
+
+    HMOAuth *oauth = [[HMOAuth alloc] initWithAccessToken:accessToken refreshToken:@"refresh" expiryDate:expiryDate tokenType:@"bearer" scope:nil];
+    [session configureWithOAuth:oauth forSessionAccess:HMOAuthSesionAccessUser];
+    return session;
+}
+
+- (void)stubResponsesWithJSONObject:(id)object statusCode:(NSInteger)statusCode delay:(NSTimeInterval)delay
+{
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        return [HMStubResponse responseWithJSONObject:object statusCode:statusCode delay:delay];
+    }];
+}
+
+- (void)stubOAuthResponsesWithDelay:(NSTimeInterval)delay responseBlock:(HMStubResponseBlock)responseBlock
+{
+    __weak typeof(self) weakSelf = self;
+    [HMStubURLProtocol setResponseBlock:^HMStubResponse *(NSURLRequest *request) {
+        if ([request.URL.path hasSuffix:@"/oauth/token"])
+        {
+            typeof(self) strongSelf = weakSelf;
+            @synchronized (strongSelf)
+            {
+                strongSelf.tokenRequestCount += 1;
+            }
+            return [HMStubResponse responseWithJSONObject:@{@"access_token": @"fresh", @"refresh_token": @"refresh", @"expires_in": @3600} statusCode:200 delay:delay];
+        }
+
+        if (responseBlock)
+            return responseBlock(request);
+
+        return [HMStubResponse responseWithJSONObject:@{} statusCode:200 delay:0];
+    }];
+}
+
+- (HMResponse*)performRequest:(HMRequest*)request client:(HMClient*)apiClient
+{
+    return [self performRequest:request client:apiClient progress:NULL];
+}
+
+- (HMResponse*)performRequest:(HMRequest*)request client:(HMClient*)apiClient progress:(NSProgress * __autoreleasing *)progress
+{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Request finished"];
+    __block HMResponse *result = nil;
+    HMRequestHandle *handle = [apiClient performRequest:request completionBlock:^(HMResponse *response) {
+        result = response;
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+
+    if (progress)
+        *progress = handle.progress;
+    return result;
+}
+
+- (NSTimeInterval)durationOfConcurrentRequests:(NSUInteger)requestCount session:(HMOAuthSession*)session
+{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"All requests finished"];
+    dispatch_group_t group = dispatch_group_create();
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    dispatch_apply(requestCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        HMRequest *request = [HMRequest requestWithPath:@"feed/%lu", (unsigned long)i];
+        dispatch_group_enter(group);
+        [session performRequest:request completionBlock:^(HMResponse *response) {
+            XCTAssertNil(response.error);
+            dispatch_group_leave(group);
+        }];
+    });
+
+    dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+        [expectation fulfill];
+    });
+
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+
+    return CFAbsoluteTimeGetCurrent() - start;
+}
+
+- (NSData*)JSONDataWithItemCount:(NSUInteger)count
+{
+    NSMutableArray *items = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i=0; i<count; ++i)
+    {
+        [items addObject:@{@"id": @(i),
+                           @"name": [NSString stringWithFormat:@"User \"%lu\" \u00e9\u4e2d\U0001F600\n", (unsigned long)i],
+                           @"score": @(i * 0.25 - 100),
+                           @"active": @(i % 2 == 0),
+                           @"tags": @[@"a", @"b", [NSNull null]]}];
+    }
+    return [NSJSONSerialization dataWithJSONObject:@{@"items": items, @"count": @(count)} options:0 error:nil];
+}
+
+@end
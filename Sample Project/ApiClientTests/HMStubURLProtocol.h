@@ -0,0 +1,72 @@
+//
+//  HMStubURLProtocol.h
+//  ApiClientTests
+//
+//  Copyright (c) 2015 Mobile Jazz. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * A stubbed HTTP response.
+ **/
+@interface HMStubResponse : NSObject
+
++ (instancetype)responseWithJSONObject:(id)object statusCode:(NSInteger)statusCode delay:(NSTimeInterval)delay;
++ (instancetype)responseWithData:(NSData*)data statusCode:(NSInteger)statusCode delay:(NSTimeInterval)delay;
++ (instancetype)responseWithError:(NSError*)error delay:(NSTimeInterval)delay;
+
+@property (nonatomic, assign) NSInteger statusCode;
+@property (nonatomic, copy) NSDictionary <NSString*, NSString*> *headerFields;
+@property (nonatomic, copy) NSData *body;
+
+/**
+ * If set, the request fails with this error instead of getting a response. If a body is set too, the response and the body are sent before failing (like a dropped connection).
+ **/
+@property (nonatomic, strong) NSError *error;
+
+/**
+ * Time to wait before sending the response.
+ **/
+@property (nonatomic, assign) NSTimeInterval delay;
+
+/**
+ * If greater than zero, the body is sent in small chunks at this rate, like a connection with limited bandwidth. Default value is 0 (the body is sent at once).
+ **/
+@property (nonatomic, assign) NSUInteger bytesPerSecond;
+
+@end
+
+typedef HMStubResponse* (^HMStubResponseBlock)(NSURLRequest *request);
+
+/**
+ * A URL protocol answering all requests with stubbed responses, to be used as a local stand-in server.
+ **/
+@interface HMStubURLProtocol : NSURLProtocol
+
+/**
+ * Sets the block returning the response for each request. If nil or if the block returns nil, requests get a 404 response.
+ **/
++ (void)setResponseBlock:(HMStubResponseBlock)block;
+
+/**
+ * An ephemeral session configuration with this protocol installed.
+ **/
++ (NSURLSessionConfiguration*)sessionConfiguration;
+
+/**
+ * The number of requests received so far.
+ **/
++ (NSUInteger)requestCount;
+
+/**
+ * The number of request body bytes received so far. Body streams are read in small chunks, like a server would.
+ **/
++ (unsigned long long)receivedBodyLength;
+
+/**
+ * If YES, request body streams are read before calling the response block, and the block gets the body in the `HTTPBody` of the request. Default value is NO.
+ **/
++ (void)setBuffersRequestBodies:(BOOL)buffersRequestBodies;
+
+@end
@@ -0,0 +1,235 @@
+//
+//  HMStubURLProtocol.m
+//  ApiClientTests
+//
+//  Copyright (c) 2015 Mobile Jazz. All rights reserved.
+//
+
+#import "HMStubURLProtocol.h"
+
+@implementation HMStubResponse
+
++ (instancetype)responseWithJSONObject:(id)object statusCode:(NSInteger)statusCode delay:(NSTimeInterval)delay
+{
+    NSData *data = object ? [NSJSONSerialization dataWithJSONObject:object options:0 error:nil] : nil;
+    HMStubResponse *response = [self responseWithData:data statusCode:statusCode delay:delay];
+    response.headerFields = @{@"Content-Type": @"application/json"};
+    return response;
+}
+
++ (instancetype)responseWithData:(NSData*)data statusCode:(NSInteger)statusCode delay:(NSTimeInterval)delay
+{
+    HMStubResponse *response = [HMStubResponse new];
+    response.statusCode = statusCode;
+    response.body = data;
+    response.delay = delay;
+    return response;
+}
+
++ (instancetype)responseWithError:(NSError*)error delay:(NSTimeInterval)delay
+{
+    HMStubResponse *response = [HMStubResponse new];
+    response.error = error;
+    response.delay = delay;
+    return response;
+}
+
+@end
+
+static HMStubResponseBlock _responseBlock = nil;
+static NSUInteger _requestCount = 0;
+static unsigned long long _receivedBodyLength = 0;
+static BOOL _buffersRequestBodies = NO;
+
+@implementation HMStubURLProtocol
+{
+    BOOL _stopped;
+}
+
++ (void)setResponseBlock:(HMStubResponseBlock)block
+{
+    @synchronized (self)
+    {
+        _responseBlock = [block copy];
+    }
+}
+
++ (HMStubResponseBlock)mjz_responseBlock
+{
+    @synchronized (self)
+    {
+        return _responseBlock;
+    }
+}
+
++ (NSURLSessionConfiguration*)sessionConfiguration
+{
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    configuration.protocolClasses = @[self];
+    return configuration;
+}
+
++ (NSUInteger)requestCount
+{
+    @synchronized (self)
+    {
+        return _requestCount;
+    }
+}
+
++ (unsigned long long)receivedBodyLength
+{
+    @synchronized (self)
+    {
+        return _receivedBodyLength;
+    }
+}
+
++ (void)setBuffersRequestBodies:(BOOL)buffersRequestBodies
+{
+    @synchronized (self)
+    {
+        _buffersRequestBodies = buffersRequestBodies;
+    }
+}
+
++ (BOOL)mjz_buffersRequestBodies
+{
+    @synchronized (self)
+    {
+        return _buffersRequestBodies;
+    }
+}
+
+#pragma mark NSURLProtocol
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request
+{
+    return YES;
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request
+{
+    return request;
+}
+
+- (void)startLoading
+{
+    @synchronized (self.class)
+    {
+        _requestCount += 1;
+    }
+    
+    // Client callbacks are delivered on the run loop of the loading thread
+    CFRunLoopRef runLoop = (CFRunLoopRef)CFRetain(CFRunLoopGetCurrent());
+    NSURLRequest *request = self.request;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+        NSURLRequest *receivedRequest = request;
+        if (request.HTTPBodyStream)
+        {
+            NSMutableData *body = [self.class mjz_buffersRequestBodies] ? [NSMutableData data] : nil;
+            [self.class mjz_readBodyStream:request.HTTPBodyStream intoData:body];
+            
+            if (body)
+            {
+                NSMutableURLRequest *bufferedRequest = [request mutableCopy];
+                bufferedRequest.HTTPBody = body;
+                receivedRequest = bufferedRequest;
+            }
+        }
+        else if (request.HTTPBody)
+        {
+            @synchronized (self.class)
+            {
+                _receivedBodyLength += request.HTTPBody.length;
+            }
+        }
+        
+        HMStubResponseBlock block = [self.class mjz_responseBlock];
+        HMStubResponse *response = block ? block(receivedRequest) : nil;
+        if (!response)
+            response = [HMStubResponse responseWithData:nil statusCode:404 delay:0];
+        
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(response.delay * NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+            [self mjz_sendResponse:response runLoop:runLoop];
+            CFRelease(runLoop);
+        });
+    });
+}
+
+- (void)stopLoading
+{
+    _stopped = YES;
+}
+
+#pragma mark Private Methods
+
++ (void)mjz_readBodyStream:(NSInputStream*)bodyStream intoData:(NSMutableData*)data
+{
+    uint8_t buffer[64*1024];
+    [bodyStream open];
+    
+    NSInteger length = 0;
+    while ((length = [bodyStream read:buffer maxLength:sizeof(buffer)]) > 0)
+    {
+        @synchronized (self)
+        {
+            _receivedBodyLength += length;
+        }
+        [data appendBytes:buffer length:length];
+    }
+    
+    [bodyStream close];
+}
+
+- (void)mjz_performBlock:(dispatch_block_t)block onRunLoop:(CFRunLoopRef)runLoop
+{
+    CFRunLoopPerformBlock(runLoop, kCFRunLoopCommonModes, ^{
+        if (!_stopped)
+            block();
+    });
+    CFRunLoopWakeUp(runLoop);
+}
+
+- (void)mjz_sendResponse:(HMStubResponse*)response runLoop:(CFRunLoopRef)runLoop
+{
+    if (response.error && !response.body)
+    {
+        [self mjz_performBlock:^{
+            [self.client URLProtocol:self didFailWithError:response.error];
+        } onRunLoop:runLoop];
+        return;
+    }
+    
+    NSHTTPURLResponse *httpResponse = [[NSHTTPURLResponse alloc] initWithURL:self.request.URL
+                                                                  statusCode:response.statusCode
+                                                                 HTTPVersion:@"HTTP/1.1"
+                                                                headerFields:response.headerFields];
+    
+    [self mjz_performBlock:^{
+        [self.client URLProtocol:self didReceiveResponse:httpResponse cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+    } onRunLoop:runLoop];
+    
+    // Throttled bodies are sent in chunks of 20ms worth of data
+    NSData *body = response.body;
+    NSUInteger chunkLength = response.bytesPerSecond > 0 ? MAX(response.bytesPerSecond / 50, 1) : body.length;
+    for (NSUInteger offset = 0; offset < body.length && !_stopped; offset += chunkLength)
+    {
+        NSData *chunk = [body subdataWithRange:NSMakeRange(offset, MIN(chunkLength, body.length - offset))];
+        if (response.bytesPerSecond > 0)
+            [NSThread sleepForTimeInterval:(double)chunk.length / response.bytesPerSecond];
+        
+        [self mjz_performBlock:^{
+            [self.client URLProtocol:self didLoadData:chunk];
+        } onRunLoop:runLoop];
+    }
+    
+    [self mjz_performBlock:^{
+        if (response.error)
+            [self.client URLProtocol:self didFailWithError:response.error];
+        else
+            [self.client URLProtocolDidFinishLoading:self];
+    } onRunLoop:runLoop];
+}
+
+@end
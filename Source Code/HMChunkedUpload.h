@@ -0,0 +1,99 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import <Foundation/Foundation.h>
+
+#import "HMRequest.h"
+
+@class AFHTTPSessionManager;
+@class HMRequestScheduler;
+@class HMUploadTask;
+
+/**
+ * Uploads the content of an upload task in chunks, remembering the acknowledged chunks across restarts.
+ * @discussion Each chunk is sent with the method, URL and headers of the base request, plus the `Upload-Identifier` header, a `Content-Range` header (i.e. "bytes 0-1048575/5242880") and the bytes of the chunk as body.
+ * The server acknowledges a chunk with any 2xx response. Acknowledged chunks are recorded in a state file named after the upload identifier, so an interrupted upload resumes from the chunks not acknowledged yet. This class is thread safe.
+ **/
+@interface HMChunkedUpload : NSObject
+
+/**
+ * Returns YES if the content of the task can be uploaded in chunks: it must be held in memory or in a file (streams cannot be read at arbitrary offsets).
+ * @param task The upload task.
+ * @return YES if the task can be uploaded in chunks.
+ **/
++ (BOOL)canUploadTask:(HMUploadTask*)task;
+
+/**
+ * Default initializer.
+ * @param task The upload task.
+ * @param identifier The identifier of the upload, stable across restarts (i.e. the identifier of the upload request).
+ * @param chunkSize The size in bytes of the chunks.
+ * @param stateDirectoryURL The directory of the state file, created if needed.
+ * @return An initialized instance.
+ **/
+- (instancetype)initWithTask:(HMUploadTask*)task identifier:(NSString*)identifier chunkSize:(NSUInteger)chunkSize stateDirectoryURL:(NSURL*)stateDirectoryURL;
+
+/**
+ * The identifier of the upload.
+ **/
+@property (nonatomic, strong, readonly) NSString *identifier;
+
+/**
+ * The size in bytes of the content.
+ **/
+@property (nonatomic, assign, readonly) unsigned long long totalLength;
+
+/**
+ * The number of bytes acknowledged by the server, including the ones of previous attempts.
+ **/
+@property (nonatomic, assign, readonly) unsigned long long acknowledgedLength;
+
+/**
+ * The maximum number of chunks being uploaded at the same time. Default value is 2.
+ **/
+@property (nonatomic, assign) NSUInteger maximumConcurrentChunks;
+
+/**
+ * Block called each time a chunk is acknowledged, in the completion queue of the session manager.
+ **/
+@property (nonatomic, copy) void (^progressBlock)(unsigned long long acknowledgedLength, unsigned long long totalLength);
+
+/**
+ * Uploads the chunks not acknowledged yet.
+ * @param baseRequest The request the chunk requests are built from.
+ * @param sessionManager The session manager sending the chunks.
+ * @param scheduler The scheduler starting the chunk requests, within its per host limits.
+ * @param priority The priority of the chunk requests.
+ * @param completionBlock Block called once all chunks are acknowledged (with a nil error) or once a chunk fails (the remaining ones are cancelled), in the completion queue of the session manager.
+ **/
+- (void)uploadWithBaseRequest:(NSURLRequest*)baseRequest
+               sessionManager:(AFHTTPSessionManager*)sessionManager
+                    scheduler:(HMRequestScheduler*)scheduler
+                     priority:(HMRequestPriority)priority
+              completionBlock:(void (^)(NSError *error))completionBlock;
+
+/**
+ * Cancels the chunk requests being sent. The completion block is called with a cancellation error.
+ **/
+- (void)cancel;
+
+/**
+ * Removes the state file. To be called once the server has completed the upload.
+ **/
+- (void)removeState;
+
+@end
@@ -0,0 +1,354 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import "HMChunkedUpload.h"
+
+#import <AFNetworking/AFNetworking.h>
+
+#import "HMRequestScheduler.h"
+#import "HMUploadRequest.h"
+
+@implementation HMChunkedUpload
+{
+    HMUploadTask *_task;
+    NSUInteger _chunkSize;
+    NSUInteger _chunkCount;
+    NSURL *_stateURL;
+    dispatch_queue_t _stateQueue; // Serializes the state file writes
+    
+    NSMutableIndexSet *_acknowledgedChunks;
+    NSMutableIndexSet *_pendingChunks;
+    NSMutableSet <NSURLSessionTask*> *_activeTasks;
+    NSUInteger _activeCount; // Including the chunks being read
+    BOOL _finished;
+    
+    NSURLRequest *_baseRequest;
+    AFHTTPSessionManager *_sessionManager;
+    HMRequestScheduler *_scheduler;
+    HMRequestPriority _priority;
+    void (^_completionBlock)(NSError *error);
+}
+
++ (BOOL)canUploadTask:(HMUploadTask*)task
+{
+    // Same precedence of sources than multipart uploads
+    return task.fileURL != nil || (task.inputStream == nil && task.data != nil);
+}
+
+- (instancetype)initWithTask:(HMUploadTask*)task identifier:(NSString*)identifier chunkSize:(NSUInteger)chunkSize stateDirectoryURL:(NSURL*)stateDirectoryURL
+{
+    self = [super init];
+    if (self)
+    {
+        _task = task;
+        _identifier = identifier;
+        _chunkSize = MAX(chunkSize, 1);
+        _maximumConcurrentChunks = 2;
+        
+        if (task.fileURL)
+            _totalLength = [[[NSFileManager defaultManager] attributesOfItemAtPath:task.fileURL.path error:nil] fileSize];
+        else
+            _totalLength = task.data.length;
+        
+        _chunkCount = (NSUInteger)((_totalLength + _chunkSize - 1) / _chunkSize);
+        _stateURL = [stateDirectoryURL URLByAppendingPathComponent:[identifier stringByAppendingPathExtension:@"plist"]];
+        _stateQueue = dispatch_queue_create("com.mobilejazz.hermod.chunked-upload", DISPATCH_QUEUE_SERIAL);
+        
+        _acknowledgedChunks = [NSMutableIndexSet indexSet];
+        _pendingChunks = [NSMutableIndexSet indexSet];
+        _activeTasks = [NSMutableSet set];
+        
+        [self mjz_loadState];
+    }
+    return self;
+}
+
+#pragma mark Properties
+
+- (unsigned long long)acknowledgedLength
+{
+    @synchronized (self)
+    {
+        return [self mjz_acknowledgedLength];
+    }
+}
+
+#pragma mark Public Methods
+
+- (void)uploadWithBaseRequest:(NSURLRequest*)baseRequest
+               sessionManager:(AFHTTPSessionManager*)sessionManager
+                    scheduler:(HMRequestScheduler*)scheduler
+                     priority:(HMRequestPriority)priority
+              completionBlock:(void (^)(NSError *error))completionBlock
+{
+    BOOL completed = NO;
+    @synchronized (self)
+    {
+        _baseRequest = [baseRequest copy];
+        _sessionManager = sessionManager;
+        _scheduler = scheduler;
+        _priority = priority;
+        _completionBlock = [completionBlock copy];
+        _finished = NO;
+        
+        [_pendingChunks addIndexesInRange:NSMakeRange(0, _chunkCount)];
+        [_pendingChunks removeIndexes:_acknowledgedChunks];
+        completed = _pendingChunks.count == 0;
+    }
+    
+    if (completed)
+    {
+        // Nothing left to upload (i.e. the previous attempt failed when completing the upload)
+        dispatch_async(sessionManager.completionQueue ?: dispatch_get_main_queue(), ^{
+            [self mjz_finishWithError:nil];
+        });
+        return;
+    }
+    
+    [self mjz_sendNextChunks];
+}
+
+- (void)cancel
+{
+    NSError *error = [NSError errorWithDomain:NSURLErrorDomain
+                                         code:NSURLErrorCancelled
+                                     userInfo:@{NSLocalizedDescriptionKey: @"The request has been cancelled"}];
+    [self mjz_finishWithError:error];
+}
+
+- (void)removeState
+{
+    NSURL *stateURL = _stateURL;
+    dispatch_async(_stateQueue, ^{
+        [[NSFileManager defaultManager] removeItemAtURL:stateURL error:nil];
+    });
+}
+
+#pragma mark Private Methods
+
+- (unsigned long long)mjz_acknowledgedLength
+{
+    unsigned long long length = (unsigned long long)_acknowledgedChunks.count * _chunkSize;
+    
+    // The last chunk might be shorter
+    if (_chunkCount > 0 && [_acknowledgedChunks containsIndex:_chunkCount - 1])
+        length -= (unsigned long long)_chunkCount * _chunkSize - _totalLength;
+    
+    return length;
+}
+
+- (void)mjz_loadState
+{
+    NSDictionary *state = [NSDictionary dictionaryWithContentsOfURL:_stateURL];
+    
+    // The state of a different content or chunk size cannot be resumed
+    if ([state[@"totalLength"] unsignedLongLongValue] != _totalLength || [state[@"chunkSize"] unsignedIntegerValue] != _chunkSize)
+        return;
+    
+    for (NSNumber *index in state[@"acknowledgedChunks"])
+    {
+        if (index.unsignedIntegerValue < _chunkCount)
+            [_acknowledgedChunks addIndex:index.unsignedIntegerValue];
+    }
+}
+
+- (void)mjz_saveState
+{
+    // Must be called inside a @synchronized block
+    NSMutableArray *acknowledgedChunks = [NSMutableArray arrayWithCapacity:_acknowledgedChunks.count];
+    [_acknowledgedChunks enumerateIndexesUsingBlock:^(NSUInteger idx, BOOL *stop) {
+        [acknowledgedChunks addObject:@(idx)];
+    }];
+    
+    NSDictionary *state = @{@"totalLength": @(_totalLength),
+                            @"chunkSize": @(_chunkSize),
+                            @"acknowledgedChunks": acknowledgedChunks};
+    
+    NSURL *stateURL = _stateURL;
+    dispatch_async(_stateQueue, ^{
+        [[NSFileManager defaultManager] createDirectoryAtURL:[stateURL URLByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+        [state writeToURL:stateURL atomically:YES];
+    });
+}
+
+- (void)mjz_sendNextChunks
+{
+    NSMutableIndexSet *indexes = [NSMutableIndexSet indexSet];
+    @synchronized (self)
+    {
+        while (!_finished && _pendingChunks.count > 0 && _activeCount < MAX(_maximumConcurrentChunks, 1))
+        {
+            NSUInteger index = _pendingChunks.firstIndex;
+            [_pendingChunks removeIndex:index];
+            [indexes addIndex:index];
+            _activeCount += 1;
+        }
+    }
+    
+    // Reading the chunks out of the completion queue
+    [indexes enumerateIndexesUsingBlock:^(NSUInteger idx, BOOL *stop) {
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+            [self mjz_sendChunkAtIndex:idx];
+        });
+    }];
+}
+
+- (NSData*)mjz_dataOfChunkAtIndex:(NSUInteger)index error:(NSError**)error
+{
+    unsigned long long offset = (unsigned long long)index * _chunkSize;
+    NSUInteger length = (NSUInteger)MIN((unsigned long long)_chunkSize, _totalLength - offset);
+    
+    if (!_task.fileURL)
+        return [_task.data subdataWithRange:NSMakeRange((NSUInteger)offset, length)];
+    
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForReadingFromURL:_task.fileURL error:error];
+    if (!fileHandle)
+        return nil;
+    
+    [fileHandle seekToFileOffset:offset];
+    NSData *data = [fileHandle readDataOfLength:length];
+    [fileHandle closeFile];
+    
+    if (data.length != length)
+    {
+        if (error)
+            *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadUnknownError userInfo:@{NSURLErrorKey: _task.fileURL}];
+        return nil;
+    }
+    
+    return data;
+}
+
+- (void)mjz_sendChunkAtIndex:(NSUInteger)index
+{
+    NSError *error = nil;
+    NSData *data = [self mjz_dataOfChunkAtIndex:index error:&error];
+    if (!data)
+    {
+        [self mjz_finishWithError:error];
+        return;
+    }
+    
+    unsigned long long offset = (unsigned long long)index * _chunkSize;
+    NSMutableURLRequest *chunkRequest = [_baseRequest mutableCopy];
+    chunkRequest.HTTPBody = data;
+    [chunkRequest setValue:_identifier forHTTPHeaderField:@"Upload-Identifier"];
+    [chunkRequest setValue:[NSString stringWithFormat:@"bytes %llu-%llu/%llu", offset, offset + data.length - 1, _totalLength] forHTTPHeaderField:@"Content-Range"];
+    [chunkRequest setValue:_task.mimeType ?: @"application/octet-stream" forHTTPHeaderField:@"Content-Type"];
+    [chunkRequest setValue:[NSString stringWithFormat:@"%lu", (unsigned long)data.length] forHTTPHeaderField:@"Content-Length"];
+    
+    HMRequestScheduler *scheduler = _scheduler;
+    __block NSURLSessionDataTask *sessionTask = nil;
+    sessionTask = [_sessionManager dataTaskWithRequest:chunkRequest
+                                        uploadProgress:nil
+                                      downloadProgress:nil
+                                     completionHandler:^(NSURLResponse *response, id responseObject, NSError *error) {
+                                         [scheduler finishRequest:sessionTask];
+                                         
+                                         // Any 2xx response acknowledges the chunk, whatever its body
+                                         NSInteger statusCode = [response isKindOfClass:NSHTTPURLResponse.class] ? ((NSHTTPURLResponse*)response).statusCode : 0;
+                                         if (statusCode >= 200 && statusCode < 300)
+                                             error = nil;
+                                         else if (!error)
+                                             error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadServerResponse userInfo:nil];
+                                         
+                                         [self mjz_finishChunkAtIndex:index task:sessionTask error:error];
+                                     }];
+    
+    BOOL finished = NO;
+    @synchronized (self)
+    {
+        finished = _finished;
+        if (!finished)
+            [_activeTasks addObject:sessionTask];
+    }
+    
+    if (finished)
+    {
+        [sessionTask cancel];
+        return;
+    }
+    
+    NSURLSessionDataTask *scheduledTask = sessionTask;
+    [scheduler scheduleRequest:scheduledTask forHost:chunkRequest.URL.host priority:_priority startBlock:^{
+        [scheduledTask resume];
+    }];
+}
+
+- (void)mjz_finishChunkAtIndex:(NSUInteger)index task:(NSURLSessionTask*)task error:(NSError*)error
+{
+    BOOL completed = NO;
+    unsigned long long acknowledgedLength = 0;
+    
+    @synchronized (self)
+    {
+        [_activeTasks removeObject:task];
+        _activeCount -= 1;
+        
+        if (_finished)
+            return;
+        
+        if (!error)
+        {
+            [_acknowledgedChunks addIndex:index];
+            [self mjz_saveState];
+            acknowledgedLength = [self mjz_acknowledgedLength];
+            completed = _acknowledgedChunks.count == _chunkCount;
+        }
+    }
+    
+    if (error)
+    {
+        [self mjz_finishWithError:error];
+        return;
+    }
+    
+    if (_progressBlock)
+        _progressBlock(acknowledgedLength, _totalLength);
+    
+    if (completed)
+        [self mjz_finishWithError:nil];
+    else
+        [self mjz_sendNextChunks];
+}
+
+- (void)mjz_finishWithError:(NSError*)error
+{
+    void (^completionBlock)(NSError *error) = nil;
+    NSArray <NSURLSessionTask*> *activeTasks = nil;
+    
+    @synchronized (self)
+    {
+        if (_finished)
+            return;
+        
+        _finished = YES;
+        completionBlock = _completionBlock;
+        _completionBlock = nil;
+        activeTasks = _activeTasks.allObjects;
+        [_pendingChunks removeAllIndexes];
+    }
+    
+    // Chunks being sent are not acknowledged anymore: they will be sent again by the next attempt
+    for (NSURLSessionTask *task in activeTasks)
+        [task cancel];
+    
+    if (completionBlock)
+        completionBlock(error);
+}
+
+@end
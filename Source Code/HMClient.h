@@ -18,9 +18,12 @@
 
 #import "HMRequest.h"
 #import "HMUploadRequest.h"
+#import "HMDownloadRequest.h"
 #import "HMResponse.h"
 #import "HMRequestExecutor.h"
+#import "HMRequestHandle.h"
 #import "HMConfigurationManager.h"
+#import "HMHTTPCache.h"
 
 /**
  * Cache managmenet flags.
@@ -30,8 +33,14 @@ typedef NS_ENUM(NSInteger, HMClientCacheManagement)
     /** Default cache management. */
     HMClientCacheManagementDefault,
 
-    /** When offline (no reachability to the internet), cache will be used. */
-    HMClientCacheManagementOffline
+    /** When offline (no reachability to the internet), cached responses will be used even if stale. Uses the `httpCache` of the configurator, or a default one if not set. */
+    HMClientCacheManagementOffline,
+    
+    /** Stale cached responses are delivered right away and refreshed in the background. The refreshed response is delivered to the refresh block of the request, if any. Uses the `httpCache` of the configurator, or a default one if not set. */
+    HMClientCacheManagementStaleWhileRevalidate,
+    
+    /** When the server fails (5xx status codes) or cannot be reached (timeouts and connectivity errors), cached responses will be used even if stale. Uses the `httpCache` of the configurator, or a default one if not set. */
+    HMClientCacheManagementStaleIfError
 };
 
 /**
@@ -65,6 +74,9 @@ typedef NS_OPTIONS(NSUInteger, HMClientResponseSerializerType)
 
     /** RAW responses */
     HMClientResponseSerializerTypeRaw = 1,
+
+    /** JSON responses, parsed incrementally while the body is being received. Bodies must be UTF-8 encoded. */
+    HMClientResponseSerializerTypeStreamingJSON = 2,
 };
 
 @protocol HMClientDelegate;
@@ -102,6 +114,13 @@ typedef NS_OPTIONS(NSUInteger, HMClientResponseSerializerType)
  **/
 @property (nonatomic, assign, readwrite) HMClientCacheManagement cacheManagement;
 
+/**
+ * The HTTP cache used to store responses of GET requests. Default value is nil.
+ * @discussion When set, the `NSURLCache` of the session configuration is disabled: responses are cached following their `Cache-Control` and `Expires` headers, and stale responses are revalidated with conditional requests.
+ * If nil and the `cacheManagement` is not `HMClientCacheManagementDefault`, a cache inside the caches directory of the app is used.
+ **/
+@property (nonatomic, strong, readwrite, nullable) HMHTTPCache *httpCache;
+
 /**
  * The request serializer type. Default value is `HMClientRequestSerializerTypeJSON`.
  **/
@@ -128,6 +147,39 @@ typedef NS_OPTIONS(NSUInteger, HMClientResponseSerializerType)
  */
 @property (nonatomic, copy, nullable) NSSet <NSString *> *acceptableContentTypes;
 
+/**
+ * If YES, a GET request performed while an equal request (same path, HTTP method, parameters and API path) is already in flight will not be sent again.
+ * Instead, it is attached to the in-flight request and receives the same `HMResponse`. Default value is NO.
+ * @discussion Each completion block is still executed on its own completion queue.
+ **/
+@property (nonatomic, assign, readwrite) BOOL coalescesRequests;
+
+/**
+ * If YES, JSON response bodies are not decoded until the `responseObject` of the `HMResponse` is accessed for the first time. Default value is NO.
+ * @discussion Only applies to the `HMClientResponseSerializerTypeJSON` response serializer. Responses with errors are always decoded.
+ * If the delegate implements `apiClient:errorForResponseBody:httpResponse:incomingError:`, bodies are decoded before calling it.
+ * Otherwise, successful responses stay lazy: the decoding error of a malformed body is set to the `error` of the `HMResponse` when its `responseObject` is accessed for the first time,
+ * and it is reported to `apiClient:didReceiveErrorInResponse:` only if that happens within the completion block.
+ **/
+@property (nonatomic, assign, readwrite) BOOL decodesResponsesLazily;
+
+/**
+ * If YES, responses finished before their completion queue gets to run are delivered together in a single dispatch, instead of one dispatch per response. Default value is NO.
+ * @discussion Error notifications to the delegate (`apiClient:didReceiveErrorInResponse:`) are batched the same way on the main queue.
+ * Completion blocks are executed in the same order the responses finished.
+ **/
+@property (nonatomic, assign, readwrite) BOOL batchesCompletionDelivery;
+
+/**
+ * The maximum number of concurrent requests per host. Requests exceeding the limit wait until a previous request finishes, and are started by priority (see `HMRequest.priority`). Default value is 0 (no limit).
+ **/
+@property (nonatomic, assign, readwrite) NSUInteger maximumConcurrentRequestsPerHost;
+
+/**
+ * The URL session configuration. Default value is nil (the default session configuration).
+ **/
+@property (nonatomic, strong, readwrite, nullable) NSURLSessionConfiguration *sessionConfiguration;
+
 @end
 
 /* ************************************************************************************************** */
@@ -185,12 +237,37 @@ typedef NS_OPTIONS(NSUInteger, HMClientResponseSerializerType)
  **/
 @property (nonatomic, assign, readonly) HMClientCacheManagement cacheManagement;
 
+/**
+ * The HTTP cache, if any.
+ **/
+@property (nonatomic, strong, readonly, nullable) HMHTTPCache *httpCache;
+
 /**
  * Requests completion block will be executed on the given queue.
  * @discussion If nil, blocks will be executed on the main queue.
  **/
 @property (nonatomic, strong, readonly, nullable) dispatch_queue_t completionBlockQueue;
 
+/**
+ * The number of requests waiting for a free slot of their host (see `maximumConcurrentRequestsPerHost`).
+ **/
+@property (nonatomic, assign, readonly) NSUInteger pendingRequestCount;
+
+/** ************************************************* **
+ * @name Request Coalescing
+ ** ************************************************* **/
+
+/**
+ * The number of requests that have been attached to an identical in-flight request instead of being sent.
+ * @discussion Only counts when `coalescesRequests` has been enabled in the configurator.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger coalescedRequestCount;
+
+/**
+ * The number of coalescable requests currently in flight.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger inFlightCoalescingRequestCount;
+
 /** ************************************************* **
  * @name Authorization Headers
  ** ************************************************* **/
@@ -260,6 +337,35 @@ typedef NS_OPTIONS(NSUInteger, HMClientResponseSerializerType)
  **/
 @property (nonatomic, strong, nullable) NSDictionary *requestGlobalParameters;
 
+/**
+ * Builds the URL request that would be sent for the given request.
+ * @param request The request.
+ * @param apiPath A custom API path (to be used instead of the default one).
+ * @param error An error pointer that is set if the request cannot be serialized.
+ * @return A new URL request configured with the request's timeout interval, or nil if the request cannot be serialized.
+ * @discussion This method does not take any client-wide lock and can be called concurrently from any thread.
+ **/
+- (NSMutableURLRequest * _Nullable)URLRequestForRequest:(HMRequest * _Nonnull)request apiPath:(NSString * _Nullable)apiPath error:(NSError * _Nullable * _Nullable)error;
+
+/** ************************************************* **
+ * @name Response Decoding
+ ** ************************************************* **/
+
+/**
+ * Registers a response decoder for all requests with the given path.
+ * @param decoder The decoder. If nil, the decoder registered for the path is removed.
+ * @param path The request path. A "*" path component matches any single component, for example "users/*".
+ * @discussion The decoder of the request (if any) has priority over registered decoders. Decoders are executed on a background processing queue.
+ **/
+- (void)registerDecoder:(id <HMResponseDecoder> _Nullable)decoder forPath:(NSString * _Nonnull)path;
+
+/**
+ * Returns the decoder to be used for the given request.
+ * @param request The request.
+ * @return The decoder of the request or the registered decoder matching its path. Nil if none.
+ **/
+- (id <HMResponseDecoder> _Nullable)decoderForRequest:(HMRequest * _Nonnull)request;
+
 /** ************************************************* **
  * @name Delegate
  ** ************************************************* **/
@@ -300,6 +406,7 @@ typedef NS_OPTIONS(NSUInteger, HMClientResponseSerializerType)
  * @param httpResponse The HTTP URL Response.
  * @param error The incoming error (can be nil).
  * @discussion This method is called for every succeed and failed API response. Either the response body is not nil, the error is not nil or both are not nil.
+ * This method is called in a private serial queue of the API client, not in the main thread.
  **/
 - (NSError * _Nullable)apiClient:(HMClient * _Nonnull)apiClient errorForResponseBody:(id _Nullable)responseBody httpResponse:(NSHTTPURLResponse * _Nonnull)httpResponse incomingError:(NSError * _Nullable)error;
 
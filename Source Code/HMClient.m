@@ -25,7 +25,84 @@
 
 #import "HMJSONResponseSerializer.h"
 
-#import "HMHTTPOfflineCacheSessionManager.h"
+#import "HMHTTPSessionManager.h"
+#import "HMRequestScheduler.h"
+#import "HMChunkedUpload.h"
+#import "HMFileDownload.h"
+#import "HMSegmentedDownload.h"
+#import "NSString+HMClientMD5Hashing.h"
+
+static BOOL HMErrorIsCancellation(NSError *error)
+{
+    return [error.domain isEqualToString:NSURLErrorDomain] && error.code == NSURLErrorCancelled;
+}
+
+static BOOL HMErrorAllowsStaleResponse(NSHTTPURLResponse *httpResponse, NSError *error)
+{
+    if (httpResponse.statusCode >= 500)
+        return YES;
+    
+    if (![error.domain isEqualToString:NSURLErrorDomain])
+        return NO;
+    
+    switch (error.code)
+    {
+        case NSURLErrorTimedOut:
+        case NSURLErrorCannotFindHost:
+        case NSURLErrorCannotConnectToHost:
+        case NSURLErrorNetworkConnectionLost:
+        case NSURLErrorDNSLookupFailed:
+        case NSURLErrorNotConnectedToInternet:
+            return YES;
+        default:
+            return NO;
+    }
+}
+
+static BOOL HMSerializerDecodesImmutableObjects(AFHTTPResponseSerializer *responseSerializer)
+{
+    // Decoded objects are shared by the responses of the cached body: they must not be mutable
+    if (![responseSerializer isKindOfClass:HMJSONResponseSerializer.class])
+        return NO;
+    
+    NSJSONReadingOptions readingOptions = ((HMJSONResponseSerializer*)responseSerializer).readingOptions;
+    return (readingOptions & (NSJSONReadingMutableContainers | NSJSONReadingMutableLeaves)) == 0;
+}
+
+static HMUploadTask* HMChunkedUploadTaskOfRequest(HMRequest *request)
+{
+    if (![request isKindOfClass:HMUploadRequest.class] || request.httpMethod != HMHTTPMethodPOST)
+        return nil;
+    
+    HMUploadRequest *uploadRequest = (id)request;
+    if (uploadRequest.chunkSize == 0 || uploadRequest.uploadTasks.count != 1)
+        return nil;
+    
+    HMUploadTask *task = uploadRequest.uploadTasks.firstObject;
+    return [HMChunkedUpload canUploadTask:task] ? task : nil;
+}
+
+static NSURL* HMDownloadFileURLOfRequest(HMRequest *request)
+{
+    if (![request isKindOfClass:HMDownloadRequest.class] || request.httpMethod != HMHTTPMethodGET)
+        return nil;
+    
+    return ((HMDownloadRequest*)request).fileURL;
+}
+
+static float HMURLSessionTaskPriorityFromRequestPriority(HMRequestPriority priority)
+{
+    switch (priority)
+    {
+        case HMRequestPriorityLow:
+            return NSURLSessionTaskPriorityLow;
+        case HMRequestPriorityHigh:
+            return NSURLSessionTaskPriorityHigh;
+        case HMRequestPriorityNormal:
+        default:
+            return NSURLSessionTaskPriorityDefault;
+    }
+}
 
 @implementation HMClientConfigurator
 
@@ -37,16 +114,60 @@
 
 @end
 
+/**
+ * A completion block waiting for a coalesced in-flight request.
+ **/
+@interface HMClientCoalescedCompletion : NSObject
+
+@property (nonatomic, strong) dispatch_queue_t queue;
+@property (nonatomic, copy) HMResponseBlock completionBlock;
+@property (nonatomic, strong) HMRequestHandle *handle;
+
+@end
+
+@implementation HMClientCoalescedCompletion
+
+@end
+
+/**
+ * An in-flight request that other identical requests can be attached to.
+ **/
+@interface HMClientInFlightRequest : NSObject
+
+@property (nonatomic, strong) HMRequest *request;
+@property (nonatomic, strong) NSString *apiPath;
+@property (nonatomic, strong) NSMutableArray <HMClientCoalescedCompletion*> *completions;
+@property (nonatomic, strong) NSURLSessionTask *sessionTask;
+@property (nonatomic, assign) BOOL ownerCancelled;
+
+@end
+
+@implementation HMClientInFlightRequest
+
+@end
+
 @interface HMClient ()
 
 @end
 
 @implementation HMClient
 {
-    AFHTTPSessionManager *_httpSessionManager;
+    HMHTTPSessionManager *_httpSessionManager;
     
     AFHTTPRequestSerializer *_requestSerializer;
     AFHTTPResponseSerializer *_responseSerializer;
+    
+    BOOL _coalescesRequests;
+    NSUInteger _coalescedRequestCount;
+    NSMutableDictionary <NSNumber*, HMClientInFlightRequest*> *_inFlightRequests;
+    
+    dispatch_queue_t _processingQueue;
+    NSMutableDictionary <NSString*, id <HMResponseDecoder>> *_decoders;
+    
+    HMRequestScheduler *_scheduler;
+    
+    BOOL _batchesCompletionDelivery;
+    NSMapTable <dispatch_queue_t, NSMutableArray <dispatch_block_t>*> *_pendingDeliveries;
 }
 
 - (id)init
@@ -81,6 +202,11 @@
 	self = [super init];
 	if (self)
 	{
+        _inFlightRequests = [NSMutableDictionary dictionary];
+        _decoders = [NSMutableDictionary dictionary];
+        _processingQueue = dispatch_queue_create("com.mobilejazz.hermod.processing", DISPATCH_QUEUE_CONCURRENT);
+        _pendingDeliveries = [NSMapTable strongToStrongObjectsMapTable];
+        
 		[self mjz_configureWithBlock:configuratorBlock];
         
         // Configuring Language
@@ -128,6 +254,27 @@
     }
 }
 
+- (NSUInteger)coalescedRequestCount
+{
+    @synchronized (_inFlightRequests)
+    {
+        return _coalescedRequestCount;
+    }
+}
+
+- (NSUInteger)inFlightCoalescingRequestCount
+{
+    @synchronized (_inFlightRequests)
+    {
+        return _inFlightRequests.count;
+    }
+}
+
+- (NSUInteger)pendingRequestCount
+{
+    return _scheduler.pendingRequestCount;
+}
+
 #pragma mark Public Methods
 
 - (void)setBearerToken:(NSString*)token
@@ -171,6 +318,84 @@
     [_httpSessionManager.requestSerializer setValue:nil forHTTPHeaderField:@"Authorization"];
 }
 
+- (NSMutableURLRequest*)URLRequestForRequest:(HMRequest*)request apiPath:(NSString*)apiPath error:(NSError**)error
+{
+    NSString *urlPath = [self mjz_urlPathForRequest:request apiPath:apiPath];
+    NSString *URLString = urlPath ? [[NSURL URLWithString:urlPath relativeToURL:_httpSessionManager.baseURL] absoluteString] : nil;
+    
+    if (!URLString)
+    {
+        if (error)
+            *error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadURL userInfo:@{NSLocalizedDescriptionKey: @"Cannot build the URL of the request"}];
+        return nil;
+    }
+    
+    NSString *method = NSStringFromHMHTTPMethod(request.httpMethod);
+    NSDictionary *parameters = [self mjz_parametersForRequest:request];
+    
+    NSMutableURLRequest *urlRequest = nil;
+    
+    // The content of chunked uploads is sent apart: the request only carries the parameters
+    if ([request isKindOfClass:HMUploadRequest.class] && request.httpMethod == HMHTTPMethodPOST && !HMChunkedUploadTaskOfRequest(request))
+    {
+        HMUploadRequest *uploadRequest = (id)request;
+        __block BOOL appendedAllParts = YES;
+        urlRequest = [_requestSerializer multipartFormRequestWithMethod:method
+                                                              URLString:URLString
+                                                             parameters:parameters
+                                              constructingBodyWithBlock:^(id<AFMultipartFormData> formData) {
+                                                  [uploadRequest.uploadTasks enumerateObjectsUsingBlock:^(HMUploadTask *task, NSUInteger idx, BOOL *stop) {
+                                                      // Files and streams are read while the body is sent, never loaded in memory
+                                                      if (task.fileURL)
+                                                      {
+                                                          appendedAllParts = [formData appendPartWithFileURL:task.fileURL
+                                                                                                        name:task.fieldName
+                                                                                                    fileName:task.filename
+                                                                                                    mimeType:task.mimeType
+                                                                                                       error:error] && appendedAllParts;
+                                                      }
+                                                      else if (task.inputStream)
+                                                      {
+                                                          [formData appendPartWithInputStream:task.inputStream
+                                                                                         name:task.fieldName
+                                                                                     fileName:task.filename
+                                                                                       length:task.inputStreamLength
+                                                                                     mimeType:task.mimeType];
+                                                      }
+                                                      else
+                                                      {
+                                                          [formData appendPartWithFileData:task.data
+                                                                                      name:task.fieldName
+                                                                                  fileName:task.filename
+                                                                                  mimeType:task.mimeType];
+                                                      }
+                                                  }];
+                                              }
+                                                                  error:error];
+        
+        // Files that cannot be read fail the request
+        if (!appendedAllParts)
+        {
+            if (error && !*error)
+                *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadUnknownError userInfo:@{NSLocalizedDescriptionKey: @"Cannot read the files to upload"}];
+            return nil;
+        }
+    }
+    else
+    {
+        urlRequest = [_requestSerializer requestWithMethod:method
+                                                 URLString:URLString
+                                                parameters:parameters
+                                                     error:error];
+    }
+    
+    // The timeout is configured on the request itself, the shared request serializer is never modified.
+    if (request.timeoutInterval != HMRequestDefaultTimeoutInterval)
+        urlRequest.timeoutInterval = request.timeoutInterval;
+    
+    return urlRequest;
+}
+
 - (void)setInsertAcceptLanguageHeader:(BOOL)insertAcceptLanguageHeader
 {
     _insertLanguageAsParameter = insertAcceptLanguageHeader;
@@ -187,6 +412,60 @@
 }
 
 
+#pragma mark Response Decoding
+
+- (void)registerDecoder:(id <HMResponseDecoder>)decoder forPath:(NSString*)path
+{
+    if (!path)
+        return;
+    
+    @synchronized (_decoders)
+    {
+        _decoders[path] = decoder;
+    }
+}
+
+- (id <HMResponseDecoder>)decoderForRequest:(HMRequest*)request
+{
+    if (request.decoder)
+        return request.decoder;
+    
+    NSString *path = request.path;
+    if (!path)
+        return nil;
+    
+    @synchronized (_decoders)
+    {
+        if (_decoders.count == 0)
+            return nil;
+        
+        id <HMResponseDecoder> decoder = _decoders[path];
+        if (decoder)
+            return decoder;
+        
+        // Matching path patterns, where "*" matches any single path component
+        NSArray <NSString*> *pathComponents = [path componentsSeparatedByString:@"/"];
+        for (NSString *pattern in _decoders)
+        {
+            if ([pattern rangeOfString:@"*"].location == NSNotFound)
+                continue;
+            
+            NSArray <NSString*> *patternComponents = [pattern componentsSeparatedByString:@"/"];
+            if (patternComponents.count != pathComponents.count)
+                continue;
+            
+            BOOL matches = YES;
+            for (NSUInteger i=0; i<patternComponents.count && matches; ++i)
+                matches = [patternComponents[i] isEqualToString:@"*"] || [patternComponents[i] isEqualToString:pathComponents[i]];
+            
+            if (matches)
+                return _decoders[pattern];
+        }
+    }
+    
+    return nil;
+}
+
 #pragma mark Private Methods
 
 - (void)mjz_configureWithBlock:(void (^)(HMClientConfigurator *))configuratorBlock
@@ -203,17 +482,34 @@
 	_apiPath = configurator.apiPath;
 	_cacheManagement = configurator.cacheManagement;
 	_completionBlockQueue = configurator.completionBlockQueue;
+	_coalescesRequests = configurator.coalescesRequests;
+	_batchesCompletionDelivery = configurator.batchesCompletionDelivery;
+	
+	// Configuring the request scheduler
+	_scheduler = [[HMRequestScheduler alloc] initWithMaximumConcurrentRequestsPerHost:configurator.maximumConcurrentRequestsPerHost];
 	
 	// Configuring the cache management
+	_httpCache = configurator.httpCache;
+	if (configurator.cacheManagement != HMClientCacheManagementDefault && !_httpCache)
+		_httpCache = [[HMHTTPCache alloc] initWithDirectoryURL:[self mjz_defaultHTTPCacheDirectoryURL] memoryCapacity:4*1024*1024 diskCapacity:20*1024*1024];
+	
+	// Monitoring the reachability to use cached responses when being offline
 	if (configurator.cacheManagement == HMClientCacheManagementOffline)
+		[[AFNetworkReachabilityManager sharedManager] startMonitoring];
+	
+	NSURLSessionConfiguration *sessionConfiguration = configurator.sessionConfiguration;
+	if (_httpCache)
 	{
-		_httpSessionManager = [[HMHTTPOfflineCacheSessionManager alloc] initWithBaseURL:[NSURL URLWithString:_serverPath]];
-	}
-	else
-	{
-		_httpSessionManager = [[AFHTTPSessionManager alloc] initWithBaseURL:[NSURL URLWithString:_serverPath]];
+		// Responses are only cached by the HTTP cache
+		sessionConfiguration = [sessionConfiguration ?: [NSURLSessionConfiguration defaultSessionConfiguration] copy];
+		sessionConfiguration.URLCache = nil;
 	}
 	
+	_httpSessionManager = [[HMHTTPSessionManager alloc] initWithBaseURL:[NSURL URLWithString:_serverPath] sessionConfiguration:sessionConfiguration];
+	
+	// Task completions are processed off the main thread, responses are then delivered to their completion block queue
+	_httpSessionManager.completionQueue = dispatch_queue_create("com.mobilejazz.hermod.completion", DISPATCH_QUEUE_SERIAL);
+	
 	// Request serializer
 	if (configurator.requestSerializerType == HMClientRequestSerializerTypeJSON)
 	{
@@ -230,6 +526,13 @@
 	{
 		HMJSONResponseSerializer *jsonResponseSerializer = [[HMJSONResponseSerializer alloc] init];
 		jsonResponseSerializer.readingOptions = NSJSONReadingAllowFragments;
+		jsonResponseSerializer.defersDecoding = configurator.decodesResponsesLazily;
+		_responseSerializer = jsonResponseSerializer;
+	}
+	else if (configurator.responseSerializerType == HMClientResponseSerializerTypeStreamingJSON)
+	{
+		HMStreamingJSONResponseSerializer *jsonResponseSerializer = [[HMStreamingJSONResponseSerializer alloc] init];
+		jsonResponseSerializer.readingOptions = NSJSONReadingAllowFragments;
 		_responseSerializer = jsonResponseSerializer;
 	}
 	else if (configurator.responseSerializerType == HMClientResponseSerializerTypeRaw)
@@ -247,6 +550,20 @@
 	_httpSessionManager.responseSerializer = _responseSerializer;
 }
 
+- (NSURL*)mjz_defaultHTTPCacheDirectoryURL
+{
+    NSURL *cachesURL = [[[NSFileManager defaultManager] URLsForDirectory:NSCachesDirectory inDomains:NSUserDomainMask] firstObject];
+    NSString *directoryName = [(_serverPath ?: @"") mjz_api_md5_stringWithMD5Hash];
+    return [[cachesURL URLByAppendingPathComponent:@"com.mobilejazz.hermod.http-cache"] URLByAppendingPathComponent:directoryName];
+}
+
+- (NSURL*)mjz_chunkedUploadDirectoryURL
+{
+    NSURL *cachesURL = [[[NSFileManager defaultManager] URLsForDirectory:NSCachesDirectory inDomains:NSUserDomainMask] firstObject];
+    NSString *directoryName = [(_serverPath ?: @"") mjz_api_md5_stringWithMD5Hash];
+    return [[cachesURL URLByAppendingPathComponent:@"com.mobilejazz.hermod.uploads"] URLByAppendingPathComponent:directoryName];
+}
+
 - (NSString*)mjz_urlPathForRequest:(HMRequest*)request apiPath:(NSString*)apiPath
 {
     if (request)
@@ -264,28 +581,9 @@
     return [[NSLocale preferredLanguages] firstObject];
 }
 
-#pragma mark - Protocols
-#pragma mark HMRequestExecutor
-
-- (void)performRequest:(HMRequest*)request completionBlock:(HMResponseBlock)completionBlock
-{
-    return [self performRequest:request apiPath:_apiPath completionBlock:completionBlock];
-}
-
-- (void)performRequest:(HMRequest*)request apiPath:(NSString*)apiPath completionBlock:(HMResponseBlock)completionBlock
+- (NSDictionary*)mjz_parametersForRequest:(HMRequest*)request
 {
-    NSURLSessionDataTask *sessionDataTask = nil;
-    
-    NSString *urlPath = [self mjz_urlPathForRequest:request apiPath:apiPath];
     NSDictionary *parameters = request.parameters;
-    HMHTTPMethod httpMethod = request.httpMethod;
-    
-    if (!urlPath)
-    {
-        if (completionBlock)
-            completionBlock(nil);
-        return;
-    }
     
     // Adding language parameter if needed
     if (_insertLanguageAsParameter && _languageParameterName.length > 0)
@@ -310,6 +608,189 @@
         parameters = [dict copy];
     }
     
+    return parameters;
+}
+
+- (void)mjz_deliverResponse:(HMResponse*)response toQueue:(dispatch_queue_t)queue completionBlock:(HMResponseBlock)completionBlock
+{
+    [self mjz_enqueueBlock:^{
+        if (completionBlock)
+            completionBlock(response);
+        
+        // Cancelled requests are not reported to the delegate.
+        // Checked after the completion block, which might have decoded a lazy body and set its decoding error.
+        if (response.error && !HMErrorIsCancellation(response.error))
+        {
+            [self mjz_enqueueBlock:^{
+                if ([_delegate respondsToSelector:@selector(apiClient:didReceiveErrorInResponse:)])
+                    [_delegate apiClient:self didReceiveErrorInResponse:response];
+            } toQueue:dispatch_get_main_queue()];
+        }
+    } toQueue:queue];
+}
+
+- (void)mjz_enqueueBlock:(dispatch_block_t)block toQueue:(dispatch_queue_t)queue
+{
+    if (!_batchesCompletionDelivery)
+    {
+        dispatch_async(queue, block);
+        return;
+    }
+    
+    // Blocks enqueued before the queue executes the pending batch are added to the same batch.
+    BOOL needsFlush = NO;
+    @synchronized (_pendingDeliveries)
+    {
+        NSMutableArray <dispatch_block_t> *blocks = [_pendingDeliveries objectForKey:queue];
+        if (!blocks)
+        {
+            blocks = [NSMutableArray array];
+            [_pendingDeliveries setObject:blocks forKey:queue];
+            needsFlush = YES;
+        }
+        [blocks addObject:[block copy]];
+    }
+    
+    if (needsFlush)
+    {
+        dispatch_async(queue, ^{
+            NSArray <dispatch_block_t> *blocks = nil;
+            @synchronized (_pendingDeliveries)
+            {
+                blocks = [_pendingDeliveries objectForKey:queue];
+                [_pendingDeliveries removeObjectForKey:queue];
+            }
+            
+            for (dispatch_block_t block in blocks)
+            {
+                @autoreleasepool
+                {
+                    block();
+                }
+            }
+        });
+    }
+}
+
+- (NSNumber*)mjz_coalescingKeyForRequest:(HMRequest*)request
+{
+    if (!_coalescesRequests)
+        return nil;
+    
+    // Only idempotent GET requests are coalesced (downloads write to their own file)
+    if (request.httpMethod != HMHTTPMethodGET || [request isKindOfClass:HMUploadRequest.class] || [request isKindOfClass:HMDownloadRequest.class])
+        return nil;
+    
+    return @(request.fingerprint);
+}
+
+- (void)mjz_finishCoalescedRequest:(HMClientInFlightRequest*)inFlightRequest forKey:(NSNumber*)key withResponse:(HMResponse*)response
+{
+    NSArray <HMClientCoalescedCompletion*> *completions = nil;
+    
+    @synchronized (_inFlightRequests)
+    {
+        completions = [inFlightRequest.completions copy];
+        [inFlightRequest.completions removeAllObjects];
+        
+        // A cancelled in-flight request might have been replaced by a new one
+        if (_inFlightRequests[key] == inFlightRequest)
+            [_inFlightRequests removeObjectForKey:key];
+    }
+    
+    // The delegate has already been notified by the original request, only completion blocks are called.
+    for (HMClientCoalescedCompletion *completion in completions)
+    {
+        if (![completion.handle markAsCompleted] || !completion.completionBlock)
+            continue;
+        
+        [self mjz_enqueueBlock:^{
+            completion.completionBlock(response);
+        } toQueue:completion.queue];
+    }
+}
+
+- (void)mjz_cancelCoalescedCompletion:(HMClientCoalescedCompletion*)completion ofRequest:(HMClientInFlightRequest*)inFlightRequest
+{
+    NSURLSessionTask *sessionTask = nil;
+    
+    @synchronized (_inFlightRequests)
+    {
+        if ([inFlightRequest.completions indexOfObjectIdenticalTo:completion] != NSNotFound)
+        {
+            [inFlightRequest.completions removeObjectIdenticalTo:completion];
+            
+            // Nobody is waiting for the response anymore
+            if (inFlightRequest.ownerCancelled && inFlightRequest.completions.count == 0)
+                sessionTask = [self mjz_detachInFlightRequest:inFlightRequest];
+        }
+    }
+    
+    if ([completion.handle markAsCompleted])
+        [self mjz_deliverResponse:[completion.handle cancelledResponse] toQueue:completion.queue completionBlock:completion.completionBlock];
+    
+    [sessionTask cancel];
+}
+
+- (BOOL)mjz_cancelCoalescingOwnerOfRequest:(HMClientInFlightRequest*)inFlightRequest
+{
+    NSURLSessionTask *sessionTask = nil;
+    
+    @synchronized (_inFlightRequests)
+    {
+        inFlightRequest.ownerCancelled = YES;
+        
+        // Other callers are still waiting for the response: the task is not cancelled.
+        if (inFlightRequest.completions.count > 0)
+            return NO;
+        
+        sessionTask = [self mjz_detachInFlightRequest:inFlightRequest];
+    }
+    
+    [sessionTask cancel];
+    return YES;
+}
+
+- (NSURLSessionTask*)mjz_detachInFlightRequest:(HMClientInFlightRequest*)inFlightRequest
+{
+    // Must be called within a @synchronized(_inFlightRequests) block.
+    // Detached requests cannot get new callers attached.
+    NSNumber *key = @(inFlightRequest.request.fingerprint);
+    if (_inFlightRequests[key] == inFlightRequest)
+        [_inFlightRequests removeObjectForKey:key];
+    
+    return inFlightRequest.sessionTask;
+}
+
+#pragma mark - Protocols
+#pragma mark HMRequestExecutor
+
+- (HMRequestHandle*)performRequest:(HMRequest*)request completionBlock:(HMResponseBlock)completionBlock
+{
+    return [self performRequest:request apiPath:_apiPath completionBlock:completionBlock];
+}
+
+- (HMRequestHandle*)performRequest:(HMRequest*)request apiPath:(NSString*)apiPath completionBlock:(HMResponseBlock)completionBlock
+{
+    return [self performRequest:request apiPath:apiPath completionBlock:completionBlock refreshBlock:nil];
+}
+
+- (HMRequestHandle*)performRequest:(HMRequest*)request completionBlock:(HMResponseBlock)completionBlock refreshBlock:(HMResponseBlock)refreshBlock
+{
+    return [self performRequest:request apiPath:_apiPath completionBlock:completionBlock refreshBlock:refreshBlock];
+}
+
+- (HMRequestHandle*)performRequest:(HMRequest*)request apiPath:(NSString*)apiPath completionBlock:(HMResponseBlock)completionBlock refreshBlock:(HMResponseBlock)refreshBlock
+{
+    if (!request)
+    {
+        if (completionBlock)
+            completionBlock(nil);
+        return nil;
+    }
+    
+    HMRequestHandle *handle = [[HMRequestHandle alloc] initWithRequest:request];
+    
     dispatch_queue_t completionBlockQueue = request.completionBlockQueue;
     if (!completionBlockQueue)
     {
@@ -318,47 +799,186 @@
             completionBlockQueue = dispatch_get_main_queue();
     }
     
-    __block BOOL didFinish = NO;
+    // Coalescing the request with an identical in-flight request if enabled
+    NSNumber *coalescingKey = [self mjz_coalescingKeyForRequest:request];
+    HMClientInFlightRequest *inFlightRequest = nil;
+    if (coalescingKey)
+    {
+        HMClientCoalescedCompletion *coalescedCompletion = [HMClientCoalescedCompletion new];
+        coalescedCompletion.queue = completionBlockQueue;
+        coalescedCompletion.completionBlock = completionBlock;
+        coalescedCompletion.handle = handle;
+        
+        BOOL attached = NO;
+        @synchronized (_inFlightRequests)
+        {
+            inFlightRequest = _inFlightRequests[coalescingKey];
+            if (!inFlightRequest)
+            {
+                inFlightRequest = [HMClientInFlightRequest new];
+                inFlightRequest.request = [request copy];
+                inFlightRequest.apiPath = apiPath;
+                inFlightRequest.completions = [NSMutableArray array];
+                _inFlightRequests[coalescingKey] = inFlightRequest;
+            }
+            else if ([inFlightRequest.request isEqual:request] &&
+                     inFlightRequest.request.decoder == request.decoder &&
+                     (inFlightRequest.apiPath == apiPath || [inFlightRequest.apiPath isEqualToString:apiPath]))
+            {
+                [inFlightRequest.completions addObject:coalescedCompletion];
+                _coalescedRequestCount += 1;
+                attached = YES;
+            }
+            else
+            {
+                // Fingerprint collision, different decoder or different API path: the request is sent on its own.
+                coalescingKey = nil;
+                inFlightRequest = nil;
+            }
+        }
+        
+        // The response of the in-flight request will be delivered to this caller too.
+        if (attached)
+        {
+            HMClientInFlightRequest *attachedRequest = inFlightRequest;
+            [handle setCancellationBlock:^{
+                [self mjz_cancelCoalescedCompletion:coalescedCompletion ofRequest:attachedRequest];
+            }];
+            return handle;
+        }
+    }
+    
+    // Defining the block that delivers the final response
+    __block BOOL deliveredStaleResponse = NO;
+    __block dispatch_block_t revalidateStaleResponse = nil;
+    __block NSURLSessionTask *revalidationTask = nil;
+    void (^finishBlock)(HMResponse *) = ^(HMResponse *response) {
+        
+        // Response of the background revalidation of an already delivered stale response
+        if (deliveredStaleResponse)
+        {
+            if (refreshBlock && response.error == nil)
+                [self mjz_deliverResponse:response toQueue:completionBlockQueue completionBlock:refreshBlock];
+            return;
+        }
+        
+        if (inFlightRequest)
+            [self mjz_finishCoalescedRequest:inFlightRequest forKey:coalescingKey withResponse:response];
+        
+        // The response is delivered once: a cancelled caller might have been notified already.
+        if ([handle markAsCompleted])
+        {
+            if (handle.isCancelled && !HMErrorIsCancellation(response.error))
+                response = [handle cancelledResponse];
+            
+            [self mjz_deliverResponse:response toQueue:completionBlockQueue completionBlock:completionBlock];
+        }
+        
+        // Once the stale response has been delivered, revalidating it
+        if (revalidateStaleResponse)
+        {
+            deliveredStaleResponse = YES;
+            
+            // The revalidation task of a cancelled handle is never resumed, it must be cancelled to be released by the session.
+            if (!handle.isCancelled)
+                revalidateStaleResponse();
+            else
+                [revalidationTask cancel];
+            
+            revalidateStaleResponse = nil;
+            revalidationTask = nil;
+        }
+    };
+    
+    // Downloads write the body to a file instead of decoding it
+    NSURL *downloadFileURL = HMDownloadFileURLOfRequest(request);
     
     // Defining task success completion block
-    void (^taskCompletion)(NSURLSessionDataTask *, id) = ^(NSURLSessionDataTask *task, id responseObject)
+    // If the body comes from (or has been stored in) the HTTP cache, its entry is given to keep the decoded object.
+    void (^taskCompletion)(NSHTTPURLResponse *, id, HMHTTPCacheEntry *) = ^(NSHTTPURLResponse *httpResponse, id responseObject, HMHTTPCacheEntry *decodedEntry)
     {
-        didFinish = YES;
+        HMResponse *response = nil;
+        HMHTTPCache *decodedObjectCache = decodedEntry && HMSerializerDecodesImmutableObjects(_httpSessionManager.responseSerializer) ? _httpCache : nil;
+        HMJSONResponseSerializer *jsonResponseSerializer = (HMJSONResponseSerializer*)_httpSessionManager.responseSerializer;
+        if ([jsonResponseSerializer isKindOfClass:HMJSONResponseSerializer.class] && jsonResponseSerializer.defersDecoding && [responseObject isKindOfClass:NSData.class])
+        {
+            // The body will be decoded the first time the response object is accessed.
+            response = [[HMResponse alloc] initWithRequest:request
+                                              httpResponse:httpResponse
+                                                      data:responseObject
+                                             decodingBlock:^id(NSData *data, NSError **error) {
+                                                 id object = [jsonResponseSerializer JSONObjectWithData:data error:error];
+                                                 if (object)
+                                                     [decodedObjectCache setDecodedObject:object forEntry:decodedEntry];
+                                                 return object;
+                                             }
+                                                     error:nil];
+        }
+        else
+        {
+            if (responseObject && ![responseObject isKindOfClass:NSData.class])
+                [decodedObjectCache setDecodedObject:responseObject forEntry:decodedEntry];
+            
+            response = [[HMResponse alloc] initWithRequest:request
+                                              httpResponse:httpResponse
+                                                    object:responseObject
+                                                     error:nil];
+        }
         
-        NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse*)task.response;
+        response.fileURL = downloadFileURL;
         
-        NSError *error = nil;
         if ([_delegate respondsToSelector:@selector(apiClient:errorForResponseBody:httpResponse:incomingError:)])
-            error = [_delegate apiClient:self errorForResponseBody:responseObject httpResponse:httpResponse incomingError:nil];
-        
-        HMResponse *response = [[HMResponse alloc] initWithRequest:request
-                                                      httpResponse:httpResponse
-                                                            object:responseObject
-                                                             error:error];
+        {
+            // Accessing the response object forces the decoding of the body (if not decoded yet).
+            id responseBody = response.responseObject;
+            response.error = [_delegate apiClient:self errorForResponseBody:responseBody httpResponse:httpResponse incomingError:response.error];
+        }
+        else if (!response.isResponseObjectDecoded && (response.error || httpResponse.statusCode < 200 || httpResponse.statusCode >= 300) && [_delegate respondsToSelector:@selector(apiClient:didReceiveErrorInResponse:)])
+        {
+            // Responses reported as errors are decoded before notifying the delegate. Successful responses stay lazy:
+            // decoding errors of their bodies are reported if the completion block accesses the response object.
+            [response responseObject];
+        }
         
         if ((_logLevel & HMClientLogLevelResponses) != 0)
-            NSLog(@"[ApiClient] RESPONSE: %@\n%@\n\n", error!=nil?@"FAILURE":@"SUCCESS", response.description);
+            NSLog(@"[ApiClient] RESPONSE: %@\n%@\n\n", response.error!=nil?@"FAILURE":@"SUCCESS", response.description);
         
-        dispatch_async(completionBlockQueue, ^{
-            if (completionBlock)
-                completionBlock(response);
-            
-            if (response.error)
+        // Responses of cancelled requests are not decoded (unless other coalesced callers are waiting for them)
+        id <HMResponseDecoder> decoder = response.error == nil ? [self decoderForRequest:request] : nil;
+        if ((handle.isCancelled && !inFlightRequest) || downloadFileURL)
+            decoder = nil;
+        
+        if (!decoder)
+        {
+            finishBlock(response);
+            return;
+        }
+        
+        // Decoding model objects on the processing queue, off the completion queue
+        dispatch_async(_processingQueue, ^{
+            @autoreleasepool
             {
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    if ([_delegate respondsToSelector:@selector(apiClient:didReceiveErrorInResponse:)])
-                        [_delegate apiClient:self didReceiveErrorInResponse:response];
-                });
+                NSError *decodingError = nil;
+                id decodedObject = [decoder decodedObjectForResponseObject:response.responseObject httpResponse:httpResponse error:&decodingError];
+                
+                if (decodedObject)
+                {
+                    // Releasing the intermediate response object
+                    response.decodedObject = decodedObject;
+                    response.responseObject = nil;
+                }
+                else if (decodingError)
+                {
+                    response.error = decodingError;
+                }
             }
+            
+            finishBlock(response);
         });
     };
     
     // Defining task fail completion block
-    void (^taskFailCompletion)(NSURLSessionDataTask *, NSError *) = ^(NSURLSessionDataTask *task, NSError *error) {
-        
-        didFinish = YES;
-        
-        NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse*)task.response;
+    void (^taskFailCompletion)(NSHTTPURLResponse *, NSError *) = ^(NSHTTPURLResponse *httpResponse, NSError *error) {
         
         NSDictionary *body = error.userInfo[HMJSONResponseSerializerBodyKey];
         if (body)
@@ -375,134 +995,352 @@
         if ((_logLevel & HMClientLogLevelResponses) != 0)
             NSLog(@"[ApiClient] RESPONSE: %@\n%@\n\n", error!=nil?@"FAILURE":@"SUCCESS", response.description);
         
-        dispatch_async(completionBlockQueue, ^{
-            if (completionBlock)
-                completionBlock(response);
+        finishBlock(response);
+    };
+    
+    // Serializing the request. Each request gets its own NSMutableURLRequest (including its own timeout interval),
+    // therefore no client-wide lock is needed and requests can be built concurrently from any thread.
+    NSError *serializationError = nil;
+    NSMutableURLRequest *urlRequest = [self URLRequestForRequest:request apiPath:apiPath error:&serializationError];
+    
+    if (!urlRequest)
+    {
+        taskFailCompletion(nil, serializationError);
+        return handle;
+    }
+    
+    HMHTTPMethod httpMethod = request.httpMethod;
+    
+    // Looking up the HTTP cache
+    HMHTTPCache *httpCache = _httpCache;
+    HMHTTPSessionManager *httpSessionManager = _httpSessionManager;
+    HMHTTPCacheEntry *cacheEntry = nil;
+    HMHTTPCacheResult cacheResult = HMHTTPCacheResultMiss;
+    BOOL revalidatesStaleEntry = NO;
+    NSDate *requestDate = [NSDate date];
+    
+    // Defining the block that completes the request with a cached response, serialized like a received one
+    void (^cacheCompletion)(HMHTTPCacheEntry *) = ^(HMHTTPCacheEntry *entry) {
+        dispatch_async(_processingQueue, ^{
+            NSHTTPURLResponse *httpResponse = [entry HTTPURLResponse];
+            NSError *error = nil;
             
-            if (response.error)
+            // Reusing the object already decoded from the cached body, if any
+            id responseObject = HMSerializerDecodesImmutableObjects(httpSessionManager.responseSerializer) ? [httpCache decodedObjectForEntry:entry] : nil;
+            HMHTTPCacheEntry *decodedEntry = nil;
+            if (!responseObject)
             {
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    if ([_delegate respondsToSelector:@selector(apiClient:didReceiveErrorInResponse:)])
-                        [_delegate apiClient:self didReceiveErrorInResponse:response];
-                });
+                responseObject = [httpSessionManager.responseSerializer responseObjectForResponse:httpResponse data:entry.data error:&error];
+                decodedEntry = entry;
             }
+            
+            dispatch_async(httpSessionManager.completionQueue ?: dispatch_get_main_queue(), ^{
+                if (error)
+                    taskFailCompletion(httpResponse, error);
+                else
+                    taskCompletion(httpResponse, responseObject, decodedEntry);
+            });
         });
     };
     
-    @synchronized (self)
+    if (httpCache)
     {
-        // Crating a synchronization block to manage the timeoutInterval. The synchrnonization will enforce the request serialization
-        // using the correct timetout defined in the HMRequest. The snchronization block will generate a semaphore that will be unlocked
-        // syncrhonously (there are no async calls involved in the unlock).
-        
-        // Storing the original timeout.
-        NSTimeInterval timeoutInterval = _requestSerializer.timeoutInterval;
-        BOOL customTimeoutInterval = (request.timeoutInterval != HMRequestDefaultTimeoutInterval);
-        
-        if (customTimeoutInterval)
+        if (httpMethod == HMHTTPMethodGET && !downloadFileURL)
+        {
+            // When offline, any cached response is better than a failure
+            HMHTTPCacheLookupOptions options = HMHTTPCacheLookupOptionsNone;
+            if (_cacheManagement == HMClientCacheManagementOffline && [AFNetworkReachabilityManager sharedManager].networkReachabilityStatus == AFNetworkReachabilityStatusNotReachable)
+                options |= HMHTTPCacheLookupOptionsAllowStaleEntries;
+            else if (_cacheManagement == HMClientCacheManagementStaleWhileRevalidate)
+                options |= HMHTTPCacheLookupOptionsStaleWhileRevalidate;
+            
+            cacheResult = [httpCache lookupEntry:&cacheEntry forRequest:urlRequest options:options];
+            
+            if (cacheResult == HMHTTPCacheResultHit)
+            {
+                request.finalURLRequest = urlRequest;
+                
+                // A stale response is delivered right away and revalidated afterwards
+                revalidatesStaleEntry = (options & HMHTTPCacheLookupOptionsStaleWhileRevalidate) && !cacheEntry.isFresh;
+                if (!revalidatesStaleEntry)
+                {
+                    cacheCompletion(cacheEntry);
+                    return handle;
+                }
+            }
+        }
+        else if (httpMethod != HMHTTPMethodHEAD)
         {
-            // If the request.timeoutInterval has been customized, configure the new timeout in the request serializer.
-            _requestSerializer.timeoutInterval = request.timeoutInterval;
+            // Unsafe methods invalidate the cached response of the resource
+            [httpCache invalidateEntryForRequest:urlRequest];
         }
+    }
+    
+    BOOL cachesResponse = httpCache && httpMethod == HMHTTPMethodGET && !downloadFileURL;
+    BOOL isConditionalRequest = cacheResult == HMHTTPCacheResultRevalidate || revalidatesStaleEntry;
+    BOOL servesStaleResponseIfError = _cacheManagement == HMClientCacheManagementStaleIfError;
+    
+    // Requests are started by the scheduler, by priority and within the per host limit
+    HMRequestScheduler *scheduler = _scheduler;
+    NSString *schedulingHost = urlRequest.URL.host;
+    
+    // The content of chunked uploads is sent before the request completing the upload
+    HMUploadTask *chunkedUploadTask = HMChunkedUploadTaskOfRequest(request);
+    HMChunkedUpload *chunkedUpload = nil;
+    __block NSError *chunkedUploadError = nil;
+    if (chunkedUploadTask)
+    {
+        HMUploadRequest *uploadRequest = (id)request;
+        chunkedUpload = [[HMChunkedUpload alloc] initWithTask:chunkedUploadTask
+                                                   identifier:uploadRequest.identifier
+                                                    chunkSize:uploadRequest.chunkSize
+                                            stateDirectoryURL:[self mjz_chunkedUploadDirectoryURL]];
+        chunkedUpload.maximumConcurrentChunks = uploadRequest.maximumConcurrentChunks;
+        
+        [urlRequest setValue:chunkedUpload.identifier forHTTPHeaderField:@"Upload-Identifier"];
+        [urlRequest setValue:[NSString stringWithFormat:@"%llu", chunkedUpload.totalLength] forHTTPHeaderField:@"Upload-Length"];
+    }
+    
+    // Downloads resume the partial file of a previous attempt, if any. Segmented downloads fetch ranges of the file in parallel instead.
+    HMFileDownload *fileDownload = nil;
+    HMSegmentedDownload *segmentedDownload = nil;
+    NSUInteger segmentCount = downloadFileURL ? ((HMDownloadRequest*)request).segmentCount : 0;
+    if (segmentCount > 1)
+    {
+        segmentedDownload = [[HMSegmentedDownload alloc] initWithFileURL:downloadFileURL segmentCount:segmentCount];
+    }
+    else if (downloadFileURL)
+    {
+        fileDownload = [[HMFileDownload alloc] initWithFileURL:downloadFileURL];
+        [fileDownload prepareRequest:urlRequest];
+    }
+    
+    if (segmentedDownload)
+    {
+        NSProgress *progress = handle.progress;
+        segmentedDownload.progressBlock = ^(unsigned long long receivedLength, long long expectedLength) {
+            progress.totalUnitCount = expectedLength;
+            progress.completedUnitCount = receivedLength;
+        };
         
-        // Executing the request (serializing it and then sending it via AFNetworking)
-        if (httpMethod == HMHTTPMethodGET)
+        if (![handle setCancellationBlock:^{
+            [segmentedDownload cancel];
+        }])
         {
-            sessionDataTask = [_httpSessionManager GET:urlPath
-                                            parameters:parameters
-                                               headers:nil
-                                              progress:nil
-                                               success:taskCompletion
-                                               failure:taskFailCompletion];
+            // Cancelled already: no request is sent
+            if ([handle markAsCompleted])
+                [self mjz_deliverResponse:[handle cancelledResponse] toQueue:completionBlockQueue completionBlock:completionBlock];
+            return handle;
         }
-        else if (httpMethod == HMHTTPMethodPOST)
+        
+        // The size is probed with a HEAD request before fetching the ranges
+        [segmentedDownload downloadWithBaseRequest:urlRequest
+                                    sessionManager:_httpSessionManager
+                                         scheduler:scheduler
+                                          priority:request.priority
+                                   completionBlock:^(NSHTTPURLResponse *httpResponse, NSError *error) {
+                                       if (error)
+                                           taskFailCompletion(httpResponse, error);
+                                       else
+                                           taskCompletion(httpResponse, nil, nil);
+                                   }];
+        
+        if ((_logLevel & HMClientLogLevelRequests) != 0)
+            NSLog(@"[ApiClient] REQUEST:\n%@\n\n", request.description);
+        
+        request.finalURLRequest = urlRequest;
+        return handle;
+    }
+    
+    __block NSURLSessionTask *sessionTask = nil;
+    void (^completionHandler)(NSURLResponse *, id, NSError *) = ^(NSURLResponse * __unused response, id responseObject, NSError *error) {
+        [scheduler finishRequest:sessionTask];
+        
+        // A failed chunk cancels the request completing the upload. Once completed, the acknowledged chunks are forgotten.
+        if (chunkedUploadError)
+            error = chunkedUploadError;
+        else if (chunkedUpload && !error)
+            [chunkedUpload removeState];
+        
+        NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse*)sessionTask.response;
+        HMHTTPCacheEntry *storedEntry = nil;
+        
+        if (fileDownload)
         {
-            if ([request isKindOfClass:HMUploadRequest.class])
+            // The body has not been given to the response serializer: its errors are ignored for successful responses
+            BOOL succeeded = httpResponse.statusCode >= 200 && httpResponse.statusCode < 300 && (!error || [error.domain isEqualToString:AFURLResponseSerializationErrorDomain]);
+            
+            NSError *fileError = nil;
+            if (!succeeded)
             {
-                HMUploadRequest *uploadRequest = (id)request;
-                
-                NSMutableURLRequest *request = [_httpSessionManager.requestSerializer multipartFormRequestWithMethod:@"POST"
-                                                                                                           URLString:[[NSURL URLWithString:urlPath relativeToURL:_httpSessionManager.baseURL] absoluteString]
-                                                                                                          parameters:parameters
-                                                                                           constructingBodyWithBlock:^(id<AFMultipartFormData> formData) {
-                                                                                               [uploadRequest.uploadTasks enumerateObjectsUsingBlock:^(HMUploadTask *task, NSUInteger idx, BOOL *stop) {
-                                                                                                   [formData appendPartWithFileData:task.data
-                                                                                                                               name:task.fieldName
-                                                                                                                           fileName:task.filename
-                                                                                                                           mimeType:task.mimeType];
-                                                                                               }];
-                                                                                           }
-                                                                                                               error:nil];
+                // The partial file is kept to resume the download, unless the server cannot satisfy its range
+                if (httpResponse.statusCode == 416)
+                    [fileDownload discard];
+                else
+                    [fileDownload interrupt];
                 
-                sessionDataTask = [_httpSessionManager uploadTaskWithStreamedRequest:request
-                                                                            progress:nil
-                                                                   completionHandler:^(NSURLResponse * __unused response, id responseObject, NSError *error) {
-                                                                       if (error)
-                                                                           taskFailCompletion(sessionDataTask, error);
-                                                                       else
-                                                                           taskCompletion(sessionDataTask, responseObject);
-                                                                   }];
-                [sessionDataTask resume];
+                taskFailCompletion(httpResponse, error);
+            }
+            else if (![fileDownload completeWithResponse:httpResponse error:&fileError])
+            {
+                taskFailCompletion(httpResponse, fileError);
             }
             else
             {
-                sessionDataTask = [_httpSessionManager POST:urlPath
-                                                 parameters:parameters
-                                                    headers:nil
-                                                   progress:nil
-                                                    success:taskCompletion
-                                                    failure:taskFailCompletion];
+                taskCompletion(httpResponse, nil, nil);
             }
+            return;
         }
-        else if (httpMethod == HMHTTPMethodPUT)
-        {
-            sessionDataTask = [_httpSessionManager PUT:urlPath
-                                            parameters:parameters
-                                               headers:nil
-                                               success:taskCompletion
-                                               failure:taskFailCompletion];
-        }
-        else if (httpMethod == HMHTTPMethodDELETE)
-        {
-            sessionDataTask = [_httpSessionManager DELETE:urlPath
-                                               parameters:parameters
-                                                  headers:nil
-                                                  success:taskCompletion
-                                                  failure:taskFailCompletion];
-        }
-        else if (httpMethod == HMHTTPMethodHEAD)
+        
+        if (cachesResponse)
         {
-            sessionDataTask = [_httpSessionManager HEAD:urlPath
-                                             parameters:parameters
-                                                headers:nil
-                                                success:^(NSURLSessionDataTask *task) {
-                                                    taskCompletion(task, nil);
-                                                }
-                                                failure:taskFailCompletion];
+            NSData *responseData = [httpSessionManager takeCapturedResponseDataForTask:sessionTask];
+            
+            // The cached response is still valid: using it with the updated headers (unless it has been delivered already)
+            if (isConditionalRequest && httpResponse.statusCode == 304)
+            {
+                HMHTTPCacheEntry *updatedEntry = [httpCache storeNotModifiedResponse:httpResponse forEntry:cacheEntry requestDate:requestDate];
+                if (!revalidatesStaleEntry)
+                    cacheCompletion(updatedEntry);
+                return;
+            }
+            
+            if (!error)
+                storedEntry = [httpCache storeResponse:httpResponse data:responseData forRequest:urlRequest requestDate:requestDate];
+            
+            // The server is failing or cannot be reached: using the cached response instead, if allowed
+            if (error && servesStaleResponseIfError && cacheEntry && !cacheEntry.mustRevalidate && HMErrorAllowsStaleResponse(httpResponse, error))
+            {
+                cacheCompletion(cacheEntry);
+                return;
+            }
         }
-        else if (httpMethod == HMHTTPMethodPATCH)
+        
+        if (error)
+            taskFailCompletion(httpResponse, error);
+        else if (httpMethod == HMHTTPMethodHEAD || httpMethod == HMHTTPMethodPATCH)
+            taskCompletion(httpResponse, nil, nil);
+        else
+            taskCompletion(httpResponse, responseObject, storedEntry);
+    };
+    
+    // Sending the request via AFNetworking
+    if ([request isKindOfClass:HMUploadRequest.class] && httpMethod == HMHTTPMethodPOST && !chunkedUpload)
+    {
+        NSProgress *progress = handle.progress;
+        sessionTask = [_httpSessionManager uploadTaskWithStreamedRequest:urlRequest
+                                                                progress:^(NSProgress *uploadProgress) {
+                                                                    progress.totalUnitCount = uploadProgress.totalUnitCount;
+                                                                    progress.completedUnitCount = uploadProgress.completedUnitCount;
+                                                                }
+                                                       completionHandler:completionHandler];
+    }
+    else
+    {
+        sessionTask = [_httpSessionManager dataTaskWithRequest:urlRequest
+                                                uploadProgress:nil
+                                              downloadProgress:nil
+                                             completionHandler:completionHandler];
+    }
+    
+    sessionTask.priority = HMURLSessionTaskPriorityFromRequestPriority(request.priority);
+    
+    if (cachesResponse)
+        [httpSessionManager captureResponseDataForTask:sessionTask];
+    
+    if (fileDownload)
+    {
+        NSProgress *progress = handle.progress;
+        [httpSessionManager setDataBlock:^BOOL(NSHTTPURLResponse *response, NSData *data) {
+            if (![fileDownload writeData:data forResponse:response])
+                return NO;
+            
+            progress.totalUnitCount = fileDownload.expectedLength;
+            progress.completedUnitCount = fileDownload.receivedLength;
+            return YES;
+        } forTask:sessionTask];
+    }
+    
+    NSURLSessionTask *scheduledTask = sessionTask;
+    void (^scheduleTask)(void) = ^{
+        [scheduler scheduleRequest:scheduledTask forHost:schedulingHost priority:request.priority startBlock:^{
+            [scheduledTask resume];
+        }];
+    };
+    
+    // Configuring the cancellation
+    if (revalidatesStaleEntry)
+    {
+        // The revalidation is sent after delivering the stale response, unless the handle is cancelled before.
+        revalidateStaleResponse = scheduleTask;
+        revalidationTask = scheduledTask;
+        cacheCompletion(cacheEntry);
+    }
+    else if (inFlightRequest)
+    {
+        @synchronized (_inFlightRequests)
         {
-            sessionDataTask = [_httpSessionManager PATCH:urlPath
-                                              parameters:parameters
-                                                 headers:nil
-                                                 success:^(NSURLSessionDataTask *task, id responseObject) {
-                                                     taskCompletion(task, nil);
-                                                 }
-                                                 failure:taskFailCompletion];
+            inFlightRequest.sessionTask = sessionTask;
         }
         
-        if (customTimeoutInterval)
+        HMClientInFlightRequest *ownedRequest = inFlightRequest;
+        [handle setCancellationBlock:^{
+            if (![self mjz_cancelCoalescingOwnerOfRequest:ownedRequest] && [handle markAsCompleted])
+                [self mjz_deliverResponse:[handle cancelledResponse] toQueue:completionBlockQueue completionBlock:completionBlock];
+        }];
+        
+        scheduleTask();
+    }
+    else if (chunkedUpload)
+    {
+        NSProgress *progress = handle.progress;
+        progress.totalUnitCount = chunkedUpload.totalLength;
+        progress.completedUnitCount = chunkedUpload.acknowledgedLength;
+        chunkedUpload.progressBlock = ^(unsigned long long acknowledgedLength, unsigned long long totalLength) {
+            progress.completedUnitCount = acknowledgedLength;
+        };
+        
+        if (![handle setCancellationBlock:^{
+            [chunkedUpload cancel];
+            [scheduledTask cancel];
+        }])
         {
-            // After serializing the request, configuring back the request serializer with the original timeout interval.
-            _requestSerializer.timeoutInterval = timeoutInterval;
+            // Cancelled already: no chunk is sent
+            [scheduledTask cancel];
+            return handle;
         }
+        
+        // The request completing the upload is sent once all chunks are acknowledged
+        [chunkedUpload uploadWithBaseRequest:urlRequest
+                              sessionManager:_httpSessionManager
+                                   scheduler:scheduler
+                                    priority:request.priority
+                             completionBlock:^(NSError *error) {
+                                 if (error)
+                                 {
+                                     chunkedUploadError = error;
+                                     [scheduledTask cancel];
+                                 }
+                                 else
+                                 {
+                                     scheduleTask();
+                                 }
+                             }];
+    }
+    else
+    {
+        [handle setCancellationBlock:^{
+            [scheduledTask cancel];
+        }];
+        
+        scheduleTask();
     }
     
     if ((_logLevel & HMClientLogLevelRequests) != 0)
     {
 #if TARGET_OS_IOS
         // If enabled, logging a CURL of the request
-        NSString *curl = [TTTURLRequestFormatter cURLCommandFromURLRequest:sessionDataTask.originalRequest];
+        NSString *curl = [TTTURLRequestFormatter cURLCommandFromURLRequest:sessionTask.originalRequest];
         NSLog(@"[ApiClient] REQUEST:\n%@\n%@\n\n", request.description, curl);
 #else
         // If enabled, logging the request description
@@ -511,7 +1349,9 @@
     }
     
     // Finally, setting the original NSURLRequest tot the HMRequest for later inspection.
-    request.finalURLRequest = sessionDataTask.originalRequest;
+    request.finalURLRequest = sessionTask.originalRequest;
+    
+    return handle;
 }
 
 @end
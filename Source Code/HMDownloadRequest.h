@@ -0,0 +1,48 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import "HMRequest.h"
+
+/**
+ * Use this class to download the response body to a file instead of into memory.
+ * @discussion The body is written to disk while it is received, and the response carries the `fileURL` instead of a response object.
+ * Interrupted downloads are kept next to the destination file and resumed by the next attempt with a `Range` request, validated with an `If-Range` header (the strong `ETag` or the `Last-Modified` date of the first response). If the resource has changed, the server sends it whole and the download starts over.
+ * Download requests are never cached nor coalesced. This class by default sets the `HMHTTPMethod` to GET, the only method supported.
+ **/
+@interface HMDownloadRequest : HMRequest
+
+/** ************************************************* **
+ * @name Destination
+ ** ************************************************* **/
+
+/**
+ * The file URL the response body is written to. An existing file is replaced once the download completes.
+ **/
+@property (nonatomic, strong) NSURL *fileURL;
+
+/** ************************************************* **
+ * @name Segmented Downloads
+ ** ************************************************* **/
+
+/**
+ * The number of byte ranges of the resource downloaded at the same time. Default value is 1 (a single request).
+ * @discussion If greater than 1, the size of the resource is probed with a HEAD request. If the server accepts byte ranges (`Accept-Ranges: bytes`) and the response has a validator, the resource is split in up to `segmentCount` ranges (of at least 256KB) fetched in parallel with `Range` and `If-Range` headers, and each range is written into place in the file. Otherwise, the resource is fetched with a single request.
+ * The response of a download split in ranges is the response of the HEAD request. Interrupted segmented downloads are not resumed.
+ **/
+@property (nonatomic, assign) NSUInteger segmentCount;
+
+@end
@@ -1,5 +1,5 @@
 //
-// Copyright 2014 Mobile Jazz SL
+// Copyright 2016 Mobile Jazz SL
 //
 // Licensed under the Apache License, Version 2.0 (the "License");
 // you may not use this file except in compliance with the License.
@@ -14,12 +14,35 @@
 // limitations under the License.
 //
 
-#import <AFNetworking/AFNetworking.h>
 
-/**
- *  This session manager basically ovverride the GET method and add
- *  support for offline caching and server side cache
- */
-@interface HMHTTPOfflineCacheSessionManager : AFHTTPSessionManager
+#import "HMDownloadRequest.h"
+
+@implementation HMDownloadRequest
+
+- (id)init
+{
+    self = [super init];
+    if (self)
+    {
+        _segmentCount = 1;
+    }
+    return self;
+}
+
+- (BOOL)isEqual:(id)object
+{
+    BOOL sameRequest = [super isEqual:object];
+    
+    if (sameRequest)
+    {
+        if ([object isKindOfClass:HMDownloadRequest.class])
+        {
+            HMDownloadRequest *request = object;
+            return _fileURL == request.fileURL || [_fileURL isEqual:request.fileURL];
+        }
+    }
+    
+    return NO;
+}
 
 @end
@@ -0,0 +1,94 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import <Foundation/Foundation.h>
+
+/**
+ * Returns the value of the header field of the response with the given name (case insensitive).
+ **/
+NSString* HMHeaderValue(NSHTTPURLResponse *response, NSString *name);
+
+/**
+ * Writes a response body to a file while it is received, keeping interrupted downloads to resume them with `Range` requests.
+ * @discussion The partial body is kept in a ".download" file next to the destination, and the validator of the response in a ".download.plist" file.
+ * Data must be written sequentially, and the download completed or interrupted once the task finishes. This class is thread safe.
+ **/
+@interface HMFileDownload : NSObject
+
+/**
+ * Returns the validator of the response usable in `If-Range` headers: its strong entity tag, or else its last modification date.
+ * @param response The response.
+ * @return The validator, or nil if the response has none (weak entity tags cannot validate ranges).
+ **/
++ (NSString*)rangeValidatorOfResponse:(NSHTTPURLResponse*)response;
+
+/**
+ * Default initializer.
+ * @param fileURL The destination file URL.
+ * @return An initialized instance.
+ **/
+- (instancetype)initWithFileURL:(NSURL*)fileURL;
+
+/**
+ * The destination file URL.
+ **/
+@property (nonatomic, strong, readonly) NSURL *fileURL;
+
+/**
+ * The number of bytes in the partial file, including the ones of previous attempts.
+ **/
+@property (nonatomic, assign, readonly) unsigned long long receivedLength;
+
+/**
+ * The expected size in bytes of the complete file, or -1 if unknown.
+ **/
+@property (nonatomic, assign, readonly) long long expectedLength;
+
+/**
+ * Adds the `Range` and `If-Range` headers to resume the partial download, if any.
+ * @param request The request.
+ **/
+- (void)prepareRequest:(NSMutableURLRequest*)request;
+
+/**
+ * Writes the next chunk of the response body.
+ * @param data The chunk.
+ * @param response The response.
+ * @return YES if the data has been consumed, NO if the response is not successful (the body should be handled as usual).
+ **/
+- (BOOL)writeData:(NSData*)data forResponse:(NSHTTPURLResponse*)response;
+
+/**
+ * Completes a successful download, moving the file to its destination.
+ * @param response The successful response.
+ * @param error On output, the error if the file could not be written.
+ * @return YES if the file is at its destination.
+ **/
+- (BOOL)completeWithResponse:(NSHTTPURLResponse*)response error:(NSError**)error;
+
+/**
+ * Closes the partial file, keeping it to resume the download later.
+ * @discussion If the partial file cannot be resumed (i.e. the content range of the response does not match it, or it could not be written), it is discarded instead.
+ **/
+- (void)interrupt;
+
+/**
+ * Closes and removes the partial file and its validator, so the next attempt starts over.
+ **/
+- (void)discard;
+
+@end
@@ -0,0 +1,248 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import "HMFileDownload.h"
+
+NSString* HMHeaderValue(NSHTTPURLResponse *response, NSString *name)
+{
+    NSDictionary *headerFields = response.allHeaderFields;
+    for (NSString *key in headerFields)
+    {
+        if ([key caseInsensitiveCompare:name] == NSOrderedSame)
+            return headerFields[key];
+    }
+    return nil;
+}
+
+@implementation HMFileDownload
+{
+    NSURL *_partialFileURL;
+    NSURL *_stateURL;
+    NSFileHandle *_fileHandle;
+    unsigned long long _resumeOffset;
+    NSString *_requestURLString;
+    NSError *_error;
+}
+
++ (NSString*)rangeValidatorOfResponse:(NSHTTPURLResponse*)response
+{
+    NSString *entityTag = HMHeaderValue(response, @"ETag");
+    if (entityTag.length > 0 && ![entityTag hasPrefix:@"W/"])
+        return entityTag;
+    
+    return HMHeaderValue(response, @"Last-Modified");
+}
+
+- (instancetype)initWithFileURL:(NSURL*)fileURL
+{
+    self = [super init];
+    if (self)
+    {
+        _fileURL = fileURL;
+        _partialFileURL = [fileURL URLByAppendingPathExtension:@"download"];
+        _stateURL = [_partialFileURL URLByAppendingPathExtension:@"plist"];
+        _expectedLength = -1;
+    }
+    return self;
+}
+
+#pragma mark Properties
+
+- (unsigned long long)receivedLength
+{
+    @synchronized (self)
+    {
+        return _receivedLength;
+    }
+}
+
+- (long long)expectedLength
+{
+    @synchronized (self)
+    {
+        return _expectedLength;
+    }
+}
+
+#pragma mark Public Methods
+
+- (void)prepareRequest:(NSMutableURLRequest*)request
+{
+    // Byte offsets must refer to the stored representation
+    [request setValue:@"identity" forHTTPHeaderField:@"Accept-Encoding"];
+    
+    NSDictionary *state = [NSDictionary dictionaryWithContentsOfURL:_stateURL];
+    NSString *validator = state[@"validator"];
+    unsigned long long length = [[[NSFileManager defaultManager] attributesOfItemAtPath:_partialFileURL.path error:nil] fileSize];
+    
+    @synchronized (self)
+    {
+        _requestURLString = request.URL.absoluteString;
+        
+        // A partial body of another URL, or without validator, cannot be resumed safely
+        if (length > 0 && validator.length > 0 && [state[@"URL"] isEqualToString:request.URL.absoluteString])
+        {
+            _resumeOffset = length;
+            _receivedLength = length;
+            [request setValue:[NSString stringWithFormat:@"bytes=%llu-", length] forHTTPHeaderField:@"Range"];
+            [request setValue:validator forHTTPHeaderField:@"If-Range"];
+        }
+        else
+        {
+            _resumeOffset = 0;
+            _receivedLength = 0;
+        }
+    }
+}
+
+- (BOOL)writeData:(NSData*)data forResponse:(NSHTTPURLResponse*)response
+{
+    if (response.statusCode != 200 && response.statusCode != 206)
+        return NO;
+    
+    @synchronized (self)
+    {
+        if (!_fileHandle && !_error)
+            [self mjz_openFileForResponse:response];
+        
+        if (_error)
+            return YES;
+        
+        @try
+        {
+            [_fileHandle writeData:data];
+            _receivedLength += data.length;
+        }
+        @catch (NSException *exception)
+        {
+            _error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:@{NSURLErrorKey: _partialFileURL, NSLocalizedDescriptionKey: exception.reason ?: @"Cannot write the downloaded file"}];
+        }
+    }
+    
+    return YES;
+}
+
+- (BOOL)completeWithResponse:(NSHTTPURLResponse*)response error:(NSError**)error
+{
+    NSError *completionError = nil;
+    
+    @synchronized (self)
+    {
+        // Empty bodies are not written: creating the file anyway
+        if (!_fileHandle && !_error)
+            [self mjz_openFileForResponse:response];
+        
+        [_fileHandle closeFile];
+        _fileHandle = nil;
+        completionError = _error;
+    }
+    
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    if (!completionError)
+    {
+        [fileManager removeItemAtURL:_fileURL error:nil];
+        [fileManager moveItemAtURL:_partialFileURL toURL:_fileURL error:&completionError];
+    }
+    
+    // A failed download is not resumed: the next attempt starts over
+    if (completionError)
+        [fileManager removeItemAtURL:_partialFileURL error:nil];
+    [fileManager removeItemAtURL:_stateURL error:nil];
+    
+    if (error)
+        *error = completionError;
+    return completionError == nil;
+}
+
+- (void)interrupt
+{
+    BOOL resumable = YES;
+    @synchronized (self)
+    {
+        [_fileHandle closeFile];
+        _fileHandle = nil;
+        resumable = _error == nil;
+    }
+    
+    if (!resumable)
+        [self discard];
+}
+
+- (void)discard
+{
+    @synchronized (self)
+    {
+        [_fileHandle closeFile];
+        _fileHandle = nil;
+        _receivedLength = 0;
+    }
+    
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    [fileManager removeItemAtURL:_partialFileURL error:nil];
+    [fileManager removeItemAtURL:_stateURL error:nil];
+}
+
+#pragma mark Private Methods
+
+- (void)mjz_openFileForResponse:(NSHTTPURLResponse*)response
+{
+    // Must be called inside a @synchronized block
+    unsigned long long offset = 0;
+    if (response.statusCode == 206)
+    {
+        // The range must start where the partial body ends
+        unsigned long long first = 0, last = 0;
+        long long total = -1;
+        NSString *contentRange = HMHeaderValue(response, @"Content-Range") ?: @"";
+        if (sscanf(contentRange.UTF8String, "bytes %llu-%llu/%lld", &first, &last, &total) < 2 || first != _resumeOffset)
+        {
+            _error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadServerResponse userInfo:@{NSLocalizedDescriptionKey: @"Unexpected content range"}];
+            return;
+        }
+        offset = first;
+        _expectedLength = total >= 0 ? total : (long long)(last + 1);
+    }
+    else
+    {
+        // The whole body is sent: the resource has changed or the server ignores ranges
+        _expectedLength = response.expectedContentLength;
+    }
+    _receivedLength = offset;
+    
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    [fileManager createDirectoryAtURL:[_fileURL URLByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+    if (offset == 0 || ![fileManager fileExistsAtPath:_partialFileURL.path])
+        [fileManager createFileAtPath:_partialFileURL.path contents:nil attributes:nil];
+    
+    NSError *error = nil;
+    _fileHandle = [NSFileHandle fileHandleForWritingToURL:_partialFileURL error:&error];
+    if (!_fileHandle)
+    {
+        _error = error;
+        return;
+    }
+    [_fileHandle truncateFileAtOffset:offset];
+    
+    // Recording the validator to resume the download if interrupted
+    NSString *validator = [HMFileDownload rangeValidatorOfResponse:response];
+    if (validator)
+        [@{@"validator": validator, @"URL": _requestURLString ?: @""} writeToURL:_stateURL atomically:YES];
+    else
+        [fileManager removeItemAtURL:_stateURL error:nil];
+}
+
+@end
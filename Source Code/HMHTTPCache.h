@@ -0,0 +1,330 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import <Foundation/Foundation.h>
+
+/**
+ * A cached HTTP response.
+ * @discussion Entries are immutable. Updating an entry (for example, after a conditional revalidation) creates a new one.
+ **/
+@interface HMHTTPCacheEntry : NSObject <NSSecureCoding>
+
+/**
+ * The cache key of the entry.
+ **/
+@property (nonatomic, strong, readonly) NSString *key;
+
+/**
+ * The URL of the response.
+ **/
+@property (nonatomic, strong, readonly) NSURL *URL;
+
+/**
+ * The HTTP status code of the response.
+ **/
+@property (nonatomic, assign, readonly) NSInteger statusCode;
+
+/**
+ * The HTTP header fields of the response.
+ **/
+@property (nonatomic, strong, readonly) NSDictionary <NSString*, NSString*> *headerFields;
+
+/**
+ * The response body.
+ **/
+@property (nonatomic, strong, readonly) NSData *data;
+
+/**
+ * The date the response was received.
+ **/
+@property (nonatomic, strong, readonly) NSDate *responseDate;
+
+/**
+ * The date the entry stops being fresh, computed from the `Cache-Control`, `Expires` and `Last-Modified` headers.
+ **/
+@property (nonatomic, strong, readonly) NSDate *expirationDate;
+
+/**
+ * YES if the response includes the `must-revalidate` cache directive: once stale, the entry must not be used without revalidating it.
+ **/
+@property (nonatomic, assign, readonly) BOOL mustRevalidate;
+
+/**
+ * The `ETag` of the response, if any.
+ **/
+@property (nonatomic, strong, readonly) NSString *entityTag;
+
+/**
+ * The `Last-Modified` date of the response, as received, if any.
+ **/
+@property (nonatomic, strong, readonly) NSString *lastModified;
+
+/**
+ * YES if the entry is fresh at the current date.
+ **/
+@property (nonatomic, assign, readonly, getter=isFresh) BOOL fresh;
+
+/**
+ * Returns an HTTP URL response equivalent to the cached one.
+ **/
+- (NSHTTPURLResponse*)HTTPURLResponse;
+
+@end
+
+/**
+ * Result of a cache lookup.
+ **/
+typedef NS_ENUM(NSInteger, HMHTTPCacheResult)
+{
+    /** No usable entry: the request must be sent. */
+    HMHTTPCacheResultMiss,
+    
+    /** A usable entry was found: the request does not need to be sent. */
+    HMHTTPCacheResultHit,
+    
+    /** A stale entry was found: the request has been made conditional (`If-None-Match`, `If-Modified-Since`). */
+    HMHTTPCacheResultRevalidate,
+};
+
+/**
+ * Cache lookup options.
+ **/
+typedef NS_OPTIONS(NSUInteger, HMHTTPCacheLookupOptions)
+{
+    /** No options. */
+    HMHTTPCacheLookupOptionsNone                 = 0,
+    
+    /** Stale entries are used as hits (for example, when offline). */
+    HMHTTPCacheLookupOptionsAllowStaleEntries    = 1 << 0,
+    
+    /** Stale entries that do not require revalidation are used as hits, and the request gets the validators of the entry to be revalidated in background. */
+    HMHTTPCacheLookupOptionsStaleWhileRevalidate = 1 << 1,
+};
+
+/**
+ * Eviction policies of the memory tier.
+ **/
+typedef NS_ENUM(NSInteger, HMHTTPCacheEvictionPolicy)
+{
+    /** The least recently used entries are evicted first. */
+    HMHTTPCacheEvictionPolicyLRU,
+    
+    /** The least frequently used entries are evicted first (the least recently used ones among equally used entries). */
+    HMHTTPCacheEvictionPolicyLFU,
+    
+    /** Expired entries and entries about to expire are evicted first (the least recently used ones among entries expiring at the same date). */
+    HMHTTPCacheEvictionPolicyTTLFirst,
+};
+
+/**
+ * An HTTP cache with a memory tier and a disk tier.
+ * @discussion Entries are keyed on the normalized request identity (URL with sorted query parameters, plus the authorization header) and follow the `Cache-Control` and `Expires` headers of the response.
+ * Stale entries with an `ETag` or a `Last-Modified` date are revalidated with conditional requests. Only successful responses (200 and 203) of GET requests are stored.
+ * The memory tier is bounded by size and entry count, globally and per path prefix, and evicts entries following the `evictionPolicy`. On iOS, half of it is released on memory warnings. The disk tier appends entries to a memory-mapped segment file, and bodies read from disk are not copied: they are views over the mapping. Disk writes are done in background. This class is thread safe.
+ **/
+@interface HMHTTPCache : NSObject
+
+/** ************************************************* **
+ * @name Initializers
+ ** ************************************************* **/
+
+/**
+ * Default initializer.
+ * @param directoryURL The directory of the disk tier, created if needed. If nil, the cache only uses memory. A dedicated directory is recommended: files of previous cache versions found in it are removed, other files are left untouched.
+ * @param memoryCapacity The maximum size in bytes of the memory tier.
+ * @param diskCapacity The maximum size in bytes of the disk tier.
+ * @return The initialized instance.
+ **/
+- (instancetype)initWithDirectoryURL:(NSURL*)directoryURL memoryCapacity:(NSUInteger)memoryCapacity diskCapacity:(NSUInteger)diskCapacity;
+
+/**
+ * The directory of the disk tier.
+ **/
+@property (nonatomic, strong, readonly) NSURL *directoryURL;
+
+/**
+ * The maximum size in bytes of the memory tier.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger memoryCapacity;
+
+/**
+ * The maximum number of entries of the memory tier. Zero means no limit, which is the default value.
+ **/
+@property (nonatomic, assign, readwrite) NSUInteger memoryCountLimit;
+
+/**
+ * The eviction policy of the memory tier. Default value is `HMHTTPCacheEvictionPolicyLRU`.
+ **/
+@property (nonatomic, assign, readwrite) HMHTTPCacheEvictionPolicy evictionPolicy;
+
+/**
+ * Limits the memory used by the entries of the URLs whose path starts with the given prefix, within the global limits.
+ * @param capacity The maximum size in bytes of the entries of the prefix. Zero means no limit.
+ * @param countLimit The maximum number of entries of the prefix. Zero means no limit.
+ * @param pathPrefix The path prefix (i.e. "/api/v1/images"). If several prefixes match a URL, the longest one is used.
+ **/
+- (void)setMemoryCapacity:(NSUInteger)capacity countLimit:(NSUInteger)countLimit forPathPrefix:(NSString*)pathPrefix;
+
+/**
+ * Evicts entries of the memory tier, following the eviction policy, until its size fits the given one.
+ * @param size The maximum size in bytes of the memory tier after trimming.
+ **/
+- (void)trimMemoryToSize:(NSUInteger)size;
+
+/**
+ * The maximum size in bytes of the disk tier.
+ * @discussion Bounds the size of the live entries. The segment file can also hold up to half of this size of replaced and removed entries before being compacted.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger diskCapacity;
+
+/** ************************************************* **
+ * @name Lookup and storage
+ ** ************************************************* **/
+
+/**
+ * Returns the cache key for the given request.
+ * @param request The request.
+ * @return The cache key.
+ **/
+- (NSString*)keyForRequest:(NSURLRequest*)request;
+
+/**
+ * Returns the entry for the given key, without updating the statistics.
+ * @param key The cache key.
+ * @return The cached entry or nil.
+ **/
+- (HMHTTPCacheEntry*)entryForKey:(NSString*)key;
+
+/**
+ * Looks up the entry for the given request.
+ * @param entry On output, the cached entry (if any), even if the result is a miss.
+ * @param request The request. If the result is `HMHTTPCacheResultRevalidate`, the conditional request headers are added to it.
+ * @param options The lookup options.
+ * @return The lookup result.
+ **/
+- (HMHTTPCacheResult)lookupEntry:(HMHTTPCacheEntry * __autoreleasing *)entry forRequest:(NSMutableURLRequest*)request options:(HMHTTPCacheLookupOptions)options;
+
+/**
+ * Stores a response.
+ * @param response The HTTP response.
+ * @param data The response body.
+ * @param request The request.
+ * @param requestDate The date the request was sent.
+ * @return The stored entry, or nil if the response is not cacheable.
+ **/
+- (HMHTTPCacheEntry*)storeResponse:(NSHTTPURLResponse*)response data:(NSData*)data forRequest:(NSURLRequest*)request requestDate:(NSDate*)requestDate;
+
+/**
+ * Updates a cached entry with the headers of a "304 Not Modified" response.
+ * @param response The 304 response.
+ * @param entry The revalidated entry.
+ * @param requestDate The date the conditional request was sent.
+ * @return The updated entry.
+ **/
+- (HMHTTPCacheEntry*)storeNotModifiedResponse:(NSHTTPURLResponse*)response forEntry:(HMHTTPCacheEntry*)entry requestDate:(NSDate*)requestDate;
+
+/**
+ * Removes the cached entry of the resource targeted by the given request. Used when the resource is modified by an unsafe request (POST, PUT, PATCH, DELETE).
+ * @param request The request.
+ **/
+- (void)invalidateEntryForRequest:(NSURLRequest*)request;
+
+/**
+ * Removes all entries.
+ **/
+- (void)removeAllEntries;
+
+/** ************************************************* **
+ * @name Decoded objects
+ ** ************************************************* **/
+
+/**
+ * The maximum approximated size in bytes of the decoded objects kept in memory. Zero disables them. Default value is the memory capacity.
+ * @discussion The cost of a decoded object is approximated as four times the size of its body.
+ **/
+@property (nonatomic, assign, readwrite) NSUInteger decodedObjectCapacity;
+
+/**
+ * Returns the object decoded from the body of the given entry, if kept in memory.
+ * @param entry The cached entry.
+ * @return The decoded object, or nil if it was not stored, was evicted, or was decoded from a different body (compared by `ETag` or, without it, by a hash of the body).
+ * @discussion Storing a new response for the resource, invalidating it or removing all entries drops its decoded object. Revalidations answered with "304 Not Modified" keep it, as the body doesn't change.
+ **/
+- (id)decodedObjectForEntry:(HMHTTPCacheEntry*)entry;
+
+/**
+ * Keeps in memory the object decoded from the body of the given entry, to skip decoding it again on cache hits.
+ * @param object The decoded object. It must be immutable, as it is shared by all the responses using it. If nil, the stored object is removed.
+ * @param entry The cached entry.
+ **/
+- (void)setDecodedObject:(id)object forEntry:(HMHTTPCacheEntry*)entry;
+
+/** ************************************************* **
+ * @name Statistics
+ ** ************************************************* **/
+
+/**
+ * Number of lookups resolved with a cached entry.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger hitCount;
+
+/**
+ * Number of lookups without a usable entry.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger missCount;
+
+/**
+ * Number of lookups resolved with a conditional request.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger revalidationCount;
+
+/**
+ * Number of conditional requests answered with "304 Not Modified".
+ **/
+@property (nonatomic, assign, readonly) NSUInteger notModifiedCount;
+
+/**
+ * Number of entries evicted from the memory tier to fit its limits (replaced and invalidated entries are not counted).
+ **/
+@property (nonatomic, assign, readonly) NSUInteger evictionCount;
+
+/**
+ * Number of cache hits served with an already decoded object.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger decodedObjectHitCount;
+
+/**
+ * The size in bytes of the entries in the memory tier.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger residentMemorySize;
+
+/**
+ * The number of entries in the memory tier.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger residentEntryCount;
+
+/**
+ * The ratio of lookups resolved with a cached entry (hits), from 0 to 1.
+ **/
+@property (nonatomic, assign, readonly) double hitRatio;
+
+/**
+ * Resets the statistics counters.
+ **/
+- (void)resetStatistics;
+
+@end
@@ -0,0 +1,1168 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import "HMHTTPCache.h"
+
+#import "HMHTTPCacheBodyStore.h"
+#import "NSString+HMClientMD5Hashing.h"
+
+#if TARGET_OS_IOS
+#import <UIKit/UIKit.h>
+#endif
+
+static NSString * const HMHTTPCacheVaryHeadersKey = @"HMHTTPCacheVaryHeaders";
+
+/**
+ * Returns the value of the header field with the given name (case insensitive).
+ **/
+static NSString* HMHTTPHeaderValue(NSDictionary *headerFields, NSString *name)
+{
+    NSString *value = headerFields[name];
+    if (value)
+        return value;
+    
+    for (NSString *key in headerFields)
+    {
+        if ([key caseInsensitiveCompare:name] == NSOrderedSame)
+            return headerFields[key];
+    }
+    return nil;
+}
+
+/**
+ * Returns YES if the file name matches the files of the previous disk layout (one file per entry, named with the MD5 hash of its key).
+ **/
+static BOOL HMHTTPCacheIsLegacyEntryFileName(NSString *fileName)
+{
+    if (fileName.length != 32)
+        return NO;
+    
+    NSCharacterSet *nonHexCharacters = [[NSCharacterSet characterSetWithCharactersInString:@"0123456789abcdefABCDEF"] invertedSet];
+    return [fileName rangeOfCharacterFromSet:nonHexCharacters].location == NSNotFound;
+}
+
+/**
+ * Parses an HTTP date (RFC 1123, RFC 850 or asctime format).
+ **/
+static NSDate* HMHTTPDateFromString(NSString *string)
+{
+    static NSArray *dateFormatters = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSMutableArray *formatters = [NSMutableArray array];
+        for (NSString *format in @[@"EEE, dd MMM yyyy HH:mm:ss zzz", @"EEEE, dd-MMM-yy HH:mm:ss zzz", @"EEE MMM d HH:mm:ss yyyy"])
+        {
+            NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+            formatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+            formatter.timeZone = [NSTimeZone timeZoneWithAbbreviation:@"GMT"];
+            formatter.dateFormat = format;
+            [formatters addObject:formatter];
+        }
+        dateFormatters = [formatters copy];
+    });
+    
+    if (string.length == 0)
+        return nil;
+    
+    for (NSDateFormatter *formatter in dateFormatters)
+    {
+        NSDate *date = [formatter dateFromString:string];
+        if (date)
+            return date;
+    }
+    return nil;
+}
+
+/**
+ * Parses a Cache-Control header into a dictionary of lowercase directives. Directives without value are mapped to NSNull.
+ **/
+static NSDictionary* HMHTTPCacheControlDirectives(NSString *cacheControl)
+{
+    if (cacheControl.length == 0)
+        return @{};
+    
+    NSMutableDictionary *directives = [NSMutableDictionary dictionary];
+    NSCharacterSet *whitespaces = [NSCharacterSet whitespaceCharacterSet];
+    for (NSString *component in [cacheControl componentsSeparatedByString:@","])
+    {
+        NSRange range = [component rangeOfString:@"="];
+        if (range.location == NSNotFound)
+        {
+            NSString *name = [[component stringByTrimmingCharactersInSet:whitespaces] lowercaseString];
+            if (name.length > 0)
+                directives[name] = [NSNull null];
+        }
+        else
+        {
+            NSString *name = [[[component substringToIndex:range.location] stringByTrimmingCharactersInSet:whitespaces] lowercaseString];
+            NSString *value = [[component substringFromIndex:NSMaxRange(range)] stringByTrimmingCharactersInSet:whitespaces];
+            value = [value stringByTrimmingCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@"\""]];
+            if (name.length > 0)
+                directives[name] = value;
+        }
+    }
+    return directives;
+}
+
+/**
+ * FNV-1a 64-bit hash, used to identify bodies without an `ETag`.
+ **/
+static uint64_t HMHTTPCacheBodyHash(NSData *data)
+{
+    __block uint64_t hash = 0xcbf29ce484222325ULL;
+    [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+        const uint8_t *byte = bytes;
+        for (NSUInteger i = 0; i < byteRange.length; ++i)
+        {
+            hash ^= byte[i];
+            hash *= 0x100000001b3ULL;
+        }
+    }];
+    return hash;
+}
+
+#pragma mark -
+
+@interface HMHTTPCacheEntry ()
+
+- (instancetype)initWithKey:(NSString*)key
+                        URL:(NSURL*)URL
+                 statusCode:(NSInteger)statusCode
+               headerFields:(NSDictionary*)headerFields
+                       data:(NSData*)data
+                requestDate:(NSDate*)requestDate
+               responseDate:(NSDate*)responseDate
+                varyHeaders:(NSDictionary*)varyHeaders;
+
+/**
+ * The values of the request headers listed in the `Vary` header of the response.
+ **/
+@property (nonatomic, strong, readonly) NSDictionary *varyHeaders;
+
+- (BOOL)mjz_matchesVaryHeadersOfRequest:(NSURLRequest*)request;
+- (NSUInteger)mjz_cost;
+- (HMHTTPCacheEntry*)mjz_entryWithData:(NSData*)data;
+- (NSString*)mjz_validator;
+
+@end
+
+@implementation HMHTTPCacheEntry
+{
+    NSString *_validator; // Lazily computed
+}
+
+- (instancetype)initWithKey:(NSString*)key
+                        URL:(NSURL*)URL
+                 statusCode:(NSInteger)statusCode
+               headerFields:(NSDictionary*)headerFields
+                       data:(NSData*)data
+                requestDate:(NSDate*)requestDate
+               responseDate:(NSDate*)responseDate
+                varyHeaders:(NSDictionary*)varyHeaders
+{
+    self = [super init];
+    if (self)
+    {
+        _key = key;
+        _URL = URL;
+        _statusCode = statusCode;
+        _headerFields = [headerFields copy];
+        _data = data ?: [NSData data];
+        _responseDate = responseDate;
+        _varyHeaders = [varyHeaders copy];
+        
+        // Computing the freshness lifetime (RFC 7234, section 4.2)
+        NSDictionary *directives = HMHTTPCacheControlDirectives(HMHTTPHeaderValue(headerFields, @"Cache-Control"));
+        _mustRevalidate = directives[@"must-revalidate"] != nil || directives[@"no-cache"] != nil;
+        
+        NSDate *date = HMHTTPDateFromString(HMHTTPHeaderValue(headerFields, @"Date")) ?: responseDate;
+        NSTimeInterval apparentAge = MAX([responseDate timeIntervalSinceDate:date], 0);
+        NSTimeInterval responseDelay = MAX([responseDate timeIntervalSinceDate:requestDate ?: responseDate], 0);
+        NSTimeInterval correctedInitialAge = MAX(apparentAge, [HMHTTPHeaderValue(headerFields, @"Age") doubleValue] + responseDelay);
+        
+        NSTimeInterval freshnessLifetime = 0;
+        NSString *expires = HMHTTPHeaderValue(headerFields, @"Expires");
+        if (directives[@"no-cache"])
+        {
+            freshnessLifetime = 0;
+        }
+        else if ([directives[@"max-age"] isKindOfClass:NSString.class])
+        {
+            freshnessLifetime = [directives[@"max-age"] doubleValue];
+        }
+        else if (expires)
+        {
+            // An invalid date (such as "0") means already expired
+            NSDate *expiresDate = HMHTTPDateFromString(expires);
+            freshnessLifetime = expiresDate ? [expiresDate timeIntervalSinceDate:date] : 0;
+        }
+        else if (self.lastModified)
+        {
+            // Heuristic freshness: 10% of the time since the last modification
+            NSDate *lastModifiedDate = HMHTTPDateFromString(self.lastModified);
+            if (lastModifiedDate)
+                freshnessLifetime = MAX([date timeIntervalSinceDate:lastModifiedDate], 0) * 0.1;
+        }
+        
+        _expirationDate = [responseDate dateByAddingTimeInterval:freshnessLifetime - correctedInitialAge];
+    }
+    return self;
+}
+
+#pragma mark Properties
+
+- (NSString*)entityTag
+{
+    return HMHTTPHeaderValue(_headerFields, @"ETag");
+}
+
+- (NSString*)lastModified
+{
+    return HMHTTPHeaderValue(_headerFields, @"Last-Modified");
+}
+
+- (BOOL)isFresh
+{
+    return _expirationDate.timeIntervalSinceNow > 0;
+}
+
+#pragma mark Public Methods
+
+- (NSHTTPURLResponse*)HTTPURLResponse
+{
+    return [[NSHTTPURLResponse alloc] initWithURL:_URL statusCode:_statusCode HTTPVersion:@"HTTP/1.1" headerFields:_headerFields];
+}
+
+#pragma mark Private Methods
+
+- (BOOL)mjz_matchesVaryHeadersOfRequest:(NSURLRequest*)request
+{
+    for (NSString *name in _varyHeaders)
+    {
+        NSString *value = [request valueForHTTPHeaderField:name] ?: @"";
+        if (![_varyHeaders[name] isEqualToString:value])
+            return NO;
+    }
+    return YES;
+}
+
+- (NSUInteger)mjz_cost
+{
+    // Approximating the size of the headers
+    return _data.length + _headerFields.count * 64 + 256;
+}
+
+- (HMHTTPCacheEntry*)mjz_entryWithData:(NSData*)data
+{
+    HMHTTPCacheEntry *entry = [HMHTTPCacheEntry new];
+    entry->_key = _key;
+    entry->_URL = _URL;
+    entry->_statusCode = _statusCode;
+    entry->_headerFields = _headerFields;
+    entry->_data = data ?: [NSData data];
+    entry->_responseDate = _responseDate;
+    entry->_expirationDate = _expirationDate;
+    entry->_mustRevalidate = _mustRevalidate;
+    entry->_varyHeaders = _varyHeaders;
+    return entry;
+}
+
+- (NSString*)mjz_validator
+{
+    @synchronized (self)
+    {
+        if (!_validator)
+        {
+            NSString *entityTag = self.entityTag;
+            if (entityTag.length > 0)
+                _validator = [@"etag:" stringByAppendingString:entityTag];
+            else
+                _validator = [NSString stringWithFormat:@"fnv:%016llx:%lu", HMHTTPCacheBodyHash(_data), (unsigned long)_data.length];
+        }
+        return _validator;
+    }
+}
+
+#pragma mark - Protocols
+#pragma mark NSSecureCoding
+
++ (BOOL)supportsSecureCoding
+{
+    return YES;
+}
+
+- (instancetype)initWithCoder:(NSCoder *)aDecoder
+{
+    self = [super init];
+    if (self)
+    {
+        NSSet *dictionaryClasses = [NSSet setWithObjects:NSDictionary.class, NSString.class, nil];
+        _key = [aDecoder decodeObjectOfClass:NSString.class forKey:@"key"];
+        _URL = [aDecoder decodeObjectOfClass:NSURL.class forKey:@"URL"];
+        _statusCode = [aDecoder decodeIntegerForKey:@"statusCode"];
+        _headerFields = [aDecoder decodeObjectOfClasses:dictionaryClasses forKey:@"headerFields"];
+        _data = [aDecoder decodeObjectOfClass:NSData.class forKey:@"data"] ?: [NSData data];
+        _responseDate = [aDecoder decodeObjectOfClass:NSDate.class forKey:@"responseDate"];
+        _expirationDate = [aDecoder decodeObjectOfClass:NSDate.class forKey:@"expirationDate"];
+        _mustRevalidate = [aDecoder decodeBoolForKey:@"mustRevalidate"];
+        _varyHeaders = [aDecoder decodeObjectOfClasses:dictionaryClasses forKey:HMHTTPCacheVaryHeadersKey];
+    }
+    return self;
+}
+
+- (void)encodeWithCoder:(NSCoder *)aCoder
+{
+    [aCoder encodeObject:_key forKey:@"key"];
+    [aCoder encodeObject:_URL forKey:@"URL"];
+    [aCoder encodeInteger:_statusCode forKey:@"statusCode"];
+    [aCoder encodeObject:_headerFields forKey:@"headerFields"];
+    [aCoder encodeObject:_data forKey:@"data"];
+    [aCoder encodeObject:_responseDate forKey:@"responseDate"];
+    [aCoder encodeObject:_expirationDate forKey:@"expirationDate"];
+    [aCoder encodeBool:_mustRevalidate forKey:@"mustRevalidate"];
+    [aCoder encodeObject:_varyHeaders forKey:HMHTTPCacheVaryHeadersKey];
+}
+
+@end
+
+#pragma mark -
+
+@class HMHTTPCacheGroup;
+
+/**
+ * A node of the memory tier, placed in the eviction heap of its group.
+ **/
+@interface HMHTTPCacheNode : NSObject
+
+@property (nonatomic, strong) HMHTTPCacheEntry *entry;
+@property (nonatomic, weak) HMHTTPCacheGroup *group;
+@property (nonatomic, assign) NSUInteger cost;
+@property (nonatomic, assign) NSTimeInterval expiration;
+@property (nonatomic, assign) uint64_t lastAccess;
+@property (nonatomic, assign) NSUInteger accessCount;
+@property (nonatomic, assign) NSUInteger heapIndex;
+
+@end
+
+@implementation HMHTTPCacheNode
+
+@end
+
+/**
+ * The entries of the memory tier sharing the same limits: the entries of a path prefix, or the remaining ones.
+ * @discussion Nodes are kept in a binary heap ordered by the eviction policy, the next node to evict first.
+ **/
+@interface HMHTTPCacheGroup : NSObject
+
+@property (nonatomic, strong) NSString *pathPrefix;
+@property (nonatomic, assign) NSUInteger capacity;
+@property (nonatomic, assign) NSUInteger countLimit;
+@property (nonatomic, assign) NSUInteger size;
+@property (nonatomic, strong) NSMutableArray <HMHTTPCacheNode*> *heap;
+
+@end
+
+@implementation HMHTTPCacheGroup
+
+@end
+
+/**
+ * A decoded response object, with the validator of the body it was decoded from.
+ **/
+@interface HMHTTPCacheDecodedObject : NSObject
+
+@property (nonatomic, strong) NSString *validator;
+@property (nonatomic, strong) id object;
+
+@end
+
+@implementation HMHTTPCacheDecodedObject
+
+@end
+
+#pragma mark -
+
+@implementation HMHTTPCache
+{
+    // Memory tier
+    NSMutableDictionary <NSString*, HMHTTPCacheNode*> *_nodes;
+    HMHTTPCacheGroup *_defaultGroup;
+    NSMutableArray <HMHTTPCacheGroup*> *_prefixGroups; // Longest prefixes first
+    uint64_t _accessClock;
+    
+    // Decoded objects (NSCache is thread safe and releases its objects under memory pressure)
+    NSCache <NSString*, HMHTTPCacheDecodedObject*> *_decodedObjects;
+    
+    // Disk tier (only accessed in the disk queue)
+    dispatch_queue_t _diskQueue;
+    HMHTTPCacheBodyStore *_bodyStore;
+    BOOL _savingIndex;
+}
+
+- (instancetype)init
+{
+    return [self initWithDirectoryURL:nil memoryCapacity:4*1024*1024 diskCapacity:0];
+}
+
+- (instancetype)initWithDirectoryURL:(NSURL*)directoryURL memoryCapacity:(NSUInteger)memoryCapacity diskCapacity:(NSUInteger)diskCapacity
+{
+    self = [super init];
+    if (self)
+    {
+        _directoryURL = directoryURL;
+        _memoryCapacity = memoryCapacity;
+        _diskCapacity = directoryURL ? diskCapacity : 0;
+        
+        _nodes = [NSMutableDictionary dictionary];
+        _defaultGroup = [HMHTTPCacheGroup new];
+        _defaultGroup.heap = [NSMutableArray array];
+        _prefixGroups = [NSMutableArray array];
+        
+        _decodedObjectCapacity = memoryCapacity;
+        _decodedObjects = [NSCache new];
+        _decodedObjects.totalCostLimit = memoryCapacity;
+        
+        _diskQueue = dispatch_queue_create("com.mobilejazz.hermod.http-cache", DISPATCH_QUEUE_SERIAL);
+        
+        if (_diskCapacity > 0)
+        {
+            dispatch_async(_diskQueue, ^{
+                [self mjz_openBodyStore];
+            });
+        }
+        
+#if TARGET_OS_IOS
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(mjz_applicationDidReceiveMemoryWarning:) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+#endif
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+#pragma mark Properties
+
+- (void)setEvictionPolicy:(HMHTTPCacheEvictionPolicy)evictionPolicy
+{
+    @synchronized (self)
+    {
+        if (_evictionPolicy == evictionPolicy)
+            return;
+        
+        _evictionPolicy = evictionPolicy;
+        
+        // Reordering the heaps with the new policy
+        [self mjz_rebuildHeapOfGroup:_defaultGroup];
+        for (HMHTTPCacheGroup *group in _prefixGroups)
+            [self mjz_rebuildHeapOfGroup:group];
+    }
+}
+
+- (void)setMemoryCountLimit:(NSUInteger)memoryCountLimit
+{
+    @synchronized (self)
+    {
+        _memoryCountLimit = memoryCountLimit;
+        [self mjz_trimMemoryToSize:_memoryCapacity];
+    }
+}
+
+- (void)setDecodedObjectCapacity:(NSUInteger)decodedObjectCapacity
+{
+    @synchronized (self)
+    {
+        _decodedObjectCapacity = decodedObjectCapacity;
+    }
+    
+    _decodedObjects.totalCostLimit = decodedObjectCapacity;
+    if (decodedObjectCapacity == 0)
+        [_decodedObjects removeAllObjects];
+}
+
+- (NSUInteger)residentEntryCount
+{
+    @synchronized (self)
+    {
+        return _nodes.count;
+    }
+}
+
+- (double)hitRatio
+{
+    @synchronized (self)
+    {
+        NSUInteger lookupCount = _hitCount + _missCount + _revalidationCount;
+        return lookupCount > 0 ? (double)_hitCount / lookupCount : 0;
+    }
+}
+
+#pragma mark Public Methods
+
+- (NSString*)keyForRequest:(NSURLRequest*)request
+{
+    // Normalizing the URL: lowercase scheme and host, no default port, no fragment and sorted query.
+    NSURLComponents *components = [NSURLComponents componentsWithURL:request.URL resolvingAgainstBaseURL:YES];
+    components.scheme = components.scheme.lowercaseString;
+    components.host = components.host.lowercaseString;
+    components.fragment = nil;
+    
+    if (([components.scheme isEqualToString:@"http"] && components.port.integerValue == 80) ||
+        ([components.scheme isEqualToString:@"https"] && components.port.integerValue == 443))
+        components.port = nil;
+    
+    if (components.percentEncodedPath.length == 0)
+        components.percentEncodedPath = @"/";
+    
+    if (components.percentEncodedQuery.length > 0)
+    {
+        NSArray *queryItems = [[components.percentEncodedQuery componentsSeparatedByString:@"&"] sortedArrayUsingSelector:@selector(compare:)];
+        components.percentEncodedQuery = [queryItems componentsJoinedByString:@"&"];
+    }
+    else
+    {
+        components.percentEncodedQuery = nil;
+    }
+    
+    NSString *key = components.URL.absoluteString ?: request.URL.absoluteString;
+    
+    // Responses of different credentials are not shared
+    NSString *authorization = [request valueForHTTPHeaderField:@"Authorization"];
+    if (authorization.length > 0)
+        key = [key stringByAppendingFormat:@" %@", [authorization mjz_api_md5_stringWithMD5Hash]];
+    
+    return key;
+}
+
+- (HMHTTPCacheEntry*)entryForKey:(NSString*)key
+{
+    if (!key)
+        return nil;
+    
+    @synchronized (self)
+    {
+        HMHTTPCacheNode *node = _nodes[key];
+        if (node)
+        {
+            [self mjz_touchNode:node];
+            return node.entry;
+        }
+    }
+    
+    if (_diskCapacity == 0)
+        return nil;
+    
+    // Reading from disk (serialized with the pending writes)
+    __block HMHTTPCacheEntry *entry = nil;
+    dispatch_sync(_diskQueue, ^{
+        entry = [self mjz_readEntryForKey:key];
+    });
+    
+    if (entry)
+    {
+        @synchronized (self)
+        {
+            // An entry stored meanwhile takes precedence
+            HMHTTPCacheNode *node = _nodes[key];
+            if (node)
+                return node.entry;
+            
+            [self mjz_addEntryToMemory:entry];
+        }
+    }
+    
+    return entry;
+}
+
+- (HMHTTPCacheResult)lookupEntry:(HMHTTPCacheEntry * __autoreleasing *)entryPtr forRequest:(NSMutableURLRequest*)request options:(HMHTTPCacheLookupOptions)options
+{
+    NSDictionary *directives = HMHTTPCacheControlDirectives([request valueForHTTPHeaderField:@"Cache-Control"]);
+    
+    HMHTTPCacheEntry *entry = nil;
+    if (!directives[@"no-store"])
+    {
+        entry = [self entryForKey:[self keyForRequest:request]];
+        if (entry && ![entry mjz_matchesVaryHeadersOfRequest:request])
+            entry = nil;
+    }
+    
+    if (entryPtr)
+        *entryPtr = entry;
+    
+    BOOL reloads = directives[@"no-cache"] != nil ||
+                   request.cachePolicy == NSURLRequestReloadIgnoringLocalCacheData ||
+                   request.cachePolicy == NSURLRequestReloadIgnoringLocalAndRemoteCacheData;
+    
+    HMHTTPCacheResult result = HMHTTPCacheResultMiss;
+    if (!entry)
+    {
+        result = HMHTTPCacheResultMiss;
+    }
+    else if (!reloads && (entry.isFresh || (options & HMHTTPCacheLookupOptionsAllowStaleEntries)))
+    {
+        result = HMHTTPCacheResultHit;
+    }
+    else if (!reloads && !entry.mustRevalidate && (options & HMHTTPCacheLookupOptionsStaleWhileRevalidate))
+    {
+        // The stale entry is used, and the request is prepared to revalidate it in background
+        [self mjz_addValidatorsOfEntry:entry toRequest:request];
+        result = HMHTTPCacheResultHit;
+    }
+    else if (entry.entityTag || entry.lastModified)
+    {
+        [self mjz_addValidatorsOfEntry:entry toRequest:request];
+        result = HMHTTPCacheResultRevalidate;
+    }
+    
+    @synchronized (self)
+    {
+        switch (result)
+        {
+            case HMHTTPCacheResultMiss:
+                _missCount += 1;
+                break;
+            case HMHTTPCacheResultHit:
+                _hitCount += 1;
+                break;
+            case HMHTTPCacheResultRevalidate:
+                _revalidationCount += 1;
+                break;
+        }
+    }
+    
+    return result;
+}
+
+- (void)mjz_addValidatorsOfEntry:(HMHTTPCacheEntry*)entry toRequest:(NSMutableURLRequest*)request
+{
+    if (entry.entityTag)
+        [request setValue:entry.entityTag forHTTPHeaderField:@"If-None-Match"];
+    if (entry.lastModified)
+        [request setValue:entry.lastModified forHTTPHeaderField:@"If-Modified-Since"];
+}
+
+- (HMHTTPCacheEntry*)storeResponse:(NSHTTPURLResponse*)response data:(NSData*)data forRequest:(NSURLRequest*)request requestDate:(NSDate*)requestDate
+{
+    if (response.statusCode != 200 && response.statusCode != 203)
+        return nil;
+    
+    NSDictionary *headerFields = response.allHeaderFields;
+    NSDictionary *requestDirectives = HMHTTPCacheControlDirectives([request valueForHTTPHeaderField:@"Cache-Control"]);
+    NSDictionary *responseDirectives = HMHTTPCacheControlDirectives(HMHTTPHeaderValue(headerFields, @"Cache-Control"));
+    if (requestDirectives[@"no-store"] || responseDirectives[@"no-store"])
+        return nil;
+    
+    // Recording the request headers selected by the response
+    NSMutableDictionary *varyHeaders = [NSMutableDictionary dictionary];
+    NSString *vary = HMHTTPHeaderValue(headerFields, @"Vary");
+    for (NSString *component in [vary componentsSeparatedByString:@","])
+    {
+        NSString *name = [component stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        if ([name isEqualToString:@"*"])
+            return nil;
+        if (name.length > 0)
+            varyHeaders[name] = [request valueForHTTPHeaderField:name] ?: @"";
+    }
+    
+    HMHTTPCacheEntry *entry = [[HMHTTPCacheEntry alloc] initWithKey:[self keyForRequest:request]
+                                                                 URL:response.URL ?: request.URL
+                                                          statusCode:response.statusCode
+                                                        headerFields:headerFields
+                                                                data:data
+                                                         requestDate:requestDate
+                                                        responseDate:[NSDate date]
+                                                         varyHeaders:varyHeaders];
+    [_decodedObjects removeObjectForKey:entry.key];
+    [self mjz_storeEntry:entry];
+    return entry;
+}
+
+- (HMHTTPCacheEntry*)storeNotModifiedResponse:(NSHTTPURLResponse*)response forEntry:(HMHTTPCacheEntry*)entry requestDate:(NSDate*)requestDate
+{
+    // Updating the stored headers with the ones of the 304 response (RFC 7234, section 4.3.4)
+    NSMutableDictionary *headerFields = [entry.headerFields mutableCopy];
+    [response.allHeaderFields enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSString *value, BOOL *stop) {
+        if ([name caseInsensitiveCompare:@"Content-Length"] == NSOrderedSame)
+            return;
+        
+        for (NSString *storedName in [headerFields allKeys])
+        {
+            if ([storedName caseInsensitiveCompare:name] == NSOrderedSame)
+                [headerFields removeObjectForKey:storedName];
+        }
+        headerFields[name] = value;
+    }];
+    
+    HMHTTPCacheEntry *updatedEntry = [[HMHTTPCacheEntry alloc] initWithKey:entry.key
+                                                                        URL:entry.URL
+                                                                 statusCode:entry.statusCode
+                                                               headerFields:headerFields
+                                                                       data:entry.data
+                                                                requestDate:requestDate
+                                                               responseDate:[NSDate date]
+                                                                varyHeaders:entry.varyHeaders];
+    [self mjz_storeEntry:updatedEntry];
+    
+    @synchronized (self)
+    {
+        _notModifiedCount += 1;
+    }
+    
+    return updatedEntry;
+}
+
+- (void)invalidateEntryForRequest:(NSURLRequest*)request
+{
+    NSString *key = [self keyForRequest:request];
+    [_decodedObjects removeObjectForKey:key];
+    
+    @synchronized (self)
+    {
+        HMHTTPCacheNode *node = _nodes[key];
+        if (node)
+            [self mjz_removeNodeFromMemory:node];
+    }
+    
+    if (_diskCapacity > 0)
+    {
+        dispatch_async(_diskQueue, ^{
+            [_bodyStore removeRecordForKey:key];
+            [self mjz_scheduleIndexSaving];
+        });
+    }
+}
+
+- (void)removeAllEntries
+{
+    [_decodedObjects removeAllObjects];
+    
+    @synchronized (self)
+    {
+        [_nodes removeAllObjects];
+        _residentMemorySize = 0;
+        
+        for (HMHTTPCacheGroup *group in [_prefixGroups arrayByAddingObject:_defaultGroup])
+        {
+            [group.heap removeAllObjects];
+            group.size = 0;
+        }
+    }
+    
+    if (_diskCapacity > 0)
+    {
+        dispatch_async(_diskQueue, ^{
+            [_bodyStore removeAllRecords];
+        });
+    }
+}
+
+- (id)decodedObjectForEntry:(HMHTTPCacheEntry*)entry
+{
+    if (!entry.key)
+        return nil;
+    
+    HMHTTPCacheDecodedObject *decodedObject = [_decodedObjects objectForKey:entry.key];
+    if (!decodedObject)
+        return nil;
+    
+    // An object decoded from another body of the resource is outdated
+    if (![decodedObject.validator isEqualToString:[entry mjz_validator]])
+    {
+        [_decodedObjects removeObjectForKey:entry.key];
+        return nil;
+    }
+    
+    @synchronized (self)
+    {
+        _decodedObjectHitCount += 1;
+    }
+    
+    return decodedObject.object;
+}
+
+- (void)setDecodedObject:(id)object forEntry:(HMHTTPCacheEntry*)entry
+{
+    if (!entry.key || _decodedObjectCapacity == 0)
+        return;
+    
+    if (!object)
+    {
+        [_decodedObjects removeObjectForKey:entry.key];
+        return;
+    }
+    
+    HMHTTPCacheDecodedObject *decodedObject = [HMHTTPCacheDecodedObject new];
+    decodedObject.validator = [entry mjz_validator];
+    decodedObject.object = object;
+    
+    // Decoded objects are usually a few times larger than their body
+    [_decodedObjects setObject:decodedObject forKey:entry.key cost:entry.data.length * 4];
+}
+
+- (void)setMemoryCapacity:(NSUInteger)capacity countLimit:(NSUInteger)countLimit forPathPrefix:(NSString*)pathPrefix
+{
+    if (pathPrefix.length == 0)
+        return;
+    
+    @synchronized (self)
+    {
+        HMHTTPCacheGroup *group = nil;
+        for (HMHTTPCacheGroup *prefixGroup in _prefixGroups)
+        {
+            if ([prefixGroup.pathPrefix isEqualToString:pathPrefix])
+                group = prefixGroup;
+        }
+        
+        if (!group)
+        {
+            group = [HMHTTPCacheGroup new];
+            group.pathPrefix = pathPrefix;
+            group.heap = [NSMutableArray array];
+            
+            NSUInteger index = [_prefixGroups indexOfObjectPassingTest:^BOOL(HMHTTPCacheGroup *prefixGroup, NSUInteger idx, BOOL *stop) {
+                return prefixGroup.pathPrefix.length < pathPrefix.length;
+            }];
+            [_prefixGroups insertObject:group atIndex:index == NSNotFound ? _prefixGroups.count : index];
+            
+            // Moving the cached entries of the prefix into the new group
+            for (HMHTTPCacheNode *node in _nodes.allValues)
+            {
+                HMHTTPCacheGroup *nodeGroup = [self mjz_groupForEntry:node.entry];
+                if (nodeGroup != node.group)
+                {
+                    [self mjz_removeNode:node fromGroup:node.group];
+                    [self mjz_addNode:node toGroup:nodeGroup];
+                }
+            }
+        }
+        
+        group.capacity = capacity;
+        group.countLimit = countLimit;
+        [self mjz_trimGroup:group];
+    }
+}
+
+- (void)trimMemoryToSize:(NSUInteger)size
+{
+    @synchronized (self)
+    {
+        [self mjz_trimMemoryToSize:MIN(size, _memoryCapacity)];
+    }
+}
+
+- (void)resetStatistics
+{
+    @synchronized (self)
+    {
+        _hitCount = 0;
+        _missCount = 0;
+        _revalidationCount = 0;
+        _notModifiedCount = 0;
+        _evictionCount = 0;
+        _decodedObjectHitCount = 0;
+    }
+}
+
+#pragma mark Private Methods
+
+- (void)mjz_storeEntry:(HMHTTPCacheEntry*)entry
+{
+    @synchronized (self)
+    {
+        HMHTTPCacheNode *node = _nodes[entry.key];
+        if (node)
+            [self mjz_removeNodeFromMemory:node];
+        
+        [self mjz_addEntryToMemory:entry];
+    }
+    
+    if (_diskCapacity > 0)
+    {
+        dispatch_async(_diskQueue, ^{
+            [self mjz_writeEntry:entry];
+        });
+    }
+}
+
+// Memory tier. Must be called inside a @synchronized(self) block.
+
+- (void)mjz_addEntryToMemory:(HMHTTPCacheEntry*)entry
+{
+    HMHTTPCacheGroup *group = [self mjz_groupForEntry:entry];
+    NSUInteger cost = [entry mjz_cost];
+    if (cost > _memoryCapacity || (group.capacity > 0 && cost > group.capacity))
+        return;
+    
+    HMHTTPCacheNode *node = [HMHTTPCacheNode new];
+    node.entry = entry;
+    node.cost = cost;
+    node.expiration = entry.expirationDate.timeIntervalSinceReferenceDate;
+    node.lastAccess = ++_accessClock;
+    node.accessCount = 1;
+    
+    _nodes[entry.key] = node;
+    _residentMemorySize += cost;
+    [self mjz_addNode:node toGroup:group];
+    
+    [self mjz_trimGroup:group];
+    [self mjz_trimMemoryToSize:_memoryCapacity];
+}
+
+- (void)mjz_removeNodeFromMemory:(HMHTTPCacheNode*)node
+{
+    [self mjz_removeNode:node fromGroup:node.group];
+    [_nodes removeObjectForKey:node.entry.key];
+    _residentMemorySize -= node.cost;
+}
+
+- (void)mjz_touchNode:(HMHTTPCacheNode*)node
+{
+    node.lastAccess = ++_accessClock;
+    node.accessCount += 1;
+    [self mjz_siftDownNode:node inHeap:node.group.heap];
+}
+
+- (HMHTTPCacheGroup*)mjz_groupForEntry:(HMHTTPCacheEntry*)entry
+{
+    NSString *path = entry.URL.path;
+    for (HMHTTPCacheGroup *group in _prefixGroups)
+    {
+        if ([path hasPrefix:group.pathPrefix])
+            return group;
+    }
+    return _defaultGroup;
+}
+
+- (void)mjz_trimGroup:(HMHTTPCacheGroup*)group
+{
+    while (group.heap.count > 0 &&
+           ((group.capacity > 0 && group.size > group.capacity) || (group.countLimit > 0 && group.heap.count > group.countLimit)))
+        [self mjz_evictNode:group.heap.firstObject];
+}
+
+- (void)mjz_trimMemoryToSize:(NSUInteger)size
+{
+    while (_nodes.count > 0 && (_residentMemorySize > size || (_memoryCountLimit > 0 && _nodes.count > _memoryCountLimit)))
+    {
+        // The next node to evict is at the top of one of the heaps
+        HMHTTPCacheNode *victim = _defaultGroup.heap.firstObject;
+        for (HMHTTPCacheGroup *group in _prefixGroups)
+        {
+            HMHTTPCacheNode *node = group.heap.firstObject;
+            if (node && (!victim || [self mjz_node:node evictsBeforeNode:victim]))
+                victim = node;
+        }
+        [self mjz_evictNode:victim];
+    }
+}
+
+- (void)mjz_evictNode:(HMHTTPCacheNode*)node
+{
+    [self mjz_removeNodeFromMemory:node];
+    _evictionCount += 1;
+}
+
+// Eviction heaps. Must be called inside a @synchronized(self) block.
+
+- (BOOL)mjz_node:(HMHTTPCacheNode*)node evictsBeforeNode:(HMHTTPCacheNode*)otherNode
+{
+    switch (_evictionPolicy)
+    {
+        case HMHTTPCacheEvictionPolicyLRU:
+            break;
+            
+        case HMHTTPCacheEvictionPolicyLFU:
+            if (node.accessCount != otherNode.accessCount)
+                return node.accessCount < otherNode.accessCount;
+            break;
+            
+        case HMHTTPCacheEvictionPolicyTTLFirst:
+            if (node.expiration != otherNode.expiration)
+                return node.expiration < otherNode.expiration;
+            break;
+    }
+    
+    // Ties are broken by recency
+    return node.lastAccess < otherNode.lastAccess;
+}
+
+- (void)mjz_addNode:(HMHTTPCacheNode*)node toGroup:(HMHTTPCacheGroup*)group
+{
+    node.group = group;
+    node.heapIndex = group.heap.count;
+    [group.heap addObject:node];
+    group.size += node.cost;
+    [self mjz_siftUpNode:node inHeap:group.heap];
+}
+
+- (void)mjz_removeNode:(HMHTTPCacheNode*)node fromGroup:(HMHTTPCacheGroup*)group
+{
+    NSMutableArray *heap = group.heap;
+    HMHTTPCacheNode *lastNode = heap.lastObject;
+    [heap removeLastObject];
+    group.size -= node.cost;
+    
+    // Moving the last node to the free position
+    if (lastNode != node)
+    {
+        lastNode.heapIndex = node.heapIndex;
+        heap[node.heapIndex] = lastNode;
+        [self mjz_siftUpNode:lastNode inHeap:heap];
+        [self mjz_siftDownNode:lastNode inHeap:heap];
+    }
+    
+    node.group = nil;
+}
+
+- (void)mjz_siftUpNode:(HMHTTPCacheNode*)node inHeap:(NSMutableArray <HMHTTPCacheNode*> *)heap
+{
+    NSUInteger index = node.heapIndex;
+    while (index > 0)
+    {
+        NSUInteger parentIndex = (index - 1) / 2;
+        HMHTTPCacheNode *parent = heap[parentIndex];
+        if (![self mjz_node:node evictsBeforeNode:parent])
+            break;
+        
+        parent.heapIndex = index;
+        heap[index] = parent;
+        index = parentIndex;
+    }
+    
+    node.heapIndex = index;
+    heap[index] = node;
+}
+
+- (void)mjz_siftDownNode:(HMHTTPCacheNode*)node inHeap:(NSMutableArray <HMHTTPCacheNode*> *)heap
+{
+    NSUInteger count = heap.count;
+    NSUInteger index = node.heapIndex;
+    while (YES)
+    {
+        NSUInteger childIndex = 2 * index + 1;
+        if (childIndex >= count)
+            break;
+        
+        if (childIndex + 1 < count && [self mjz_node:heap[childIndex + 1] evictsBeforeNode:heap[childIndex]])
+            childIndex += 1;
+        
+        HMHTTPCacheNode *child = heap[childIndex];
+        if (![self mjz_node:child evictsBeforeNode:node])
+            break;
+        
+        child.heapIndex = index;
+        heap[index] = child;
+        index = childIndex;
+    }
+    
+    node.heapIndex = index;
+    heap[index] = node;
+}
+
+- (void)mjz_rebuildHeapOfGroup:(HMHTTPCacheGroup*)group
+{
+    NSMutableArray *heap = group.heap;
+    for (NSUInteger index = heap.count / 2; index > 0; --index)
+        [self mjz_siftDownNode:heap[index - 1] inHeap:heap];
+}
+
+#if TARGET_OS_IOS
+- (void)mjz_applicationDidReceiveMemoryWarning:(NSNotification*)notification
+{
+    // Releasing half of the memory tier, keeping the entries most valuable for the eviction policy
+    @synchronized (self)
+    {
+        [self mjz_trimMemoryToSize:_residentMemorySize / 2];
+    }
+}
+#endif
+
+// Disk tier. Must be called in the disk queue.
+
+- (void)mjz_openBodyStore
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    [fileManager createDirectoryAtURL:_directoryURL withIntermediateDirectories:YES attributes:nil error:nil];
+    
+    // Removing the files of previous versions (one file per entry). Any other file is left untouched.
+    NSSet *fileNames = [HMHTTPCacheBodyStore fileNames];
+    for (NSURL *fileURL in [fileManager contentsOfDirectoryAtURL:_directoryURL includingPropertiesForKeys:nil options:NSDirectoryEnumerationSkipsHiddenFiles error:nil])
+    {
+        NSString *fileName = fileURL.lastPathComponent;
+        if (![fileNames containsObject:fileName] && HMHTTPCacheIsLegacyEntryFileName(fileName))
+            [fileManager removeItemAtURL:fileURL error:nil];
+    }
+    
+    _bodyStore = [[HMHTTPCacheBodyStore alloc] initWithDirectoryURL:_directoryURL capacity:_diskCapacity];
+}
+
+- (HMHTTPCacheEntry*)mjz_readEntryForKey:(NSString*)key
+{
+    NSData *metadata = nil;
+    NSData *body = nil;
+    if (![_bodyStore getMetadata:&metadata body:&body forKey:key])
+        return nil;
+    
+    HMHTTPCacheEntry *entry = nil;
+    @try
+    {
+        entry = [NSKeyedUnarchiver unarchiveObjectWithData:metadata];
+    }
+    @catch (NSException *exception)
+    {
+        entry = nil;
+    }
+    
+    if (![entry isKindOfClass:HMHTTPCacheEntry.class] || ![entry.key isEqualToString:key])
+    {
+        // Corrupted record
+        [_bodyStore removeRecordForKey:key];
+        [self mjz_scheduleIndexSaving];
+        return nil;
+    }
+    
+    // The body is not copied: it is a view over the mapped segment file
+    return [entry mjz_entryWithData:body];
+}
+
+- (void)mjz_writeEntry:(HMHTTPCacheEntry*)entry
+{
+    @autoreleasepool
+    {
+        // The body is stored apart from the archived metadata
+        NSData *metadata = [NSKeyedArchiver archivedDataWithRootObject:[entry mjz_entryWithData:nil]];
+        [_bodyStore setMetadata:metadata body:entry.data forKey:entry.key];
+        [self mjz_scheduleIndexSaving];
+    }
+}
+
+- (void)mjz_scheduleIndexSaving
+{
+    // Records written meanwhile are replayed when opening the store, so the index is saved lazily
+    if (_savingIndex)
+        return;
+    
+    _savingIndex = YES;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(2 * NSEC_PER_SEC)), _diskQueue, ^{
+        _savingIndex = NO;
+        [_bodyStore saveIndex];
+    });
+}
+
+@end
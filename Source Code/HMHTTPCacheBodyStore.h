@@ -0,0 +1,118 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import <Foundation/Foundation.h>
+
+/**
+ * Stores cached responses in an append-only segment file, read back through a memory mapping.
+ * @discussion Each record holds a key, its metadata and the response body. Records are appended to the segment file and never modified: replacing or removing a record appends a new record (or a tombstone) and leaves the old one as dead space. Bodies are returned as `NSData` views over the mapping of the segment file, without being copied.
+ * A compact index (offsets and lengths, in least recently used order) is saved next to the segment file. When opening the store, the records appended after the saved index are replayed, and a partially written record at the end of the segment (i.e. after a crash) is discarded.
+ * When the dead space exceeds half of the capacity, the live records are copied into a new segment file that replaces the current one.
+ * This class is not thread safe: it must be used from a single serial queue.
+ **/
+@interface HMHTTPCacheBodyStore : NSObject
+
+/** ************************************************* **
+ * @name Initializers
+ ** ************************************************* **/
+
+/**
+ * Default initializer. Opens the store, recovering it if needed.
+ * @param directoryURL The directory of the segment and index files, created if needed.
+ * @param capacity The maximum size in bytes of the live records. The least recently used records are removed to fit it.
+ * @return The initialized instance, or nil if the segment file cannot be opened.
+ **/
+- (instancetype)initWithDirectoryURL:(NSURL*)directoryURL capacity:(NSUInteger)capacity;
+
+/**
+ * The directory of the segment and index files.
+ **/
+@property (nonatomic, strong, readonly) NSURL *directoryURL;
+
+/**
+ * The maximum size in bytes of the live records.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger capacity;
+
+/**
+ * The names of the files managed by the store inside its directory.
+ **/
++ (NSSet <NSString*> *)fileNames;
+
+/** ************************************************* **
+ * @name Records
+ ** ************************************************* **/
+
+/**
+ * Appends a record, replacing the previous one of the same key.
+ * @param metadata The metadata of the record.
+ * @param body The response body.
+ * @param key The key of the record.
+ * @return YES if the record has been written, NO otherwise (i.e. larger than the capacity or an I/O error).
+ **/
+- (BOOL)setMetadata:(NSData*)metadata body:(NSData*)body forKey:(NSString*)key;
+
+/**
+ * Reads a record and marks it as recently used.
+ * @param metadata On output, the metadata of the record.
+ * @param body On output, the response body, as a view over the mapping of the segment file.
+ * @param key The key of the record.
+ * @return YES if the record exists, NO otherwise.
+ **/
+- (BOOL)getMetadata:(NSData * __autoreleasing *)metadata body:(NSData * __autoreleasing *)body forKey:(NSString*)key;
+
+/**
+ * Removes the record of the given key.
+ * @param key The key of the record.
+ **/
+- (void)removeRecordForKey:(NSString*)key;
+
+/**
+ * Removes all records, truncating the segment file.
+ **/
+- (void)removeAllRecords;
+
+/**
+ * The number of live records.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger recordCount;
+
+/** ************************************************* **
+ * @name Maintenance
+ ** ************************************************* **/
+
+/**
+ * Saves the index of the segment file. Done automatically after compacting.
+ **/
+- (void)saveIndex;
+
+/**
+ * Copies the live records into a new segment file, discarding the dead space.
+ **/
+- (void)compact;
+
+/**
+ * The size in bytes of the live records.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger liveSize;
+
+/**
+ * The size in bytes of the segment file, including replaced and removed records.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger segmentSize;
+
+@end
@@ -0,0 +1,675 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import "HMHTTPCacheBodyStore.h"
+
+#import <fcntl.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <sys/uio.h>
+#import <unistd.h>
+
+static NSString * const HMHTTPCacheSegmentFileName = @"responses.segment";
+static NSString * const HMHTTPCacheCompactingSegmentFileName = @"responses.segment.tmp";
+static NSString * const HMHTTPCacheIndexFileName = @"responses.index";
+
+static uint32_t const HMHTTPCacheSegmentMagic = 0x47534d48; // "HMSG"
+static uint32_t const HMHTTPCacheRecordMagic = 0x43524d48;  // "HMRC"
+static uint32_t const HMHTTPCacheIndexMagic = 0x58494d48;   // "HMIX"
+static uint32_t const HMHTTPCacheFormatVersion = 1;
+
+typedef NS_ENUM(uint32_t, HMHTTPCacheRecordType)
+{
+    HMHTTPCacheRecordTypeValue      = 1,
+    HMHTTPCacheRecordTypeTombstone  = 2,
+};
+
+/**
+ * Header of the segment file. The generation changes every time the segment file is replaced.
+ **/
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t generation;
+} HMHTTPCacheSegmentHeader;
+
+/**
+ * Header of a record, followed by the key, the metadata and the body.
+ **/
+typedef struct
+{
+    uint32_t magic;
+    uint32_t type;
+    uint32_t keyLength;
+    uint32_t metadataLength;
+    uint64_t bodyLength;
+    uint32_t checksum;
+    uint32_t reserved;
+} HMHTTPCacheRecordHeader;
+
+/**
+ * Header of the index file, followed by one entry per record.
+ **/
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t generation;
+    uint64_t segmentLength;
+    uint64_t recordCount;
+} HMHTTPCacheIndexHeader;
+
+/**
+ * Entry of the index file, followed by the key.
+ **/
+typedef struct
+{
+    uint64_t offset;
+    uint32_t keyLength;
+    uint32_t metadataLength;
+    uint64_t bodyLength;
+} HMHTTPCacheIndexEntry;
+
+/**
+ * FNV-1a hash, used to detect partially written records.
+ **/
+static uint32_t HMHTTPCacheChecksum(uint32_t hash, const void *bytes, size_t length)
+{
+    const uint8_t *data = bytes;
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t HMHTTPCacheRecordChecksum(NSData *key, NSData *metadata, NSData *body)
+{
+    uint32_t hash = 2166136261u;
+    hash = HMHTTPCacheChecksum(hash, key.bytes, key.length);
+    hash = HMHTTPCacheChecksum(hash, metadata.bytes, metadata.length);
+    hash = HMHTTPCacheChecksum(hash, body.bytes, body.length);
+    return hash;
+}
+
+#pragma mark -
+
+/**
+ * A read only mapping of the segment file. Kept alive by the data views created over it.
+ **/
+@interface HMHTTPCacheMapping : NSObject
+
+- (instancetype)initWithBytes:(void*)bytes length:(size_t)length;
+
+@property (nonatomic, assign, readonly) const uint8_t *bytes;
+@property (nonatomic, assign, readonly) size_t length;
+
+- (NSData*)dataWithOffset:(uint64_t)offset length:(uint64_t)length;
+
+@end
+
+@implementation HMHTTPCacheMapping
+
+- (instancetype)initWithBytes:(void*)bytes length:(size_t)length
+{
+    self = [super init];
+    if (self)
+    {
+        _bytes = bytes;
+        _length = length;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    munmap((void*)_bytes, _length);
+}
+
+- (NSData*)dataWithOffset:(uint64_t)offset length:(uint64_t)length
+{
+    if (length == 0)
+        return [NSData data];
+    
+    HMHTTPCacheMapping *mapping = self;
+    return [[NSData alloc] initWithBytesNoCopy:(void*)(_bytes + offset) length:(NSUInteger)length deallocator:^(void *viewBytes, NSUInteger viewLength) {
+        // Releasing the mapping once the last view is deallocated
+        (void)mapping;
+    }];
+}
+
+@end
+
+#pragma mark -
+
+/**
+ * Location of a live record in the segment file.
+ **/
+@interface HMHTTPCacheRecord : NSObject
+
+@property (nonatomic, assign) uint64_t offset;
+@property (nonatomic, assign) uint32_t keyLength;
+@property (nonatomic, assign) uint32_t metadataLength;
+@property (nonatomic, assign) uint64_t bodyLength;
+@property (nonatomic, assign, readonly) uint64_t size;
+
+@end
+
+@implementation HMHTTPCacheRecord
+
+- (uint64_t)size
+{
+    return sizeof(HMHTTPCacheRecordHeader) + _keyLength + _metadataLength + _bodyLength;
+}
+
+@end
+
+#pragma mark -
+
+@implementation HMHTTPCacheBodyStore
+{
+    int _fileDescriptor;
+    uint64_t _generation;
+    uint64_t _segmentLength;
+    HMHTTPCacheMapping *_mapping;
+    
+    NSMutableDictionary <NSString*, HMHTTPCacheRecord*> *_records;
+    NSMutableOrderedSet <NSString*> *_usage; // Least recently used keys first
+}
+
++ (NSSet <NSString*> *)fileNames
+{
+    return [NSSet setWithObjects:HMHTTPCacheSegmentFileName, HMHTTPCacheCompactingSegmentFileName, HMHTTPCacheIndexFileName, nil];
+}
+
+- (instancetype)init
+{
+    return [self initWithDirectoryURL:nil capacity:0];
+}
+
+- (instancetype)initWithDirectoryURL:(NSURL*)directoryURL capacity:(NSUInteger)capacity
+{
+    self = [super init];
+    if (self)
+    {
+        _directoryURL = directoryURL;
+        _capacity = capacity;
+        _fileDescriptor = -1;
+        _records = [NSMutableDictionary dictionary];
+        _usage = [NSMutableOrderedSet orderedSet];
+        
+        if (!directoryURL)
+            return nil;
+        
+        NSFileManager *fileManager = [NSFileManager defaultManager];
+        [fileManager createDirectoryAtURL:directoryURL withIntermediateDirectories:YES attributes:nil error:nil];
+        
+        // A compaction interrupted by a crash
+        [fileManager removeItemAtURL:[self mjz_URLForFileName:HMHTTPCacheCompactingSegmentFileName] error:nil];
+        
+        if (![self mjz_openSegment])
+            return nil;
+        
+        [self mjz_trimToCapacity];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    if (_fileDescriptor >= 0)
+        close(_fileDescriptor);
+}
+
+#pragma mark Properties
+
+- (NSUInteger)recordCount
+{
+    return _records.count;
+}
+
+- (NSUInteger)segmentSize
+{
+    return (NSUInteger)_segmentLength;
+}
+
+#pragma mark Public Methods
+
+- (BOOL)setMetadata:(NSData*)metadata body:(NSData*)body forKey:(NSString*)key
+{
+    NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+    
+    HMHTTPCacheRecord *record = [HMHTTPCacheRecord new];
+    record.keyLength = (uint32_t)keyData.length;
+    record.metadataLength = (uint32_t)metadata.length;
+    record.bodyLength = body.length;
+    
+    if (!keyData || record.size > _capacity)
+    {
+        [self removeRecordForKey:key];
+        return NO;
+    }
+    
+    uint64_t offset = 0;
+    if (![self mjz_appendRecordOfType:HMHTTPCacheRecordTypeValue key:keyData metadata:metadata body:body offset:&offset])
+        return NO;
+    
+    // The previous record of the key (if any) becomes dead space
+    record.offset = offset;
+    [self mjz_setRecord:record forKey:key];
+    
+    [self mjz_trimToCapacity];
+    [self mjz_compactIfNeeded];
+    
+    return YES;
+}
+
+- (BOOL)getMetadata:(NSData * __autoreleasing *)metadata body:(NSData * __autoreleasing *)body forKey:(NSString*)key
+{
+    HMHTTPCacheRecord *record = _records[key];
+    if (!record)
+        return NO;
+    
+    if (![self mjz_mapLength:record.offset + record.size])
+        return NO;
+    
+    // Checking that the indexed record is the expected one
+    const uint8_t *bytes = _mapping.bytes + record.offset;
+    HMHTTPCacheRecordHeader header;
+    memcpy(&header, bytes, sizeof(header));
+    
+    NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+    if (header.magic != HMHTTPCacheRecordMagic ||
+        header.type != HMHTTPCacheRecordTypeValue ||
+        header.keyLength != record.keyLength ||
+        header.metadataLength != record.metadataLength ||
+        header.bodyLength != record.bodyLength ||
+        keyData.length != record.keyLength ||
+        memcmp(bytes + sizeof(header), keyData.bytes, keyData.length) != 0)
+    {
+        [self removeRecordForKey:key];
+        return NO;
+    }
+    
+    uint64_t metadataOffset = record.offset + sizeof(header) + record.keyLength;
+    if (metadata)
+        *metadata = [_mapping dataWithOffset:metadataOffset length:record.metadataLength];
+    if (body)
+        *body = [_mapping dataWithOffset:metadataOffset + record.metadataLength length:record.bodyLength];
+    
+    // Marking the record as recently used
+    [_usage removeObject:key];
+    [_usage addObject:key];
+    
+    return YES;
+}
+
+- (void)removeRecordForKey:(NSString*)key
+{
+    if (!_records[key])
+        return;
+    
+    [self mjz_setRecord:nil forKey:key];
+    
+    // The tombstone prevents the record from being recovered when replaying the segment
+    NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+    [self mjz_appendRecordOfType:HMHTTPCacheRecordTypeTombstone key:keyData metadata:nil body:nil offset:NULL];
+    
+    [self mjz_compactIfNeeded];
+}
+
+- (void)removeAllRecords
+{
+    [_records removeAllObjects];
+    [_usage removeAllObjects];
+    _liveSize = 0;
+    
+    [self compact];
+}
+
+- (void)saveIndex
+{
+    HMHTTPCacheIndexHeader header;
+    header.magic = HMHTTPCacheIndexMagic;
+    header.version = HMHTTPCacheFormatVersion;
+    header.generation = _generation;
+    header.segmentLength = _segmentLength;
+    header.recordCount = _usage.count;
+    
+    NSMutableData *data = [NSMutableData dataWithBytes:&header length:sizeof(header)];
+    for (NSString *key in _usage)
+    {
+        HMHTTPCacheRecord *record = _records[key];
+        NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+        
+        HMHTTPCacheIndexEntry entry;
+        entry.offset = record.offset;
+        entry.keyLength = record.keyLength;
+        entry.metadataLength = record.metadataLength;
+        entry.bodyLength = record.bodyLength;
+        
+        [data appendBytes:&entry length:sizeof(entry)];
+        [data appendData:keyData];
+    }
+    
+    [data writeToURL:[self mjz_URLForFileName:HMHTTPCacheIndexFileName] options:NSDataWritingAtomic error:nil];
+}
+
+- (void)compact
+{
+    if (_usage.count > 0 && ![self mjz_mapLength:_segmentLength])
+        return;
+    
+    // Copying the live records (in usage order) into a new segment file
+    HMHTTPCacheMapping *mapping = _mapping;
+    NSURL *fileURL = [self mjz_URLForFileName:HMHTTPCacheCompactingSegmentFileName];
+    uint64_t generation = 0;
+    int fileDescriptor = [self mjz_createSegmentFileAtURL:fileURL generation:&generation];
+    if (fileDescriptor < 0)
+        return;
+    
+    uint64_t length = sizeof(HMHTTPCacheSegmentHeader);
+    NSMutableDictionary *records = [NSMutableDictionary dictionaryWithCapacity:_records.count];
+    for (NSString *key in _usage)
+    {
+        HMHTTPCacheRecord *record = _records[key];
+        if (pwrite(fileDescriptor, mapping.bytes + record.offset, (size_t)record.size, (off_t)length) != (ssize_t)record.size)
+        {
+            close(fileDescriptor);
+            unlink(fileURL.fileSystemRepresentation);
+            return;
+        }
+        
+        HMHTTPCacheRecord *compactedRecord = [HMHTTPCacheRecord new];
+        compactedRecord.offset = length;
+        compactedRecord.keyLength = record.keyLength;
+        compactedRecord.metadataLength = record.metadataLength;
+        compactedRecord.bodyLength = record.bodyLength;
+        records[key] = compactedRecord;
+        
+        length += record.size;
+    }
+    
+    // Replacing the segment file. Views over the previous mapping remain valid.
+    if (fsync(fileDescriptor) != 0 || rename(fileURL.fileSystemRepresentation, [self mjz_URLForFileName:HMHTTPCacheSegmentFileName].fileSystemRepresentation) != 0)
+    {
+        close(fileDescriptor);
+        unlink(fileURL.fileSystemRepresentation);
+        return;
+    }
+    
+    close(_fileDescriptor);
+    _fileDescriptor = fileDescriptor;
+    _generation = generation;
+    _segmentLength = length;
+    _mapping = nil;
+    [_records setDictionary:records];
+    
+    [self saveIndex];
+}
+
+#pragma mark Private Methods
+
+- (NSURL*)mjz_URLForFileName:(NSString*)fileName
+{
+    return [_directoryURL URLByAppendingPathComponent:fileName];
+}
+
+- (int)mjz_createSegmentFileAtURL:(NSURL*)fileURL generation:(uint64_t*)generation
+{
+    int fileDescriptor = open(fileURL.fileSystemRepresentation, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fileDescriptor < 0)
+        return -1;
+    
+    HMHTTPCacheSegmentHeader header;
+    header.magic = HMHTTPCacheSegmentMagic;
+    header.version = HMHTTPCacheFormatVersion;
+    header.generation = ((uint64_t)arc4random() << 32) | arc4random();
+    
+    if (pwrite(fileDescriptor, &header, sizeof(header), 0) != sizeof(header))
+    {
+        close(fileDescriptor);
+        unlink(fileURL.fileSystemRepresentation);
+        return -1;
+    }
+    
+    *generation = header.generation;
+    return fileDescriptor;
+}
+
+- (BOOL)mjz_openSegment
+{
+    NSURL *fileURL = [self mjz_URLForFileName:HMHTTPCacheSegmentFileName];
+    _fileDescriptor = open(fileURL.fileSystemRepresentation, O_RDWR | O_CREAT, 0644);
+    if (_fileDescriptor < 0)
+        return NO;
+    
+    struct stat status;
+    HMHTTPCacheSegmentHeader header;
+    if (fstat(_fileDescriptor, &status) != 0 ||
+        status.st_size < (off_t)sizeof(header) ||
+        pread(_fileDescriptor, &header, sizeof(header), 0) != sizeof(header) ||
+        header.magic != HMHTTPCacheSegmentMagic ||
+        header.version != HMHTTPCacheFormatVersion)
+    {
+        // New or unreadable segment file: starting an empty one
+        _segmentLength = sizeof(header);
+        [self compact];
+        return _generation != 0;
+    }
+    
+    _generation = header.generation;
+    _segmentLength = (uint64_t)status.st_size;
+    
+    uint64_t offset = [self mjz_loadIndex];
+    [self mjz_replayRecordsFromOffset:offset];
+    
+    return YES;
+}
+
+/**
+ * Loads the saved index and returns the length of the segment file it covers.
+ **/
+- (uint64_t)mjz_loadIndex
+{
+    NSData *data = [NSData dataWithContentsOfURL:[self mjz_URLForFileName:HMHTTPCacheIndexFileName] options:NSDataReadingMappedIfSafe error:nil];
+    
+    HMHTTPCacheIndexHeader header;
+    if (data.length < sizeof(header))
+        return sizeof(HMHTTPCacheSegmentHeader);
+    
+    // An index of a previous segment file (i.e. saved before a compaction) is ignored
+    memcpy(&header, data.bytes, sizeof(header));
+    if (header.magic != HMHTTPCacheIndexMagic ||
+        header.version != HMHTTPCacheFormatVersion ||
+        header.generation != _generation ||
+        header.segmentLength < sizeof(HMHTTPCacheSegmentHeader) ||
+        header.segmentLength > _segmentLength)
+        return sizeof(HMHTTPCacheSegmentHeader);
+    
+    const uint8_t *bytes = data.bytes;
+    NSUInteger position = sizeof(header);
+    for (uint64_t i = 0; i < header.recordCount; ++i)
+    {
+        HMHTTPCacheIndexEntry entry;
+        if (data.length - position < sizeof(entry))
+            break;
+        memcpy(&entry, bytes + position, sizeof(entry));
+        position += sizeof(entry);
+        
+        if (data.length - position < entry.keyLength)
+            break;
+        NSString *key = [[NSString alloc] initWithBytes:bytes + position length:entry.keyLength encoding:NSUTF8StringEncoding];
+        position += entry.keyLength;
+        
+        HMHTTPCacheRecord *record = [HMHTTPCacheRecord new];
+        record.offset = entry.offset;
+        record.keyLength = entry.keyLength;
+        record.metadataLength = entry.metadataLength;
+        record.bodyLength = entry.bodyLength;
+        
+        if (!key || record.offset < sizeof(HMHTTPCacheSegmentHeader) || record.offset + record.size > header.segmentLength)
+            break;
+        
+        [self mjz_setRecord:record forKey:key];
+    }
+    
+    if (_records.count != header.recordCount)
+    {
+        // Corrupted index: replaying the whole segment file
+        [_records removeAllObjects];
+        [_usage removeAllObjects];
+        _liveSize = 0;
+        return sizeof(HMHTTPCacheSegmentHeader);
+    }
+    
+    return header.segmentLength;
+}
+
+/**
+ * Applies the records written after the given offset, discarding a partially written record at the end of the segment file.
+ **/
+- (void)mjz_replayRecordsFromOffset:(uint64_t)offset
+{
+    while (_segmentLength - offset >= sizeof(HMHTTPCacheRecordHeader))
+    {
+        HMHTTPCacheRecordHeader header;
+        if (pread(_fileDescriptor, &header, sizeof(header), (off_t)offset) != sizeof(header) || header.magic != HMHTTPCacheRecordMagic)
+            break;
+        
+        HMHTTPCacheRecord *record = [HMHTTPCacheRecord new];
+        record.offset = offset;
+        record.keyLength = header.keyLength;
+        record.metadataLength = header.metadataLength;
+        record.bodyLength = header.bodyLength;
+        if (record.bodyLength > _segmentLength || record.size > _segmentLength - offset)
+            break;
+        
+        NSMutableData *payload = [NSMutableData dataWithLength:(NSUInteger)(record.size - sizeof(header))];
+        if (pread(_fileDescriptor, payload.mutableBytes, payload.length, (off_t)(offset + sizeof(header))) != (ssize_t)payload.length)
+            break;
+        
+        NSData *keyData = [payload subdataWithRange:NSMakeRange(0, record.keyLength)];
+        NSData *metadata = [payload subdataWithRange:NSMakeRange(record.keyLength, record.metadataLength)];
+        NSData *body = [payload subdataWithRange:NSMakeRange(record.keyLength + record.metadataLength, (NSUInteger)record.bodyLength)];
+        NSString *key = [[NSString alloc] initWithData:keyData encoding:NSUTF8StringEncoding];
+        if (!key || header.checksum != HMHTTPCacheRecordChecksum(keyData, metadata, body))
+            break;
+        
+        if (header.type == HMHTTPCacheRecordTypeValue)
+            [self mjz_setRecord:record forKey:key];
+        else if (header.type == HMHTTPCacheRecordTypeTombstone)
+            [self mjz_setRecord:nil forKey:key];
+        else
+            break;
+        
+        offset += record.size;
+    }
+    
+    // Discarding the partially written record, if any. The file is not mapped yet.
+    if (offset < _segmentLength && ftruncate(_fileDescriptor, (off_t)offset) == 0)
+        _segmentLength = offset;
+}
+
+- (BOOL)mjz_appendRecordOfType:(HMHTTPCacheRecordType)type key:(NSData*)key metadata:(NSData*)metadata body:(NSData*)body offset:(uint64_t*)offset
+{
+    HMHTTPCacheRecordHeader header;
+    header.magic = HMHTTPCacheRecordMagic;
+    header.type = type;
+    header.keyLength = (uint32_t)key.length;
+    header.metadataLength = (uint32_t)metadata.length;
+    header.bodyLength = body.length;
+    header.checksum = HMHTTPCacheRecordChecksum(key, metadata, body);
+    header.reserved = 0;
+    
+    struct iovec vectors[4] = {
+        {&header, sizeof(header)},
+        {(void*)key.bytes, key.length},
+        {(void*)metadata.bytes, metadata.length},
+        {(void*)body.bytes, body.length},
+    };
+    size_t length = sizeof(header) + key.length + metadata.length + body.length;
+    
+    if (lseek(_fileDescriptor, (off_t)_segmentLength, SEEK_SET) < 0)
+        return NO;
+    
+    if (writev(_fileDescriptor, vectors, 4) != (ssize_t)length)
+    {
+        // Removing the partially written record. It cannot be mapped yet, as it is past the end of the known segment.
+        ftruncate(_fileDescriptor, (off_t)_segmentLength);
+        return NO;
+    }
+    
+    if (offset)
+        *offset = _segmentLength;
+    _segmentLength += length;
+    
+    return YES;
+}
+
+- (BOOL)mjz_mapLength:(uint64_t)length
+{
+    if (_mapping.length >= length)
+        return YES;
+    
+    // Mapping the whole segment file. The previous mapping is kept alive by its views, if any.
+    void *bytes = mmap(NULL, (size_t)_segmentLength, PROT_READ, MAP_SHARED, _fileDescriptor, 0);
+    if (bytes == MAP_FAILED)
+        return NO;
+    
+    _mapping = [[HMHTTPCacheMapping alloc] initWithBytes:bytes length:(size_t)_segmentLength];
+    return _mapping.length >= length;
+}
+
+- (void)mjz_setRecord:(HMHTTPCacheRecord*)record forKey:(NSString*)key
+{
+    HMHTTPCacheRecord *previousRecord = _records[key];
+    if (previousRecord)
+    {
+        _liveSize -= (NSUInteger)previousRecord.size;
+        [_usage removeObject:key];
+    }
+    
+    if (record)
+    {
+        _records[key] = record;
+        _liveSize += (NSUInteger)record.size;
+        [_usage addObject:key];
+    }
+    else
+    {
+        [_records removeObjectForKey:key];
+    }
+}
+
+- (void)mjz_trimToCapacity
+{
+    while (_liveSize > _capacity && _usage.count > 0)
+        [self removeRecordForKey:_usage.firstObject];
+}
+
+- (void)mjz_compactIfNeeded
+{
+    // Dead space: replaced and removed records, and tombstones
+    uint64_t deadSize = _segmentLength - sizeof(HMHTTPCacheSegmentHeader) - _liveSize;
+    if (deadSize > _capacity / 2)
+        [self compact];
+}
+
+@end
@@ -0,0 +1,79 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import <AFNetworking/AFNetworking.h>
+
+/**
+ * Response serializers conforming to this protocol consume the response body while it is being received, instead of receiving it all at once when the task completes.
+ **/
+@protocol HMStreamingResponseSerialization <AFURLResponseSerialization>
+
+/**
+ * Processes the next chunk of the response body.
+ * @param data The data chunk.
+ * @param response The response the data belongs to.
+ * @param task The task receiving the response. Serializers processing chunks asynchronously can suspend it while they are behind, and resume it once they catch up.
+ * @discussion Chunks of the same response are delivered sequentially and in order, on the session delegate queue shared by all tasks: this method must not block.
+ **/
+- (void)processData:(NSData*)data forResponse:(NSURLResponse*)response task:(NSURLSessionTask*)task;
+
+/**
+ * Discards any state associated to the given response. Called when the task fails before completing.
+ * @param response The response.
+ **/
+- (void)discardDataForResponse:(NSURLResponse*)response;
+
+@end
+
+/**
+ * The session manager used by HMClient.
+ * @discussion If the response serializer conforms to `HMStreamingResponseSerialization`, response bodies are not buffered: the received chunks are forwarded to the serializer and the `data` parameter of `responseObjectForResponse:data:error:` is empty.
+ * The download progress of data tasks is not updated in that case.
+ **/
+@interface HMHTTPSessionManager : AFHTTPSessionManager
+
+/** ************************************************* **
+ * @name Capturing response bodies
+ ** ************************************************* **/
+
+/**
+ * Keeps a copy of the raw response body of the given task, regardless of the response serializer.
+ * @param task The task, before being resumed.
+ * @discussion The captured body must be retrieved with `takeCapturedResponseDataForTask:` once the task completes.
+ **/
+- (void)captureResponseDataForTask:(NSURLSessionTask*)task;
+
+/**
+ * Returns the captured response body of the given task and stops capturing it.
+ * @param task The task.
+ * @return The received body, or nil if the task was not being captured.
+ **/
+- (NSData*)takeCapturedResponseDataForTask:(NSURLSessionTask*)task;
+
+/** ************************************************* **
+ * @name Consuming response bodies
+ ** ************************************************* **/
+
+/**
+ * Forwards the received chunks of the response body of the given task to a block, instead of buffering them.
+ * @param block The block, called sequentially for each chunk. It returns YES if it consumed the chunk, or NO to let the chunk be handled as usual (i.e. for error responses).
+ * @param task The task, before being resumed.
+ * @discussion The block is released once the task completes.
+ **/
+- (void)setDataBlock:(BOOL (^)(NSHTTPURLResponse *response, NSData *data))block forTask:(NSURLSessionTask*)task;
+
+@end
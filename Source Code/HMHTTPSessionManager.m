@@ -0,0 +1,116 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import "HMHTTPSessionManager.h"
+
+@implementation HMHTTPSessionManager
+{
+    NSMapTable <NSURLSessionTask*, NSMutableData*> *_capturedData;
+    NSMapTable <NSURLSessionTask*, BOOL (^)(NSHTTPURLResponse*, NSData*)> *_dataBlocks;
+}
+
+- (instancetype)initWithBaseURL:(NSURL *)url sessionConfiguration:(NSURLSessionConfiguration *)configuration
+{
+    self = [super initWithBaseURL:url sessionConfiguration:configuration];
+    if (self)
+    {
+        _capturedData = [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsStrongMemory|NSPointerFunctionsObjectPointerPersonality
+                                                  valueOptions:NSPointerFunctionsStrongMemory
+                                                      capacity:0];
+        _dataBlocks = [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsStrongMemory|NSPointerFunctionsObjectPointerPersonality
+                                                valueOptions:NSPointerFunctionsStrongMemory
+                                                    capacity:0];
+    }
+    return self;
+}
+
+#pragma mark Public Methods
+
+- (void)captureResponseDataForTask:(NSURLSessionTask*)task
+{
+    @synchronized (_capturedData)
+    {
+        [_capturedData setObject:[NSMutableData data] forKey:task];
+    }
+}
+
+- (NSData*)takeCapturedResponseDataForTask:(NSURLSessionTask*)task
+{
+    @synchronized (_capturedData)
+    {
+        NSData *data = [_capturedData objectForKey:task];
+        [_capturedData removeObjectForKey:task];
+        return data;
+    }
+}
+
+- (void)setDataBlock:(BOOL (^)(NSHTTPURLResponse *response, NSData *data))block forTask:(NSURLSessionTask*)task
+{
+    @synchronized (_dataBlocks)
+    {
+        if (block)
+            [_dataBlocks setObject:[block copy] forKey:task];
+        else
+            [_dataBlocks removeObjectForKey:task];
+    }
+}
+
+#pragma mark - NSURLSessionDataDelegate
+
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveData:(NSData *)data
+{
+    BOOL (^dataBlock)(NSHTTPURLResponse*, NSData*) = nil;
+    @synchronized (_dataBlocks)
+    {
+        dataBlock = [_dataBlocks objectForKey:dataTask];
+    }
+    
+    if (dataBlock && [dataTask.response isKindOfClass:NSHTTPURLResponse.class] && dataBlock((NSHTTPURLResponse*)dataTask.response, data))
+        return;
+    
+    @synchronized (_capturedData)
+    {
+        [[_capturedData objectForKey:dataTask] appendData:data];
+    }
+    
+    id serializer = self.responseSerializer;
+    if (dataTask.response && [serializer conformsToProtocol:@protocol(HMStreamingResponseSerialization)])
+    {
+        [serializer processData:data forResponse:dataTask.response task:dataTask];
+        return;
+    }
+    
+    [super URLSession:session dataTask:dataTask didReceiveData:data];
+}
+
+#pragma mark - NSURLSessionTaskDelegate
+
+- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didCompleteWithError:(NSError *)error
+{
+    @synchronized (_dataBlocks)
+    {
+        [_dataBlocks removeObjectForKey:task];
+    }
+    
+    id serializer = self.responseSerializer;
+    if (error && task.response && [serializer conformsToProtocol:@protocol(HMStreamingResponseSerialization)])
+        [serializer discardDataForResponse:task.response];
+    
+    [super URLSession:session task:task didCompleteWithError:error];
+}
+
+@end
@@ -16,6 +16,8 @@
 
 #import <AFNetworking/AFNetworking.h>
 
+#import "HMHTTPSessionManager.h"
+
 /**
  * The key of the HTTP response body that will be added in the `NSError` when a request failes.
  **/
@@ -27,4 +29,27 @@ extern NSString * const HMJSONResponseSerializerBodyKey;
  **/
 @interface HMJSONResponseSerializer : AFJSONResponseSerializer
 
+/**
+ * If YES, successful responses are validated but not decoded: the response object is the raw body `NSData` (or nil if the body is empty), to be decoded later using `JSONObjectWithData:error:`. Default value is NO.
+ * @discussion Error responses are always decoded, in order to include the body in the error. Not supported by `HMStreamingJSONResponseSerializer`.
+ **/
+@property (nonatomic, assign) BOOL defersDecoding;
+
+/**
+ * Decodes a response body using the reading options of the serializer.
+ * @param data The response body.
+ * @param error An error pointer set if the body is not valid JSON.
+ * @return The decoded object, or nil if the body is empty or not valid JSON.
+ **/
+- (id)JSONObjectWithData:(NSData*)data error:(NSError**)error;
+
+@end
+
+/**
+ * A JSON response serializer that parses the response body incrementally while it is being received.
+ * @discussion Must be used with a `HMHTTPSessionManager`. Each response is parsed on its own serial queue, so the raw body is never buffered entirely in memory and parsing overlaps with the download. If parsing falls behind, the task is suspended until the pending chunks are parsed, without blocking the other tasks of the session.
+ * The parsed objects are equivalent to the ones returned by `HMJSONResponseSerializer`. Response bodies must be UTF-8 encoded.
+ **/
+@interface HMStreamingJSONResponseSerializer : HMJSONResponseSerializer <HMStreamingResponseSerialization>
+
 @end
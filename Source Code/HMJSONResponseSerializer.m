@@ -15,9 +15,34 @@
 //
 
 #import "HMJSONResponseSerializer.h"
+#import "HMStreamingJSONParser.h"
 
 NSString * const HMJSONResponseSerializerBodyKey = @"HMJSONResponseSerializerBodyKey";
 
+static id HMJSONObjectByRemovingKeysWithNullValues(id JSONObject, NSJSONReadingOptions readingOptions)
+{
+    if ([JSONObject isKindOfClass:NSArray.class])
+    {
+        NSMutableArray *mutableArray = [NSMutableArray arrayWithCapacity:[JSONObject count]];
+        for (id value in JSONObject)
+            [mutableArray addObject:HMJSONObjectByRemovingKeysWithNullValues(value, readingOptions)];
+        
+        return (readingOptions & NSJSONReadingMutableContainers) ? mutableArray : [mutableArray copy];
+    }
+    else if ([JSONObject isKindOfClass:NSDictionary.class])
+    {
+        NSMutableDictionary *mutableDictionary = [NSMutableDictionary dictionaryWithCapacity:[JSONObject count]];
+        [JSONObject enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+            if (value && ![value isEqual:[NSNull null]])
+                mutableDictionary[key] = HMJSONObjectByRemovingKeysWithNullValues(value, readingOptions);
+        }];
+        
+        return (readingOptions & NSJSONReadingMutableContainers) ? mutableDictionary : [mutableDictionary copy];
+    }
+    
+    return JSONObject;
+}
+
 @implementation HMJSONResponseSerializer
 
 - (id)responseObjectForResponse:(NSURLResponse *)response
@@ -41,7 +66,242 @@ NSString * const HMJSONResponseSerializerBodyKey = @"HMJSONResponseSerializerBod
         return nil;
     }
     
+    if (_defersDecoding)
+        return data.length > 0 ? data : nil;
+    
     return [super responseObjectForResponse:response data:data error:error];
 }
 
+- (id)JSONObjectWithData:(NSData*)data error:(NSError**)error
+{
+    // Same as AFJSONResponseSerializer: empty and single space bodies are not decoded.
+    if (data.length == 0 || (data.length == 1 && ((const char*)data.bytes)[0] == ' '))
+        return nil;
+    
+    id jsonObject = [NSJSONSerialization JSONObjectWithData:data options:self.readingOptions error:error];
+    
+    if (jsonObject && self.removesKeysWithNullValues)
+        jsonObject = HMJSONObjectByRemovingKeysWithNullValues(jsonObject, self.readingOptions);
+    
+    return jsonObject;
+}
+
+#pragma mark NSCopying
+
+- (instancetype)copyWithZone:(NSZone *)zone
+{
+    HMJSONResponseSerializer *serializer = [super copyWithZone:zone];
+    serializer.defersDecoding = _defersDecoding;
+    return serializer;
+}
+
+@end
+
+/* ************************************************************************************************** */
+#pragma mark -
+
+/**
+ * The maximum number of received chunks waiting to be parsed. When reached, the task is suspended until the parser catches up.
+ **/
+static const NSUInteger HMStreamingJSONMaxPendingChunkCount = 4;
+
+/**
+ * Parses the body of a single response on its own serial queue.
+ **/
+@interface HMStreamingJSONParsingContext : NSObject
+
+- (instancetype)initWithReadingOptions:(NSJSONReadingOptions)options;
+
+- (void)appendData:(NSData*)data forTask:(NSURLSessionTask*)task;
+- (id)finishWithError:(NSError**)error;
+
+@end
+
+@implementation HMStreamingJSONParsingContext
+{
+    HMStreamingJSONParser *_parser;
+    dispatch_queue_t _queue;
+    NSUInteger _pendingChunkCount;
+    NSURLSessionTask *_suspendedTask;
+}
+
+- (instancetype)initWithReadingOptions:(NSJSONReadingOptions)options
+{
+    self = [super init];
+    if (self)
+    {
+        _parser = [[HMStreamingJSONParser alloc] initWithReadingOptions:options];
+        _queue = dispatch_queue_create("com.mobilejazz.hermod.json-parsing", DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+
+- (void)appendData:(NSData*)data forTask:(NSURLSessionTask*)task
+{
+    // The session delegate queue is shared by all tasks and must not be blocked:
+    // instead, the task is suspended while the parser is behind, so the raw body does not pile up in memory.
+    @synchronized (self)
+    {
+        _pendingChunkCount += 1;
+        if (_pendingChunkCount >= HMStreamingJSONMaxPendingChunkCount && !_suspendedTask && task.state == NSURLSessionTaskStateRunning)
+        {
+            _suspendedTask = task;
+            [task suspend];
+        }
+    }
+    
+    HMStreamingJSONParser *parser = _parser;
+    dispatch_async(_queue, ^{
+        [parser appendData:data error:nil];
+        [self mjz_didParseChunk];
+    });
+}
+- (id)finishWithError:(NSError**)error
+{
+    __block id object = nil;
+    __block NSError *parsingError = nil;
+    
+    // Waiting for all pending chunks to be parsed
+    HMStreamingJSONParser *parser = _parser;
+    dispatch_sync(_queue, ^{
+        object = [parser finishWithError:&parsingError];
+    });
+    
+    if (error)
+        *error = parsingError;
+    
+    return object;
+}
+
+#pragma mark Private Methods
+
+- (void)mjz_didParseChunk
+{
+    @synchronized (self)
+    {
+        _pendingChunkCount -= 1;
+        
+        // Resuming the task once all pending chunks are parsed
+        if (_pendingChunkCount == 0 && _suspendedTask)
+        {
+            [_suspendedTask resume];
+            _suspendedTask = nil;
+        }
+    }
+}
+
+@end
+
+/* ************************************************************************************************** */
+#pragma mark -
+
+@implementation HMStreamingJSONResponseSerializer
+{
+    NSMapTable <NSURLResponse*, HMStreamingJSONParsingContext*> *_contexts;
+}
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        _contexts = [self mjz_contextsMapTable];
+    }
+    return self;
+}
+
+- (instancetype)initWithCoder:(NSCoder *)decoder
+{
+    self = [super initWithCoder:decoder];
+    if (self)
+    {
+        _contexts = [self mjz_contextsMapTable];
+    }
+    return self;
+}
+
+- (id)responseObjectForResponse:(NSURLResponse *)response
+                           data:(NSData *)data
+                          error:(NSError *__autoreleasing *)error
+{
+    HMStreamingJSONParsingContext *context = nil;
+    @synchronized(_contexts)
+    {
+        context = [_contexts objectForKey:response];
+        if (context)
+            [_contexts removeObjectForKey:response];
+    }
+    
+    // The body has not been streamed (i.e. the serializer is not used by a HMHTTPSessionManager).
+    if (!context && data.length > 0)
+        return [super responseObjectForResponse:response data:data error:error];
+    
+    NSError *parsingError = nil;
+    id jsonObject = [context finishWithError:&parsingError];
+    
+    if (![self validateResponse:(NSHTTPURLResponse *)response data:data error:error])
+    {
+        if (error && *error != nil)
+        {
+            NSMutableDictionary *userInfo = [(*error).userInfo mutableCopy];
+            
+            if (jsonObject)
+                userInfo[HMJSONResponseSerializerBodyKey] = jsonObject;
+            
+            *error = [NSError errorWithDomain:(*error).domain code:(*error).code userInfo:[userInfo copy]];
+        }
+        
+        return nil;
+    }
+    
+    if (!jsonObject)
+    {
+        if (error)
+            *error = parsingError;
+        
+        return nil;
+    }
+    
+    if (self.removesKeysWithNullValues)
+        jsonObject = HMJSONObjectByRemovingKeysWithNullValues(jsonObject, self.readingOptions);
+    
+    return jsonObject;
+}
+
+#pragma mark HMStreamingResponseSerialization
+
+- (void)processData:(NSData*)data forResponse:(NSURLResponse*)response task:(NSURLSessionTask*)task
+{
+    HMStreamingJSONParsingContext *context = nil;
+    @synchronized(_contexts)
+    {
+        context = [_contexts objectForKey:response];
+        if (!context)
+        {
+            context = [[HMStreamingJSONParsingContext alloc] initWithReadingOptions:self.readingOptions];
+            [_contexts setObject:context forKey:response];
+        }
+    }
+    
+    [context appendData:data forTask:task];
+}
+
+- (void)discardDataForResponse:(NSURLResponse*)response
+{
+    @synchronized(_contexts)
+    {
+        [_contexts removeObjectForKey:response];
+    }
+}
+
+#pragma mark Private Methods
+
+- (NSMapTable*)mjz_contextsMapTable
+{
+    // Responses are compared by pointer and not retained.
+    return [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsWeakMemory | NSPointerFunctionsObjectPointerPersonality
+                                     valueOptions:NSPointerFunctionsStrongMemory
+                                         capacity:0];
+}
+
 @end
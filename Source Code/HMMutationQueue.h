@@ -0,0 +1,141 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import <Foundation/Foundation.h>
+
+#import "HMRequestExecutor.h"
+
+@protocol HMMutationQueueDelegate;
+
+/**
+ * A store-and-forward queue of mutating requests (POST, PUT, PATCH and DELETE).
+ * @discussion Mutating requests that cannot reach the server (no connection, unknown host) are persisted and replayed in order once the network returns. While requests are queued, new mutating requests are queued after them, as well as while a request of a related path sent directly has not finished yet (it is queued first if it does not reach the server). Other requests are performed directly by the request executor.
+ * Before being replayed, superseded requests are compacted: a PUT or DELETE removes the queued PUT and PATCH requests of the same path, unless a request of a related path (the same path or a sub-path) is queued in between. The completion blocks of the removed requests are called with the response of the request that superseded them.
+ * Requests are replayed with a bounded concurrency. A request is not started until the previous requests of related paths have finished. Requests failing with a connectivity error did not reach the server: they are kept in the queue and retried later.
+ * Idempotent requests (PUT and DELETE) failing with a server error (5xx, 429) are retried too, up to `maximumRetryCount` times. POST and PATCH requests are not retried after reaching the server, as the server might have applied them already.
+ * Completion blocks are kept in memory: requests restored from disk are notified to the delegate only. This class is thread safe.
+ **/
+@interface HMMutationQueue : NSObject <HMRequestExecutor>
+
+/** ************************************************* **
+ * @name Initializers
+ ** ************************************************* **/
+
+/**
+ * Default initializer. Restores the requests queued in the given file, if any.
+ * @param requestExecutor The request executor performing the requests (i.e. an HMClient or an HMOAuthSession).
+ * @param fileURL The file where the queued requests are persisted.
+ * @return The initialized instance.
+ **/
+- (instancetype)initWithRequestExecutor:(id <HMRequestExecutor>)requestExecutor fileURL:(NSURL*)fileURL;
+
+/**
+ * The request executor performing the requests.
+ **/
+@property (nonatomic, strong, readonly) id <HMRequestExecutor> requestExecutor;
+
+/**
+ * The file where the queued requests are persisted.
+ **/
+@property (nonatomic, strong, readonly) NSURL *fileURL;
+
+/**
+ * The maximum number of requests replayed at the same time. Default value is 2.
+ **/
+@property (nonatomic, assign) NSUInteger maximumConcurrentReplays;
+
+/**
+ * The maximum number of times an idempotent request failing with a server error (5xx, 429) is retried. Once reached, its callers get the error. Default value is 3.
+ **/
+@property (nonatomic, assign) NSUInteger maximumRetryCount;
+
+/**
+ * Time to wait before replaying again after a failed replay. Default value is 30 seconds.
+ * @discussion The queue is also replayed when the network becomes reachable.
+ **/
+@property (nonatomic, assign) NSTimeInterval retryTimeInterval;
+
+/**
+ * The delegate.
+ **/
+@property (nonatomic, weak) id <HMMutationQueueDelegate> delegate;
+
+/** ************************************************* **
+ * @name Managing the queue
+ ** ************************************************* **/
+
+/**
+ * Queues a mutating request, even if the network is reachable. It is sent when replaying the queue.
+ * @param request The request.
+ * @param apiPath A custom API path, or nil to use the default one.
+ * @param completionBlock The completion block, called once the request (or the request superseding it) has been replayed.
+ * @return A handle that can be used to cancel the request. Queued requests are not sent once cancelled, unless they superseded other requests.
+ **/
+- (HMRequestHandle*)enqueueRequest:(HMRequest*)request apiPath:(NSString*)apiPath completionBlock:(HMResponseBlock)completionBlock;
+
+/**
+ * Replays the queued requests, if the network is reachable.
+ **/
+- (void)replay;
+
+/**
+ * Writes the queued requests to disk and waits until done.
+ **/
+- (void)flush;
+
+/**
+ * The number of queued requests, including the ones being replayed.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger queuedRequestCount;
+
+/** ************************************************* **
+ * @name Statistics
+ ** ************************************************* **/
+
+/**
+ * Number of requests sent when replaying the queue.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger replayedRequestCount;
+
+/**
+ * Number of superseded requests removed from the queue before being sent.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger compactedRequestCount;
+
+/**
+ * Number of redundant writes sent: replayed requests that were superseded by a later request while being sent, too late to be compacted.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger redundantWriteCount;
+
+@end
+
+/**
+ * Delegate of the mutation queue.
+ **/
+@protocol HMMutationQueueDelegate <NSObject>
+
+@optional
+
+/**
+ * Called when a queued request has been replayed (successfully or with an error that is not retried).
+ * @param mutationQueue The mutation queue.
+ * @param request The replayed request.
+ * @param response The response.
+ **/
+- (void)mutationQueue:(HMMutationQueue*)mutationQueue didReplayRequest:(HMRequest*)request response:(HMResponse*)response;
+
+@end
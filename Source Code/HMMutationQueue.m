@@ -0,0 +1,640 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import "HMMutationQueue.h"
+
+#import <AFNetworking/AFNetworking.h>
+
+#import "HMUploadRequest.h"
+
+/**
+ * Returns YES if the error means that the request did not reach the server.
+ **/
+static BOOL HMErrorIsConnectivityError(NSError *error)
+{
+    if (![error.domain isEqualToString:NSURLErrorDomain])
+        return NO;
+    
+    switch (error.code)
+    {
+        case NSURLErrorNotConnectedToInternet:
+        case NSURLErrorCannotFindHost:
+        case NSURLErrorCannotConnectToHost:
+        case NSURLErrorDNSLookupFailed:
+        case NSURLErrorInternationalRoamingOff:
+        case NSURLErrorDataNotAllowed:
+            return YES;
+        default:
+            return NO;
+    }
+}
+
+/**
+ * Returns YES if both paths are the same or one is a sub-path of the other.
+ **/
+static BOOL HMPathsAreRelated(NSString *path1, NSString *path2)
+{
+    NSCharacterSet *slashes = [NSCharacterSet characterSetWithCharactersInString:@"/"];
+    path1 = [path1 stringByTrimmingCharactersInSet:slashes] ?: @"";
+    path2 = [path2 stringByTrimmingCharactersInSet:slashes] ?: @"";
+    
+    if (path1.length > path2.length)
+    {
+        NSString *path = path1;
+        path1 = path2;
+        path2 = path;
+    }
+    
+    if ([path1 isEqualToString:path2] || path1.length == 0)
+        return YES;
+    
+    return [path2 hasPrefix:[path1 stringByAppendingString:@"/"]];
+}
+
+#pragma mark -
+
+/**
+ * A caller waiting for a queued request.
+ **/
+@interface HMMutationQueueCompletion : NSObject
+
+@property (nonatomic, strong) HMRequestHandle *handle;
+@property (nonatomic, copy) HMResponseBlock completionBlock;
+
+@end
+
+@implementation HMMutationQueueCompletion
+
+@end
+
+#pragma mark -
+
+/**
+ * A queued request.
+ **/
+@interface HMMutationQueueItem : NSObject <NSCoding>
+
+@property (nonatomic, assign) uint64_t sequence;
+@property (nonatomic, strong) HMRequest *request;
+@property (nonatomic, strong) NSString *apiPath;
+@property (nonatomic, assign) NSUInteger retryCount;
+
+// Not persisted
+@property (nonatomic, strong) HMRequestHandle *handle;
+@property (nonatomic, strong) NSMutableArray <HMMutationQueueCompletion*> *completions;
+
+@end
+
+@implementation HMMutationQueueItem
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        _completions = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (instancetype)initWithCoder:(NSCoder *)coder
+{
+    self = [self init];
+    if (self)
+    {
+        _sequence = [coder decodeInt64ForKey:@"sequence"];
+        _request = [coder decodeObjectForKey:@"request"];
+        _apiPath = [coder decodeObjectForKey:@"apiPath"];
+        _retryCount = [coder decodeIntegerForKey:@"retryCount"];
+    }
+    return self;
+}
+
+- (void)encodeWithCoder:(NSCoder *)coder
+{
+    [coder encodeInt64:_sequence forKey:@"sequence"];
+    [coder encodeObject:_request forKey:@"request"];
+    [coder encodeObject:_apiPath forKey:@"apiPath"];
+    [coder encodeInteger:_retryCount forKey:@"retryCount"];
+}
+
+- (BOOL)isRelatedToItem:(HMMutationQueueItem*)item
+{
+    return (_apiPath == item.apiPath || [_apiPath isEqualToString:item.apiPath]) && HMPathsAreRelated(_request.path, item.request.path);
+}
+
+- (BOOL)hasSameResourceAsItem:(HMMutationQueueItem*)item
+{
+    return (_apiPath == item.apiPath || [_apiPath isEqualToString:item.apiPath]) && [_request.path isEqualToString:item.request.path];
+}
+
+@end
+
+#pragma mark -
+
+@implementation HMMutationQueue
+{
+    NSMutableArray <HMMutationQueueItem*> *_pendingItems; // In queue order
+    NSMutableArray <HMMutationQueueItem*> *_replayingItems;
+    NSMutableArray <HMMutationQueueItem*> *_directItems; // Sent directly, queued if they do not reach the server
+    uint64_t _nextSequence;
+    BOOL _suspended;
+    BOOL _retryScheduled;
+    
+    dispatch_queue_t _persistenceQueue;
+}
+
+- (instancetype)init
+{
+    return [self initWithRequestExecutor:nil fileURL:nil];
+}
+
+- (instancetype)initWithRequestExecutor:(id <HMRequestExecutor>)requestExecutor fileURL:(NSURL*)fileURL
+{
+    self = [super init];
+    if (self)
+    {
+        _requestExecutor = requestExecutor;
+        _fileURL = fileURL;
+        _maximumConcurrentReplays = 2;
+        _maximumRetryCount = 3;
+        _retryTimeInterval = 30;
+        
+        _pendingItems = [NSMutableArray array];
+        _replayingItems = [NSMutableArray array];
+        _directItems = [NSMutableArray array];
+        _persistenceQueue = dispatch_queue_create("com.mobilejazz.hermod.mutation-queue", DISPATCH_QUEUE_SERIAL);
+        
+        // Restoring the requests queued in a previous session
+        NSData *data = fileURL ? [NSData dataWithContentsOfURL:fileURL] : nil;
+        NSArray *items = nil;
+        @try
+        {
+            items = data ? [NSKeyedUnarchiver unarchiveObjectWithData:data] : nil;
+        }
+        @catch (NSException *exception)
+        {
+            items = nil;
+        }
+        
+        for (HMMutationQueueItem *item in items)
+        {
+            if (![item isKindOfClass:HMMutationQueueItem.class] || !item.request)
+                continue;
+            
+            [_pendingItems addObject:item];
+            _nextSequence = MAX(_nextSequence, item.sequence + 1);
+        }
+        
+        [[AFNetworkReachabilityManager sharedManager] startMonitoring];
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(mjz_reachabilityDidChange:) name:AFNetworkingReachabilityDidChangeNotification object:nil];
+        
+        if (_pendingItems.count > 0)
+        {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [self replay];
+            });
+        }
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+#pragma mark Properties
+
+- (NSUInteger)queuedRequestCount
+{
+    @synchronized (self)
+    {
+        return _pendingItems.count + _replayingItems.count;
+    }
+}
+
+#pragma mark Public Methods
+
+- (HMRequestHandle*)enqueueRequest:(HMRequest*)request apiPath:(NSString*)apiPath completionBlock:(HMResponseBlock)completionBlock
+{
+    HMRequestHandle *handle = [[HMRequestHandle alloc] initWithRequest:request];
+    [self mjz_enqueueRequest:request apiPath:apiPath handle:handle completionBlock:completionBlock];
+    [self mjz_replayPendingItems];
+    return handle;
+}
+
+- (void)replay
+{
+    @synchronized (self)
+    {
+        _suspended = NO;
+    }
+    
+    [self mjz_replayPendingItems];
+}
+
+- (void)flush
+{
+    dispatch_sync(_persistenceQueue, ^{ });
+}
+
+#pragma mark Private Methods
+
+- (BOOL)mjz_isQueueableRequest:(HMRequest*)request
+{
+    // Streamed uploads cannot be persisted
+    if ([request isKindOfClass:HMUploadRequest.class])
+        return NO;
+    
+    switch (request.httpMethod)
+    {
+        case HMHTTPMethodPOST:
+        case HMHTTPMethodPUT:
+        case HMHTTPMethodPATCH:
+        case HMHTTPMethodDELETE:
+            return YES;
+        default:
+            return NO;
+    }
+}
+
+- (HMRequestHandle*)mjz_performRequest:(HMRequest*)request apiPath:(NSString*)apiPath completionBlock:(HMResponseBlock)completionBlock
+{
+    // A nil API path stands for the default API path of the executor (also once restored from disk)
+    if (!apiPath)
+        return [_requestExecutor performRequest:request completionBlock:completionBlock];
+    
+    return [_requestExecutor performRequest:request apiPath:apiPath completionBlock:completionBlock];
+}
+
+- (BOOL)mjz_isReachable
+{
+    return [AFNetworkReachabilityManager sharedManager].networkReachabilityStatus != AFNetworkReachabilityStatusNotReachable;
+}
+
+- (void)mjz_enqueueRequest:(HMRequest*)request apiPath:(NSString*)apiPath handle:(HMRequestHandle*)handle completionBlock:(HMResponseBlock)completionBlock
+{
+    HMMutationQueueItem *item = [HMMutationQueueItem new];
+    item.request = [request copy];
+    item.apiPath = apiPath;
+    item.handle = handle;
+    
+    HMMutationQueueCompletion *completion = [HMMutationQueueCompletion new];
+    completion.handle = handle;
+    completion.completionBlock = completionBlock;
+    [item.completions addObject:completion];
+    
+    @synchronized (self)
+    {
+        item.sequence = _nextSequence++;
+        [self mjz_compactWithItem:item];
+        [_pendingItems addObject:item];
+        [self mjz_persist];
+    }
+    
+    if (![handle setCancellationBlock:^{ [self mjz_cancelCompletion:completion]; }])
+        [self mjz_cancelCompletion:completion];
+}
+
+/**
+ * Removes the pending requests superseded by the given one. Must be called inside a @synchronized(self) block.
+ **/
+- (void)mjz_compactWithItem:(HMMutationQueueItem*)item
+{
+    HMHTTPMethod httpMethod = item.request.httpMethod;
+    if (httpMethod != HMHTTPMethodPUT && httpMethod != HMHTTPMethodDELETE)
+        return;
+    
+    // Scanning backwards, until a request of a related path that cannot be superseded
+    NSMutableIndexSet *indexes = [NSMutableIndexSet indexSet];
+    for (NSInteger index = _pendingItems.count - 1; index >= 0; --index)
+    {
+        HMMutationQueueItem *pendingItem = _pendingItems[index];
+        if (![pendingItem isRelatedToItem:item])
+            continue;
+        
+        HMHTTPMethod pendingMethod = pendingItem.request.httpMethod;
+        if (![pendingItem hasSameResourceAsItem:item] || (pendingMethod != HMHTTPMethodPUT && pendingMethod != HMHTTPMethodPATCH))
+            break;
+        
+        [indexes addIndex:index];
+        [item.completions addObjectsFromArray:pendingItem.completions];
+    }
+    
+    [_pendingItems removeObjectsAtIndexes:indexes];
+    _compactedRequestCount += indexes.count;
+    
+    // Requests being sent cannot be removed anymore
+    for (HMMutationQueueItem *replayingItem in _replayingItems)
+    {
+        HMHTTPMethod replayingMethod = replayingItem.request.httpMethod;
+        if ([replayingItem hasSameResourceAsItem:item] && (replayingMethod == HMHTTPMethodPUT || replayingMethod == HMHTTPMethodPATCH))
+            _redundantWriteCount += 1;
+    }
+}
+
+- (void)mjz_cancelCompletion:(HMMutationQueueCompletion*)completion
+{
+    @synchronized (self)
+    {
+        for (HMMutationQueueItem *item in _pendingItems)
+        {
+            if (![item.completions containsObject:completion])
+                continue;
+            
+            [item.completions removeObject:completion];
+            
+            // The request is not sent, unless other callers are waiting for it
+            if (item.handle == completion.handle && item.completions.count == 0)
+            {
+                [_pendingItems removeObject:item];
+                [self mjz_persist];
+            }
+            break;
+        }
+        
+        for (HMMutationQueueItem *item in _replayingItems)
+            [item.completions removeObject:completion];
+    }
+    
+    if ([completion.handle markAsCompleted] && completion.completionBlock)
+        completion.completionBlock([completion.handle cancelledResponse]);
+}
+
+- (void)mjz_replayPendingItems
+{
+    NSMutableArray *items = [NSMutableArray array];
+    
+    @synchronized (self)
+    {
+        if (_suspended || ![self mjz_isReachable])
+            return;
+        
+        NSUInteger index = 0;
+        while (_replayingItems.count < _maximumConcurrentReplays && index < _pendingItems.count)
+        {
+            HMMutationQueueItem *item = _pendingItems[index];
+            
+            // Waiting for the previous requests of related paths
+            BOOL waits = NO;
+            for (HMMutationQueueItem *replayingItem in _replayingItems)
+                waits = waits || [replayingItem isRelatedToItem:item];
+            for (HMMutationQueueItem *directItem in _directItems)
+                waits = waits || [directItem isRelatedToItem:item];
+            for (NSUInteger previousIndex = 0; previousIndex < index && !waits; ++previousIndex)
+                waits = [_pendingItems[previousIndex] isRelatedToItem:item];
+            
+            if (waits)
+            {
+                index += 1;
+                continue;
+            }
+            
+            [_pendingItems removeObjectAtIndex:index];
+            [_replayingItems addObject:item];
+            [items addObject:item];
+            _replayedRequestCount += 1;
+        }
+    }
+    
+    for (HMMutationQueueItem *item in items)
+    {
+        [self mjz_performRequest:item.request apiPath:item.apiPath completionBlock:^(HMResponse *response) {
+            [self mjz_didReplayItem:item response:response];
+        }];
+    }
+}
+
+- (void)mjz_didReplayItem:(HMMutationQueueItem*)item response:(HMResponse*)response
+{
+    NSInteger statusCode = response.httpResponse.statusCode;
+    HMHTTPMethod httpMethod = item.request.httpMethod;
+    BOOL isIdempotent = httpMethod == HMHTTPMethodPUT || httpMethod == HMHTTPMethodDELETE;
+    BOOL isServerError = statusCode >= 500 || statusCode == 429;
+    
+    NSArray *completions = nil;
+    BOOL retries = NO;
+    @synchronized (self)
+    {
+        [_replayingItems removeObject:item];
+        
+        // Requests that did not reach the server are always retried. Server errors only for idempotent requests, a limited number of times.
+        if (HMErrorIsConnectivityError(response.error))
+        {
+            retries = YES;
+        }
+        else if (isServerError && isIdempotent && item.retryCount < _maximumRetryCount)
+        {
+            item.retryCount += 1;
+            retries = YES;
+        }
+        
+        if (retries)
+        {
+            // Back to its position in the queue, waiting for the next replay
+            [self mjz_insertPendingItem:item];
+            _suspended = YES;
+            [self mjz_persist];
+        }
+        else
+        {
+            completions = [item.completions copy];
+            [item.completions removeAllObjects];
+            [self mjz_persist];
+        }
+    }
+    
+    if (retries)
+    {
+        [self mjz_scheduleRetry];
+        return;
+    }
+    
+    for (HMMutationQueueCompletion *completion in completions)
+    {
+        if ([completion.handle markAsCompleted] && completion.completionBlock)
+            completion.completionBlock(response);
+    }
+    
+    if ([_delegate respondsToSelector:@selector(mutationQueue:didReplayRequest:response:)])
+        [_delegate mutationQueue:self didReplayRequest:item.request response:response];
+    
+    [self mjz_replayPendingItems];
+}
+
+- (void)mjz_didPerformDirectItem:(HMMutationQueueItem*)item response:(HMResponse*)response
+{
+    HMRequestHandle *handle = item.handle;
+    HMMutationQueueCompletion *completion = item.completions.firstObject;
+    
+    // The request did not reach the server: queueing it before the requests queued while it was being sent
+    BOOL enqueues = HMErrorIsConnectivityError(response.error) && !handle.isCancelled;
+    @synchronized (self)
+    {
+        [_directItems removeObject:item];
+        
+        if (enqueues)
+        {
+            [self mjz_insertPendingItem:item];
+            _suspended = YES;
+            [self mjz_persist];
+        }
+    }
+    
+    if (enqueues)
+    {
+        if (![handle setCancellationBlock:^{ [self mjz_cancelCompletion:completion]; }])
+            [self mjz_cancelCompletion:completion];
+        
+        [self mjz_scheduleRetry];
+        return;
+    }
+    
+    if ([handle markAsCompleted] && completion.completionBlock)
+        completion.completionBlock(response);
+    
+    // Queued requests of related paths might be waiting for this one
+    [self mjz_replayPendingItems];
+}
+
+- (void)mjz_scheduleRetry
+{
+    @synchronized (self)
+    {
+        if (_retryScheduled)
+            return;
+        _retryScheduled = YES;
+    }
+    
+    __weak HMMutationQueue *weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_retryTimeInterval * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        HMMutationQueue *strongSelf = weakSelf;
+        if (!strongSelf)
+            return;
+        
+        @synchronized (strongSelf)
+        {
+            strongSelf->_retryScheduled = NO;
+        }
+        [strongSelf replay];
+    });
+}
+
+/**
+ * Inserts the item in the pending items by sequence. Must be called inside a @synchronized(self) block.
+ **/
+- (void)mjz_insertPendingItem:(HMMutationQueueItem*)item
+{
+    NSUInteger index = [_pendingItems indexOfObjectPassingTest:^BOOL(HMMutationQueueItem *pendingItem, NSUInteger idx, BOOL *stop) {
+        return pendingItem.sequence > item.sequence;
+    }];
+    [_pendingItems insertObject:item atIndex:index == NSNotFound ? _pendingItems.count : index];
+}
+
+/**
+ * Writes the queued requests in background. Must be called inside a @synchronized(self) block.
+ **/
+- (void)mjz_persist
+{
+    if (!_fileURL)
+        return;
+    
+    NSArray *items = [_replayingItems arrayByAddingObjectsFromArray:_pendingItems];
+    items = [items sortedArrayUsingComparator:^NSComparisonResult(HMMutationQueueItem *item1, HMMutationQueueItem *item2) {
+        return [@(item1.sequence) compare:@(item2.sequence)];
+    }];
+    
+    NSURL *fileURL = _fileURL;
+    dispatch_async(_persistenceQueue, ^{
+        NSData *data = [NSKeyedArchiver archivedDataWithRootObject:items];
+        [data writeToURL:fileURL options:NSDataWritingAtomic error:nil];
+    });
+}
+
+- (void)mjz_reachabilityDidChange:(NSNotification*)notification
+{
+    if ([self mjz_isReachable])
+        [self replay];
+}
+
+#pragma mark - Protocols
+#pragma mark HMRequestExecutor
+
+- (HMRequestHandle*)performRequest:(HMRequest*)request completionBlock:(HMResponseBlock)completionBlock
+{
+    return [self performRequest:request apiPath:nil completionBlock:completionBlock];
+}
+
+- (HMRequestHandle*)performRequest:(HMRequest*)request apiPath:(NSString*)apiPath completionBlock:(HMResponseBlock)completionBlock
+{
+    if (!request)
+    {
+        if (completionBlock)
+            completionBlock(nil);
+        return nil;
+    }
+    
+    if (![self mjz_isQueueableRequest:request])
+        return [self mjz_performRequest:request apiPath:apiPath completionBlock:completionBlock];
+    
+    HMRequestHandle *handle = [[HMRequestHandle alloc] initWithRequest:request];
+    
+    HMMutationQueueItem *item = [HMMutationQueueItem new];
+    item.request = [request copy];
+    item.apiPath = apiPath;
+    item.handle = handle;
+    
+    HMMutationQueueCompletion *completion = [HMMutationQueueCompletion new];
+    completion.handle = handle;
+    completion.completionBlock = completionBlock;
+    [item.completions addObject:completion];
+    
+    // Keeping the order: while requests are queued, new requests are queued after them.
+    // Requests of related paths sent directly are waited for too, as they are queued if they do not reach the server.
+    BOOL queues = NO;
+    @synchronized (self)
+    {
+        queues = _pendingItems.count > 0 || _replayingItems.count > 0 || ![self mjz_isReachable];
+        for (HMMutationQueueItem *directItem in _directItems)
+            queues = queues || [directItem isRelatedToItem:item];
+        
+        if (!queues)
+        {
+            item.sequence = _nextSequence++;
+            [_directItems addObject:item];
+        }
+    }
+    
+    if (queues)
+    {
+        [self mjz_enqueueRequest:request apiPath:apiPath handle:handle completionBlock:completionBlock];
+        [self mjz_replayPendingItems];
+        return handle;
+    }
+    
+    HMRequestHandle *executorHandle = [self mjz_performRequest:request apiPath:apiPath completionBlock:^(HMResponse *response) {
+        [self mjz_didPerformDirectItem:item response:response];
+    }];
+    
+    if (![handle setCancellationBlock:^{ [executorHandle cancel]; }])
+        [executorHandle cancel];
+    
+    return handle;
+}
+
+@end
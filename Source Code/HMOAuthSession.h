@@ -19,6 +19,7 @@
 #import "HMClient.h"
 #import "HMOAuth.h"
 #import "HMRequestExecutor.h"
+#import "HMOAuthTokenStore.h"
 
 /**
  * The configurator object.
@@ -63,6 +64,36 @@
  **/
 @property (nonatomic, assign) NSTimeInterval validTokenOffsetTimeInterval;
 
+/**
+ * YES to refresh the token in use before it expires, without waiting for a request to find it expired. Default value is NO.
+ * @discussion The refresh is scheduled at "expiryDate - validTokenOffsetTimeInterval - jitter", where the jitter is a random interval up to `proactiveRefreshJitterTimeInterval`.
+ **/
+@property (nonatomic, assign) BOOL refreshesTokensProactively;
+
+/**
+ * The maximum random interval subtracted from the proactive refresh date, so that many clients do not refresh at the same time. Default value is 30 seconds.
+ **/
+@property (nonatomic, assign) NSTimeInterval proactiveRefreshJitterTimeInterval;
+
+/**
+ * YES to refresh the token and replay the request once when the server responds with an HTTP 401 (Unauthorized) status code, for example, if the token has been revoked before its expiry date. Default value is YES.
+ * @discussion Requests rejected with the same token wait for a single refresh.
+ **/
+@property (nonatomic, assign) BOOL replaysUnauthorizedRequests;
+
+/**
+ * The queue used to call the `validateOAuth:` blocks and to receive the token refresh responses (and therefore, the delegate calls and the `sessionAccess` changes). Default value is nil.
+ * @discussion If nil, `validateOAuth:` blocks are called in the main thread and token refresh responses are received in the completion block queue of the API client.
+ * Requests performed via the session do not hop to the main thread, regardless of this value, as long as the completion block queue of the API client (or of the request) is not the main queue.
+ **/
+@property (nonatomic, strong) dispatch_queue_t callbackQueue;
+
+/**
+ * The store used to persist the tokens. Default value is nil, which stores the tokens in the keychain.
+ * @discussion Tokens are written in background and read from memory. Use a store with a `HMFileTokenStorage` to replace the keychain, for example in tests.
+ **/
+@property (nonatomic, strong) HMOAuthTokenStore *tokenStore;
+
 /**
  * The oauth object configuration.
  **/
@@ -131,6 +162,7 @@ typedef NS_ENUM(NSUInteger, HMOAuthSesionAccess)
 /**
  * Performs a block ensuring the validity of the session access tokens.
  * @discussion If a oauth object is about to expire or expired, the session will attepmt to refresh credentials before calling the block.
+ * Blocks submitted while a refresh is in progress wait for that same refresh, and no thread is blocked while waiting. The block is called in the `callbackQueue` of the configurator, or in the main thread if not set.
  **/
 - (void)validateOAuth:(void (^)(void))completionBlock;
 
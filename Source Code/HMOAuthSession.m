@@ -17,6 +17,7 @@
 #import "HMOAuthSession.h"
 
 #import "HMClientKeychainManager.h"
+#import "HMOAuthTokenStore.h"
 #import "NSString+HMClientMD5Hashing.h"
 
 @implementation HMOAuthSesionConfigurator
@@ -34,7 +35,18 @@
 
 @implementation HMOAuthSession
 {
-    NSOperationQueue *_requestOperationQueue;
+    NSMutableArray *_validationBlocks;
+    BOOL _refreshingOAuth;
+    BOOL _refreshingRejectedOAuth;
+    NSUInteger _oauthGeneration;
+    BOOL _replaysUnauthorizedRequests;
+    dispatch_queue_t _callbackQueue;
+    HMOAuthTokenStore *_tokenStore;
+    
+    BOOL _refreshesTokensProactively;
+    NSTimeInterval _proactiveRefreshJitterTimeInterval;
+    dispatch_queue_t _proactiveRefreshQueue;
+    dispatch_source_t _proactiveRefreshTimer;
     
     HMClient *_apiClient;
     NSString *_apiOAuthPath;
@@ -70,13 +82,13 @@
     self = [super init];
     if (self)
     {
-        // One request at a time.
-        _requestOperationQueue = [[NSOperationQueue alloc] init];
-        _requestOperationQueue.maxConcurrentOperationCount = 1;
+        _validationBlocks = [NSMutableArray array];
         
         HMOAuthSesionConfigurator *configurator = [[HMOAuthSesionConfigurator alloc] init];
         configurator.validTokenOffsetTimeInterval = 60;
         configurator.useAppToken = YES;
+        configurator.proactiveRefreshJitterTimeInterval = 30;
+        configurator.replaysUnauthorizedRequests = YES;
         configurator.oauthConfiguration = [[HMOAuthConfiguration alloc] init];
         
         if (configuratorBlock)
@@ -89,20 +101,38 @@
         _oauthConfiguration = configurator.oauthConfiguration;
         _validTokenOffsetTimeInterval = configurator.validTokenOffsetTimeInterval;
         _useAppToken = configurator.useAppToken;
+        _refreshesTokensProactively = configurator.refreshesTokensProactively;
+        _replaysUnauthorizedRequests = configurator.replaysUnauthorizedRequests;
+        _callbackQueue = configurator.callbackQueue;
+        _proactiveRefreshJitterTimeInterval = MAX(configurator.proactiveRefreshJitterTimeInterval, 0);
+        _proactiveRefreshQueue = dispatch_queue_create("com.mobilejazz.hermod.oauth-refresh", DISPATCH_QUEUE_SERIAL);
         
         NSString *string = [NSString stringWithFormat:@"host:%@::clientId:%@", _apiClient.serverPath, _clientId];
         _identifier = [string mjz_api_md5_stringWithMD5Hash];
+        
+        _tokenStore = configurator.tokenStore;
+        if (!_tokenStore)
+            _tokenStore = [[HMOAuthTokenStore alloc] initWithStorage:[[HMKeychainTokenStorage alloc] initWithKeychainManager:[self mjz_keychainManager]]];
 
         [self mjz_load];
     }
     return self;
 }
 
+- (void)dealloc
+{
+    if (_proactiveRefreshTimer)
+        dispatch_source_cancel(_proactiveRefreshTimer);
+}
+
 #pragma mark Properties
 
 - (void)setOauthForAppAccess:(HMOAuth *)oauthForAppAccess
 {
-    _oauthForAppAccess = oauthForAppAccess;
+    @synchronized (self)
+    {
+        _oauthForAppAccess = oauthForAppAccess;
+    }
     [self mjz_refreshApiClientAuthorization];
     [self mjz_save];
     
@@ -112,7 +142,10 @@
 
 - (void)setOauthForUserAccess:(HMOAuth *)oauthForUserAccess
 {
-    _oauthForUserAccess = oauthForUserAccess;
+    @synchronized (self)
+    {
+        _oauthForUserAccess = oauthForUserAccess;
+    }
     [self mjz_refreshApiClientAuthorization];
     [self mjz_save];
     
@@ -124,73 +157,30 @@
 
 - (void)validateOAuth:(void (^)(void))block
 {
-    NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock:^{
-        
-        // This operation must be alive until the given block can be called safely
-        // having a valid token or an error while refreshnig the token happens.
-        
-        dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
-        
-        void (^endOperation)(BOOL succeed) = ^(BOOL succeed){
-            dispatch_semaphore_signal(semaphore);
-            
-            if ([NSThread isMainThread])
-            {
-                if (block)
-                    block();
-            }
-            else
-            {
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    if (block)
-                        block();
-                });
-            }
-        };
-        
-        if (_oauthForUserAccess != nil)
-        {
-            // Checking validity of the user oauth token.
-            if ([_oauthForUserAccess isValidWithOffset:_validTokenOffsetTimeInterval])
-            {
-                endOperation(YES);
-            }
-            else
-            {
-                // Validating app token
-                [self mjz_appTokenBlock:^(BOOL succeed) {
-                                        
-                    // Refreshing user token
-                    [self mjz_refreshToken:_oauthForUserAccess.refreshToken completionBlock:^(HMOAuth *oauth, NSError *error) {
-                        if (!error)
-                            self.oauthForUserAccess = oauth;
-                        else
-                            self.oauthForUserAccess = nil;
-                        
-                        endOperation(error == nil);
-                    }];
-                }];
-            }
-        }
-        else 
-        {
-            // Checking validity of the app oauth token.
-            [self mjz_appTokenBlock:^(BOOL succeed) {
-                endOperation(succeed);
-            }];
-        }
-        
-        dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
-        semaphore = NULL;
-    }];
+    if (!block)
+    {
+        [self mjz_validateOAuthWithOffset:_validTokenOffsetTimeInterval rejectedGeneration:NSNotFound block:nil];
+        return;
+    }
     
-    [_requestOperationQueue addOperation:operation];
+    dispatch_queue_t callbackQueue = _callbackQueue;
+    [self mjz_validateOAuthWithOffset:_validTokenOffsetTimeInterval rejectedGeneration:NSNotFound block:^{
+        if (callbackQueue)
+            dispatch_async(callbackQueue, block);
+        else if ([NSThread isMainThread])
+            block();
+        else
+            dispatch_async(dispatch_get_main_queue(), block);
+    }];
 }
 
 - (void)logout
 {
-    _oauthForAppAccess = nil;
-    _oauthForUserAccess = nil;
+    @synchronized (self)
+    {
+        _oauthForAppAccess = nil;
+        _oauthForUserAccess = nil;
+    }
     
     [self mjz_refreshApiClientAuthorization];
     [self mjz_save];
@@ -219,7 +209,8 @@
                            @"client_secret": _clientSecret,
                            };
     
-    [self validateOAuth:^{
+    // The request is sent from the current context: the API client is safe to use from any thread.
+    [self mjz_validateOAuthWithOffset:_validTokenOffsetTimeInterval rejectedGeneration:NSNotFound block:^{
         [_apiClient performRequest:request apiPath:nil completionBlock:^(HMResponse *response) {
             if (response.error == nil)
             {
@@ -240,13 +231,12 @@
 
 - (void)configureWithOAuth:(HMOAuth*)oauth forSessionAccess:(HMOAuthSesionAccess)sessionAccess
 {
-    if (sessionAccess == HMOAuthSesionAccessUser)
-    {
-        _oauthForUserAccess = oauth;
-    }
-    else if (sessionAccess == HMOAuthSesionAccessApp)
+    @synchronized (self)
     {
-        _oauthForAppAccess = oauth;
+        if (sessionAccess == HMOAuthSesionAccessUser)
+            _oauthForUserAccess = oauth;
+        else if (sessionAccess == HMOAuthSesionAccessApp)
+            _oauthForAppAccess = oauth;
     }
     
     [self mjz_refreshApiClientAuthorization];
@@ -255,7 +245,241 @@
 
 #pragma mark Private Mehtods
 
-- (void)mjz_appTokenBlock:(void (^)(BOOL succeed))block
+- (void)mjz_validateOAuthWithOffset:(NSTimeInterval)offset rejectedGeneration:(NSUInteger)rejectedGeneration block:(void (^)(void))block
+{
+    BOOL isValid = NO;
+    BOOL startsRefresh = NO;
+    
+    @synchronized (self)
+    {
+        // A token rejected by the server must be refreshed even if it has not expired yet.
+        // If the token changed since the rejected request was sent, the new token is used instead.
+        BOOL isRejected = rejectedGeneration == _oauthGeneration;
+        if (isRejected)
+            offset = DBL_MAX;
+        
+        // Fast path: a valid token, not rejected by the server. Requests are not held by a proactive refresh in progress:
+        // only expired or rejected tokens wait for the shared refresh.
+        isValid = !isRejected && !_refreshingRejectedOAuth && [self mjz_isOAuthValidWithOffset:offset];
+        
+        // Otherwise, waiting for the ongoing (or a new) refresh. No thread is blocked meanwhile.
+        if (!isValid)
+        {
+            if (block)
+                [_validationBlocks addObject:[block copy]];
+            
+            if (isRejected)
+                _refreshingRejectedOAuth = YES;
+            
+            if (!_refreshingOAuth)
+            {
+                _refreshingOAuth = YES;
+                startsRefresh = YES;
+            }
+        }
+    }
+    
+    if (isValid)
+    {
+        if (block)
+            [self mjz_performValidationBlocks:@[block]];
+    }
+    else if (startsRefresh)
+    {
+        [self mjz_refreshOAuthWithOffset:offset completionBlock:^(BOOL succeed) {
+            NSArray *blocks = nil;
+            @synchronized (self)
+            {
+                blocks = [_validationBlocks copy];
+                [_validationBlocks removeAllObjects];
+                _refreshingOAuth = NO;
+                _refreshingRejectedOAuth = NO;
+            }
+            [self mjz_performValidationBlocks:blocks];
+        }];
+    }
+}
+
+- (void)mjz_performRequest:(HMRequest*)request
+                   apiPath:(NSString*)apiPath
+                    handle:(HMRequestHandle*)handle
+ replaysUnauthorizedRequest:(BOOL)replaysUnauthorizedRequest
+           completionBlock:(HMResponseBlock)completionBlock
+              refreshBlock:(HMResponseBlock)refreshBlock
+{
+    if (handle.isCancelled)
+        return;
+    
+    NSUInteger generation = 0;
+    @synchronized (self)
+    {
+        generation = _oauthGeneration;
+    }
+    
+    HMRequestHandle *clientHandle = [_apiClient performRequest:request apiPath:apiPath completionBlock:^(HMResponse *response) {
+        
+        // The token was rejected (i.e. revoked before its expiry date): refreshing it once and replaying the request.
+        // Requests rejected with the same token wait for the same refresh.
+        if (replaysUnauthorizedRequest && response.httpResponse.statusCode == HMHTTPStatusCode401Unauthorized && !handle.isCancelled)
+        {
+            [self mjz_setWaitingCancellationBlockForHandle:handle completionBlock:completionBlock];
+            [self mjz_validateOAuthWithOffset:_validTokenOffsetTimeInterval rejectedGeneration:generation block:^{
+                [self mjz_performRequest:request apiPath:apiPath handle:handle replaysUnauthorizedRequest:NO completionBlock:completionBlock refreshBlock:refreshBlock];
+            }];
+            return;
+        }
+        
+        if ([handle markAsCompleted] && completionBlock)
+            completionBlock(response);
+    } refreshBlock:refreshBlock];
+    
+    // From now on, cancelling the handle cancels the request sent by the API client.
+    if (![handle setCancellationBlock:^{ [clientHandle cancel]; }])
+        [clientHandle cancel];
+}
+
+- (void)mjz_setWaitingCancellationBlockForHandle:(HMRequestHandle*)handle completionBlock:(HMResponseBlock)completionBlock
+{
+    // While waiting for a valid token, cancelling the handle finishes the request right away.
+    HMRequest *request = handle.request;
+    HMClient *apiClient = _apiClient;
+    void (^cancellationBlock)(void) = ^{
+        if ([handle markAsCompleted])
+        {
+            dispatch_queue_t queue = request.completionBlockQueue ?: apiClient.completionBlockQueue ?: dispatch_get_main_queue();
+            HMResponse *response = [handle cancelledResponse];
+            dispatch_async(queue, ^{
+                if (completionBlock)
+                    completionBlock(response);
+            });
+        }
+    };
+    
+    if (![handle setCancellationBlock:cancellationBlock])
+        cancellationBlock();
+}
+
+- (BOOL)mjz_isOAuthValidWithOffset:(NSTimeInterval)offset
+{
+    @synchronized (self)
+    {
+        if (_oauthForUserAccess != nil)
+            return [_oauthForUserAccess isValidWithOffset:offset];
+        
+        if (_useAppToken == NO)
+            return YES;
+        
+        return [_oauthForAppAccess isValidWithOffset:offset];
+    }
+}
+
+- (void)mjz_refreshOAuthWithOffset:(NSTimeInterval)offset completionBlock:(void (^)(BOOL succeed))completionBlock
+{
+    HMOAuth *oauthForUserAccess = nil;
+    @synchronized (self)
+    {
+        oauthForUserAccess = _oauthForUserAccess;
+    }
+    
+    if (oauthForUserAccess != nil)
+    {
+        if ([oauthForUserAccess isValidWithOffset:offset])
+        {
+            completionBlock(YES);
+            return;
+        }
+        
+        // Validating app token
+        [self mjz_appTokenWithOffset:_validTokenOffsetTimeInterval block:^(BOOL succeed) {
+            
+            // Refreshing user token
+            [self mjz_refreshToken:oauthForUserAccess.refreshToken completionBlock:^(HMOAuth *oauth, NSError *error) {
+                // A failed proactive refresh keeps the token until it actually expires.
+                if (!error)
+                    self.oauthForUserAccess = oauth;
+                else if (![oauthForUserAccess isValidWithOffset:_validTokenOffsetTimeInterval])
+                    self.oauthForUserAccess = nil;
+                
+                completionBlock(error == nil);
+            }];
+        }];
+    }
+    else
+    {
+        // Checking validity of the app oauth token.
+        [self mjz_appTokenWithOffset:offset block:^(BOOL succeed) {
+            completionBlock(succeed);
+        }];
+    }
+}
+
+- (void)mjz_scheduleProactiveRefresh
+{
+    if (!_refreshesTokensProactively)
+        return;
+    
+    @synchronized (self)
+    {
+        if (_proactiveRefreshTimer)
+        {
+            dispatch_source_cancel(_proactiveRefreshTimer);
+            _proactiveRefreshTimer = nil;
+        }
+        
+        // Only the token in use is refreshed. A user token without refresh token cannot be refreshed.
+        HMOAuth *oauth = nil;
+        if (_oauthForUserAccess != nil)
+            oauth = _oauthForUserAccess.refreshToken ? _oauthForUserAccess : nil;
+        else if (_useAppToken)
+            oauth = _oauthForAppAccess;
+        
+        // Expired tokens are refreshed by the next request. This also avoids refreshing in a loop
+        // when the server issues tokens that expire within the offset.
+        if (![oauth isValidWithOffset:_validTokenOffsetTimeInterval])
+            return;
+        
+        NSTimeInterval jitter = _proactiveRefreshJitterTimeInterval * (arc4random_uniform(1001) / 1000.0);
+        NSTimeInterval delay = MAX(oauth.expiryDate.timeIntervalSinceNow - _validTokenOffsetTimeInterval - jitter, 0);
+        
+        _proactiveRefreshTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _proactiveRefreshQueue);
+        dispatch_source_set_timer(_proactiveRefreshTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), DISPATCH_TIME_FOREVER, NSEC_PER_SEC);
+        
+        __weak typeof(self) weakSelf = self;
+        dispatch_source_set_event_handler(_proactiveRefreshTimer, ^{
+            [weakSelf mjz_performProactiveRefresh];
+        });
+        dispatch_resume(_proactiveRefreshTimer);
+    }
+}
+
+- (void)mjz_performProactiveRefresh
+{
+    @synchronized (self)
+    {
+        if (_proactiveRefreshTimer)
+        {
+            dispatch_source_cancel(_proactiveRefreshTimer);
+            _proactiveRefreshTimer = nil;
+        }
+    }
+    
+    // Widening the validity offset by the maximum jitter, the token in use is considered expired and refreshed now.
+    // Requests issued meanwhile keep using the current token while it is valid, and only wait for this refresh (instead of starting another one) once it has expired.
+    NSTimeInterval offset = _validTokenOffsetTimeInterval + _proactiveRefreshJitterTimeInterval + 1;
+    [self mjz_validateOAuthWithOffset:offset rejectedGeneration:NSNotFound block:nil];
+}
+
+- (void)mjz_performValidationBlocks:(NSArray*)blocks
+{
+    if (blocks.count == 0)
+        return;
+    
+    // Blocks run in the calling context. Blocks of the public API dispatch themselves to the callback queue.
+    for (void (^block)(void) in blocks)
+        block();
+}
+
+- (void)mjz_appTokenWithOffset:(NSTimeInterval)offset block:(void (^)(BOOL succeed))block
 {
     if (_useAppToken == NO)
     {
@@ -265,17 +489,18 @@
     }
     
     // Checking validity of the app oauth token.
-    if ([_oauthForAppAccess isValidWithOffset:_validTokenOffsetTimeInterval])
+    if ([_oauthForAppAccess isValidWithOffset:offset])
     {
         if (block)
             block(YES);
     }
     else
     {
+        HMOAuth *oauthForAppAccess = _oauthForAppAccess;
         [self mjz_clientCredentialsWithCompletionBlock:^(HMOAuth *oauth, NSError *error) {
             if (!error)
                 self.oauthForAppAccess = oauth;
-            else
+            else if (![oauthForAppAccess isValidWithOffset:_validTokenOffsetTimeInterval])
                 self.oauthForAppAccess = nil;
             
             if (block)
@@ -319,6 +544,7 @@
                            @"client_id": _clientId,
                            @"client_secret": _clientSecret,
                            };
+    request.completionBlockQueue = _callbackQueue;
     
     [_apiClient performRequest:request apiPath:nil completionBlock:^(HMResponse *response) {
         if (response.error == nil)
@@ -348,6 +574,7 @@
                            @"client_id": _clientId,
                            @"client_secret": _clientSecret,
                            };
+    request.completionBlockQueue = _callbackQueue;
     
     [_apiClient performRequest:request apiPath:nil completionBlock:^(HMResponse *response) {
         if (response.error == nil)
@@ -367,24 +594,17 @@
 
 - (void)mjz_load
 {
-    NSData *appData = [[self mjz_keychainManager] keychainDataForKey:[self mjz_keychainOAuthAppKey]];
-    NSData *userData = [[self mjz_keychainManager] keychainDataForKey:[self mjz_keychainOAuthUserKey]];
+    HMOAuth *appOauth = [_tokenStore objectForKey:[self mjz_keychainOAuthAppKey]];
+    HMOAuth *userOauth = [_tokenStore objectForKey:[self mjz_keychainOAuthUserKey]];
     
-    if (appData)
+    if (appOauth.accessToken && appOauth.refreshToken)
     {
-        HMOAuth *appOauth = [NSKeyedUnarchiver unarchiveObjectWithData:appData];
-        if (appOauth.accessToken && appOauth.refreshToken)
-        {
-            _oauthForAppAccess = appOauth;
-        }
+        _oauthForAppAccess = appOauth;
     }
     
-    if (userData) {
-        HMOAuth *userOauth = [NSKeyedUnarchiver unarchiveObjectWithData:userData];
-        if (userOauth.accessToken && userOauth.refreshToken)
-        {
-            _oauthForUserAccess = userOauth;
-        }
+    if (userOauth.accessToken && userOauth.refreshToken)
+    {
+        _oauthForUserAccess = userOauth;
     }
     
     [self mjz_refreshApiClientAuthorization];
@@ -392,25 +612,17 @@
 
 - (void)mjz_save
 {
-    if (_oauthForAppAccess)
+    HMOAuth *oauthForAppAccess = nil;
+    HMOAuth *oauthForUserAccess = nil;
+    @synchronized (self)
     {
-        NSData *data = [NSKeyedArchiver archivedDataWithRootObject:_oauthForAppAccess];
-        [[self mjz_keychainManager] setKeychainData:data forKey:[self mjz_keychainOAuthAppKey]];
-    }
-    else
-    {
-        [[self mjz_keychainManager] removeKeychainEntryForKey:[self mjz_keychainOAuthAppKey]];
+        oauthForAppAccess = _oauthForAppAccess;
+        oauthForUserAccess = _oauthForUserAccess;
     }
     
-    if (_oauthForUserAccess)
-    {
-        NSData *data = [NSKeyedArchiver archivedDataWithRootObject:_oauthForUserAccess];
-        [[self mjz_keychainManager] setKeychainData:data forKey:[self mjz_keychainOAuthUserKey]];
-    }
-    else
-    {
-        [[self mjz_keychainManager] removeKeychainEntryForKey:[self mjz_keychainOAuthUserKey]];
-    }
+    // Tokens are persisted in background by the token store. Unchanged tokens are not written again.
+    [_tokenStore setObject:oauthForAppAccess forKey:[self mjz_keychainOAuthAppKey]];
+    [_tokenStore setObject:oauthForUserAccess forKey:[self mjz_keychainOAuthUserKey]];
 }
 
 - (void)mjz_refreshApiClientAuthorization
@@ -429,12 +641,20 @@
         access = HMOAuthSesionAccessApp;
     }
     
+    @synchronized (self)
+    {
+        _oauthGeneration += 1;
+    }
+    
     // Set the oauth authorization headers
     if (oauth)
         [_apiClient setBearerToken:oauth.accessToken];
     else
         [_apiClient removeAuthorizationHeaders];
     
+    // Rescheduling the proactive refresh for the token in use
+    [self mjz_scheduleProactiveRefresh];
+    
     // update the session access flag
     if (access != _sessionAccess)
     {
@@ -459,18 +679,39 @@
 #pragma mark - Protocols
 #pragma mark HMRequestExecutor
 
-- (void)performRequest:(HMRequest *)request completionBlock:(HMResponseBlock)completionBlock
+- (HMRequestHandle*)performRequest:(HMRequest *)request completionBlock:(HMResponseBlock)completionBlock
 {
-    [self validateOAuth:^{
-        [_apiClient performRequest:request completionBlock:completionBlock];
-    }];
+    return [self performRequest:request apiPath:_apiClient.apiPath completionBlock:completionBlock];
 }
 
-- (void)performRequest:(HMRequest *)request apiPath:(NSString *)apiPath completionBlock:(HMResponseBlock)completionBlock
+- (HMRequestHandle*)performRequest:(HMRequest *)request apiPath:(NSString *)apiPath completionBlock:(HMResponseBlock)completionBlock
 {
-    [self validateOAuth:^{
-        [_apiClient performRequest:request completionBlock:completionBlock];
+    return [self performRequest:request apiPath:apiPath completionBlock:completionBlock refreshBlock:nil];
+}
+
+- (HMRequestHandle*)performRequest:(HMRequest *)request completionBlock:(HMResponseBlock)completionBlock refreshBlock:(HMResponseBlock)refreshBlock
+{
+    return [self performRequest:request apiPath:_apiClient.apiPath completionBlock:completionBlock refreshBlock:refreshBlock];
+}
+
+- (HMRequestHandle*)performRequest:(HMRequest *)request apiPath:(NSString *)apiPath completionBlock:(HMResponseBlock)completionBlock refreshBlock:(HMResponseBlock)refreshBlock
+{
+    if (!request)
+    {
+        if (completionBlock)
+            completionBlock(nil);
+        return nil;
+    }
+    
+    HMRequestHandle *handle = [[HMRequestHandle alloc] initWithRequest:request];
+    [self mjz_setWaitingCancellationBlockForHandle:handle completionBlock:completionBlock];
+    
+    // The request is sent from the current context (or the one finishing the token refresh), without hopping to the main thread.
+    [self mjz_validateOAuthWithOffset:_validTokenOffsetTimeInterval rejectedGeneration:NSNotFound block:^{
+        [self mjz_performRequest:request apiPath:apiPath handle:handle replaysUnauthorizedRequest:_replaysUnauthorizedRequests completionBlock:completionBlock refreshBlock:refreshBlock];
     }];
+    
+    return handle;
 }
 
 @end
@@ -0,0 +1,137 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import <Foundation/Foundation.h>
+
+@class HMClientKeychainManager;
+
+/**
+ * A storage backend for OAuth tokens.
+ * @discussion Methods are called in a background queue of the token store, one at a time.
+ **/
+@protocol HMOAuthTokenStorage <NSObject>
+
+/**
+ * Retrieves the data for the given key.
+ * @param key The key.
+ * @return The stored data or nil.
+ **/
+- (NSData*)dataForKey:(NSString*)key;
+
+/**
+ * Stores data for the given key.
+ * @param data The data to store.
+ * @param key The key.
+ **/
+- (void)setData:(NSData*)data forKey:(NSString*)key;
+
+/**
+ * Removes the data stored for the given key.
+ * @param key The key.
+ **/
+- (void)removeDataForKey:(NSString*)key;
+
+@end
+
+/**
+ * Token storage backed by the keychain.
+ **/
+@interface HMKeychainTokenStorage : NSObject <HMOAuthTokenStorage>
+
+/**
+ * Default initializer.
+ * @param keychainManager The keychain manager.
+ * @return The initialized instance.
+ **/
+- (instancetype)initWithKeychainManager:(HMClientKeychainManager*)keychainManager;
+
+/**
+ * The keychain manager.
+ **/
+@property (nonatomic, strong, readonly) HMClientKeychainManager *keychainManager;
+
+@end
+
+/**
+ * Token storage backed by files inside a directory, one file per key.
+ * @discussion Files are not encrypted beyond the data protection of the device. Intended for tests and benchmarks, where the keychain is not available or too slow.
+ **/
+@interface HMFileTokenStorage : NSObject <HMOAuthTokenStorage>
+
+/**
+ * Default initializer.
+ * @param directoryURL The URL of the directory. The directory is created if needed.
+ * @return The initialized instance.
+ **/
+- (instancetype)initWithDirectoryURL:(NSURL*)directoryURL;
+
+/**
+ * The URL of the directory.
+ **/
+@property (nonatomic, strong, readonly) NSURL *directoryURL;
+
+@end
+
+/**
+ * A write-behind store of OAuth tokens.
+ * @discussion Reads are served from memory. Writes update the memory immediately and are persisted later in a background queue: consecutive updates of the same key result in a single write of the latest value. This class is thread safe.
+ **/
+@interface HMOAuthTokenStore : NSObject
+
+/** ************************************************* **
+ * @name Initializers
+ ** ************************************************* **/
+
+/**
+ * Default initializer.
+ * @param storage The storage backend.
+ * @return The initialized instance.
+ **/
+- (instancetype)initWithStorage:(id <HMOAuthTokenStorage>)storage;
+
+/**
+ * The storage backend.
+ **/
+@property (nonatomic, strong, readonly) id <HMOAuthTokenStorage> storage;
+
+/** ************************************************* **
+ * @name Methods
+ ** ************************************************* **/
+
+/**
+ * Returns the object for the given key.
+ * @param key The key.
+ * @return The object or nil.
+ * @discussion The first read of a key loads it from the storage, subsequent reads are served from memory.
+ **/
+- (id)objectForKey:(NSString*)key;
+
+/**
+ * Sets the object for the given key.
+ * @param object An object conforming to NSCoding, or nil to remove it.
+ * @param key The key.
+ * @discussion The object is archived and written to the storage in background.
+ **/
+- (void)setObject:(id <NSCoding>)object forKey:(NSString*)key;
+
+/**
+ * Writes all pending changes to the storage and waits until done.
+ * @discussion Pending changes are also written when the app enters background.
+ **/
+- (void)flush;
+
+@end
@@ -0,0 +1,243 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import "HMOAuthTokenStore.h"
+
+#if TARGET_OS_IOS
+#import <UIKit/UIKit.h>
+#endif
+
+#import "HMClientKeychainManager.h"
+
+@implementation HMKeychainTokenStorage
+
+- (instancetype)initWithKeychainManager:(HMClientKeychainManager*)keychainManager
+{
+    self = [super init];
+    if (self)
+    {
+        _keychainManager = keychainManager;
+    }
+    return self;
+}
+
+- (NSData*)dataForKey:(NSString*)key
+{
+    return [_keychainManager keychainDataForKey:key];
+}
+
+- (void)setData:(NSData*)data forKey:(NSString*)key
+{
+    [_keychainManager setKeychainData:data forKey:key];
+}
+
+- (void)removeDataForKey:(NSString*)key
+{
+    [_keychainManager removeKeychainEntryForKey:key];
+}
+
+@end
+
+#pragma mark -
+
+@implementation HMFileTokenStorage
+
+- (instancetype)initWithDirectoryURL:(NSURL*)directoryURL
+{
+    self = [super init];
+    if (self)
+    {
+        _directoryURL = directoryURL;
+        [[NSFileManager defaultManager] createDirectoryAtURL:directoryURL withIntermediateDirectories:YES attributes:nil error:nil];
+    }
+    return self;
+}
+
+- (NSData*)dataForKey:(NSString*)key
+{
+    return [NSData dataWithContentsOfURL:[self mjz_fileURLForKey:key]];
+}
+
+- (void)setData:(NSData*)data forKey:(NSString*)key
+{
+    [data writeToURL:[self mjz_fileURLForKey:key] options:NSDataWritingAtomic error:nil];
+}
+
+- (void)removeDataForKey:(NSString*)key
+{
+    [[NSFileManager defaultManager] removeItemAtURL:[self mjz_fileURLForKey:key] error:nil];
+}
+
+#pragma mark Private Methods
+
+- (NSURL*)mjz_fileURLForKey:(NSString*)key
+{
+    NSString *fileName = [key stringByReplacingOccurrencesOfString:@"/" withString:@"_"];
+    return [_directoryURL URLByAppendingPathComponent:fileName];
+}
+
+@end
+
+#pragma mark -
+
+@implementation HMOAuthTokenStore
+{
+    dispatch_queue_t _writeQueue;
+    
+    NSMutableDictionary *_objects; // <-- key: NSString, value: object or NSNull
+    NSMutableSet *_dirtyKeys;
+    BOOL _writeScheduled;
+}
+
+- (instancetype)initWithStorage:(id <HMOAuthTokenStorage>)storage
+{
+    self = [super init];
+    if (self)
+    {
+        _storage = storage;
+        _writeQueue = dispatch_queue_create("com.mobilejazz.hermod.token-store", DISPATCH_QUEUE_SERIAL);
+        _objects = [NSMutableDictionary dictionary];
+        _dirtyKeys = [NSMutableSet set];
+        
+#if TARGET_OS_IOS
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(mjz_applicationDidEnterBackground:) name:UIApplicationDidEnterBackgroundNotification object:nil];
+#endif
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+#pragma mark Public Methods
+
+- (id)objectForKey:(NSString*)key
+{
+    @synchronized (self)
+    {
+        id object = _objects[key];
+        if (object)
+            return object == [NSNull null] ? nil : object;
+    }
+    
+    // Loading the object from the storage (serialized with pending writes)
+    __block NSData *data = nil;
+    dispatch_sync(_writeQueue, ^{
+        data = [_storage dataForKey:key];
+    });
+    
+    id object = data ? [NSKeyedUnarchiver unarchiveObjectWithData:data] : nil;
+    
+    @synchronized (self)
+    {
+        // A value set meanwhile takes precedence
+        if (!_objects[key])
+            _objects[key] = object ?: [NSNull null];
+        
+        object = _objects[key];
+        return object == [NSNull null] ? nil : object;
+    }
+}
+
+- (void)setObject:(id <NSCoding>)object forKey:(NSString*)key
+{
+    @synchronized (self)
+    {
+        id value = object ?: [NSNull null];
+        if (_objects[key] == value)
+            return;
+        
+        _objects[key] = value;
+        [_dirtyKeys addObject:key];
+        
+        // Updates done before the write runs are persisted together
+        if (_writeScheduled)
+            return;
+        
+        _writeScheduled = YES;
+    }
+    
+    dispatch_async(_writeQueue, ^{
+        [self mjz_writeDirtyObjects];
+    });
+}
+
+- (void)flush
+{
+    dispatch_sync(_writeQueue, ^{
+        [self mjz_writeDirtyObjects];
+    });
+}
+
+#pragma mark Private Methods
+
+- (void)mjz_writeDirtyObjects
+{
+    NSDictionary *objects = nil;
+    
+    @synchronized (self)
+    {
+        _writeScheduled = NO;
+        
+        if (_dirtyKeys.count == 0)
+            return;
+        
+        NSMutableDictionary *dirtyObjects = [NSMutableDictionary dictionaryWithCapacity:_dirtyKeys.count];
+        for (NSString *key in _dirtyKeys)
+            dirtyObjects[key] = _objects[key];
+        
+        objects = dirtyObjects;
+        [_dirtyKeys removeAllObjects];
+    }
+    
+    [objects enumerateKeysAndObjectsUsingBlock:^(NSString *key, id object, BOOL *stop) {
+        @autoreleasepool
+        {
+            if (object == [NSNull null])
+            {
+                [_storage removeDataForKey:key];
+            }
+            else
+            {
+                NSData *data = [NSKeyedArchiver archivedDataWithRootObject:object];
+                [_storage setData:data forKey:key];
+            }
+        }
+    }];
+}
+
+#if TARGET_OS_IOS
+- (void)mjz_applicationDidEnterBackground:(NSNotification*)notification
+{
+    UIApplication *application = [UIApplication sharedApplication];
+    __block UIBackgroundTaskIdentifier taskIdentifier = [application beginBackgroundTaskWithExpirationHandler:^{
+        [application endBackgroundTask:taskIdentifier];
+        taskIdentifier = UIBackgroundTaskInvalid;
+    }];
+    
+    dispatch_async(_writeQueue, ^{
+        [self mjz_writeDirtyObjects];
+        
+        if (taskIdentifier != UIBackgroundTaskInvalid)
+            [application endBackgroundTask:taskIdentifier];
+    });
+}
+#endif
+
+@end
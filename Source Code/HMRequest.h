@@ -17,9 +17,25 @@
 #import <Foundation/Foundation.h>
 
 #import "HMConstants.h"
+#import "HMResponseDecoder.h"
 
 extern NSTimeInterval const HMRequestDefaultTimeoutInterval;
 
+/**
+ * Request priorities.
+ **/
+typedef NS_ENUM(NSInteger, HMRequestPriority)
+{
+    /** Low priority, for background work (i.e. synchronization or prefetching). */
+    HMRequestPriorityLow = 0,
+    
+    /** Default priority. */
+    HMRequestPriorityNormal = 1,
+    
+    /** High priority, for interactive requests (i.e. the content the user is waiting for). */
+    HMRequestPriorityHigh = 2,
+};
+
 /**
  * A HMRequest object contains all the needed information to perform a HTTP request.
  **/
@@ -53,7 +69,7 @@ extern NSTimeInterval const HMRequestDefaultTimeoutInterval;
 /**
  * The dictionary parameters.
  **/
-@property (nonatomic, strong) NSDictionary *parameters;
+@property (nonatomic, copy) NSDictionary *parameters;
 
 /**
  * The timout interval used on this request. If it is set to `HMRequestDefaultTimeoutInterval`,
@@ -61,11 +77,24 @@ extern NSTimeInterval const HMRequestDefaultTimeoutInterval;
  **/
 @property (nonatomic, assign) NSTimeInterval timeoutInterval;
 
+/**
+ * The priority of the request. Default value is `HMRequestPriorityNormal`.
+ * @discussion Pending requests with higher priority are started first by the HMClient, and the priority is passed to the `NSURLSessionTask`. The priority is not part of the identity of the request.
+ **/
+@property (nonatomic, assign) HMRequestPriority priority;
+
 /**
  The keyPaths included in this array will not be logged.
  */
 @property (nonatomic, strong, readwrite) NSArray<NSString *> *sensitiveParameterKeyPahts;
 
+/**
+ * The decoder used to convert the response object into model objects, available in the `decodedObject` property of the `HMResponse`.
+ * @discussion If nil, the decoder registered in the HMClient for the request path (if any) is used. The decoder is executed on the client's processing queue.
+ * Once decoded, the response object is released and the `responseObject` of the response is nil. The decoder is not part of the identity of the request.
+ **/
+@property (nonatomic, strong) id <HMResponseDecoder> decoder;
+
 /** ************************************************* **
  * @name Identifying the request
  ** ************************************************* **/
@@ -73,9 +102,17 @@ extern NSTimeInterval const HMRequestDefaultTimeoutInterval;
 /**
  * Returns a unique hash identifier for the current api request.
  * @discussion This method can be used to get an unique hash string for each configured request.
+ * The identifier is computed (MD5) on every call. For hashing and equality the cheaper `fingerprint` is used instead.
  **/
 - (NSString*)identifier;
 
+/**
+ * A fast non-cryptographic 64-bit fingerprint of the request (path, HTTP method and parameters).
+ * @discussion The fingerprint is computed once and cached until the path, the HTTP method or the parameters change. 
+ * It is used by `-hash` and `-isEqual:`.
+ **/
+@property (nonatomic, assign, readonly) uint64_t fingerprint;
+
 /** ************************************************* **
  * @name Threading
  ** ************************************************* **/
@@ -17,10 +17,15 @@
 #import "HMRequest.h"
 #import "NSString+HMClientMD5Hashing.h"
 #import "NSDictionary+DescriptionHelpers.h"
+#import "HMFingerprint.h"
 
 NSTimeInterval const HMRequestDefaultTimeoutInterval = 0;
 
 @implementation HMRequest
+{
+    // Cached fingerprint. Zero means not computed yet.
+    uint64_t _fingerprint;
+}
 
 + (instancetype)requestWithPath:(NSString*)format, ...
 {
@@ -42,6 +47,7 @@ NSTimeInterval const HMRequestDefaultTimeoutInterval = 0;
     {
         _httpMethod = HMHTTPMethodGET;
         _timeoutInterval = HMRequestDefaultTimeoutInterval;
+        _priority = HMRequestPriorityNormal;
     }
     return self;
 }
@@ -51,11 +57,12 @@ NSTimeInterval const HMRequestDefaultTimeoutInterval = 0;
     self = [super init];
     if (self)
     {
-        _parameters = [coder decodeObjectForKey:@"parameters"];
+        _parameters = [[coder decodeObjectForKey:@"parameters"] copy];
         _httpMethod = [coder decodeIntegerForKey:@"httpMethod"];
         _path = [coder decodeObjectForKey:@"path"];
         _timeoutInterval = [coder decodeIntegerForKey:@"timeoutInterval"];
         _sensitiveParameterKeyPahts = [coder decodeObjectForKey:@"sensitiveParameterKeyPahts"];
+        _priority = [coder containsValueForKey:@"priority"] ? [coder decodeIntegerForKey:@"priority"] : HMRequestPriorityNormal;
     }
     return self;
 }
@@ -67,6 +74,7 @@ NSTimeInterval const HMRequestDefaultTimeoutInterval = 0;
     [coder encodeObject:_path forKey:@"path"];
     [coder encodeInteger:_timeoutInterval forKey:@"timeoutInterval"];
     [coder encodeObject:_sensitiveParameterKeyPahts forKey:@"sensitiveParameterKeyPahts"];
+    [coder encodeInteger:_priority forKey:@"priority"];
 }
 
 - (instancetype)copyWithZone:(NSZone *)zone
@@ -78,28 +86,34 @@ NSTimeInterval const HMRequestDefaultTimeoutInterval = 0;
     request.path = [_path copy];
     request.timeoutInterval = _timeoutInterval;
     request.sensitiveParameterKeyPahts = [_sensitiveParameterKeyPahts copy];
+    request.decoder = _decoder;
+    request.priority = _priority;
     
     return request;
 }
 
 - (NSUInteger)hash
 {
-    return [self.identifier hash];
+    return (NSUInteger)self.fingerprint;
 }
 
 - (BOOL)isEqual:(id)object
 {
+    if (object == self)
+        return YES;
+    
     if ([object isKindOfClass:HMRequest.class])
     {
         HMRequest *request = object;
-        BOOL sameHash = [self.identifier isEqualToString:request.identifier];
+        BOOL sameHash = self.fingerprint == request.fingerprint;
         
         if (!sameHash)
             return NO;
         
+        // Nil paths and parameters are equal too
         if (request.httpMethod == _httpMethod &&
-            [request.path isEqualToString:_path] &&
-            [request.parameters isEqualToDictionary:_parameters])
+            (request.path == _path || [request.path isEqualToString:_path]) &&
+            (request.parameters == _parameters || [request.parameters isEqualToDictionary:_parameters]))
             return YES;
     }
     
@@ -116,6 +130,46 @@ NSTimeInterval const HMRequestDefaultTimeoutInterval = 0;
             [_parameters hm_descriptionRemovingKeyPaths:self.sensitiveParameterKeyPahts]];
 }
 
+#pragma mark Properties
+
+- (void)setPath:(NSString *)path
+{
+    _path = path;
+    _fingerprint = 0;
+}
+
+- (void)setHttpMethod:(HMHTTPMethod)httpMethod
+{
+    _httpMethod = httpMethod;
+    _fingerprint = 0;
+}
+
+- (void)setParameters:(NSDictionary *)parameters
+{
+    _parameters = [parameters copy];
+    _fingerprint = 0;
+}
+
+- (uint64_t)fingerprint
+{
+    uint64_t fingerprint = _fingerprint;
+    
+    if (fingerprint == 0)
+    {
+        fingerprint = HMFingerprintAppendString(HMFingerprintSeed, _path);
+        fingerprint = HMFingerprintAppendInteger(fingerprint, _httpMethod);
+        fingerprint = HMFingerprintAppendObject(fingerprint, _parameters);
+        
+        // Zero is reserved to flag a fingerprint that must be computed.
+        if (fingerprint == 0)
+            fingerprint = 1;
+        
+        _fingerprint = fingerprint;
+    }
+    
+    return fingerprint;
+}
+
 #pragma mark Public Methods
 
 - (NSString*)identifier
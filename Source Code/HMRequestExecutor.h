@@ -10,6 +10,7 @@
 
 @class HMResponse;
 @class HMRequest;
+@class HMRequestHandle;
 
 typedef void (^HMResponseBlock)(HMResponse *response);
 
@@ -26,15 +27,38 @@ typedef void (^HMResponseBlock)(HMResponse *response);
  * Performs an API request and call the completion block when finish.
  * @param request The API request.
  * @param completionBlock A completion block.
+ * @return A handle that can be used to cancel the request.
  **/
-- (void)performRequest:(HMRequest*)request completionBlock:(HMResponseBlock)completionBlock;
+- (HMRequestHandle*)performRequest:(HMRequest*)request completionBlock:(HMResponseBlock)completionBlock;
 
 /**
  * Performs an API request and call the completion block when finish.
  * @param request The API request.
  * @param apiPath A custom API path (to be used instead of the default one).
  * @param completionBlock A completion block.
+ * @return A handle that can be used to cancel the request.
  **/
-- (void)performRequest:(HMRequest*)request apiPath:(NSString*)apiPath completionBlock:(HMResponseBlock)completionBlock;
+- (HMRequestHandle*)performRequest:(HMRequest*)request apiPath:(NSString*)apiPath completionBlock:(HMResponseBlock)completionBlock;
+
+@optional
+
+/**
+ * Performs an API request and call the completion block when finish. If the completion block receives a stale cached response, the refresh block is called with the refreshed response.
+ * @param request The API request.
+ * @param completionBlock A completion block.
+ * @param refreshBlock A block called with the response that refreshes a stale response delivered to the completion block. It is not called if the refresh fails or the cached response is still valid.
+ * @return A handle that can be used to cancel the request.
+ **/
+- (HMRequestHandle*)performRequest:(HMRequest*)request completionBlock:(HMResponseBlock)completionBlock refreshBlock:(HMResponseBlock)refreshBlock;
+
+/**
+ * Performs an API request and call the completion block when finish. If the completion block receives a stale cached response, the refresh block is called with the refreshed response.
+ * @param request The API request.
+ * @param apiPath A custom API path (to be used instead of the default one).
+ * @param completionBlock A completion block.
+ * @param refreshBlock A block called with the response that refreshes a stale response delivered to the completion block. It is not called if the refresh fails or the cached response is still valid.
+ * @return A handle that can be used to cancel the request.
+ **/
+- (HMRequestHandle*)performRequest:(HMRequest*)request apiPath:(NSString*)apiPath completionBlock:(HMResponseBlock)completionBlock refreshBlock:(HMResponseBlock)refreshBlock;
 
 @end
@@ -0,0 +1,127 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import <Foundation/Foundation.h>
+
+#import "HMRequest.h"
+#import "HMResponse.h"
+
+/**
+ * A handle of a performed request, that can be used to cancel it.
+ * @discussion When a request is cancelled, its completion block is called with an error of domain `NSURLErrorDomain` and code `NSURLErrorCancelled` (unless the response was already delivered).
+ * Cancelled requests do not notify the HMClient delegate about the error. This class is thread safe.
+ **/
+@interface HMRequestHandle : NSObject
+
+/** ************************************************* **
+ * @name Initializers
+ ** ************************************************* **/
+
+/**
+ * Default initializer.
+ * @param request The request.
+ * @return An initialized instance.
+ * @discussion Handles are created by request executors.
+ **/
+- (instancetype)initWithRequest:(HMRequest*)request;
+
+/** ************************************************* **
+ * @name Attributes
+ ** ************************************************* **/
+
+/**
+ * The request.
+ **/
+@property (nonatomic, strong, readonly) HMRequest *request;
+
+/**
+ * YES if the request has been cancelled.
+ **/
+@property (nonatomic, assign, readonly, getter=isCancelled) BOOL cancelled;
+
+/**
+ * YES if the response has been delivered (or is being delivered) to the completion block.
+ **/
+@property (nonatomic, assign, readonly, getter=isCompleted) BOOL completed;
+
+/**
+ * The progress of the request, in bytes. `HMClient` reports the progress of the upload of the body of `HMUploadRequest` requests.
+ * @discussion The total unit count is -1 until it is known.
+ **/
+@property (nonatomic, strong, readonly) NSProgress *progress;
+
+/** ************************************************* **
+ * @name Cancelling
+ ** ************************************************* **/
+
+/**
+ * Cancels the request. Does nothing if the request is already cancelled or completed.
+ **/
+- (void)cancel;
+
+/** ************************************************* **
+ * @name Request executors
+ ** ************************************************* **/
+
+/**
+ * Sets the block that cancels the current stage of the request, replacing the previous one.
+ * @param block The cancellation block, executed once when the handle is cancelled.
+ * @return NO if the handle is already cancelled, in which case the block is not stored nor executed.
+ **/
+- (BOOL)setCancellationBlock:(void (^)(void))block;
+
+/**
+ * Marks the handle as completed.
+ * @return YES the first time, NO if the handle was already completed. Only the caller getting YES must deliver the response.
+ **/
+- (BOOL)markAsCompleted;
+
+/**
+ * Creates a response for the request with a cancellation error.
+ **/
+- (HMResponse*)cancelledResponse;
+
+@end
+
+/**
+ * A group of request handles that can be cancelled all at once (i.e. all requests of a screen or a batch job).
+ * @discussion Handles are weakly referenced, and removed from the group once completed. This class is thread safe.
+ **/
+@interface HMCancellationGroup : NSObject
+
+/**
+ * Adds a handle to the group. If the group has been invalidated, the handle is cancelled.
+ * @param handle The request handle.
+ **/
+- (void)addHandle:(HMRequestHandle*)handle;
+
+/**
+ * Cancels all the handles of the group. Handles added later are not affected.
+ **/
+- (void)cancelAll;
+
+/**
+ * Cancels all the handles of the group, as well as any handle added later.
+ **/
+- (void)invalidate;
+
+/**
+ * The number of handles of the group not completed yet.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger count;
+
+@end
@@ -0,0 +1,216 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import "HMRequestHandle.h"
+
+@implementation HMRequestHandle
+{
+    void (^_cancellationBlock)(void);
+}
+
+- (instancetype)init
+{
+    return [self initWithRequest:nil];
+}
+
+- (instancetype)initWithRequest:(HMRequest*)request
+{
+    self = [super init];
+    if (self)
+    {
+        _request = request;
+        _progress = [NSProgress discreteProgressWithTotalUnitCount:-1];
+    }
+    return self;
+}
+
+- (NSString*)description
+{
+    return [NSString stringWithFormat:@"%@ - Cancelled: %@ | Completed: %@ | Request: %@",
+            [super description],
+            self.isCancelled ? @"YES" : @"NO",
+            self.isCompleted ? @"YES" : @"NO",
+            _request.path];
+}
+
+#pragma mark Properties
+
+- (BOOL)isCancelled
+{
+    @synchronized (self)
+    {
+        return _cancelled;
+    }
+}
+
+- (BOOL)isCompleted
+{
+    @synchronized (self)
+    {
+        return _completed;
+    }
+}
+
+#pragma mark Public Methods
+
+- (void)cancel
+{
+    void (^cancellationBlock)(void) = nil;
+    
+    @synchronized (self)
+    {
+        if (_cancelled || _completed)
+            return;
+        
+        _cancelled = YES;
+        cancellationBlock = _cancellationBlock;
+        _cancellationBlock = nil;
+    }
+    
+    if (cancellationBlock)
+        cancellationBlock();
+}
+
+- (BOOL)setCancellationBlock:(void (^)(void))block
+{
+    @synchronized (self)
+    {
+        if (_cancelled)
+            return NO;
+        
+        _cancellationBlock = [block copy];
+        return YES;
+    }
+}
+
+- (BOOL)markAsCompleted
+{
+    @synchronized (self)
+    {
+        if (_completed)
+            return NO;
+        
+        _completed = YES;
+        _cancellationBlock = nil;
+        return YES;
+    }
+}
+
+- (HMResponse*)cancelledResponse
+{
+    NSError *error = [NSError errorWithDomain:NSURLErrorDomain
+                                         code:NSURLErrorCancelled
+                                     userInfo:@{NSLocalizedDescriptionKey: @"The request has been cancelled"}];
+    
+    return [[HMResponse alloc] initWithRequest:_request httpResponse:nil object:nil error:error];
+}
+
+@end
+
+#pragma mark -
+
+@implementation HMCancellationGroup
+{
+    NSHashTable <HMRequestHandle*> *_handles;
+    NSUInteger _pruneThreshold;
+    BOOL _invalidated;
+}
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        _handles = [NSHashTable weakObjectsHashTable];
+        _pruneThreshold = 64;
+    }
+    return self;
+}
+
+#pragma mark Properties
+
+- (NSUInteger)count
+{
+    @synchronized (self)
+    {
+        [self mjz_removeCompletedHandles];
+        return _handles.count;
+    }
+}
+
+#pragma mark Public Methods
+
+- (void)addHandle:(HMRequestHandle*)handle
+{
+    if (!handle)
+        return;
+    
+    BOOL invalidated = NO;
+    @synchronized (self)
+    {
+        invalidated = _invalidated;
+        if (!invalidated)
+        {
+            // Pruning completed handles only when the table grows, to keep additions cheap
+            if (_handles.count >= _pruneThreshold)
+            {
+                [self mjz_removeCompletedHandles];
+                _pruneThreshold = MAX(64, _handles.count * 2);
+            }
+            [_handles addObject:handle];
+        }
+    }
+    
+    if (invalidated)
+        [handle cancel];
+}
+
+- (void)cancelAll
+{
+    NSArray <HMRequestHandle*> *handles = nil;
+    @synchronized (self)
+    {
+        handles = _handles.allObjects;
+        [_handles removeAllObjects];
+    }
+    
+    for (HMRequestHandle *handle in handles)
+        [handle cancel];
+}
+
+- (void)invalidate
+{
+    @synchronized (self)
+    {
+        _invalidated = YES;
+    }
+    
+    [self cancelAll];
+}
+
+#pragma mark Private Methods
+
+- (void)mjz_removeCompletedHandles
+{
+    for (HMRequestHandle *handle in _handles.allObjects)
+    {
+        if (handle.isCompleted)
+            [_handles removeObject:handle];
+    }
+}
+
+@end
@@ -0,0 +1,61 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import <Foundation/Foundation.h>
+
+#import "HMRequest.h"
+
+/**
+ * Schedules the start of requests by priority, limiting the number of concurrent requests per host.
+ * @discussion Pending requests of a host are started from the highest to the lowest priority, in FIFO order for the same priority. 
+ * Every scheduled request must be finished by calling `finishRequest:`, either once completed or when cancelled before being started. This class is thread safe.
+ **/
+@interface HMRequestScheduler : NSObject
+
+/**
+ * Default initializer.
+ * @param maximumConcurrentRequestsPerHost The maximum number of concurrent requests per host. Zero means no limit.
+ * @return An initialized instance.
+ **/
+- (instancetype)initWithMaximumConcurrentRequestsPerHost:(NSUInteger)maximumConcurrentRequestsPerHost;
+
+/**
+ * The maximum number of concurrent requests per host. Zero means no limit.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger maximumConcurrentRequestsPerHost;
+
+/**
+ * Schedules a request.
+ * @param request An object identifying the request (i.e. its session task), used when finishing the request.
+ * @param host The host of the request.
+ * @param priority The priority of the request.
+ * @param startBlock The block that starts the request. Executed synchronously if the host has a free slot, otherwise later on the thread that finishes a previous request.
+ **/
+- (void)scheduleRequest:(id)request forHost:(NSString*)host priority:(HMRequestPriority)priority startBlock:(void (^)(void))startBlock;
+
+/**
+ * Notifies that a scheduled request has finished. If the request was started, its slot is released. Otherwise, it is removed from the pending requests and will never be started.
+ * @param request The object identifying the request.
+ **/
+- (void)finishRequest:(id)request;
+
+/**
+ * The number of requests waiting for a free slot.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger pendingRequestCount;
+
+@end
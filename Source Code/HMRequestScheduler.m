@@ -0,0 +1,202 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import "HMRequestScheduler.h"
+
+static NSUInteger const HMRequestPriorityCount = HMRequestPriorityHigh + 1;
+
+/**
+ * A scheduled request.
+ **/
+@interface HMRequestSchedulerTicket : NSObject
+
+@property (nonatomic, strong) NSString *host;
+@property (nonatomic, assign) HMRequestPriority priority;
+@property (nonatomic, copy) void (^startBlock)(void);
+@property (nonatomic, assign) BOOL started;
+
+@end
+
+@implementation HMRequestSchedulerTicket
+
+@end
+
+/**
+ * The scheduling state of a single host.
+ **/
+@interface HMRequestSchedulerHost : NSObject
+
+@property (nonatomic, assign) NSUInteger activeCount;
+@property (nonatomic, strong, readonly) NSArray <NSMutableArray <HMRequestSchedulerTicket*> *> *pendingTickets;
+
+@end
+
+@implementation HMRequestSchedulerHost
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        NSMutableArray *pendingTickets = [NSMutableArray arrayWithCapacity:HMRequestPriorityCount];
+        for (NSUInteger i=0; i<HMRequestPriorityCount; ++i)
+            [pendingTickets addObject:[NSMutableArray array]];
+        _pendingTickets = [pendingTickets copy];
+    }
+    return self;
+}
+
+@end
+
+@implementation HMRequestScheduler
+{
+    NSMutableDictionary <NSString*, HMRequestSchedulerHost*> *_hosts;
+    NSMapTable <id, HMRequestSchedulerTicket*> *_tickets;
+}
+
+- (instancetype)init
+{
+    return [self initWithMaximumConcurrentRequestsPerHost:0];
+}
+
+- (instancetype)initWithMaximumConcurrentRequestsPerHost:(NSUInteger)maximumConcurrentRequestsPerHost
+{
+    self = [super init];
+    if (self)
+    {
+        _maximumConcurrentRequestsPerHost = maximumConcurrentRequestsPerHost;
+        _hosts = [NSMutableDictionary dictionary];
+        _tickets = [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality
+                                             valueOptions:NSPointerFunctionsStrongMemory
+                                                 capacity:0];
+    }
+    return self;
+}
+
+#pragma mark Public Methods
+
+- (void)scheduleRequest:(id)request forHost:(NSString*)host priority:(HMRequestPriority)priority startBlock:(void (^)(void))startBlock
+{
+    HMRequestSchedulerTicket *ticket = [HMRequestSchedulerTicket new];
+    ticket.host = host ?: @"";
+    ticket.priority = MAX(HMRequestPriorityLow, MIN(HMRequestPriorityHigh, priority));
+    
+    BOOL start = NO;
+    @synchronized (self)
+    {
+        [_tickets setObject:ticket forKey:request];
+        
+        HMRequestSchedulerHost *schedulerHost = [self mjz_hostForName:ticket.host];
+        if (_maximumConcurrentRequestsPerHost == 0 || schedulerHost.activeCount < _maximumConcurrentRequestsPerHost)
+        {
+            schedulerHost.activeCount += 1;
+            ticket.started = YES;
+            start = YES;
+        }
+        else
+        {
+            ticket.startBlock = startBlock;
+            [schedulerHost.pendingTickets[ticket.priority] addObject:ticket];
+            _pendingRequestCount += 1;
+        }
+    }
+    
+    if (start)
+        startBlock();
+}
+
+- (void)finishRequest:(id)request
+{
+    if (!request)
+        return;
+    
+    HMRequestSchedulerTicket *nextTicket = nil;
+    void (^startBlock)(void) = nil;
+    
+    @synchronized (self)
+    {
+        HMRequestSchedulerTicket *finishedTicket = [_tickets objectForKey:request];
+        if (!finishedTicket)
+            return;
+        
+        [_tickets removeObjectForKey:request];
+        
+        HMRequestSchedulerHost *schedulerHost = _hosts[finishedTicket.host];
+        if (!schedulerHost)
+            return;
+        
+        if (!finishedTicket.started)
+        {
+            // Cancelled before being started: it just leaves the queue
+            [schedulerHost.pendingTickets[finishedTicket.priority] removeObjectIdenticalTo:finishedTicket];
+            finishedTicket.startBlock = nil;
+            _pendingRequestCount -= 1;
+            return;
+        }
+        
+        // Taking the slot for the next pending request with the highest priority
+        for (NSInteger priority = HMRequestPriorityHigh; priority >= HMRequestPriorityLow && !nextTicket; --priority)
+        {
+            NSMutableArray <HMRequestSchedulerTicket*> *tickets = schedulerHost.pendingTickets[priority];
+            if (tickets.count > 0)
+            {
+                nextTicket = tickets.firstObject;
+                [tickets removeObjectAtIndex:0];
+                _pendingRequestCount -= 1;
+            }
+        }
+        
+        if (nextTicket)
+        {
+            nextTicket.started = YES;
+            startBlock = nextTicket.startBlock;
+            nextTicket.startBlock = nil;
+        }
+        else
+        {
+            schedulerHost.activeCount -= 1;
+            if (schedulerHost.activeCount == 0)
+                [_hosts removeObjectForKey:finishedTicket.host];
+        }
+    }
+    
+    if (startBlock)
+        startBlock();
+}
+
+- (NSUInteger)pendingRequestCount
+{
+    @synchronized (self)
+    {
+        return _pendingRequestCount;
+    }
+}
+
+#pragma mark Private Methods
+
+- (HMRequestSchedulerHost*)mjz_hostForName:(NSString*)host
+{
+    HMRequestSchedulerHost *schedulerHost = _hosts[host];
+    if (!schedulerHost)
+    {
+        schedulerHost = [HMRequestSchedulerHost new];
+        _hosts[host] = schedulerHost;
+    }
+    return schedulerHost;
+}
+
+@end
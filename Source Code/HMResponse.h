@@ -40,6 +40,22 @@
                object:(id)responseObject
                 error:(NSError*)error;
 
+/**
+ * Initializer for responses whose body is decoded lazily.
+ * @param request The original request.
+ * @param response The HTTP headers response.
+ * @param data The raw body data.
+ * @param decodingBlock The block that decodes the raw body into the response object. It is called at most once, the first time the response object is accessed.
+ * @param error The error.
+ * @return An initialized instance.
+ * @discussion The only class that creates api responses is the HMClient.
+ **/
+- (id)initWithRequest:(HMRequest*)request
+         httpResponse:(NSHTTPURLResponse*)response
+                 data:(NSData*)data
+        decodingBlock:(id (^)(NSData *data, NSError **error))decodingBlock
+                error:(NSError*)error;
+
 /** ************************************************* **
  * @name Attributes
  ** ************************************************* **/
@@ -61,9 +77,32 @@
 
 /**
  * The body response object.
+ * @discussion If the response is decoded lazily, the raw body is decoded the first time this property is accessed. Decoding is thread safe and happens only once.
+ * If decoding fails, this property is nil and the decoding error is set to the `error` property (unless it already contains an error).
+ * Therefore, the `error` of a lazily decoded response can be set after the response has been delivered, when this property is accessed for the first time.
  **/
 @property (nonatomic, strong) id responseObject;
 
+/**
+ * The object returned by the response decoder of the request (see `HMResponseDecoder`). Nil if no decoder has been used.
+ **/
+@property (nonatomic, strong) id decodedObject;
+
+/**
+ * The file containing the response body, only available for download requests (see `HMDownloadRequest`). The response object is nil in that case.
+ **/
+@property (nonatomic, strong) NSURL *fileURL;
+
+/**
+ * The raw body data, only available if the response is decoded lazily.
+ **/
+@property (nonatomic, strong, readonly) NSData *responseData;
+
+/**
+ * YES if the response object has already been decoded (or if it was not decoded lazily), NO otherwise.
+ **/
+@property (nonatomic, assign, readonly, getter=isResponseObjectDecoded) BOOL responseObjectDecoded;
+
 @end
 
 
@@ -17,6 +17,12 @@
 #import "HMResponse.h"
 
 @implementation HMResponse
+{
+    id (^_decodingBlock)(NSData *data, NSError **error);
+}
+
+@synthesize error = _error;
+@synthesize responseObject = _responseObject;
 
 - (id)init
 {
@@ -39,16 +45,94 @@
     return self;
 }
 
+- (id)initWithRequest:(HMRequest*)request
+         httpResponse:(NSHTTPURLResponse*)response
+                 data:(NSData*)data
+        decodingBlock:(id (^)(NSData *data, NSError **error))decodingBlock
+                error:(NSError*)error
+{
+    self = [self initWithRequest:request httpResponse:response object:nil error:error];
+    if (self)
+    {
+        _responseData = data;
+        _decodingBlock = [decodingBlock copy];
+    }
+    return self;
+}
+
 - (NSString*)description
 {
+    // The description does not force the decoding of the response object
+    NSString *objectDescription = nil;
+    if (self.isResponseObjectDecoded)
+        objectDescription = [self.responseObject description];
+    else
+        objectDescription = [NSString stringWithFormat:@"<%lu bytes, not decoded yet>", (unsigned long)_responseData.length];
+    
+    if (_fileURL)
+        objectDescription = [NSString stringWithFormat:@"<file at %@>", _fileURL.path];
+    
     return [NSString stringWithFormat:@"\n\nREQUEST: %@\n\nERROR: %@\n\nHTTP RESPONSE: %@\n\nOBJECT: %@\n\n",
             _request.description,
-            _error.description,
+            self.error.description,
             _httpResponse.description,
-            [_responseObject description]
+            objectDescription
             ];
 }
 
+#pragma mark Properties
+
+- (NSError*)error
+{
+    // The error can be set by a lazy decoding happening on another thread
+    @synchronized (self)
+    {
+        return _error;
+    }
+}
+
+- (void)setError:(NSError*)error
+{
+    @synchronized (self)
+    {
+        _error = error;
+    }
+}
+
+- (id)responseObject
+{
+    @synchronized (self)
+    {
+        if (_decodingBlock)
+        {
+            NSError *decodingError = nil;
+            _responseObject = _decodingBlock(_responseData, &decodingError);
+            _decodingBlock = nil;
+            
+            if (!_responseObject && decodingError && !_error)
+                _error = decodingError;
+        }
+        return _responseObject;
+    }
+}
+
+- (void)setResponseObject:(id)responseObject
+{
+    @synchronized (self)
+    {
+        _responseObject = responseObject;
+        _decodingBlock = nil;
+    }
+}
+
+- (BOOL)isResponseObjectDecoded
+{
+    @synchronized (self)
+    {
+        return _decodingBlock == nil;
+    }
+}
+
 #pragma mark - Protocols
 #pragma mark NSCoding
 
@@ -61,7 +145,11 @@
     [aCoder encodeInteger:_httpResponse.statusCode forKey:@"httpResponse.statusCode"];
     [aCoder encodeObject:@"HTTP/1.1" forKey:@"httpResponse.version"];
     [aCoder encodeObject:_httpResponse.allHeaderFields forKey:@"httpResponse.headerFields"];
-    [aCoder encodeObject:_responseObject forKey:@"responseObject"];
+    [aCoder encodeObject:self.responseObject forKey:@"responseObject"];
+    [aCoder encodeObject:_fileURL forKey:@"fileURL"];
+    
+    if ([_decodedObject conformsToProtocol:@protocol(NSCoding)])
+        [aCoder encodeObject:_decodedObject forKey:@"decodedObject"];
 }
 
 - (id)initWithCoder:(NSCoder *)aDecoder
@@ -76,6 +164,8 @@
                                                    HTTPVersion:[aDecoder decodeObjectForKey:@"httpResponse.version"]
                                                   headerFields:[aDecoder decodeObjectForKey:@"httpResponse.headerFields"]];
         _responseObject = [aDecoder decodeObjectForKey:@"responseObject"];
+        _decodedObject = [aDecoder decodeObjectForKey:@"decodedObject"];
+        _fileURL = [aDecoder decodeObjectForKey:@"fileURL"];
     }
     return self;
 }
@@ -87,10 +177,36 @@
                                                                  HTTPVersion:@"HTTP/1.1"
                                                                 headerFields:[_httpResponse.allHeaderFields copy]];
     
-    HMResponse *response = [[HMResponse allocWithZone:zone] initWithRequest:[_request copy]
-                                                                     httpResponse:httpResponse
-                                                                           object:[_responseObject copy]
-                                                                            error:[_error copy]];
+    id (^decodingBlock)(NSData *data, NSError **error) = nil;
+    id responseObject = nil;
+    @synchronized (self)
+    {
+        decodingBlock = _decodingBlock;
+        responseObject = _responseObject;
+    }
+    
+    HMResponse *response = nil;
+    
+    // Lazily decoded responses are copied without being decoded
+    if (decodingBlock)
+    {
+        response = [[HMResponse allocWithZone:zone] initWithRequest:[_request copy]
+                                                       httpResponse:httpResponse
+                                                               data:_responseData
+                                                      decodingBlock:decodingBlock
+                                                              error:[_error copy]];
+    }
+    else
+    {
+        response = [[HMResponse allocWithZone:zone] initWithRequest:[_request copy]
+                                                       httpResponse:httpResponse
+                                                             object:[responseObject copy]
+                                                              error:[_error copy]];
+    }
+    
+    // Decoded model objects are shared, as they are not required to conform to NSCopying
+    response.decodedObject = _decodedObject;
+    response.fileURL = _fileURL;
     
     return response;
 }
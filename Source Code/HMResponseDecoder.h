@@ -0,0 +1,49 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import <Foundation/Foundation.h>
+
+/**
+ * A response decoder converts the response object (typically a JSON `NSDictionary` or `NSArray`) into model objects.
+ * @discussion Decoders are executed on a background processing queue of the HMClient, never on the completion queue. Implementations must be thread safe.
+ **/
+@protocol HMResponseDecoder <NSObject>
+
+/**
+ * Decodes the response object.
+ * @param responseObject The response object.
+ * @param httpResponse The HTTP response.
+ * @param error An error pointer to be set if the response object cannot be decoded.
+ * @return The decoded object, or nil if the response object cannot be decoded.
+ **/
+- (id _Nullable)decodedObjectForResponseObject:(id _Nullable)responseObject httpResponse:(NSHTTPURLResponse * _Nullable)httpResponse error:(NSError * _Nullable * _Nullable)error;
+
+@end
+
+/**
+ * A response decoder defined with a block.
+ **/
+@interface HMBlockResponseDecoder : NSObject <HMResponseDecoder>
+
+/**
+ * Default instance creator.
+ * @param block The decoding block.
+ * @return An initialized instance.
+ **/
++ (instancetype _Nonnull)decoderWithBlock:(id _Nullable (^ _Nonnull)(id _Nullable responseObject, NSHTTPURLResponse * _Nullable httpResponse, NSError * _Nullable * _Nullable error))block;
+
+@end
@@ -0,0 +1,42 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import "HMResponseDecoder.h"
+
+@implementation HMBlockResponseDecoder
+{
+    id (^_block)(id responseObject, NSHTTPURLResponse *httpResponse, NSError **error);
+}
+
++ (instancetype)decoderWithBlock:(id (^)(id responseObject, NSHTTPURLResponse *httpResponse, NSError **error))block
+{
+    HMBlockResponseDecoder *decoder = [[self alloc] init];
+    decoder->_block = [block copy];
+    return decoder;
+}
+
+#pragma mark HMResponseDecoder
+
+- (id)decodedObjectForResponseObject:(id)responseObject httpResponse:(NSHTTPURLResponse *)httpResponse error:(NSError **)error
+{
+    if (!_block)
+        return responseObject;
+    
+    return _block(responseObject, httpResponse, error);
+}
+
+@end
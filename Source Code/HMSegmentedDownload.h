@@ -0,0 +1,79 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import <Foundation/Foundation.h>
+
+#import "HMRequest.h"
+
+@class HMHTTPSessionManager;
+@class HMRequestScheduler;
+
+/**
+ * Downloads a resource to a file by fetching several byte ranges of it in parallel.
+ * @discussion The size of the resource is probed first with a HEAD request. If the server accepts byte ranges and gives a validator (strong `ETag` or `Last-Modified`), each range is requested with the method, URL and headers of the base request plus a `Range` header (i.e. "bytes=0-1048575") and an `If-Range` header, and is written into place in a ".download" file next to the destination, sized beforehand. Otherwise (or if the server does not answer HEAD requests), the whole resource is fetched with a single request.
+ * A range answered with anything else than its "206 Partial Content" fails the download. This class is thread safe.
+ **/
+@interface HMSegmentedDownload : NSObject
+
+/**
+ * Default initializer.
+ * @param fileURL The destination file URL.
+ * @param segmentCount The maximum number of ranges fetched in parallel.
+ * @return An initialized instance.
+ **/
+- (instancetype)initWithFileURL:(NSURL*)fileURL segmentCount:(NSUInteger)segmentCount;
+
+/**
+ * The destination file URL.
+ **/
+@property (nonatomic, strong, readonly) NSURL *fileURL;
+
+/**
+ * The number of bytes received so far.
+ **/
+@property (nonatomic, assign, readonly) unsigned long long receivedLength;
+
+/**
+ * The size in bytes of the resource, or -1 if unknown.
+ **/
+@property (nonatomic, assign, readonly) long long expectedLength;
+
+/**
+ * Block called each time data is written to the file, in the delegate queue of the session manager.
+ **/
+@property (nonatomic, copy) void (^progressBlock)(unsigned long long receivedLength, long long expectedLength);
+
+/**
+ * Probes the resource and downloads its ranges.
+ * @param baseRequest The GET request the HEAD request and the range requests are built from.
+ * @param sessionManager The session manager sending the requests.
+ * @param scheduler The scheduler starting the requests, within its per host limits.
+ * @param priority The priority of the requests.
+ * @param completionBlock Block called once the file is at its destination (with the response of the HEAD request, or of the single request if the resource has not been split, and a nil error) or once a request fails (the remaining ones are cancelled), in the completion queue of the session manager.
+ **/
+- (void)downloadWithBaseRequest:(NSURLRequest*)baseRequest
+                 sessionManager:(HMHTTPSessionManager*)sessionManager
+                      scheduler:(HMRequestScheduler*)scheduler
+                       priority:(HMRequestPriority)priority
+                completionBlock:(void (^)(NSHTTPURLResponse *response, NSError *error))completionBlock;
+
+/**
+ * Cancels the requests being sent and removes the partial file. The completion block is called with a cancellation error.
+ **/
+- (void)cancel;
+
+@end
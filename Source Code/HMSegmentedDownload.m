@@ -0,0 +1,417 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import "HMSegmentedDownload.h"
+
+#import <AFNetworking/AFNetworking.h>
+
+#import "HMHTTPSessionManager.h"
+#import "HMRequestScheduler.h"
+#import "HMFileDownload.h"
+
+/**
+ * The minimum size of a range: below it, the latency of an extra request outweighs the gain.
+ **/
+static const unsigned long long HMSegmentedDownloadMinimumSegmentLength = 256*1024;
+
+/**
+ * A range of the resource being downloaded.
+ **/
+@interface HMDownloadSegment : NSObject
+
+@property (nonatomic, assign) unsigned long long offset;
+@property (nonatomic, assign) unsigned long long length;
+@property (nonatomic, assign) unsigned long long receivedLength;
+
+/**
+ * NO if the whole resource is fetched with a single request (the length is unknown then).
+ **/
+@property (nonatomic, assign) BOOL ranged;
+
+@end
+
+@implementation HMDownloadSegment
+
+@end
+
+@implementation HMSegmentedDownload
+{
+    NSUInteger _segmentCount;
+    NSURL *_partialFileURL;
+    NSFileHandle *_fileHandle;
+    NSHTTPURLResponse *_response; // The response of the HEAD request, or of the single request fetching the whole resource
+    
+    NSMutableSet <NSURLSessionTask*> *_activeTasks;
+    NSUInteger _pendingSegmentCount;
+    BOOL _finished;
+    
+    NSURLRequest *_baseRequest;
+    HMHTTPSessionManager *_sessionManager;
+    HMRequestScheduler *_scheduler;
+    HMRequestPriority _priority;
+    void (^_completionBlock)(NSHTTPURLResponse *response, NSError *error);
+}
+
+- (instancetype)initWithFileURL:(NSURL*)fileURL segmentCount:(NSUInteger)segmentCount
+{
+    self = [super init];
+    if (self)
+    {
+        _fileURL = fileURL;
+        _segmentCount = MAX(segmentCount, 1);
+        _partialFileURL = [fileURL URLByAppendingPathExtension:@"download"];
+        _expectedLength = -1;
+        _activeTasks = [NSMutableSet set];
+    }
+    return self;
+}
+
+#pragma mark Properties
+
+- (unsigned long long)receivedLength
+{
+    @synchronized (self)
+    {
+        return _receivedLength;
+    }
+}
+
+- (long long)expectedLength
+{
+    @synchronized (self)
+    {
+        return _expectedLength;
+    }
+}
+
+#pragma mark Public Methods
+
+- (void)downloadWithBaseRequest:(NSURLRequest*)baseRequest
+                 sessionManager:(HMHTTPSessionManager*)sessionManager
+                      scheduler:(HMRequestScheduler*)scheduler
+                       priority:(HMRequestPriority)priority
+                completionBlock:(void (^)(NSHTTPURLResponse *response, NSError *error))completionBlock
+{
+    NSMutableURLRequest *probeRequest = [baseRequest mutableCopy];
+    
+    // Byte offsets must refer to the stored representation
+    [probeRequest setValue:@"identity" forHTTPHeaderField:@"Accept-Encoding"];
+    
+    @synchronized (self)
+    {
+        _baseRequest = [probeRequest copy];
+        _sessionManager = sessionManager;
+        _scheduler = scheduler;
+        _priority = priority;
+        _completionBlock = [completionBlock copy];
+        _finished = NO;
+    }
+    
+    probeRequest.HTTPMethod = @"HEAD";
+    [self mjz_sendRequest:probeRequest dataBlock:nil completionHandler:^(NSHTTPURLResponse *response, NSError *error) {
+        @synchronized (self)
+        {
+            _response = response;
+        }
+        
+        // Servers not answering HEAD requests get a single request (that fails too if the resource cannot be fetched)
+        if (error && !response)
+            [self mjz_finishWithError:error];
+        else
+            [self mjz_startSegmentsWithProbeResponse:response];
+    }];
+}
+
+- (void)cancel
+{
+    NSError *error = [NSError errorWithDomain:NSURLErrorDomain
+                                         code:NSURLErrorCancelled
+                                     userInfo:@{NSLocalizedDescriptionKey: @"The request has been cancelled"}];
+    [self mjz_finishWithError:error];
+}
+
+#pragma mark Private Methods
+
+- (void)mjz_sendRequest:(NSURLRequest*)urlRequest
+              dataBlock:(BOOL (^)(NSHTTPURLResponse *response, NSData *data))dataBlock
+      completionHandler:(void (^)(NSHTTPURLResponse *response, NSError *error))completionHandler
+{
+    HMRequestScheduler *scheduler = _scheduler;
+    __block NSURLSessionDataTask *sessionTask = nil;
+    sessionTask = [_sessionManager dataTaskWithRequest:urlRequest
+                                        uploadProgress:nil
+                                      downloadProgress:nil
+                                     completionHandler:^(NSURLResponse *response, id responseObject, NSError *error) {
+                                         [scheduler finishRequest:sessionTask];
+                                         
+                                         @synchronized (self)
+                                         {
+                                             [_activeTasks removeObject:sessionTask];
+                                         }
+                                         
+                                         // The body has not been given to the response serializer: its errors are ignored for successful responses
+                                         NSHTTPURLResponse *httpResponse = [response isKindOfClass:NSHTTPURLResponse.class] ? (NSHTTPURLResponse*)response : nil;
+                                         if (httpResponse.statusCode >= 200 && httpResponse.statusCode < 300 && [error.domain isEqualToString:AFURLResponseSerializationErrorDomain])
+                                             error = nil;
+                                         else if (!error)
+                                             error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadServerResponse userInfo:nil];
+                                         
+                                         completionHandler(httpResponse, error);
+                                     }];
+    
+    if (dataBlock)
+        [_sessionManager setDataBlock:dataBlock forTask:sessionTask];
+    
+    BOOL finished = NO;
+    @synchronized (self)
+    {
+        finished = _finished;
+        if (!finished)
+            [_activeTasks addObject:sessionTask];
+    }
+    
+    if (finished)
+    {
+        [sessionTask cancel];
+        return;
+    }
+    
+    NSURLSessionDataTask *scheduledTask = sessionTask;
+    [scheduler scheduleRequest:scheduledTask forHost:urlRequest.URL.host priority:_priority startBlock:^{
+        [scheduledTask resume];
+    }];
+}
+
+- (NSArray <HMDownloadSegment*>*)mjz_segmentsForProbeResponse:(NSHTTPURLResponse*)response
+{
+    long long length = response.statusCode >= 200 && response.statusCode < 300 ? response.expectedContentLength : -1;
+    NSString *acceptRanges = HMHeaderValue(response, @"Accept-Ranges");
+    BOOL acceptsRanges = acceptRanges && [acceptRanges rangeOfString:@"bytes" options:NSCaseInsensitiveSearch].location != NSNotFound;
+    
+    // Without a validator, ranges of different versions of the resource could be mixed up
+    NSUInteger segmentCount = 1;
+    if (acceptsRanges && length > 0 && [HMFileDownload rangeValidatorOfResponse:response])
+        segmentCount = (NSUInteger)MIN((unsigned long long)_segmentCount, MAX((unsigned long long)length / HMSegmentedDownloadMinimumSegmentLength, 1ULL));
+    
+    if (segmentCount == 1)
+    {
+        HMDownloadSegment *segment = [HMDownloadSegment new];
+        segment.ranged = NO;
+        return @[segment];
+    }
+    
+    unsigned long long segmentLength = ((unsigned long long)length + segmentCount - 1) / segmentCount;
+    NSMutableArray <HMDownloadSegment*> *segments = [NSMutableArray arrayWithCapacity:segmentCount];
+    for (unsigned long long offset = 0; offset < (unsigned long long)length; offset += segmentLength)
+    {
+        HMDownloadSegment *segment = [HMDownloadSegment new];
+        segment.offset = offset;
+        segment.length = MIN(segmentLength, (unsigned long long)length - offset);
+        segment.ranged = YES;
+        [segments addObject:segment];
+    }
+    return segments;
+}
+
+- (void)mjz_startSegmentsWithProbeResponse:(NSHTTPURLResponse*)response
+{
+    NSArray <HMDownloadSegment*> *segments = [self mjz_segmentsForProbeResponse:response];
+    BOOL ranged = segments.firstObject.ranged;
+    
+    // The partial file is sized beforehand, so ranges are written into place in any order
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    [fileManager createDirectoryAtURL:[_fileURL URLByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+    [fileManager createFileAtPath:_partialFileURL.path contents:nil attributes:nil];
+    
+    NSError *error = nil;
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingToURL:_partialFileURL error:&error];
+    if (!fileHandle)
+    {
+        [self mjz_finishWithError:error];
+        return;
+    }
+    
+    if (ranged)
+        [fileHandle truncateFileAtOffset:(unsigned long long)response.expectedContentLength];
+    
+    NSString *validator = [HMFileDownload rangeValidatorOfResponse:response];
+    NSURLRequest *baseRequest = nil;
+    @synchronized (self)
+    {
+        if (_finished)
+        {
+            [fileHandle closeFile];
+            [fileManager removeItemAtURL:_partialFileURL error:nil];
+            return;
+        }
+        
+        _fileHandle = fileHandle;
+        _expectedLength = ranged ? response.expectedContentLength : -1;
+        _pendingSegmentCount = segments.count;
+        baseRequest = _baseRequest;
+    }
+    
+    for (HMDownloadSegment *segment in segments)
+    {
+        NSMutableURLRequest *segmentRequest = [baseRequest mutableCopy];
+        if (segment.ranged)
+        {
+            [segmentRequest setValue:[NSString stringWithFormat:@"bytes=%llu-%llu", segment.offset, segment.offset + segment.length - 1] forHTTPHeaderField:@"Range"];
+            [segmentRequest setValue:validator forHTTPHeaderField:@"If-Range"];
+        }
+        
+        [self mjz_sendRequest:segmentRequest
+                    dataBlock:^BOOL(NSHTTPURLResponse *response, NSData *data) {
+                        return [self mjz_writeData:data forResponse:response segment:segment];
+                    }
+            completionHandler:^(NSHTTPURLResponse *response, NSError *error) {
+                [self mjz_finishSegment:segment response:response error:error];
+            }];
+    }
+}
+
+- (BOOL)mjz_writeData:(NSData*)data forResponse:(NSHTTPURLResponse*)response segment:(HMDownloadSegment*)segment
+{
+    // Error bodies are handled as usual, by the response serializer
+    if (response.statusCode < 200 || response.statusCode >= 300)
+        return NO;
+    
+    NSError *error = nil;
+    unsigned long long receivedLength = 0;
+    long long expectedLength = 0;
+    
+    @synchronized (self)
+    {
+        if (_finished)
+            return YES;
+        
+        // A whole body means the resource has changed since it was probed
+        unsigned long long first = 0;
+        NSString *contentRange = HMHeaderValue(response, @"Content-Range") ?: @"";
+        if (segment.ranged && (response.statusCode != 206 || sscanf(contentRange.UTF8String, "bytes %llu-", &first) != 1 || first != segment.offset || segment.receivedLength + data.length > segment.length))
+        {
+            error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadServerResponse userInfo:@{NSLocalizedDescriptionKey: @"Unexpected content range"}];
+        }
+        else
+        {
+            @try
+            {
+                [_fileHandle seekToFileOffset:segment.offset + segment.receivedLength];
+                [_fileHandle writeData:data];
+                segment.receivedLength += data.length;
+                _receivedLength += data.length;
+            }
+            @catch (NSException *exception)
+            {
+                error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:@{NSURLErrorKey: _partialFileURL, NSLocalizedDescriptionKey: exception.reason ?: @"Cannot write the downloaded file"}];
+            }
+        }
+        
+        receivedLength = _receivedLength;
+        expectedLength = _expectedLength;
+    }
+    
+    if (error)
+    {
+        [self mjz_finishWithError:error];
+        return YES;
+    }
+    
+    if (_progressBlock)
+        _progressBlock(receivedLength, expectedLength);
+    
+    return YES;
+}
+
+- (void)mjz_finishSegment:(HMDownloadSegment*)segment response:(NSHTTPURLResponse*)response error:(NSError*)error
+{
+    BOOL completed = NO;
+    
+    @synchronized (self)
+    {
+        if (_finished)
+            return;
+        
+        if (!segment.ranged || error)
+            _response = response ?: _response;
+        
+        // Truncated ranges cannot be completed later
+        if (!error && segment.ranged && (response.statusCode != 206 || segment.receivedLength != segment.length))
+            error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadServerResponse userInfo:@{NSLocalizedDescriptionKey: @"Incomplete content range"}];
+        
+        // Neither can a whole body shorter than announced
+        if (!error && !segment.ranged && response.expectedContentLength >= 0 && segment.receivedLength != (unsigned long long)response.expectedContentLength)
+            error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:@{NSLocalizedDescriptionKey: @"Incomplete content"}];
+        
+        if (!error)
+        {
+            _pendingSegmentCount -= 1;
+            completed = _pendingSegmentCount == 0;
+        }
+    }
+    
+    if (error || completed)
+        [self mjz_finishWithError:error];
+}
+
+- (void)mjz_finishWithError:(NSError*)error
+{
+    void (^completionBlock)(NSHTTPURLResponse *response, NSError *error) = nil;
+    NSArray <NSURLSessionTask*> *activeTasks = nil;
+    NSFileHandle *fileHandle = nil;
+    NSHTTPURLResponse *response = nil;
+    dispatch_queue_t completionQueue = nil;
+    
+    @synchronized (self)
+    {
+        if (_finished)
+            return;
+        
+        _finished = YES;
+        completionBlock = _completionBlock;
+        _completionBlock = nil;
+        activeTasks = _activeTasks.allObjects;
+        fileHandle = _fileHandle;
+        _fileHandle = nil;
+        response = _response;
+        completionQueue = _sessionManager.completionQueue;
+    }
+    
+    for (NSURLSessionTask *task in activeTasks)
+        [task cancel];
+    
+    [fileHandle closeFile];
+    
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    if (!error)
+    {
+        [fileManager removeItemAtURL:_fileURL error:nil];
+        [fileManager moveItemAtURL:_partialFileURL toURL:_fileURL error:&error];
+    }
+    
+    if (error)
+        [fileManager removeItemAtURL:_partialFileURL error:nil];
+    
+    if (completionBlock)
+    {
+        dispatch_async(completionQueue ?: dispatch_get_main_queue(), ^{
+            completionBlock(response, error);
+        });
+    }
+}
+
+@end
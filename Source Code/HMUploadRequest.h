@@ -18,6 +18,7 @@
 
 /**
  * This class wraps all the fields needed to perform an upload data task.
+ * @discussion The uploaded content can be held in memory (`data`), or streamed from a file (`fileURL`) or an input stream (`inputStream`), so the size of the upload doesn't affect the memory used. If several sources are set, the first one in this order is used: `fileURL`, `inputStream`, `data`.
  **/
 @interface HMUploadTask : NSObject
 
@@ -38,6 +39,35 @@
                      filename:(NSString*)filename
                      mimeType:(NSString*)mimeType;
 
+/**
+ * Initializer for uploads streamed from a file.
+ * @param fileURL The URL of the file to upload.
+ * @param fieldName The field name for the upload request.
+ * @param filename The filename for the server of the uploaded data.
+ * @param mimeType The mimeType of the data beign uploaded.
+ * @return An initialized instance.
+ **/
++ (HMUploadTask*)taskWithFileURL:(NSURL*)fileURL
+                       fieldName:(NSString*)fieldName
+                        filename:(NSString*)filename
+                        mimeType:(NSString*)mimeType;
+
+/**
+ * Initializer for uploads streamed from an input stream.
+ * @param inputStream The stream to upload, not opened yet.
+ * @param length The number of bytes of the stream.
+ * @param fieldName The field name for the upload request.
+ * @param filename The filename for the server of the uploaded data.
+ * @param mimeType The mimeType of the data beign uploaded.
+ * @return An initialized instance.
+ * @discussion A stream can only be read once: if the request has to be sent again (for example, after renewing an expired OAuth token), a new task must be used.
+ **/
++ (HMUploadTask*)taskWithInputStream:(NSInputStream*)inputStream
+                              length:(unsigned long long)length
+                           fieldName:(NSString*)fieldName
+                            filename:(NSString*)filename
+                            mimeType:(NSString*)mimeType;
+
 /** ************************************************* **
  * @name Attributes
  ** ************************************************* **/
@@ -47,6 +77,21 @@
  **/
 @property (nonatomic, strong) NSData *data;
 
+/**
+ * The URL of the file to upload.
+ **/
+@property (nonatomic, strong) NSURL *fileURL;
+
+/**
+ * The stream to upload.
+ **/
+@property (nonatomic, strong) NSInputStream *inputStream;
+
+/**
+ * The number of bytes of the `inputStream`.
+ **/
+@property (nonatomic, assign) unsigned long long inputStreamLength;
+
 /**
  * The field name for the upload request.
  **/
@@ -62,6 +107,18 @@
  **/
 @property (nonatomic, strong) NSString *mimeType;
 
+/**
+ * The SHA-256 digest of the content, as an hexadecimal string. Nil for input stream contents, which cannot be read without consuming them.
+ * @discussion Computed the first time it is needed (by this property, equality, hashing or the identifier of the request), reading the content in chunks, and cached until the content changes. Files are expected not to change while the task is used.
+ **/
+@property (nonatomic, strong, readonly) NSString *contentDigest;
+
+/**
+ * A fast non-cryptographic 64-bit fingerprint of the task, cached until any attribute changes.
+ * @discussion Derived from the content digest: computing it for the first time reads the whole content.
+ **/
+@property (nonatomic, assign, readonly) uint64_t fingerprint;
+
 @end
 
 /**
@@ -79,4 +136,21 @@
  **/
 @property (nonatomic, strong) NSArray *uploadTasks;
 
+/** ************************************************* **
+ * @name Chunked Uploads
+ ** ************************************************* **/
+
+/**
+ * If greater than zero, the content of the upload task is sent in chunks of this size in bytes, instead of as a multipart form. Default value is 0.
+ * @discussion Chunked uploads require a single upload task, with its content in memory or in a file. Each chunk is sent to the URL of the request with the `Upload-Identifier` header (the `identifier` of the request), a `Content-Range` header (i.e. "bytes 0-1048575/5242880") and the bytes of the chunk as body, and is acknowledged by the server with any 2xx response.
+ * Once all chunks are acknowledged, the request is sent with its parameters, the `Upload-Identifier` header and the `Upload-Length` header (the size of the content), and its response completes the upload.
+ * Acknowledged chunks are remembered across app restarts: performing again an interrupted upload only sends the chunks not acknowledged yet.
+ **/
+@property (nonatomic, assign) NSUInteger chunkSize;
+
+/**
+ * The maximum number of chunks being uploaded at the same time. Default value is 2.
+ **/
+@property (nonatomic, assign) NSUInteger maximumConcurrentChunks;
+
 @end
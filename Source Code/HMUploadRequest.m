@@ -16,8 +16,81 @@
 
 #import "HMUploadRequest.h"
 #import "NSString+HMClientMD5Hashing.h"
+#import "HMFingerprint.h"
+
+#import <CommonCrypto/CommonDigest.h>
+
+static NSUInteger const HMUploadTaskDigestChunkSize = 1024*1024;
+
+/**
+ * Returns the hexadecimal representation of a SHA-256 digest.
+ **/
+static NSString* HMDigestString(CC_SHA256_CTX *context)
+{
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256_Final(digest, context);
+    
+    NSMutableString *string = [NSMutableString stringWithCapacity:CC_SHA256_DIGEST_LENGTH * 2];
+    for (NSUInteger i=0; i<CC_SHA256_DIGEST_LENGTH; ++i)
+        [string appendFormat:@"%02x", digest[i]];
+    return string;
+}
+
+/**
+ * SHA-256 digest of data, hashed in chunks (without flattening non-contiguous data).
+ **/
+static NSString* HMDigestOfData(NSData *data)
+{
+    CC_SHA256_CTX context;
+    CC_SHA256_Init(&context);
+    
+    [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+        for (NSUInteger offset = 0; offset < byteRange.length; offset += HMUploadTaskDigestChunkSize)
+            CC_SHA256_Update(&context, (const uint8_t *)bytes + offset, (CC_LONG)MIN(HMUploadTaskDigestChunkSize, byteRange.length - offset));
+    }];
+    
+    return HMDigestString(&context);
+}
+
+/**
+ * SHA-256 digest of a file, read in chunks. Returns nil if the file cannot be read.
+ **/
+static NSString* HMDigestOfFile(NSURL *fileURL)
+{
+    NSInputStream *inputStream = [NSInputStream inputStreamWithURL:fileURL];
+    [inputStream open];
+    
+    CC_SHA256_CTX context;
+    CC_SHA256_Init(&context);
+    
+    uint8_t *buffer = malloc(HMUploadTaskDigestChunkSize);
+    NSInteger length = 0;
+    while ((length = [inputStream read:buffer maxLength:HMUploadTaskDigestChunkSize]) > 0)
+        CC_SHA256_Update(&context, buffer, (CC_LONG)length);
+    free(buffer);
+    
+    BOOL failed = length < 0 || inputStream.streamStatus == NSStreamStatusError;
+    [inputStream close];
+    
+    NSString *digest = HMDigestString(&context);
+    return failed ? nil : digest;
+}
+
+@interface HMUploadTask ()
+
+- (NSData*)mjz_identityDigest;
+
+@end
 
 @implementation HMUploadTask
+{
+    // Cached fingerprint. Zero means not computed yet.
+    uint64_t _fingerprint;
+    
+    // Cached digests. Nil means not computed yet.
+    NSString *_contentDigest;
+    NSData *_identityDigest;
+}
 
 + (HMUploadTask*)taskWithData:(NSData*)data
                     fieldName:(NSString*)fieldName
@@ -31,6 +104,34 @@
     return task;
 }
 
++ (HMUploadTask*)taskWithFileURL:(NSURL*)fileURL
+                       fieldName:(NSString*)fieldName
+                        filename:(NSString*)filename
+                        mimeType:(NSString*)mimeType
+{
+    HMUploadTask *task = [[HMUploadTask alloc] initWithData:nil
+                                                  fieldName:fieldName
+                                                   filename:filename
+                                                   mimeType:mimeType];
+    task.fileURL = fileURL;
+    return task;
+}
+
++ (HMUploadTask*)taskWithInputStream:(NSInputStream*)inputStream
+                              length:(unsigned long long)length
+                           fieldName:(NSString*)fieldName
+                            filename:(NSString*)filename
+                            mimeType:(NSString*)mimeType
+{
+    HMUploadTask *task = [[HMUploadTask alloc] initWithData:nil
+                                                  fieldName:fieldName
+                                                   filename:filename
+                                                   mimeType:mimeType];
+    task.inputStream = inputStream;
+    task.inputStreamLength = length;
+    return task;
+}
+
 - (id)init
 {
     return [self initWithData:nil
@@ -57,8 +158,7 @@
 
 - (NSUInteger)hash
 {
-    NSString *identifier = [NSString stringWithFormat:@"%@:%@:%lu:%@",_fieldName, _filename, (unsigned long)_data.hash, _mimeType];
-    return [[identifier mjz_api_md5_stringWithMD5Hash] hash];
+    return (NSUInteger)self.fingerprint;
 }
 
 - (BOOL)isEqual:(id)object
@@ -67,10 +167,15 @@
     {
         HMUploadTask *task = object;
         
+        if (task == self)
+            return YES;
+        
+        // Contents are compared by digest (computed once per task), never byte for byte
         if ([_fieldName isEqualToString:task.fieldName] &&
             [_mimeType isEqualToString:task.mimeType] &&
             [_filename isEqualToString:task.filename] &&
-            [_data isEqualToData:task.data])
+            self.fingerprint == task.fingerprint &&
+            [[self mjz_identityDigest] isEqualToData:[task mjz_identityDigest]])
         {
             return YES;
         }
@@ -79,6 +184,152 @@
     return NO;
 }
 
+#pragma mark Properties
+
+- (void)setData:(NSData *)data
+{
+    _data = data;
+    _fingerprint = 0;
+    [self mjz_invalidateContentDigest];
+}
+
+- (void)setFileURL:(NSURL *)fileURL
+{
+    _fileURL = fileURL;
+    _fingerprint = 0;
+    [self mjz_invalidateContentDigest];
+}
+
+- (void)setInputStream:(NSInputStream *)inputStream
+{
+    _inputStream = inputStream;
+    _fingerprint = 0;
+    [self mjz_invalidateContentDigest];
+}
+
+- (void)setFieldName:(NSString *)fieldName
+{
+    _fieldName = fieldName;
+    _fingerprint = 0;
+    [self mjz_invalidateIdentityDigest];
+}
+
+- (void)setFilename:(NSString *)filename
+{
+    _filename = filename;
+    _fingerprint = 0;
+    [self mjz_invalidateIdentityDigest];
+}
+
+- (void)setMimeType:(NSString *)mimeType
+{
+    _mimeType = mimeType;
+    _fingerprint = 0;
+    [self mjz_invalidateIdentityDigest];
+}
+
+- (uint64_t)fingerprint
+{
+    uint64_t fingerprint = _fingerprint;
+    
+    if (fingerprint == 0)
+    {
+        fingerprint = HMFingerprintAppendString(HMFingerprintSeed, _fieldName);
+        fingerprint = HMFingerprintAppendString(fingerprint, _filename);
+        fingerprint = HMFingerprintAppendString(fingerprint, _mimeType);
+        
+        NSData *identityDigest = [self mjz_identityDigest];
+        fingerprint = HMFingerprintAppendBytes(fingerprint, identityDigest.bytes, identityDigest.length);
+        
+        if (fingerprint == 0)
+            fingerprint = 1;
+        
+        _fingerprint = fingerprint;
+    }
+    
+    return fingerprint;
+}
+
+- (NSString*)contentDigest
+{
+    NSURL *fileURL = nil;
+    NSInputStream *inputStream = nil;
+    NSData *data = nil;
+    
+    @synchronized (self)
+    {
+        if (_contentDigest)
+            return _contentDigest;
+        
+        fileURL = _fileURL;
+        inputStream = _inputStream;
+        data = _data;
+    }
+    
+    // Streams cannot be read without consuming them
+    if (!fileURL && inputStream)
+        return nil;
+    
+    NSString *contentDigest = fileURL ? HMDigestOfFile(fileURL) : HMDigestOfData(data ?: [NSData data]);
+    
+    @synchronized (self)
+    {
+        // Not cached if the content changed meanwhile
+        if (_fileURL == fileURL && _inputStream == inputStream && _data == data)
+            _contentDigest = contentDigest;
+    }
+    
+    return contentDigest;
+}
+
+#pragma mark Private Methods
+
+- (void)mjz_invalidateContentDigest
+{
+    @synchronized (self)
+    {
+        _contentDigest = nil;
+        _identityDigest = nil;
+    }
+}
+
+- (void)mjz_invalidateIdentityDigest
+{
+    @synchronized (self)
+    {
+        _identityDigest = nil;
+    }
+}
+
+/**
+ * MD5 digest of the attributes and the content digest of the task. Tasks streaming unreadable files or input streams are identified by the file URL or the stream instance.
+ **/
+- (NSData*)mjz_identityDigest
+{
+    @synchronized (self)
+    {
+        if (_identityDigest)
+            return _identityDigest;
+    }
+    
+    NSString *content = self.contentDigest;
+    if (!content)
+        content = _fileURL ? _fileURL.absoluteString : [NSString stringWithFormat:@"%p", _inputStream];
+    
+    NSString *identity = [NSString stringWithFormat:@"%@:%@:%@:%@", _fieldName, _filename, _mimeType, content];
+    const char *cString = identity.UTF8String;
+    unsigned char digest[CC_MD5_DIGEST_LENGTH];
+    CC_MD5(cString, (CC_LONG)strlen(cString), digest);
+    NSData *identityDigest = [NSData dataWithBytes:digest length:CC_MD5_DIGEST_LENGTH];
+    
+    @synchronized (self)
+    {
+        _identityDigest = identityDigest;
+    }
+    
+    return identityDigest;
+}
+
 @end
 
 @implementation HMUploadRequest
@@ -89,6 +340,7 @@
     if (self)
     {
         self.httpMethod = HMHTTPMethodPOST;
+        _maximumConcurrentChunks = 2;
     }
     return self;
 }
@@ -111,17 +363,30 @@
     return NO;
 }
 
-- (NSString*)identifier
+- (uint64_t)fingerprint
 {
-    NSMutableString *string = [NSMutableString string];
-    [string appendString:[super identifier]];
-    
-    NSArray *uploadTasks = [_uploadTasks sortedArrayUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"fieldName" ascending:YES]]];
+    // Task fingerprints are cached by each task and combined by addition (order independent), therefore no sorting is needed.
+    uint64_t sum = 0;
+    for (HMUploadTask *task in _uploadTasks)
+        sum += HMFingerprintMix(task.fingerprint);
     
-    [uploadTasks enumerateObjectsUsingBlock:^(HMUploadTask *task, NSUInteger idx, BOOL *stop) {
-        [string appendFormat:@":%@:%@:%@:%lu",task.fieldName, task.filename, task.mimeType, (unsigned long)task.data.hash];
-    }];
+    uint64_t fingerprint = HMFingerprintAppendInteger([super fingerprint], sum);
+    return HMFingerprintAppendInteger(fingerprint, _uploadTasks.count);
+}
+
+- (NSString*)identifier
+{
+    // Task identity digests are cached by each task and combined by addition (order independent), therefore no sorting is needed.
+    uint64_t sum[2] = {0, 0};
+    for (HMUploadTask *task in _uploadTasks)
+    {
+        uint64_t digest[2];
+        [[task mjz_identityDigest] getBytes:digest length:sizeof(digest)];
+        sum[0] += digest[0];
+        sum[1] += digest[1];
+    }
     
+    NSString *string = [NSString stringWithFormat:@"%@:%016llx%016llx:%lu", [super identifier], sum[0], sum[1], (unsigned long)_uploadTasks.count];
     return [string mjz_api_md5_stringWithMD5Hash];
 }
 
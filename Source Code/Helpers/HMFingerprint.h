@@ -0,0 +1,55 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import <Foundation/Foundation.h>
+
+/**
+ * Fast non-cryptographic 64-bit fingerprints (FNV-1a based).
+ * @discussion Fingerprints are meant for hashing and equality shortcuts, never for security purposes.
+ **/
+
+/**
+ * The initial value of an empty fingerprint.
+ **/
+extern uint64_t const HMFingerprintSeed;
+
+/**
+ * Appends raw bytes to a fingerprint.
+ **/
+uint64_t HMFingerprintAppendBytes(uint64_t fingerprint, const void *bytes, size_t length);
+
+/**
+ * Appends a 64-bit integer to a fingerprint.
+ **/
+uint64_t HMFingerprintAppendInteger(uint64_t fingerprint, uint64_t value);
+
+/**
+ * Appends the UTF8 representation of a string to a fingerprint without allocating intermediate objects.
+ **/
+uint64_t HMFingerprintAppendString(uint64_t fingerprint, NSString *string);
+
+/**
+ * Appends an object to a fingerprint.
+ * @discussion Strings, numbers, arrays, dictionaries and NSNull are fingerprinted by value (dictionaries independently of the key order).
+ * Any other object is fingerprinted using its description. Objects that are equal produce the same fingerprint.
+ **/
+uint64_t HMFingerprintAppendObject(uint64_t fingerprint, id object);
+
+/**
+ * Scrambles a fingerprint so it can be combined in an order-independent way (by addition).
+ **/
+uint64_t HMFingerprintMix(uint64_t fingerprint);
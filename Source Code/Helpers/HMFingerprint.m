@@ -0,0 +1,148 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import "HMFingerprint.h"
+
+uint64_t const HMFingerprintSeed = 0xcbf29ce484222325ULL;
+
+static uint64_t const HMFingerprintPrime = 0x100000001b3ULL;
+
+typedef NS_ENUM(uint8_t, HMFingerprintTag)
+{
+    HMFingerprintTagNil = 0,
+    HMFingerprintTagString,
+    HMFingerprintTagNumber,
+    HMFingerprintTagArray,
+    HMFingerprintTagDictionary,
+    HMFingerprintTagNull,
+    HMFingerprintTagOther,
+};
+
+uint64_t HMFingerprintAppendBytes(uint64_t fingerprint, const void *bytes, size_t length)
+{
+    const uint8_t *ptr = bytes;
+    for (size_t i=0; i<length; ++i)
+    {
+        fingerprint ^= ptr[i];
+        fingerprint *= HMFingerprintPrime;
+    }
+    return fingerprint;
+}
+
+uint64_t HMFingerprintAppendInteger(uint64_t fingerprint, uint64_t value)
+{
+    return HMFingerprintAppendBytes(fingerprint, &value, sizeof(value));
+}
+
+uint64_t HMFingerprintAppendString(uint64_t fingerprint, NSString *string)
+{
+    if (!string)
+        return HMFingerprintAppendInteger(fingerprint, HMFingerprintTagNil);
+    
+    const char *cString = CFStringGetCStringPtr((__bridge CFStringRef)string, kCFStringEncodingUTF8);
+    if (cString)
+    {
+        fingerprint = HMFingerprintAppendBytes(fingerprint, cString, strlen(cString));
+    }
+    else
+    {
+        // Encoding the string in chunks into a stack buffer
+        uint8_t buffer[256];
+        NSRange range = NSMakeRange(0, string.length);
+        while (range.length > 0)
+        {
+            NSUInteger usedLength = 0;
+            [string getBytes:buffer
+                   maxLength:sizeof(buffer)
+                  usedLength:&usedLength
+                    encoding:NSUTF8StringEncoding
+                     options:0
+                       range:range
+              remainingRange:&range];
+            
+            if (usedLength == 0)
+                break;
+            
+            fingerprint = HMFingerprintAppendBytes(fingerprint, buffer, usedLength);
+        }
+    }
+    
+    // Terminating the string to avoid ambiguities between consecutive strings
+    return HMFingerprintAppendInteger(fingerprint, string.length);
+}
+
+uint64_t HMFingerprintMix(uint64_t fingerprint)
+{
+    // splitmix64 finalizer
+    fingerprint ^= fingerprint >> 30;
+    fingerprint *= 0xbf58476d1ce4e5b9ULL;
+    fingerprint ^= fingerprint >> 27;
+    fingerprint *= 0x94d049bb133111ebULL;
+    fingerprint ^= fingerprint >> 31;
+    return fingerprint;
+}
+
+uint64_t HMFingerprintAppendObject(uint64_t fingerprint, id object)
+{
+    if (object == nil)
+    {
+        return HMFingerprintAppendInteger(fingerprint, HMFingerprintTagNil);
+    }
+    else if ([object isKindOfClass:NSString.class])
+    {
+        fingerprint = HMFingerprintAppendInteger(fingerprint, HMFingerprintTagString);
+        return HMFingerprintAppendString(fingerprint, object);
+    }
+    else if ([object isKindOfClass:NSNumber.class])
+    {
+        // Equal numbers (i.e. @1 and @1.0) have the same double value.
+        double value = [object doubleValue];
+        if (value == 0)
+            value = 0; // Normalizing -0.0
+        
+        fingerprint = HMFingerprintAppendInteger(fingerprint, HMFingerprintTagNumber);
+        return HMFingerprintAppendBytes(fingerprint, &value, sizeof(value));
+    }
+    else if ([object isKindOfClass:NSArray.class])
+    {
+        fingerprint = HMFingerprintAppendInteger(fingerprint, HMFingerprintTagArray);
+        for (id item in object)
+            fingerprint = HMFingerprintAppendObject(fingerprint, item);
+        return HMFingerprintAppendInteger(fingerprint, [object count]);
+    }
+    else if ([object isKindOfClass:NSDictionary.class])
+    {
+        // Combining key-value fingerprints by addition, so no key sorting is required.
+        __block uint64_t sum = 0;
+        [object enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+            uint64_t pair = HMFingerprintAppendObject(HMFingerprintSeed, key);
+            pair = HMFingerprintAppendObject(pair, value);
+            sum += HMFingerprintMix(pair);
+        }];
+        
+        fingerprint = HMFingerprintAppendInteger(fingerprint, HMFingerprintTagDictionary);
+        fingerprint = HMFingerprintAppendInteger(fingerprint, sum);
+        return HMFingerprintAppendInteger(fingerprint, [object count]);
+    }
+    else if ([object isKindOfClass:NSNull.class])
+    {
+        return HMFingerprintAppendInteger(fingerprint, HMFingerprintTagNull);
+    }
+    
+    fingerprint = HMFingerprintAppendInteger(fingerprint, HMFingerprintTagOther);
+    return HMFingerprintAppendString(fingerprint, [object description]);
+}
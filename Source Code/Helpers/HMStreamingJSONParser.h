@@ -0,0 +1,60 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import <Foundation/Foundation.h>
+
+/**
+ * An incremental (push) JSON parser.
+ * @discussion Data can be appended in chunks of any size as it is received. Each chunk is parsed immediately and does not need to be retained.
+ * The resulting object is equivalent to the one returned by `NSJSONSerialization` for the same UTF-8 input and reading options.
+ * This class is not thread safe: all calls must be serialized by the caller.
+ **/
+@interface HMStreamingJSONParser : NSObject
+
+/**
+ * Default initializer.
+ * @param options The JSON reading options. `NSJSONReadingMutableContainers`, `NSJSONReadingMutableLeaves` and `NSJSONReadingAllowFragments` are supported.
+ * @return An initialized instance.
+ **/
+- (instancetype)initWithReadingOptions:(NSJSONReadingOptions)options;
+
+/**
+ * The JSON reading options.
+ **/
+@property (nonatomic, assign, readonly) NSJSONReadingOptions readingOptions;
+
+/**
+ * Parses the next chunk of data.
+ * @param data The data chunk.
+ * @param error An error pointer set if the data is not valid JSON.
+ * @return YES if the chunk has been parsed, NO if an error happened. Once an error happened, any further data is ignored.
+ **/
+- (BOOL)appendData:(NSData*)data error:(NSError**)error;
+
+/**
+ * Finishes the parsing.
+ * @param error An error pointer set if the JSON document is not valid or is incomplete.
+ * @return The parsed object or nil if no object could be parsed. An empty (or whitespace only) input returns nil without error.
+ **/
+- (id)finishWithError:(NSError**)error;
+
+/**
+ * The number of bytes parsed so far.
+ **/
+@property (nonatomic, assign, readonly) NSUInteger parsedLength;
+
+@end
@@ -0,0 +1,615 @@
+//
+// Copyright 2016 Mobile Jazz SL
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#import "HMStreamingJSONParser.h"
+
+#include <xlocale.h>
+
+typedef NS_ENUM(NSInteger, HMStreamingJSONLexerMode)
+{
+    HMStreamingJSONLexerModeDefault,
+    HMStreamingJSONLexerModeString,
+    HMStreamingJSONLexerModeEscape,
+    HMStreamingJSONLexerModeUnicodeEscape,
+    HMStreamingJSONLexerModeNumber,
+    HMStreamingJSONLexerModeLiteral,
+};
+
+typedef NS_ENUM(NSInteger, HMStreamingJSONExpectation)
+{
+    HMStreamingJSONExpectationValue,
+    HMStreamingJSONExpectationValueOrArrayEnd,
+    HMStreamingJSONExpectationCommaOrArrayEnd,
+    HMStreamingJSONExpectationKeyOrObjectEnd,
+    HMStreamingJSONExpectationKey,
+    HMStreamingJSONExpectationColon,
+    HMStreamingJSONExpectationCommaOrObjectEnd,
+    HMStreamingJSONExpectationNothing,
+};
+
+static NSUInteger const HMStreamingJSONMaximumDepth = 512;
+
+@interface HMStreamingJSONFrame : NSObject
+
+@property (nonatomic, strong) id container;
+@property (nonatomic, strong) NSString *key;
+@property (nonatomic, assign) BOOL isObject;
+
+@end
+
+@implementation HMStreamingJSONFrame
+
+@end
+
+@implementation HMStreamingJSONParser
+{
+    NSMutableArray <HMStreamingJSONFrame*> *_frames;
+    HMStreamingJSONExpectation _expectation;
+    HMStreamingJSONLexerMode _mode;
+    NSMutableData *_tokenBuffer;
+    uint32_t _unicodeValue;
+    NSUInteger _unicodeDigits;
+    uint32_t _highSurrogate;
+    id _rootObject;
+    NSError *_error;
+    BOOL _skippedBOM;
+}
+
+- (instancetype)init
+{
+    return [self initWithReadingOptions:0];
+}
+
+- (instancetype)initWithReadingOptions:(NSJSONReadingOptions)options
+{
+    self = [super init];
+    if (self)
+    {
+        _readingOptions = options;
+        _frames = [NSMutableArray array];
+        _tokenBuffer = [NSMutableData dataWithCapacity:64];
+        _expectation = HMStreamingJSONExpectationValue;
+        _mode = HMStreamingJSONLexerModeDefault;
+    }
+    return self;
+}
+
+#pragma mark Public Methods
+
+- (BOOL)appendData:(NSData*)data error:(NSError**)error
+{
+    if (_error)
+    {
+        if (error)
+            *error = _error;
+        return NO;
+    }
+    
+    __block BOOL succeed = YES;
+    [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+        succeed = [self mjz_parseBytes:bytes length:byteRange.length];
+        *stop = !succeed;
+    }];
+    
+    if (!succeed && error)
+        *error = _error;
+    
+    return succeed;
+}
+
+- (id)finishWithError:(NSError**)error
+{
+    if (!_error)
+    {
+        if (_mode == HMStreamingJSONLexerModeNumber || _mode == HMStreamingJSONLexerModeLiteral)
+            [self mjz_finishToken];
+        
+        if (!_error)
+        {
+            if (_mode != HMStreamingJSONLexerModeDefault)
+                [self mjz_failWithReason:@"Unterminated string"];
+            else if (_frames.count > 0)
+                [self mjz_failWithReason:@"Unexpected end of data"];
+        }
+    }
+    
+    if (_error)
+    {
+        if (error)
+            *error = _error;
+        return nil;
+    }
+    
+    // An empty input results in a nil object without error.
+    return _rootObject;
+}
+
+#pragma mark Private Methods
+
+- (BOOL)mjz_failWithReason:(NSString*)reason
+{
+    if (!_error)
+    {
+        NSString *description = [NSString stringWithFormat:@"%@ around character %lu.", reason, (unsigned long)_parsedLength];
+        _error = [NSError errorWithDomain:NSCocoaErrorDomain
+                                     code:NSPropertyListReadCorruptError
+                                 userInfo:@{NSDebugDescriptionErrorKey: description}];
+    }
+    return NO;
+}
+
+- (BOOL)mjz_expectsValue
+{
+    return _expectation == HMStreamingJSONExpectationValue || _expectation == HMStreamingJSONExpectationValueOrArrayEnd;
+}
+
+- (BOOL)mjz_parseBytes:(const uint8_t*)bytes length:(NSUInteger)length
+{
+    NSUInteger i = 0;
+    
+    if (!_skippedBOM && length > 0)
+    {
+        // Skipping the UTF-8 byte order mark, if any
+        if (length >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF)
+            i = 3;
+        _skippedBOM = YES;
+    }
+    
+    while (i < length)
+    {
+        uint8_t c = bytes[i];
+        
+        switch (_mode)
+        {
+            case HMStreamingJSONLexerModeDefault:
+            {
+                if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
+                {
+                    ++i;
+                    ++_parsedLength;
+                    continue;
+                }
+                
+                if (![self mjz_parseStructuralByte:c])
+                    return NO;
+                
+                ++i;
+                break;
+            }
+            case HMStreamingJSONLexerModeString:
+            {
+                // Copying the longest run of plain characters at once
+                NSUInteger start = i;
+                while (i < length && bytes[i] != '"' && bytes[i] != '\\' && bytes[i] >= 0x20)
+                    ++i;
+                
+                if (i > start)
+                {
+                    if (_highSurrogate != 0)
+                        return [self mjz_failWithReason:@"Unpaired surrogate in string"];
+                    
+                    [_tokenBuffer appendBytes:bytes + start length:i - start];
+                    _parsedLength += i - start;
+                }
+                
+                if (i == length)
+                    break;
+                
+                c = bytes[i];
+                if (c == '"')
+                {
+                    if (_highSurrogate != 0)
+                        return [self mjz_failWithReason:@"Unpaired surrogate in string"];
+                    
+                    _mode = HMStreamingJSONLexerModeDefault;
+                    if (![self mjz_finishString])
+                        return NO;
+                }
+                else if (c == '\\')
+                {
+                    _mode = HMStreamingJSONLexerModeEscape;
+                }
+                else
+                {
+                    return [self mjz_failWithReason:@"Unescaped control character"];
+                }
+                
+                ++i;
+                break;
+            }
+            case HMStreamingJSONLexerModeEscape:
+            {
+                if (_highSurrogate != 0 && c != 'u')
+                    return [self mjz_failWithReason:@"Unpaired surrogate in string"];
+                
+                char unescaped = 0;
+                switch (c)
+                {
+                    case '"': unescaped = '"'; break;
+                    case '\\': unescaped = '\\'; break;
+                    case '/': unescaped = '/'; break;
+                    case 'b': unescaped = '\b'; break;
+                    case 'f': unescaped = '\f'; break;
+                    case 'n': unescaped = '\n'; break;
+                    case 'r': unescaped = '\r'; break;
+                    case 't': unescaped = '\t'; break;
+                    case 'u':
+                        _mode = HMStreamingJSONLexerModeUnicodeEscape;
+                        _unicodeValue = 0;
+                        _unicodeDigits = 0;
+                        break;
+                    default:
+                        return [self mjz_failWithReason:@"Invalid escape sequence"];
+                }
+                
+                if (unescaped != 0)
+                {
+                    [_tokenBuffer appendBytes:&unescaped length:1];
+                    _mode = HMStreamingJSONLexerModeString;
+                }
+                
+                ++i;
+                break;
+            }
+            case HMStreamingJSONLexerModeUnicodeEscape:
+            {
+                uint32_t digit;
+                if (c >= '0' && c <= '9')
+                    digit = c - '0';
+                else if (c >= 'a' && c <= 'f')
+                    digit = c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F')
+                    digit = c - 'A' + 10;
+                else
+                    return [self mjz_failWithReason:@"Invalid unicode escape sequence"];
+                
+                _unicodeValue = (_unicodeValue << 4) | digit;
+                ++_unicodeDigits;
+                
+                if (_unicodeDigits == 4)
+                {
+                    if (![self mjz_appendUnicodeScalar:_unicodeValue])
+                        return NO;
+                    _mode = HMStreamingJSONLexerModeString;
+                }
+                
+                ++i;
+                break;
+            }
+            case HMStreamingJSONLexerModeNumber:
+            case HMStreamingJSONLexerModeLiteral:
+            {
+                BOOL isTokenByte;
+                if (_mode == HMStreamingJSONLexerModeNumber)
+                    isTokenByte = (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+                else
+                    isTokenByte = (c >= 'a' && c <= 'z');
+                
+                if (isTokenByte)
+                {
+                    [_tokenBuffer appendBytes:&c length:1];
+                    ++i;
+                }
+                else
+                {
+                    // The current byte is processed again in the default mode
+                    if (![self mjz_finishToken])
+                        return NO;
+                    continue;
+                }
+                break;
+            }
+        }
+        
+        if (_mode != HMStreamingJSONLexerModeString || c == '\\' || c == '"')
+            ++_parsedLength;
+    }
+    
+    return YES;
+}
+
+- (BOOL)mjz_parseStructuralByte:(uint8_t)c
+{
+    if (_expectation == HMStreamingJSONExpectationNothing)
+        return [self mjz_failWithReason:@"Garbage at end"];
+    
+    switch (c)
+    {
+        case '{':
+        case '[':
+        {
+            if (![self mjz_expectsValue])
+                return [self mjz_failWithReason:@"Unexpected container start"];
+            
+            if (_frames.count >= HMStreamingJSONMaximumDepth)
+                return [self mjz_failWithReason:@"Too many nested arrays or dictionaries"];
+            
+            HMStreamingJSONFrame *frame = [HMStreamingJSONFrame new];
+            frame.isObject = (c == '{');
+            frame.container = frame.isObject ? [NSMutableDictionary dictionary] : [NSMutableArray array];
+            [_frames addObject:frame];
+            
+            _expectation = frame.isObject ? HMStreamingJSONExpectationKeyOrObjectEnd : HMStreamingJSONExpectationValueOrArrayEnd;
+            return YES;
+        }
+        case '}':
+        case ']':
+        {
+            HMStreamingJSONFrame *frame = _frames.lastObject;
+            BOOL validEnd = NO;
+            if (c == '}')
+                validEnd = frame.isObject && (_expectation == HMStreamingJSONExpectationKeyOrObjectEnd || _expectation == HMStreamingJSONExpectationCommaOrObjectEnd);
+            else
+                validEnd = frame && !frame.isObject && (_expectation == HMStreamingJSONExpectationValueOrArrayEnd || _expectation == HMStreamingJSONExpectationCommaOrArrayEnd);
+            
+            if (!validEnd)
+                return [self mjz_failWithReason:@"Unexpected container end"];
+            
+            [_frames removeLastObject];
+            
+            id container = frame.container;
+            if (!(_readingOptions & NSJSONReadingMutableContainers))
+                container = [container copy];
+            
+            return [self mjz_addValue:container];
+        }
+        case ':':
+        {
+            if (_expectation != HMStreamingJSONExpectationColon)
+                return [self mjz_failWithReason:@"Unexpected colon"];
+            
+            _expectation = HMStreamingJSONExpectationValue;
+            return YES;
+        }
+        case ',':
+        {
+            if (_expectation == HMStreamingJSONExpectationCommaOrArrayEnd)
+                _expectation = HMStreamingJSONExpectationValue;
+            else if (_expectation == HMStreamingJSONExpectationCommaOrObjectEnd)
+                _expectation = HMStreamingJSONExpectationKey;
+            else
+                return [self mjz_failWithReason:@"Unexpected comma"];
+            
+            return YES;
+        }
+        case '"':
+        {
+            if (![self mjz_expectsValue] && _expectation != HMStreamingJSONExpectationKey && _expectation != HMStreamingJSONExpectationKeyOrObjectEnd)
+                return [self mjz_failWithReason:@"Unexpected string"];
+            
+            _tokenBuffer.length = 0;
+            _highSurrogate = 0;
+            _mode = HMStreamingJSONLexerModeString;
+            return YES;
+        }
+        default:
+        {
+            if (![self mjz_expectsValue])
+                return [self mjz_failWithReason:@"Unexpected character"];
+            
+            _tokenBuffer.length = 0;
+            [_tokenBuffer appendBytes:&c length:1];
+            
+            if (c == '-' || (c >= '0' && c <= '9'))
+                _mode = HMStreamingJSONLexerModeNumber;
+            else if (c == 't' || c == 'f' || c == 'n')
+                _mode = HMStreamingJSONLexerModeLiteral;
+            else
+                return [self mjz_failWithReason:@"Invalid value"];
+            
+            return YES;
+        }
+    }
+}
+
+- (BOOL)mjz_addValue:(id)value
+{
+    HMStreamingJSONFrame *frame = _frames.lastObject;
+    
+    if (!frame)
+    {
+        if (!(_readingOptions & NSJSONReadingAllowFragments) && ![value isKindOfClass:NSArray.class] && ![value isKindOfClass:NSDictionary.class])
+            return [self mjz_failWithReason:@"JSON text did not start with array or object and option to allow fragments not set"];
+        
+        _rootObject = value;
+        _expectation = HMStreamingJSONExpectationNothing;
+    }
+    else if (frame.isObject)
+    {
+        [frame.container setObject:value forKey:frame.key];
+        frame.key = nil;
+        _expectation = HMStreamingJSONExpectationCommaOrObjectEnd;
+    }
+    else
+    {
+        [frame.container addObject:value];
+        _expectation = HMStreamingJSONExpectationCommaOrArrayEnd;
+    }
+    return YES;
+}
+
+- (BOOL)mjz_appendUnicodeScalar:(uint32_t)value
+{
+    if (_highSurrogate != 0)
+    {
+        if (value < 0xDC00 || value > 0xDFFF)
+            return [self mjz_failWithReason:@"Unpaired surrogate in string"];
+        
+        value = 0x10000 + ((_highSurrogate - 0xD800) << 10) + (value - 0xDC00);
+        _highSurrogate = 0;
+    }
+    else if (value >= 0xD800 && value <= 0xDBFF)
+    {
+        // Waiting for the low surrogate
+        _highSurrogate = value;
+        return YES;
+    }
+    else if (value >= 0xDC00 && value <= 0xDFFF)
+    {
+        return [self mjz_failWithReason:@"Unpaired surrogate in string"];
+    }
+    
+    uint8_t utf8[4];
+    NSUInteger length;
+    if (value < 0x80)
+    {
+        utf8[0] = value;
+        length = 1;
+    }
+    else if (value < 0x800)
+    {
+        utf8[0] = 0xC0 | (value >> 6);
+        utf8[1] = 0x80 | (value & 0x3F);
+        length = 2;
+    }
+    else if (value < 0x10000)
+    {
+        utf8[0] = 0xE0 | (value >> 12);
+        utf8[1] = 0x80 | ((value >> 6) & 0x3F);
+        utf8[2] = 0x80 | (value & 0x3F);
+        length = 3;
+    }
+    else
+    {
+        utf8[0] = 0xF0 | (value >> 18);
+        utf8[1] = 0x80 | ((value >> 12) & 0x3F);
+        utf8[2] = 0x80 | ((value >> 6) & 0x3F);
+        utf8[3] = 0x80 | (value & 0x3F);
+        length = 4;
+    }
+    
+    [_tokenBuffer appendBytes:utf8 length:length];
+    return YES;
+}
+
+- (BOOL)mjz_finishString
+{
+    NSString *string = nil;
+    if (_readingOptions & NSJSONReadingMutableLeaves)
+        string = [[NSMutableString alloc] initWithBytes:_tokenBuffer.bytes length:_tokenBuffer.length encoding:NSUTF8StringEncoding];
+    else
+        string = [[NSString alloc] initWithBytes:_tokenBuffer.bytes length:_tokenBuffer.length encoding:NSUTF8StringEncoding];
+    
+    if (!string)
+        return [self mjz_failWithReason:@"Unable to convert data to string"];
+    
+    HMStreamingJSONFrame *frame = _frames.lastObject;
+    if (frame.isObject && (_expectation == HMStreamingJSONExpectationKey || _expectation == HMStreamingJSONExpectationKeyOrObjectEnd))
+    {
+        frame.key = string;
+        _expectation = HMStreamingJSONExpectationColon;
+        return YES;
+    }
+    
+    return [self mjz_addValue:string];
+}
+
+- (BOOL)mjz_finishToken
+{
+    HMStreamingJSONLexerMode mode = _mode;
+    _mode = HMStreamingJSONLexerModeDefault;
+    
+    if (mode == HMStreamingJSONLexerModeLiteral)
+    {
+        const char *bytes = _tokenBuffer.bytes;
+        NSUInteger length = _tokenBuffer.length;
+        
+        if (length == 4 && memcmp(bytes, "true", 4) == 0)
+            return [self mjz_addValue:@YES];
+        else if (length == 5 && memcmp(bytes, "false", 5) == 0)
+            return [self mjz_addValue:@NO];
+        else if (length == 4 && memcmp(bytes, "null", 4) == 0)
+            return [self mjz_addValue:[NSNull null]];
+        
+        return [self mjz_failWithReason:@"Invalid value"];
+    }
+    
+    NSNumber *number = [self mjz_numberFromTokenBuffer];
+    if (!number)
+        return [self mjz_failWithReason:@"Invalid number"];
+    
+    return [self mjz_addValue:number];
+}
+
+- (NSNumber*)mjz_numberFromTokenBuffer
+{
+    const char *bytes = _tokenBuffer.bytes;
+    NSUInteger length = _tokenBuffer.length;
+    NSUInteger i = 0;
+    BOOL isInteger = YES;
+    
+    // Validating the JSON number grammar: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+    if (i < length && bytes[i] == '-')
+        ++i;
+    
+    if (i < length && bytes[i] == '0')
+        ++i;
+    else if (i < length && bytes[i] >= '1' && bytes[i] <= '9')
+        while (i < length && bytes[i] >= '0' && bytes[i] <= '9') ++i;
+    else
+        return nil;
+    
+    if (i < length && bytes[i] == '.')
+    {
+        isInteger = NO;
+        NSUInteger start = ++i;
+        while (i < length && bytes[i] >= '0' && bytes[i] <= '9') ++i;
+        if (i == start)
+            return nil;
+    }
+    
+    if (i < length && (bytes[i] == 'e' || bytes[i] == 'E'))
+    {
+        isInteger = NO;
+        ++i;
+        if (i < length && (bytes[i] == '+' || bytes[i] == '-'))
+            ++i;
+        NSUInteger start = i;
+        while (i < length && bytes[i] >= '0' && bytes[i] <= '9') ++i;
+        if (i == start)
+            return nil;
+    }
+    
+    if (i != length)
+        return nil;
+    
+    // Null terminating the token for the C conversion functions
+    char terminator = 0;
+    [_tokenBuffer appendBytes:&terminator length:1];
+    bytes = _tokenBuffer.bytes;
+    
+    if (isInteger)
+    {
+        errno = 0;
+        long long value = strtoll(bytes, NULL, 10);
+        if (errno == 0)
+            return @(value);
+        
+        if (bytes[0] != '-')
+        {
+            errno = 0;
+            unsigned long long unsignedValue = strtoull(bytes, NULL, 10);
+            if (errno == 0)
+                return @(unsignedValue);
+        }
+    }
+    
+    // The C locale is used, as JSON numbers always use "." as decimal separator.
+    return @(strtod_l(bytes, NULL, NULL));
+}
+
+@end
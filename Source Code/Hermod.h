@@ -21,8 +21,14 @@
 #import "HMClient.h"
 #import "HMRequest.h"
 #import "HMUploadRequest.h"
+#import "HMDownloadRequest.h"
 #import "HMResponse.h"
+#import "HMResponseDecoder.h"
+#import "HMHTTPCache.h"
 #import "HMRequestExecutor.h"
+#import "HMRequestHandle.h"
+#import "HMMutationQueue.h"
 
 // OAuth
 #import "HMOAuthSession.h"
+#import "HMOAuthTokenStore.h"